@@ -0,0 +1,382 @@
+/*
+ *    Copyright (c) 2021 Jay Logue
+ *    All rights reserved.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/**
+ *    @file
+ *      AES-CMAC (RFC 4493, NIST SP 800-38B) over the block cipher backends
+ *      of the EAX classes.
+ *
+ */
+
+#ifndef CMACT_H_
+#define CMACT_H_
+
+#include <EAXT.h>
+
+/** AES-CMAC engine
+ *
+ * CMACT computes AES-CMAC with the block cipher of an EAX backend, so that
+ * any backend (AESNI, VAES, portable, SoftDevice ECB, nrf_crypto/CC310)
+ * serves both EAX and plain CMAC computations (e.g. the Bluetooth f4
+ * function, or MACs over tokens). The CMAC subkeys K1 and K2 are the L2 and
+ * L4 pad blocks of EAX; they are cached with the key if the policy of the
+ * backend enables PadCache.
+ *
+ * Backend must be a concrete EAX class, either an EAXT<> backend (e.g.
+ * EAXT_128_AESNI) or a subclass of EAX (e.g. EAX_128_nrfcrypto). Expanded
+ * keys can be loaded with LoadKey(), as for EAXT::LoadKey(), when the
+ * backend supports it (e.g. from an EAXSessionTable).
+ *
+ * API usage:
+ *
+ *  - Set the key with SetKey() or LoadKey().
+ *
+ *  - Compute a MAC with Compute(), or with Start(), any number of
+ *    Update() calls, and Finish(). Verify() checks a MAC in constant time.
+ *
+ *  - ComputeMulti() computes the MACs of several messages with the same
+ *    key, in lockstep: the CBC chains of the messages advance together,
+ *    and the blocks of each step are encrypted with a single
+ *    AESEncryptBlocks() call, which a pipelined backend processes in
+ *    parallel.
+ *
+ * With a backend that implements CMAC natively (AESModesSupported()),
+ * Compute() hands the whole message to the backend.
+ */
+template <class Backend>
+class CMACT
+{
+public:
+    enum {
+        kBlockLength = 16,
+        kMACLength = 16,
+        kMaxMultiCount = 8      // maximum number of messages of ComputeMulti()
+    };
+
+    CMACT(void);
+    ~CMACT(void);
+
+    /** Clear the key and any computation in progress
+     */
+    void Reset(void);
+
+    /** Set the key
+     */
+    void SetKey(const uint8_t *key, size_t keyLen);
+
+    /** Set the key from values saved with EAXT::SaveKey()
+     */
+    template <class Schedule>
+    void LoadKey(const Schedule *sched, const uint8_t *pads);
+
+    /** Start a new MAC computation
+     *
+     * Any computation in progress is abandoned.
+     */
+    void Start(void);
+
+    /** Process message data
+     *
+     * The message may be given in any number of chunks, of arbitrary
+     * lengths.
+     */
+    void Update(const uint8_t *data, size_t len);
+
+    /** Finish the MAC computation
+     *
+     * Write the first macLen bytes (1 to 16) of the MAC to 'mac'.
+     */
+    void Finish(uint8_t *mac, size_t macLen = kMACLength);
+
+    /** Compute the MAC of a message in one call
+     */
+    void Compute(const uint8_t *data, size_t len, uint8_t *mac, size_t macLen = kMACLength);
+
+    /** Verify the MAC of a message
+     *
+     * Returns true if the first macLen bytes of the MAC of the message are
+     * equal to 'mac'. The comparison is constant-time.
+     */
+    bool Verify(const uint8_t *data, size_t len, const uint8_t *mac, size_t macLen = kMACLength);
+
+    /** Compute the MACs of several messages in lockstep
+     *
+     * Compute the full MAC of msgs[i] into macs[i], for i in 0..count-1;
+     * count must not exceed kMaxMultiCount.
+     */
+    void ComputeMulti(const EAXSegment *msgs, size_t count, uint8_t (*macs)[kBlockLength]);
+
+private:
+    Backend mEngine;                // block cipher and pad blocks
+    uint8_t mBuf[kBlockLength];     // unprocessed message bytes
+    uint8_t mMAC[kBlockLength];     // CBC-MAC value
+    uint8_t mPtr;                   // number of bytes in mBuf[]
+    bool mKeyed;
+
+    static void ClearSecretData(void * buf, size_t len) { EAXSecureWipe(buf, len); }
+};
+
+/*
+ * Implementation Notes
+ * ====================
+ *
+ * As in EAXT::omac_process(), the last block of the message is kept in
+ * mBuf[] until Finish(), since it gets special processing: mPtr ranges
+ * from 0 (only at the start of the message) to 16. Complete blocks
+ * that are not the last one go through the CBC chain in mMAC[].
+ */
+
+template <class Backend>
+CMACT<Backend>::CMACT(void)
+{
+    mPtr = 0;
+    mKeyed = false;
+}
+
+template <class Backend>
+CMACT<Backend>::~CMACT(void)
+{
+    Reset();
+}
+
+template <class Backend>
+void
+CMACT<Backend>::Reset(void)
+{
+    mEngine.Reset();
+    ClearSecretData(mBuf, sizeof mBuf);
+    ClearSecretData(mMAC, sizeof mMAC);
+    mPtr = 0;
+    mKeyed = false;
+}
+
+template <class Backend>
+void
+CMACT<Backend>::SetKey(const uint8_t *key, size_t keyLen)
+{
+    mEngine.Reset();
+    mEngine.SetKey(key, keyLen);
+    mKeyed = true;
+    Start();
+}
+
+template <class Backend>
+template <class Schedule>
+void
+CMACT<Backend>::LoadKey(const Schedule *sched, const uint8_t *pads)
+{
+    mEngine.LoadKey(sched, pads);
+    mKeyed = true;
+    Start();
+}
+
+template <class Backend>
+void
+CMACT<Backend>::Start(void)
+{
+    assert(mKeyed);
+
+    memset(mMAC, 0, sizeof mMAC);
+    ClearSecretData(mBuf, sizeof mBuf);
+    mPtr = 0;
+}
+
+template <class Backend>
+void
+CMACT<Backend>::Update(const uint8_t *data, size_t len)
+{
+    size_t n;
+
+    assert(mKeyed);
+
+    while (len > 0) {
+        /*
+         * A full buffer is not the last block, since there is more data.
+         */
+        if (mPtr == kBlockLength) {
+            mEngine.xor_block(mBuf, mMAC);
+            mEngine.aes_block(mMAC);
+            mPtr = 0;
+
+            while (len > kBlockLength) {
+                mEngine.xor_block(data, mMAC);
+                mEngine.aes_block(mMAC);
+                data += kBlockLength;
+                len -= kBlockLength;
+            }
+        }
+
+        n = kBlockLength - mPtr;
+        if (n > len) {
+            n = len;
+        }
+        memcpy(mBuf + mPtr, data, n);
+        mPtr += (uint8_t)n;
+        data += n;
+        len -= n;
+    }
+}
+
+template <class Backend>
+void
+CMACT<Backend>::Finish(uint8_t *mac, size_t macLen)
+{
+    uint8_t pad[kBlockLength];
+    size_t u;
+
+    assert(mKeyed);
+    assert(macLen >= 1 && macLen <= kMACLength);
+
+    /*
+     * The last block is XORed with K1 (L2) if it is complete, or else
+     * padded with 0x80 then zeros, and XORed with K2 (L4).
+     */
+    mEngine.get_pad(mPtr != kBlockLength, pad);
+    for (u = 0; u < mPtr; u ++) {
+        mMAC[u] ^= mBuf[u];
+    }
+    if (mPtr != kBlockLength) {
+        mMAC[mPtr] ^= 0x80;
+    }
+    mEngine.xor_block(pad, mMAC);
+    mEngine.aes_block(mMAC);
+    memcpy(mac, mMAC, macLen);
+
+    ClearSecretData(pad, sizeof pad);
+    mEngine.wipe_temporaries();
+    Start();
+}
+
+template <class Backend>
+void
+CMACT<Backend>::Compute(const uint8_t *data, size_t len, uint8_t *mac, size_t macLen)
+{
+    uint8_t full[kBlockLength];
+
+    assert(mKeyed);
+    assert(macLen >= 1 && macLen <= kMACLength);
+
+    /*
+     * The native CMAC of the backend takes a first block apart from the
+     * rest of the data.
+     */
+    if (len >= kBlockLength && mEngine.aes_modes()) {
+        mEngine.aes_cmac(data, data + kBlockLength, len - kBlockLength, full);
+        memcpy(mac, full, macLen);
+        ClearSecretData(full, sizeof full);
+        return;
+    }
+
+    Start();
+    Update(data, len);
+    Finish(mac, macLen);
+}
+
+template <class Backend>
+bool
+CMACT<Backend>::Verify(const uint8_t *data, size_t len, const uint8_t *mac, size_t macLen)
+{
+    uint8_t full[kBlockLength];
+    unsigned z;
+    size_t u;
+
+    /*
+     * Invalid MAC lengths are reported as a failed verification, since
+     * they might be triggered with crafted incoming data.
+     */
+    if (macLen < 1 || macLen > kMACLength) {
+        return false;
+    }
+
+    Compute(data, len, full, kMACLength);
+    z = 0;
+    for (u = 0; u < macLen; u ++) {
+        z |= mac[u] ^ full[u];
+    }
+    ClearSecretData(full, sizeof full);
+    return z == 0;
+}
+
+/*
+ * At each step, every message that is not complete contributes its next
+ * block, which is XORed into its CBC-MAC value (with the padding and
+ * subkey for the last block), and the values are encrypted together.
+ */
+template <class Backend>
+void
+CMACT<Backend>::ComputeMulti(const EAXSegment *msgs, size_t count, uint8_t (*macs)[kBlockLength])
+{
+    uint8_t k1[kBlockLength], k2[kBlockLength];
+    uint8_t blocks[kMaxMultiCount * kBlockLength];
+    size_t pos[kMaxMultiCount], idx[kMaxMultiCount];
+    bool done[kMaxMultiCount];
+    size_t i, n, u, v;
+
+    assert(mKeyed);
+    assert(count <= kMaxMultiCount);
+
+    mEngine.get_pad(false, k1);
+    mEngine.get_pad(true, k2);
+    for (i = 0; i < count; i ++) {
+        memset(macs[i], 0, kBlockLength);
+        pos[i] = 0;
+        done[i] = false;
+    }
+
+    for (;;) {
+        n = 0;
+        for (i = 0; i < count; i ++) {
+            const uint8_t *data = msgs[i].data;
+            const size_t len = msgs[i].len;
+
+            if (done[i]) {
+                continue;
+            }
+            u = pos[i];
+            if (len - u > kBlockLength) {
+                mEngine.xor_block(data + u, macs[i]);
+                pos[i] = u + kBlockLength;
+            } else {
+                for (v = 0; (u + v) < len; v ++) {
+                    macs[i][v] ^= data[u + v];
+                }
+                if (v < kBlockLength) {
+                    macs[i][v] ^= 0x80;
+                }
+                mEngine.xor_block((v < kBlockLength) ? k2 : k1, macs[i]);
+                done[i] = true;
+            }
+            memcpy(blocks + n * kBlockLength, macs[i], kBlockLength);
+            idx[n ++] = i;
+        }
+        if (n == 0) {
+            break;
+        }
+
+        mEngine.aes_blocks(blocks, n);
+        for (u = 0; u < n; u ++) {
+            memcpy(macs[idx[u]], blocks + u * kBlockLength, kBlockLength);
+        }
+    }
+
+    ClearSecretData(k1, sizeof k1);
+    ClearSecretData(k2, sizeof k2);
+    ClearSecretData(blocks, sizeof blocks);
+    mEngine.wipe_temporaries();
+}
+
+#endif // CMACT_H_
@@ -29,6 +29,12 @@
 
 #include <EAX-AESNI.h>
 
+bool AESNISupported(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("aes");
+}
+
 #define ExpandRoundKey128(KEYS, N, RCON, TMP)                           \
 do {                                                                    \
     TMP = _mm_aeskeygenassist_si128(KEYS[N-1], RCON);                   \
@@ -39,6 +45,24 @@ do {                                                                    \
     KEYS[N] = _mm_xor_si128(KEYS[N], TMP);                              \
 } while (0)
 
+void AESNIExpandKey128(const uint8_t *key, __m128i *keys)
+{
+    __m128i tmp;
+
+    keys[0] = _mm_loadu_si128((const __m128i *)key);
+    ExpandRoundKey128(keys, 1, 0x01, tmp);
+    ExpandRoundKey128(keys, 2, 0x02, tmp);
+    ExpandRoundKey128(keys, 3, 0x04, tmp);
+    ExpandRoundKey128(keys, 4, 0x08, tmp);
+    ExpandRoundKey128(keys, 5, 0x10, tmp);
+    ExpandRoundKey128(keys, 6, 0x20, tmp);
+    ExpandRoundKey128(keys, 7, 0x40, tmp);
+    ExpandRoundKey128(keys, 8, 0x80, tmp);
+    ExpandRoundKey128(keys, 9, 0x1b, tmp);
+    ExpandRoundKey128(keys, 10, 0x36, tmp);
+    EAXSecureWipe(&tmp, sizeof(tmp));
+}
+
 EAX_128_AESNI::EAX_128_AESNI(void)
 {
     ClearSecretData(&mKey, sizeof(mKey));
@@ -56,42 +80,18 @@ void EAX_128_AESNI::AESReset(void)
 
 void EAX_128_AESNI::AESSetKey(const uint8_t *key, size_t keyLen)
 {
-    __m128i tmp;
-
     assert(keyLen == kKeyLength);
-
-    mKey[0] = _mm_loadu_si128((__m128i *)key);
-    ExpandRoundKey128(mKey, 1, 0x01, tmp);
-    ExpandRoundKey128(mKey, 2, 0x02, tmp);
-    ExpandRoundKey128(mKey, 3, 0x04, tmp);
-    ExpandRoundKey128(mKey, 4, 0x08, tmp);
-    ExpandRoundKey128(mKey, 5, 0x10, tmp);
-    ExpandRoundKey128(mKey, 6, 0x20, tmp);
-    ExpandRoundKey128(mKey, 7, 0x40, tmp);
-    ExpandRoundKey128(mKey, 8, 0x80, tmp);
-    ExpandRoundKey128(mKey, 9, 0x1b, tmp);
-    ExpandRoundKey128(mKey, 10, 0x36, tmp);
-    ClearSecretData((uint8_t *)&tmp, sizeof(tmp));
+    AESNIExpandKey128(key, mKey);
 }
 
 void EAX_128_AESNI::AESEncryptBlock(uint8_t *data)
 {
-    __m128i block;
+    AESNIEncryptBlock(mKey, kRoundCount, data);
+}
 
-    block = _mm_loadu_si128((const __m128i *)data);
-    block = _mm_xor_si128(block, mKey[0]);
-    block = _mm_aesenc_si128(block, mKey[1]);
-    block = _mm_aesenc_si128(block, mKey[2]);
-    block = _mm_aesenc_si128(block, mKey[3]);
-    block = _mm_aesenc_si128(block, mKey[4]);
-    block = _mm_aesenc_si128(block, mKey[5]);
-    block = _mm_aesenc_si128(block, mKey[6]);
-    block = _mm_aesenc_si128(block, mKey[7]);
-    block = _mm_aesenc_si128(block, mKey[8]);
-    block = _mm_aesenc_si128(block, mKey[9]);
-    block = _mm_aesenclast_si128(block, mKey[10]);
-    _mm_storeu_si128((__m128i*)data, block);
-    ClearSecretData((uint8_t *)&block, sizeof(block));
+void EAX_128_AESNI::AESEncryptBlocks(uint8_t *data, size_t nBlocks)
+{
+    AESNIEncryptBlocks(mKey, kRoundCount, data, nBlocks);
 }
 
 #define ExpandEvenRoundKey256(KEYS, N, RCON, TMP)     \
@@ -120,6 +120,28 @@ do {                                                  \
     KEYS[N] = _mm_xor_si128 (KEYS[N], TMP);           \
 } while (0)
 
+void AESNIExpandKey256(const uint8_t *key, __m128i *keys)
+{
+    __m128i tmp;
+
+    keys[0] = _mm_loadu_si128((const __m128i *)key);
+    keys[1] = _mm_loadu_si128((const __m128i *)(key + 16));
+    ExpandEvenRoundKey256(keys, 2, 0x01, tmp);
+    ExpandOddRoundKey256(keys, 3, tmp);
+    ExpandEvenRoundKey256(keys, 4, 0x02, tmp);
+    ExpandOddRoundKey256(keys, 5, tmp);
+    ExpandEvenRoundKey256(keys, 6, 0x04, tmp);
+    ExpandOddRoundKey256(keys, 7, tmp);
+    ExpandEvenRoundKey256(keys, 8, 0x08, tmp);
+    ExpandOddRoundKey256(keys, 9, tmp);
+    ExpandEvenRoundKey256(keys, 10, 0x10, tmp);
+    ExpandOddRoundKey256(keys, 11, tmp);
+    ExpandEvenRoundKey256(keys, 12, 0x20, tmp);
+    ExpandOddRoundKey256(keys, 13, tmp);
+    ExpandEvenRoundKey256(keys, 14, 0x40, tmp);
+    EAXSecureWipe(&tmp, sizeof(tmp));
+}
+
 EAX_256_AESNI::EAX_256_AESNI(void)
 {
     ClearSecretData(&mKey, sizeof(mKey));
@@ -137,66 +159,103 @@ void EAX_256_AESNI::AESReset(void)
 
 void EAX_256_AESNI::AESSetKey(const uint8_t *key, size_t keyLen)
 {
-    __m128i tmp;
-
     assert(keyLen == kKeyLength);
-
-    mKey[0] = _mm_loadu_si128((const __m128i *)key);
-    mKey[1] = _mm_loadu_si128((const __m128i *)(key + 16));
-    ExpandEvenRoundKey256(mKey, 2, 0x01, tmp);
-    ExpandOddRoundKey256(mKey, 3, tmp);
-    ExpandEvenRoundKey256(mKey, 4, 0x02, tmp);
-    ExpandOddRoundKey256(mKey, 5, tmp);
-    ExpandEvenRoundKey256(mKey, 6, 0x04, tmp);
-    ExpandOddRoundKey256(mKey, 7, tmp);
-    ExpandEvenRoundKey256(mKey, 8, 0x08, tmp);
-    ExpandOddRoundKey256(mKey, 9, tmp);
-    ExpandEvenRoundKey256(mKey, 10, 0x10, tmp);
-    ExpandOddRoundKey256(mKey, 11, tmp);
-    ExpandEvenRoundKey256(mKey, 12, 0x20, tmp);
-    ExpandOddRoundKey256(mKey, 13, tmp);
-    ExpandEvenRoundKey256(mKey, 14, 0x40, tmp);
-    ClearSecretData((uint8_t *)&tmp, sizeof(tmp));
+    AESNIExpandKey256(key, mKey);
 }
 
 void EAX_256_AESNI::AESEncryptBlock(uint8_t *data)
 {
-    __m128i block;
-
-    block = _mm_loadu_si128((const __m128i *)data);
-    block = _mm_xor_si128(block, mKey[0]);
-    block = _mm_aesenc_si128(block, mKey[1]);
-    block = _mm_aesenc_si128(block, mKey[2]);
-    block = _mm_aesenc_si128(block, mKey[3]);
-    block = _mm_aesenc_si128(block, mKey[4]);
-    block = _mm_aesenc_si128(block, mKey[5]);
-    block = _mm_aesenc_si128(block, mKey[6]);
-    block = _mm_aesenc_si128(block, mKey[7]);
-    block = _mm_aesenc_si128(block, mKey[8]);
-    block = _mm_aesenc_si128(block, mKey[9]);
-    block = _mm_aesenc_si128(block, mKey[10]);
-    block = _mm_aesenc_si128(block, mKey[11]);
-    block = _mm_aesenc_si128(block, mKey[12]);
-    block = _mm_aesenc_si128(block, mKey[13]);
-    block = _mm_aesenclast_si128(block, mKey[14]);
-    _mm_storeu_si128((__m128i*)data, block);
-    ClearSecretData((uint8_t *)&block, sizeof(block));
+    AESNIEncryptBlock(mKey, kRoundCount, data);
+}
+
+void EAX_256_AESNI::AESEncryptBlocks(uint8_t *data, size_t nBlocks)
+{
+    AESNIEncryptBlocks(mKey, kRoundCount, data, nBlocks);
 }
 
 //
 // Compile as follows to create a stand-alone program for testing EAX-128-AESNI
-// against the standard test vectors.
+// (both the virtual and the devirtualized forms) against the standard test vectors.
 //
-//    c++ -O3 -maes -o test-eax-128-aesni -I. -DUNIT_TEST EAX.cpp EAX-AESNI.cpp EAXTest.cpp
+//    c++ -O3 -maes -pthread -o test-eax-128-aesni -I. -DUNIT_TEST EAX.cpp EAX-AESNI.cpp EAXTest.cpp
 //
 #ifdef UNIT_TEST
 
 #include <stdio.h>
+#include <EAXTest.h>
+#include <EAXParallel.h>
+#include <EAXAsync.h>
+
+// The smallest engine, and one with every optional feature, whatever the
+// CONFIG_EAX_* defaults of the build
+typedef EAXP_128_AESNI<EAXPolicy<false, false> > EAXT_128_AESNI_Min;
+typedef EAXP_128_AESNI<EAXPolicy<true, true, 16, 4> > EAXT_128_AESNI_Full;
+typedef EAXP_128_AESNI<EAXPolicy<true, true, 16, 0, true> > EAXT_128_AESNI_Stats;
+
+// C++20 builds must test the coroutine interface of EAXAsync
+#if __cplusplus >= 202002L
+static_assert(EAXASYNC_COROUTINES, "EAXAsync built without coroutines");
+#endif
 
 int main(int argc, char *argv[])
 {
-    EAX_128_AESNI eax;
-    TestEAX128(eax);
+    {
+        EAX_128_AESNI eax;
+        TestEAX128(eax);
+    }
+    {
+        EAXT_128_AESNI eax;
+        TestEAX128(eax);
+    }
+    {
+        EAXT_128_AESNI_Min eax;
+        TestEAX128(eax);
+    }
+    {
+        EAXT_128_AESNI_Full eax;
+        TestEAX128(eax);
+    }
+    static_assert(sizeof(EAXT_128_AESNI_Min) < sizeof(EAXT_128_AESNI_Full), "Policy state not dropped");
+    {
+        EAXT_128_AESNI_Stats eax;
+        TestEAX128(eax);
+        TestEAX128Stats(eax);
+    }
+    {
+        EAXP_128_AESNI<EAXPolicy<false, true, 16, 0, true> > eax;
+        TestEAX128Stats(eax);
+    }
+#if CONFIG_EAX_STATS
+    {
+        EAXT_128_AESNI eax;
+        TestEAX128Stats(eax);
+    }
+#endif
+    {
+        EAXBatch<EAXT_128_AESNI, 4> batch;
+        TestEAX128Batch(batch);
+    }
+    TestEAX128SessionTable<EAXT_128_AESNI>();
+    TestCMAC128<EAXT_128_AESNI>();
+    TestCMAC128<EAXT_128_AESNI_Min>();
+    {
+        EAXT_128_AESNI eax;
+        TestEAX128NonceQueue(eax);
+        TestEAX128HeaderCache(eax);
+        TestEAX128Stream(eax);
+    }
+    {
+        EAXParallel<EAXT_128_AESNI_Full> par(3, 64, 0);
+        TestEAX128Parallel(par);
+    }
+    {
+        EAXAsync<EAXT_128_AESNI, 4> async(3);
+        TestEAX128Async(async);
+    }
+    {
+        EAXBatch<EAXT_128_AESNI_Min, 4> batch;
+        TestEAX128Batch(batch);
+    }
     printf("All tests passed\n");
 }
 
@@ -29,6 +29,146 @@
 #include <EAX.h>
 #include <wmmintrin.h>
 
+/** Returns true if the processor supports the AESNI instructions.
+ */
+extern bool AESNISupported(void);
+
+/** Expand an AES-128 key into 11 round keys using AESNI instructions.
+ */
+extern void AESNIExpandKey128(const uint8_t *key, __m128i *keys);
+
+/** Expand an AES-256 key into 15 round keys using AESNI instructions.
+ */
+extern void AESNIExpandKey256(const uint8_t *key, __m128i *keys);
+
+/** Encrypt a single block in place with an expanded AES key.
+ */
+inline void AESNIEncryptBlock(const __m128i *keys, unsigned roundCount, uint8_t *data)
+{
+    __m128i block;
+    unsigned r;
+
+    block = _mm_loadu_si128((const __m128i *)data);
+    block = _mm_xor_si128(block, keys[0]);
+    for (r = 1; r < roundCount; r++) {
+        block = _mm_aesenc_si128(block, keys[r]);
+    }
+    block = _mm_aesenclast_si128(block, keys[roundCount]);
+    _mm_storeu_si128((__m128i*)data, block);
+    EAXWipeBlockTemp(&block, sizeof(block));
+}
+
+/** Encrypt nBlocks independent blocks in place with an expanded AES key.
+ *
+ * AESENC has a latency of several cycles but can be issued every cycle,
+ * so a single block chain leaves the AES unit mostly idle. Blocks are
+ * therefore processed in groups of 8 (then 4) with the rounds interleaved
+ * across the group, so that several independent AESENC operations are in
+ * flight at any time. Any remaining blocks are processed one at a time.
+ */
+inline void AESNIEncryptBlocks(const __m128i *keys, unsigned roundCount, uint8_t *data, size_t nBlocks)
+{
+    __m128i b[8];
+    unsigned r;
+    size_t i;
+
+    for (; nBlocks >= 8; nBlocks -= 8, data += 8 * 16) {
+        for (i = 0; i < 8; i++) {
+            b[i] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(data + i * 16)), keys[0]);
+        }
+        for (r = 1; r < roundCount; r++) {
+            for (i = 0; i < 8; i++) {
+                b[i] = _mm_aesenc_si128(b[i], keys[r]);
+            }
+        }
+        for (i = 0; i < 8; i++) {
+            _mm_storeu_si128((__m128i *)(data + i * 16), _mm_aesenclast_si128(b[i], keys[roundCount]));
+        }
+    }
+
+    if (nBlocks >= 4) {
+        for (i = 0; i < 4; i++) {
+            b[i] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)(data + i * 16)), keys[0]);
+        }
+        for (r = 1; r < roundCount; r++) {
+            for (i = 0; i < 4; i++) {
+                b[i] = _mm_aesenc_si128(b[i], keys[r]);
+            }
+        }
+        for (i = 0; i < 4; i++) {
+            _mm_storeu_si128((__m128i *)(data + i * 16), _mm_aesenclast_si128(b[i], keys[roundCount]));
+        }
+        nBlocks -= 4;
+        data += 4 * 16;
+    }
+
+    for (; nBlocks > 0; nBlocks--, data += 16) {
+        b[0] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)data), keys[0]);
+        for (r = 1; r < roundCount; r++) {
+            b[0] = _mm_aesenc_si128(b[0], keys[r]);
+        }
+        _mm_storeu_si128((__m128i *)data, _mm_aesenclast_si128(b[0], keys[roundCount]));
+    }
+
+    EAXSecureWipe(b, sizeof(b));
+}
+
+/** Encrypt n independent blocks in place, block i with the expanded AES
+ *  key keys[i].
+ *
+ * This is the multi-key counterpart of AESNIEncryptBlocks(): the rounds
+ * are interleaved across groups of 8 (then 4) blocks in the same way, but
+ * each block uses its own key schedule. All keys must have the same round
+ * count.
+ */
+inline void AESNIEncryptLanes(const __m128i *const *keys, unsigned roundCount, uint8_t *const *blocks, size_t n)
+{
+    __m128i b[8];
+    unsigned r;
+    size_t i;
+
+    for (; n >= 8; n -= 8, keys += 8, blocks += 8) {
+        for (i = 0; i < 8; i++) {
+            b[i] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)blocks[i]), keys[i][0]);
+        }
+        for (r = 1; r < roundCount; r++) {
+            for (i = 0; i < 8; i++) {
+                b[i] = _mm_aesenc_si128(b[i], keys[i][r]);
+            }
+        }
+        for (i = 0; i < 8; i++) {
+            _mm_storeu_si128((__m128i *)blocks[i], _mm_aesenclast_si128(b[i], keys[i][roundCount]));
+        }
+    }
+
+    if (n >= 4) {
+        for (i = 0; i < 4; i++) {
+            b[i] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)blocks[i]), keys[i][0]);
+        }
+        for (r = 1; r < roundCount; r++) {
+            for (i = 0; i < 4; i++) {
+                b[i] = _mm_aesenc_si128(b[i], keys[i][r]);
+            }
+        }
+        for (i = 0; i < 4; i++) {
+            _mm_storeu_si128((__m128i *)blocks[i], _mm_aesenclast_si128(b[i], keys[i][roundCount]));
+        }
+        n -= 4;
+        keys += 4;
+        blocks += 4;
+    }
+
+    for (; n > 0; n--, keys++, blocks++) {
+        b[0] = _mm_xor_si128(_mm_loadu_si128((const __m128i *)blocks[0]), keys[0][0]);
+        for (r = 1; r < roundCount; r++) {
+            b[0] = _mm_aesenc_si128(b[0], keys[0][r]);
+        }
+        _mm_storeu_si128((__m128i *)blocks[0], _mm_aesenclast_si128(b[0], keys[0][roundCount]));
+    }
+
+    EAXSecureWipe(b, sizeof(b));
+}
+
 /** An implementation of EAX mode based on AES-128 using AESNI instructions.
  */
 class EAX_128_AESNI final : public EAX
@@ -41,6 +181,7 @@ protected:
     virtual void AESReset(void);
     virtual void AESSetKey(const uint8_t *key, size_t keyLen);
     virtual void AESEncryptBlock(uint8_t *data);
+    virtual void AESEncryptBlocks(uint8_t *data, size_t nBlocks);
 
 private:
     enum
@@ -65,6 +206,7 @@ protected:
     virtual void AESReset(void);
     virtual void AESSetKey(const uint8_t *key, size_t keyLen);
     virtual void AESEncryptBlock(uint8_t *data);
+    virtual void AESEncryptBlocks(uint8_t *data, size_t nBlocks);
 
 private:
     enum
@@ -77,4 +219,224 @@ private:
     __m128i mKey[kRoundCount + 1];
 };
 
+/** A devirtualized implementation of EAX mode based on AES-128 using
+ *  AESNI instructions.
+ *
+ * Equivalent to EAX_128_AESNI, but with the AES block cipher bound to the
+ * EAX engine at compile time, so that the AESNI round sequence is inlined
+ * into the EAX processing.  Use this class when the implementation does
+ * not need to be selected at run time.
+ *
+ * Policy is an EAXPolicy<> instantiation that selects the optional state
+ * of the engine (see EAXPolicy). EAXT_128_AESNI is the engine with the
+ * default policy.
+ */
+template <class Policy = EAXPolicy<> >
+class EAXP_128_AESNI final : public EAXT<EAXP_128_AESNI<Policy>, Policy>
+{
+public:
+    EAXP_128_AESNI(void);
+    ~EAXP_128_AESNI(void);
+
+    /** Expanded key, as saved by SaveKey() and loaded by LoadKey()
+     */
+    struct AESKeySchedule
+    {
+        __m128i rk[11];
+    };
+
+private:
+    friend class EAXT<EAXP_128_AESNI, Policy>;
+
+    enum
+    {
+        kKeyLength      = 16,
+        kBlockLength    = 16,
+        kRoundCount     = 10
+    };
+
+    __m128i mKey[kRoundCount + 1];
+
+    void AESReset(void);
+    void AESSetKey(const uint8_t *key, size_t keyLen);
+    void AESSaveKey(AESKeySchedule *sched) const;
+    void AESLoadKey(const AESKeySchedule *sched);
+    void AESEncryptBlock(uint8_t *data);
+    void AESEncryptBlocks(uint8_t *data, size_t nBlocks);
+    static void AESEncryptLanes(EAXP_128_AESNI *const *lanes, uint8_t *const *blocks, size_t n);
+};
+
+typedef EAXP_128_AESNI<> EAXT_128_AESNI;
+
+/** A devirtualized implementation of EAX mode based on AES-256 using
+ *  AESNI instructions.
+ *
+ * Equivalent to EAX_256_AESNI, but with the AES block cipher bound to the
+ * EAX engine at compile time. See EAXP_128_AESNI for the Policy parameter.
+ */
+template <class Policy = EAXPolicy<> >
+class EAXP_256_AESNI final : public EAXT<EAXP_256_AESNI<Policy>, Policy>
+{
+public:
+    EAXP_256_AESNI(void);
+    ~EAXP_256_AESNI(void);
+
+    /** Expanded key, as saved by SaveKey() and loaded by LoadKey()
+     */
+    struct AESKeySchedule
+    {
+        __m128i rk[15];
+    };
+
+private:
+    friend class EAXT<EAXP_256_AESNI, Policy>;
+
+    enum
+    {
+        kKeyLength      = 32,
+        kBlockLength    = 16,
+        kRoundCount     = 14
+    };
+
+    __m128i mKey[kRoundCount + 1];
+
+    void AESReset(void);
+    void AESSetKey(const uint8_t *key, size_t keyLen);
+    void AESSaveKey(AESKeySchedule *sched) const;
+    void AESLoadKey(const AESKeySchedule *sched);
+    void AESEncryptBlock(uint8_t *data);
+    void AESEncryptBlocks(uint8_t *data, size_t nBlocks);
+    static void AESEncryptLanes(EAXP_256_AESNI *const *lanes, uint8_t *const *blocks, size_t n);
+};
+
+typedef EAXP_256_AESNI<> EAXT_256_AESNI;
+
+template <class Policy>
+inline EAXP_128_AESNI<Policy>::EAXP_128_AESNI(void)
+{
+    this->ClearSecretData(&mKey, sizeof(mKey));
+}
+
+template <class Policy>
+inline EAXP_128_AESNI<Policy>::~EAXP_128_AESNI(void)
+{
+    this->ClearSecretData(&mKey, sizeof(mKey));
+}
+
+template <class Policy>
+inline void EAXP_128_AESNI<Policy>::AESReset(void)
+{
+    this->ClearSecretData(&mKey, sizeof(mKey));
+}
+
+template <class Policy>
+inline void EAXP_128_AESNI<Policy>::AESSetKey(const uint8_t *key, size_t keyLen)
+{
+    assert(keyLen == kKeyLength);
+    AESNIExpandKey128(key, mKey);
+}
+
+template <class Policy>
+inline void EAXP_128_AESNI<Policy>::AESSaveKey(AESKeySchedule *sched) const
+{
+    memcpy(sched->rk, mKey, sizeof(mKey));
+}
+
+template <class Policy>
+inline void EAXP_128_AESNI<Policy>::AESLoadKey(const AESKeySchedule *sched)
+{
+    memcpy(mKey, sched->rk, sizeof(mKey));
+}
+
+template <class Policy>
+inline void EAXP_128_AESNI<Policy>::AESEncryptBlock(uint8_t *data)
+{
+    AESNIEncryptBlock(mKey, kRoundCount, data);
+}
+
+template <class Policy>
+inline void EAXP_128_AESNI<Policy>::AESEncryptBlocks(uint8_t *data, size_t nBlocks)
+{
+    AESNIEncryptBlocks(mKey, kRoundCount, data, nBlocks);
+}
+
+template <class Policy>
+inline void EAXP_128_AESNI<Policy>::AESEncryptLanes(EAXP_128_AESNI *const *lanes, uint8_t *const *blocks, size_t n)
+{
+    const __m128i *keys[8];
+    size_t i, m;
+
+    for (; n > 0; n -= m, lanes += m, blocks += m) {
+        m = (n < 8) ? n : 8;
+        for (i = 0; i < m; i++) {
+            keys[i] = lanes[i]->mKey;
+        }
+        AESNIEncryptLanes(keys, kRoundCount, blocks, m);
+    }
+}
+
+template <class Policy>
+inline EAXP_256_AESNI<Policy>::EAXP_256_AESNI(void)
+{
+    this->ClearSecretData(&mKey, sizeof(mKey));
+}
+
+template <class Policy>
+inline EAXP_256_AESNI<Policy>::~EAXP_256_AESNI(void)
+{
+    this->ClearSecretData(&mKey, sizeof(mKey));
+}
+
+template <class Policy>
+inline void EAXP_256_AESNI<Policy>::AESReset(void)
+{
+    this->ClearSecretData(&mKey, sizeof(mKey));
+}
+
+template <class Policy>
+inline void EAXP_256_AESNI<Policy>::AESSetKey(const uint8_t *key, size_t keyLen)
+{
+    assert(keyLen == kKeyLength);
+    AESNIExpandKey256(key, mKey);
+}
+
+template <class Policy>
+inline void EAXP_256_AESNI<Policy>::AESSaveKey(AESKeySchedule *sched) const
+{
+    memcpy(sched->rk, mKey, sizeof(mKey));
+}
+
+template <class Policy>
+inline void EAXP_256_AESNI<Policy>::AESLoadKey(const AESKeySchedule *sched)
+{
+    memcpy(mKey, sched->rk, sizeof(mKey));
+}
+
+template <class Policy>
+inline void EAXP_256_AESNI<Policy>::AESEncryptBlock(uint8_t *data)
+{
+    AESNIEncryptBlock(mKey, kRoundCount, data);
+}
+
+template <class Policy>
+inline void EAXP_256_AESNI<Policy>::AESEncryptBlocks(uint8_t *data, size_t nBlocks)
+{
+    AESNIEncryptBlocks(mKey, kRoundCount, data, nBlocks);
+}
+
+template <class Policy>
+inline void EAXP_256_AESNI<Policy>::AESEncryptLanes(EAXP_256_AESNI *const *lanes, uint8_t *const *blocks, size_t n)
+{
+    const __m128i *keys[8];
+    size_t i, m;
+
+    for (; n > 0; n -= m, lanes += m, blocks += m) {
+        m = (n < 8) ? n : 8;
+        for (i = 0; i < m; i++) {
+            keys[i] = lanes[i]->mKey;
+        }
+        AESNIEncryptLanes(keys, kRoundCount, blocks, m);
+    }
+}
+
 #endif // EAX_AESNI_H_
@@ -0,0 +1,677 @@
+/*
+ *    Copyright (c) 2021 Jay Logue
+ *    All rights reserved.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/**
+ *    @file
+ *      An implementation of the EAX authenticated encryption mode that uses
+ *      a portable, constant-time, bitsliced software implementation of the
+ *      AES block cipher.
+ *
+ */
+
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include <EAX-Soft.h>
+
+/*
+ * Implementation Notes
+ * ====================
+ *
+ * This is a bitsliced AES implementation, in the style of the "ct64"
+ * implementation of BearSSL (Thomas Pornin). Four blocks are processed in
+ * parallel, in an array of eight 64-bit words q[0..7]. After the
+ * orthogonalization step, q[i] holds bit i of every byte of the four
+ * blocks, so that the S-box can be computed with a fixed sequence of
+ * boolean operations (the circuit of Boyar and Peralta), and ShiftRows
+ * and MixColumns become fixed bit permutations. There are no table
+ * lookups and no data-dependent branches, so the execution time does not
+ * depend on the key or the data.
+ *
+ * Round keys are stored in a compressed form of two 64-bit words per
+ * round (the same size as the AES round key itself), and are expanded to
+ * eight words when used.
+ *
+ * The round functions are templates over the word type W. With
+ * CONFIG_SOFT_AES_VECTOR, W is a vector of two 64-bit words, and two
+ * groups of four blocks are processed together with SIMD instructions.
+ */
+
+namespace {
+
+#if CONFIG_SOFT_AES_VECTOR
+typedef uint64_t SoftAESVector __attribute__((vector_size(16)));
+#endif
+
+template <class W>
+inline void SwapN(W & x, W & y, uint64_t cl, uint64_t ch, unsigned s)
+{
+    W a = x, b = y;
+
+    x = (a & cl) | ((b & cl) << s);
+    y = ((a & ch) >> s) | (b & ch);
+}
+
+/*
+ * Convert four blocks between the interleaved representation and the
+ * bitsliced one (the transformation is its own inverse).
+ */
+template <class W>
+inline void Ortho(W *q)
+{
+    SwapN(q[0], q[1], 0x5555555555555555, 0xAAAAAAAAAAAAAAAA, 1);
+    SwapN(q[2], q[3], 0x5555555555555555, 0xAAAAAAAAAAAAAAAA, 1);
+    SwapN(q[4], q[5], 0x5555555555555555, 0xAAAAAAAAAAAAAAAA, 1);
+    SwapN(q[6], q[7], 0x5555555555555555, 0xAAAAAAAAAAAAAAAA, 1);
+
+    SwapN(q[0], q[2], 0x3333333333333333, 0xCCCCCCCCCCCCCCCC, 2);
+    SwapN(q[1], q[3], 0x3333333333333333, 0xCCCCCCCCCCCCCCCC, 2);
+    SwapN(q[4], q[6], 0x3333333333333333, 0xCCCCCCCCCCCCCCCC, 2);
+    SwapN(q[5], q[7], 0x3333333333333333, 0xCCCCCCCCCCCCCCCC, 2);
+
+    SwapN(q[0], q[4], 0x0F0F0F0F0F0F0F0F, 0xF0F0F0F0F0F0F0F0, 4);
+    SwapN(q[1], q[5], 0x0F0F0F0F0F0F0F0F, 0xF0F0F0F0F0F0F0F0, 4);
+    SwapN(q[2], q[6], 0x0F0F0F0F0F0F0F0F, 0xF0F0F0F0F0F0F0F0, 4);
+    SwapN(q[3], q[7], 0x0F0F0F0F0F0F0F0F, 0xF0F0F0F0F0F0F0F0, 4);
+}
+
+/*
+ * The AES S-box, applied to all bytes of the four blocks, as a circuit of
+ * 113 boolean operations (Boyar and Peralta).
+ */
+template <class W>
+inline void SBox(W *q)
+{
+    W x0, x1, x2, x3, x4, x5, x6, x7;
+    W y1, y2, y3, y4, y5, y6, y7, y8, y9;
+    W y10, y11, y12, y13, y14, y15, y16, y17, y18, y19;
+    W y20, y21;
+    W z0, z1, z2, z3, z4, z5, z6, z7, z8, z9;
+    W z10, z11, z12, z13, z14, z15, z16, z17;
+    W t0, t1, t2, t3, t4, t5, t6, t7, t8, t9;
+    W t10, t11, t12, t13, t14, t15, t16, t17, t18, t19;
+    W t20, t21, t22, t23, t24, t25, t26, t27, t28, t29;
+    W t30, t31, t32, t33, t34, t35, t36, t37, t38, t39;
+    W t40, t41, t42, t43, t44, t45, t46, t47, t48, t49;
+    W t50, t51, t52, t53, t54, t55, t56, t57, t58, t59;
+    W t60, t61, t62, t63, t64, t65, t66, t67;
+    W s0, s1, s2, s3, s4, s5, s6, s7;
+
+    x0 = q[7];
+    x1 = q[6];
+    x2 = q[5];
+    x3 = q[4];
+    x4 = q[3];
+    x5 = q[2];
+    x6 = q[1];
+    x7 = q[0];
+
+    /*
+     * Top linear transformation.
+     */
+    y14 = x3 ^ x5;
+    y13 = x0 ^ x6;
+    y9 = x0 ^ x3;
+    y8 = x0 ^ x5;
+    t0 = x1 ^ x2;
+    y1 = t0 ^ x7;
+    y4 = y1 ^ x3;
+    y12 = y13 ^ y14;
+    y2 = y1 ^ x0;
+    y5 = y1 ^ x6;
+    y3 = y5 ^ y8;
+    t1 = x4 ^ y12;
+    y15 = t1 ^ x5;
+    y20 = t1 ^ x1;
+    y6 = y15 ^ x7;
+    y10 = y15 ^ t0;
+    y11 = y20 ^ y9;
+    y7 = x7 ^ y11;
+    y17 = y10 ^ y11;
+    y19 = y10 ^ y8;
+    y16 = t0 ^ y11;
+    y21 = y13 ^ y16;
+    y18 = x0 ^ y16;
+
+    /*
+     * Non-linear section.
+     */
+    t2 = y12 & y15;
+    t3 = y3 & y6;
+    t4 = t3 ^ t2;
+    t5 = y4 & x7;
+    t6 = t5 ^ t2;
+    t7 = y13 & y16;
+    t8 = y5 & y1;
+    t9 = t8 ^ t7;
+    t10 = y2 & y7;
+    t11 = t10 ^ t7;
+    t12 = y9 & y11;
+    t13 = y14 & y17;
+    t14 = t13 ^ t12;
+    t15 = y8 & y10;
+    t16 = t15 ^ t12;
+    t17 = t4 ^ t14;
+    t18 = t6 ^ t16;
+    t19 = t9 ^ t14;
+    t20 = t11 ^ t16;
+    t21 = t17 ^ y20;
+    t22 = t18 ^ y19;
+    t23 = t19 ^ y21;
+    t24 = t20 ^ y18;
+
+    t25 = t21 ^ t22;
+    t26 = t21 & t23;
+    t27 = t24 ^ t26;
+    t28 = t25 & t27;
+    t29 = t28 ^ t22;
+    t30 = t23 ^ t24;
+    t31 = t22 ^ t26;
+    t32 = t31 & t30;
+    t33 = t32 ^ t24;
+    t34 = t23 ^ t33;
+    t35 = t27 ^ t33;
+    t36 = t24 & t35;
+    t37 = t36 ^ t34;
+    t38 = t27 ^ t36;
+    t39 = t29 & t38;
+    t40 = t25 ^ t39;
+
+    t41 = t40 ^ t37;
+    t42 = t29 ^ t33;
+    t43 = t29 ^ t40;
+    t44 = t33 ^ t37;
+    t45 = t42 ^ t41;
+    z0 = t44 & y15;
+    z1 = t37 & y6;
+    z2 = t33 & x7;
+    z3 = t43 & y16;
+    z4 = t40 & y1;
+    z5 = t29 & y7;
+    z6 = t42 & y11;
+    z7 = t45 & y17;
+    z8 = t41 & y10;
+    z9 = t44 & y12;
+    z10 = t37 & y3;
+    z11 = t33 & y4;
+    z12 = t43 & y13;
+    z13 = t40 & y5;
+    z14 = t29 & y2;
+    z15 = t42 & y9;
+    z16 = t45 & y14;
+    z17 = t41 & y8;
+
+    /*
+     * Bottom linear transformation.
+     */
+    t46 = z15 ^ z16;
+    t47 = z10 ^ z11;
+    t48 = z5 ^ z13;
+    t49 = z9 ^ z10;
+    t50 = z2 ^ z12;
+    t51 = z2 ^ z5;
+    t52 = z7 ^ z8;
+    t53 = z0 ^ z3;
+    t54 = z6 ^ z7;
+    t55 = z16 ^ z17;
+    t56 = z12 ^ t48;
+    t57 = t50 ^ t53;
+    t58 = z4 ^ t46;
+    t59 = z3 ^ t54;
+    t60 = t46 ^ t57;
+    t61 = z14 ^ t57;
+    t62 = t52 ^ t58;
+    t63 = t49 ^ t58;
+    t64 = z4 ^ t59;
+    t65 = t61 ^ t62;
+    t66 = z1 ^ t63;
+    s0 = t59 ^ t63;
+    s6 = t56 ^ ~t62;
+    s7 = t48 ^ ~t60;
+    t67 = t64 ^ t65;
+    s3 = t53 ^ t66;
+    s4 = t51 ^ t66;
+    s5 = t47 ^ t65;
+    s1 = t64 ^ ~s3;
+    s2 = t55 ^ ~t67;
+
+    q[7] = s0;
+    q[6] = s1;
+    q[5] = s2;
+    q[4] = s3;
+    q[3] = s4;
+    q[2] = s5;
+    q[1] = s6;
+    q[0] = s7;
+}
+
+template <class W>
+inline void ShiftRows(W *q)
+{
+    for (int i = 0; i < 8; i++) {
+        W x = q[i];
+
+        q[i] = (x & 0x000000000000FFFF)
+             | ((x & 0x00000000FFF00000) >> 4)
+             | ((x & 0x00000000000F0000) << 12)
+             | ((x & 0x0000FF0000000000) >> 8)
+             | ((x & 0x000000FF00000000) << 8)
+             | ((x & 0xF000000000000000) >> 12)
+             | ((x & 0x0FFF000000000000) << 4);
+    }
+}
+
+template <class W>
+inline W Rotr32(W x)
+{
+    return (x << 32) | (x >> 32);
+}
+
+template <class W>
+inline void MixColumns(W *q)
+{
+    W q0, q1, q2, q3, q4, q5, q6, q7;
+    W r0, r1, r2, r3, r4, r5, r6, r7;
+
+    q0 = q[0];
+    q1 = q[1];
+    q2 = q[2];
+    q3 = q[3];
+    q4 = q[4];
+    q5 = q[5];
+    q6 = q[6];
+    q7 = q[7];
+    r0 = (q0 >> 16) | (q0 << 48);
+    r1 = (q1 >> 16) | (q1 << 48);
+    r2 = (q2 >> 16) | (q2 << 48);
+    r3 = (q3 >> 16) | (q3 << 48);
+    r4 = (q4 >> 16) | (q4 << 48);
+    r5 = (q5 >> 16) | (q5 << 48);
+    r6 = (q6 >> 16) | (q6 << 48);
+    r7 = (q7 >> 16) | (q7 << 48);
+
+    q[0] = q7 ^ r7 ^ r0 ^ Rotr32(q0 ^ r0);
+    q[1] = q0 ^ r0 ^ q7 ^ r7 ^ r1 ^ Rotr32(q1 ^ r1);
+    q[2] = q1 ^ r1 ^ r2 ^ Rotr32(q2 ^ r2);
+    q[3] = q2 ^ r2 ^ q7 ^ r7 ^ r3 ^ Rotr32(q3 ^ r3);
+    q[4] = q3 ^ r3 ^ q7 ^ r7 ^ r4 ^ Rotr32(q4 ^ r4);
+    q[5] = q4 ^ r4 ^ r5 ^ Rotr32(q5 ^ r5);
+    q[6] = q5 ^ r5 ^ r6 ^ Rotr32(q6 ^ r6);
+    q[7] = q6 ^ r6 ^ r7 ^ Rotr32(q7 ^ r7);
+}
+
+/*
+ * Expand the two compressed words of a round key, and XOR them into the
+ * state.
+ */
+template <class W>
+inline void AddRoundKey(W *q, const uint64_t *compKey)
+{
+    for (int u = 0; u < 2; u++) {
+        uint64_t x0, x1, x2, x3;
+
+        x0 = compKey[u] & 0x1111111111111111;
+        x1 = (compKey[u] & 0x2222222222222222) >> 1;
+        x2 = (compKey[u] & 0x4444444444444444) >> 2;
+        x3 = (compKey[u] & 0x8888888888888888) >> 3;
+        q[u * 4 + 0] ^= (x0 << 4) - x0;
+        q[u * 4 + 1] ^= (x1 << 4) - x1;
+        q[u * 4 + 2] ^= (x2 << 4) - x2;
+        q[u * 4 + 3] ^= (x3 << 4) - x3;
+    }
+}
+
+template <class W>
+void EncryptBitsliced(const uint64_t *roundKeys, unsigned roundCount, W *q)
+{
+    unsigned r;
+
+    AddRoundKey(q, roundKeys);
+    for (r = 1; r < roundCount; r++) {
+        SBox(q);
+        ShiftRows(q);
+        MixColumns(q);
+        AddRoundKey(q, roundKeys + r * 2);
+    }
+    SBox(q);
+    ShiftRows(q);
+    AddRoundKey(q, roundKeys + roundCount * 2);
+}
+
+inline uint32_t LoadLE32(const uint8_t *src)
+{
+    return (uint32_t)src[0] | ((uint32_t)src[1] << 8) | ((uint32_t)src[2] << 16) | ((uint32_t)src[3] << 24);
+}
+
+inline void StoreLE32(uint8_t *dst, uint32_t val)
+{
+    dst[0] = (uint8_t)val;
+    dst[1] = (uint8_t)(val >> 8);
+    dst[2] = (uint8_t)(val >> 16);
+    dst[3] = (uint8_t)(val >> 24);
+}
+
+/*
+ * Spread the four 32-bit words of a block over two 64-bit words, so that
+ * four blocks can then be orthogonalized.
+ */
+void InterleaveIn(uint64_t *q0, uint64_t *q1, const uint32_t *w)
+{
+    uint64_t x0, x1, x2, x3;
+
+    x0 = w[0];
+    x1 = w[1];
+    x2 = w[2];
+    x3 = w[3];
+    x0 |= (x0 << 16);
+    x1 |= (x1 << 16);
+    x2 |= (x2 << 16);
+    x3 |= (x3 << 16);
+    x0 &= 0x0000FFFF0000FFFF;
+    x1 &= 0x0000FFFF0000FFFF;
+    x2 &= 0x0000FFFF0000FFFF;
+    x3 &= 0x0000FFFF0000FFFF;
+    x0 |= (x0 << 8);
+    x1 |= (x1 << 8);
+    x2 |= (x2 << 8);
+    x3 |= (x3 << 8);
+    x0 &= 0x00FF00FF00FF00FF;
+    x1 &= 0x00FF00FF00FF00FF;
+    x2 &= 0x00FF00FF00FF00FF;
+    x3 &= 0x00FF00FF00FF00FF;
+    *q0 = x0 | (x2 << 8);
+    *q1 = x1 | (x3 << 8);
+}
+
+void InterleaveOut(uint32_t *w, uint64_t q0, uint64_t q1)
+{
+    uint64_t x0, x1, x2, x3;
+
+    x0 = q0 & 0x00FF00FF00FF00FF;
+    x1 = q1 & 0x00FF00FF00FF00FF;
+    x2 = (q0 >> 8) & 0x00FF00FF00FF00FF;
+    x3 = (q1 >> 8) & 0x00FF00FF00FF00FF;
+    x0 |= (x0 >> 8);
+    x1 |= (x1 >> 8);
+    x2 |= (x2 >> 8);
+    x3 |= (x3 >> 8);
+    x0 &= 0x0000FFFF0000FFFF;
+    x1 &= 0x0000FFFF0000FFFF;
+    x2 &= 0x0000FFFF0000FFFF;
+    x3 &= 0x0000FFFF0000FFFF;
+    w[0] = (uint32_t)x0 | (uint32_t)(x0 >> 16);
+    w[1] = (uint32_t)x1 | (uint32_t)(x1 >> 16);
+    w[2] = (uint32_t)x2 | (uint32_t)(x2 >> 16);
+    w[3] = (uint32_t)x3 | (uint32_t)(x3 >> 16);
+}
+
+/*
+ * Load up to four blocks (missing ones are zero) into the interleaved
+ * representation.
+ */
+void LoadBlocks(uint64_t *q, const uint8_t *data, size_t nBlocks)
+{
+    uint32_t w[4];
+
+    for (size_t i = 0; i < 4; i++) {
+        for (size_t j = 0; j < 4; j++) {
+            w[j] = (i < nBlocks) ? LoadLE32(data + i * 16 + j * 4) : 0;
+        }
+        InterleaveIn(&q[i], &q[i + 4], w);
+    }
+}
+
+void StoreBlocks(uint8_t *data, size_t nBlocks, const uint64_t *q)
+{
+    uint32_t w[4];
+
+    for (size_t i = 0; i < nBlocks; i++) {
+        InterleaveOut(w, q[i], q[i + 4]);
+        for (size_t j = 0; j < 4; j++) {
+            StoreLE32(data + i * 16 + j * 4, w[j]);
+        }
+    }
+    EAXWipeBlockTemp(w, sizeof(w));
+}
+
+/*
+ * Encrypt up to four blocks.
+ */
+void EncryptGroup(const uint64_t *roundKeys, unsigned roundCount, uint8_t *data, size_t nBlocks)
+{
+    uint64_t q[8];
+
+    LoadBlocks(q, data, nBlocks);
+    Ortho(q);
+    EncryptBitsliced(roundKeys, roundCount, q);
+    Ortho(q);
+    StoreBlocks(data, nBlocks, q);
+    EAXWipeBlockTemp(q, sizeof(q));
+}
+
+#if CONFIG_SOFT_AES_VECTOR
+
+/*
+ * Encrypt eight blocks, as two groups of four in the two lanes of the
+ * vector words.
+ */
+void EncryptVectorGroup(const uint64_t *roundKeys, unsigned roundCount, uint8_t *data)
+{
+    uint64_t a[8], b[8];
+    SoftAESVector q[8];
+
+    LoadBlocks(a, data, 4);
+    LoadBlocks(b, data + 4 * 16, 4);
+    for (int i = 0; i < 8; i++) {
+        q[i] = (SoftAESVector){ a[i], b[i] };
+    }
+    Ortho(q);
+    EncryptBitsliced(roundKeys, roundCount, q);
+    Ortho(q);
+    for (int i = 0; i < 8; i++) {
+        a[i] = q[i][0];
+        b[i] = q[i][1];
+    }
+    StoreBlocks(data, 4, a);
+    StoreBlocks(data + 4 * 16, 4, b);
+    EAXWipeBlockTemp(a, sizeof(a));
+    EAXWipeBlockTemp(b, sizeof(b));
+    EAXWipeBlockTemp(q, sizeof(q));
+}
+
+#endif // CONFIG_SOFT_AES_VECTOR
+
+/*
+ * Apply the S-box to the four bytes of a word (key schedule).
+ */
+uint32_t SubWord(uint32_t x)
+{
+    uint64_t q[8];
+
+    EAXSecureWipe(q, sizeof(q));
+    q[0] = x;
+    Ortho(q);
+    SBox(q);
+    Ortho(q);
+    x = (uint32_t)q[0];
+    EAXSecureWipe(q, sizeof(q));
+    return x;
+}
+
+} // unnamed namespace
+
+void SoftAESExpandKey(const uint8_t *key, size_t keyLen, uint64_t *roundKeys)
+{
+    static const uint8_t sRcon[] = { 0x01, 0x02, 0x04, 0x08, 0x10, 0x20, 0x40, 0x80, 0x1B, 0x36 };
+    uint32_t skey[60];
+    uint32_t tmp;
+    size_t nk, nkf, i, j, k;
+
+    assert(keyLen == 16 || keyLen == 32);
+
+    /*
+     * Standard AES key expansion, on little-endian 32-bit words.
+     */
+    nk = keyLen / 4;
+    nkf = (nk + 7) * 4;
+    for (i = 0; i < nk; i++) {
+        skey[i] = LoadLE32(key + i * 4);
+    }
+    tmp = skey[nk - 1];
+    for (i = nk, j = 0, k = 0; i < nkf; i++) {
+        if (j == 0) {
+            tmp = (tmp << 24) | (tmp >> 8);
+            tmp = SubWord(tmp) ^ sRcon[k];
+        } else if (nk > 6 && j == 4) {
+            tmp = SubWord(tmp);
+        }
+        tmp ^= skey[i - nk];
+        skey[i] = tmp;
+        if (++j == nk) {
+            j = 0;
+            k++;
+        }
+    }
+
+    /*
+     * Convert each round key to the bitsliced representation (as if the
+     * same key were used for the four blocks), and keep one copy of each
+     * bit.
+     */
+    for (i = 0, j = 0; i < nkf; i += 4, j += 2) {
+        uint64_t q[8];
+
+        InterleaveIn(&q[0], &q[4], skey + i);
+        q[1] = q[0];
+        q[2] = q[0];
+        q[3] = q[0];
+        q[5] = q[4];
+        q[6] = q[4];
+        q[7] = q[4];
+        Ortho(q);
+        roundKeys[j] = (q[0] & 0x1111111111111111) | (q[1] & 0x2222222222222222)
+                     | (q[2] & 0x4444444444444444) | (q[3] & 0x8888888888888888);
+        roundKeys[j + 1] = (q[4] & 0x1111111111111111) | (q[5] & 0x2222222222222222)
+                         | (q[6] & 0x4444444444444444) | (q[7] & 0x8888888888888888);
+        EAXSecureWipe(q, sizeof(q));
+    }
+
+    EAXSecureWipe(skey, sizeof(skey));
+    tmp = 0;
+}
+
+void SoftAESEncryptBlock(const uint64_t *roundKeys, unsigned roundCount, uint8_t *data)
+{
+    EncryptGroup(roundKeys, roundCount, data, 1);
+}
+
+void SoftAESEncryptBlocks(const uint64_t *roundKeys, unsigned roundCount, uint8_t *data, size_t nBlocks)
+{
+#if CONFIG_SOFT_AES_VECTOR
+    for (; nBlocks >= 8; nBlocks -= 8, data += 8 * 16) {
+        EncryptVectorGroup(roundKeys, roundCount, data);
+    }
+#endif
+    for (; nBlocks >= 4; nBlocks -= 4, data += 4 * 16) {
+        EncryptGroup(roundKeys, roundCount, data, 4);
+    }
+    if (nBlocks > 0) {
+        EncryptGroup(roundKeys, roundCount, data, nBlocks);
+    }
+}
+
+EAX_128_Soft::EAX_128_Soft(void)
+{
+    ClearSecretData(mKey, sizeof(mKey));
+}
+
+EAX_128_Soft::~EAX_128_Soft(void)
+{
+    ClearSecretData(mKey, sizeof(mKey));
+}
+
+void EAX_128_Soft::AESReset(void)
+{
+    ClearSecretData(mKey, sizeof(mKey));
+}
+
+void EAX_128_Soft::AESSetKey(const uint8_t *key, size_t keyLen)
+{
+    assert(keyLen == kKeyLength);
+    SoftAESExpandKey(key, keyLen, mKey);
+}
+
+void EAX_128_Soft::AESEncryptBlock(uint8_t *data)
+{
+    SoftAESEncryptBlock(mKey, kRoundCount, data);
+}
+
+void EAX_128_Soft::AESEncryptBlocks(uint8_t *data, size_t nBlocks)
+{
+    SoftAESEncryptBlocks(mKey, kRoundCount, data, nBlocks);
+}
+
+EAX_256_Soft::EAX_256_Soft(void)
+{
+    ClearSecretData(mKey, sizeof(mKey));
+}
+
+EAX_256_Soft::~EAX_256_Soft(void)
+{
+    ClearSecretData(mKey, sizeof(mKey));
+}
+
+void EAX_256_Soft::AESReset(void)
+{
+    ClearSecretData(mKey, sizeof(mKey));
+}
+
+void EAX_256_Soft::AESSetKey(const uint8_t *key, size_t keyLen)
+{
+    assert(keyLen == kKeyLength);
+    SoftAESExpandKey(key, keyLen, mKey);
+}
+
+void EAX_256_Soft::AESEncryptBlock(uint8_t *data)
+{
+    SoftAESEncryptBlock(mKey, kRoundCount, data);
+}
+
+void EAX_256_Soft::AESEncryptBlocks(uint8_t *data, size_t nBlocks)
+{
+    SoftAESEncryptBlocks(mKey, kRoundCount, data, nBlocks);
+}
+
+//
+// Compile as follows to create a stand-alone program for testing EAX-128-Soft
+// against the standard test vectors.
+//
+//    c++ -O3 -o test-eax-128-soft -I. -DUNIT_TEST EAX.cpp EAX-Soft.cpp EAXTest.cpp
+//
+#ifdef UNIT_TEST
+
+#include <stdio.h>
+
+int main(int argc, char *argv[])
+{
+    EAX_128_Soft eax;
+    TestEAX128(eax);
+    printf("All tests passed\n");
+}
+
+#endif // UNIT_TEST
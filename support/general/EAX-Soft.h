@@ -0,0 +1,126 @@
+/*
+ *    Copyright (c) 2021 Jay Logue
+ *    All rights reserved.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/**
+ *    @file
+ *      An implementation of the EAX authenticated encryption mode that uses
+ *      a portable, constant-time, bitsliced software implementation of the
+ *      AES block cipher.
+ *
+ */
+
+#ifndef EAX_SOFT_H_
+#define EAX_SOFT_H_
+
+#include <EAX.h>
+
+/* CONFIGURATION OPTIONS */
+
+/** CONFIG_SOFT_AES_VECTOR
+ *
+ * If non-zero, the bitsliced AES code uses the GCC/Clang vector extensions
+ * to process 8 blocks at a time (two 64-bit lanes of 4 blocks each) rather
+ * than 4. This is only beneficial on targets with 128-bit SIMD registers,
+ * and is enabled by default on those (x86 with SSE2, ARM with NEON).
+ */
+#ifndef CONFIG_SOFT_AES_VECTOR
+#if defined(__GNUC__) && (defined(__SSE2__) || defined(__ARM_NEON))
+#define CONFIG_SOFT_AES_VECTOR 1
+#else
+#define CONFIG_SOFT_AES_VECTOR 0
+#endif
+#endif
+
+/** Number of 64-bit words in a bitsliced AES key schedule with the given
+ *  number of rounds.
+ */
+#define SOFT_AES_KEY_WORDS(ROUND_COUNT) (((ROUND_COUNT) + 1) * 2)
+
+/** Expand an AES key (16 or 32 bytes) into a bitsliced key schedule of
+ *  SOFT_AES_KEY_WORDS(roundCount) words.
+ */
+extern void SoftAESExpandKey(const uint8_t *key, size_t keyLen, uint64_t *roundKeys);
+
+/** Encrypt a single block in place with a bitsliced key schedule.
+ */
+extern void SoftAESEncryptBlock(const uint64_t *roundKeys, unsigned roundCount, uint8_t *data);
+
+/** Encrypt nBlocks independent blocks in place with a bitsliced key schedule.
+ *
+ * Blocks are processed 4 at a time (8 with CONFIG_SOFT_AES_VECTOR); the
+ * cost of a partial group is the same as that of a full one.
+ */
+extern void SoftAESEncryptBlocks(const uint64_t *roundKeys, unsigned roundCount, uint8_t *data, size_t nBlocks);
+
+/** An implementation of EAX mode based on AES-128 using a portable software
+ *  block cipher.
+ *
+ * The block cipher is bitsliced: it uses no table lookups and no secret-
+ * dependent branches, and so runs in constant time. It is the fallback for
+ * hosts without hardware AES support, and runs on any 32- or 64-bit processor
+ * (e.g. Cortex-M4).
+ */
+class EAX_128_Soft final : public EAX
+{
+public:
+    EAX_128_Soft(void);
+    virtual ~EAX_128_Soft(void);
+
+protected:
+    virtual void AESReset(void);
+    virtual void AESSetKey(const uint8_t *key, size_t keyLen);
+    virtual void AESEncryptBlock(uint8_t *data);
+    virtual void AESEncryptBlocks(uint8_t *data, size_t nBlocks);
+
+private:
+    enum
+    {
+        kKeyLength      = 16,
+        kBlockLength    = 16,
+        kRoundCount     = 10
+    };
+
+    uint64_t mKey[SOFT_AES_KEY_WORDS(kRoundCount)];
+};
+
+/** An implementation of EAX mode based on AES-256 using a portable software
+ *  block cipher.
+ */
+class EAX_256_Soft final : public EAX
+{
+public:
+    EAX_256_Soft(void);
+    virtual ~EAX_256_Soft(void);
+
+protected:
+    virtual void AESReset(void);
+    virtual void AESSetKey(const uint8_t *key, size_t keyLen);
+    virtual void AESEncryptBlock(uint8_t *data);
+    virtual void AESEncryptBlocks(uint8_t *data, size_t nBlocks);
+
+private:
+    enum
+    {
+        kKeyLength      = 32,
+        kBlockLength    = 16,
+        kRoundCount     = 14
+    };
+
+    uint64_t mKey[SOFT_AES_KEY_WORDS(kRoundCount)];
+};
+
+#endif // EAX_SOFT_H_
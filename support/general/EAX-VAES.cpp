@@ -0,0 +1,260 @@
+/*
+ *    Copyright (c) 2021 Jay Logue
+ *    All rights reserved.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/**
+ *    @file
+ *      An implementation of the EAX authenticated encryption mode that uses
+ *      the VAES (vector AES) instructions of AVX-512 capable processors for
+ *      the underlying block cipher.
+ *
+ */
+
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include <immintrin.h>
+
+#include <EAX-VAES.h>
+
+#define VAES_TARGET __attribute__((target("aes,vaes,avx512f")))
+
+namespace {
+
+/*
+ * Encrypt G groups of four blocks, one group per 512-bit register, with the
+ * rounds interleaved across the groups. rk[] holds the round keys broadcast
+ * to all four 128-bit lanes.
+ */
+template <size_t G>
+VAES_TARGET inline void VAESEncryptGroups(const __m512i *rk, unsigned roundCount, uint8_t *data)
+{
+    __m512i b[G];
+    unsigned r;
+    size_t i;
+
+    for (i = 0; i < G; i++) {
+        b[i] = _mm512_xor_si512(_mm512_loadu_si512((const void *)(data + i * 64)), rk[0]);
+    }
+    for (r = 1; r < roundCount; r++) {
+        for (i = 0; i < G; i++) {
+            b[i] = _mm512_aesenc_epi128(b[i], rk[r]);
+        }
+    }
+    for (i = 0; i < G; i++) {
+        _mm512_storeu_si512((void *)(data + i * 64), _mm512_aesenclast_epi128(b[i], rk[roundCount]));
+    }
+    EAXSecureWipe(b, sizeof(b));
+}
+
+/*
+ * Gather the round key r of four lanes into the four 128-bit lanes of a
+ * 512-bit register.
+ */
+VAES_TARGET inline __m512i VAESLaneRoundKey(const __m128i *const *keys, unsigned r)
+{
+    __m512i k;
+
+    k = _mm512_maskz_broadcast_i32x4(0xFFFF, keys[0][r]);
+    k = _mm512_mask_broadcast_i32x4(k, 0x00F0, keys[1][r]);
+    k = _mm512_mask_broadcast_i32x4(k, 0x0F00, keys[2][r]);
+    k = _mm512_mask_broadcast_i32x4(k, 0xF000, keys[3][r]);
+    return k;
+}
+
+/*
+ * Encrypt G groups of four blocks, each block with its own key schedule.
+ */
+template <size_t G>
+VAES_TARGET inline void VAESEncryptLaneGroups(const __m128i *const *keys, unsigned roundCount, uint8_t *const *blocks)
+{
+    __m512i b[G];
+    unsigned r;
+    size_t i;
+
+    for (i = 0; i < G; i++) {
+        const size_t j = i * 4;
+
+        b[i] = _mm512_castsi128_si512(_mm_loadu_si128((const __m128i *)blocks[j]));
+        b[i] = _mm512_inserti32x4(b[i], _mm_loadu_si128((const __m128i *)blocks[j + 1]), 1);
+        b[i] = _mm512_inserti32x4(b[i], _mm_loadu_si128((const __m128i *)blocks[j + 2]), 2);
+        b[i] = _mm512_inserti32x4(b[i], _mm_loadu_si128((const __m128i *)blocks[j + 3]), 3);
+        b[i] = _mm512_xor_si512(b[i], VAESLaneRoundKey(keys + j, 0));
+    }
+    for (r = 1; r < roundCount; r++) {
+        for (i = 0; i < G; i++) {
+            b[i] = _mm512_aesenc_epi128(b[i], VAESLaneRoundKey(keys + i * 4, r));
+        }
+    }
+    for (i = 0; i < G; i++) {
+        const size_t j = i * 4;
+
+        b[i] = _mm512_aesenclast_epi128(b[i], VAESLaneRoundKey(keys + j, roundCount));
+        _mm_storeu_si128((__m128i *)blocks[j], _mm512_maskz_extracti32x4_epi32(0xF, b[i], 0));
+        _mm_storeu_si128((__m128i *)blocks[j + 1], _mm512_maskz_extracti32x4_epi32(0xF, b[i], 1));
+        _mm_storeu_si128((__m128i *)blocks[j + 2], _mm512_maskz_extracti32x4_epi32(0xF, b[i], 2));
+        _mm_storeu_si128((__m128i *)blocks[j + 3], _mm512_maskz_extracti32x4_epi32(0xF, b[i], 3));
+    }
+    EAXSecureWipe(b, sizeof(b));
+}
+
+} // unnamed namespace
+
+bool VAESSupported(void)
+{
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("aes") && __builtin_cpu_supports("vaes") && __builtin_cpu_supports("avx512f");
+}
+
+/*
+ * Blocks are processed sixteen at a time (four 512-bit registers, so that
+ * several VAES instructions are in flight), then in groups of four; the
+ * last one to three blocks are processed with masked loads and stores.
+ */
+VAES_TARGET void VAESEncryptBlocks(const __m128i *keys, unsigned roundCount, uint8_t *data, size_t nBlocks)
+{
+    __m512i rk[15];
+    unsigned r;
+
+    for (r = 0; r <= roundCount; r++) {
+        rk[r] = _mm512_maskz_broadcast_i32x4(0xFFFF, keys[r]);
+    }
+
+    for (; nBlocks >= 16; nBlocks -= 16, data += 16 * 16) {
+        VAESEncryptGroups<4>(rk, roundCount, data);
+    }
+    switch (nBlocks / 4) {
+    case 3:
+        VAESEncryptGroups<3>(rk, roundCount, data);
+        break;
+    case 2:
+        VAESEncryptGroups<2>(rk, roundCount, data);
+        break;
+    case 1:
+        VAESEncryptGroups<1>(rk, roundCount, data);
+        break;
+    }
+    data += (nBlocks / 4) * 4 * 16;
+    nBlocks %= 4;
+
+    if (nBlocks > 0) {
+        const __mmask8 mask = (__mmask8)((1u << (2 * nBlocks)) - 1);
+        __m512i b;
+
+        b = _mm512_xor_si512(_mm512_maskz_loadu_epi64(mask, data), rk[0]);
+        for (r = 1; r < roundCount; r++) {
+            b = _mm512_aesenc_epi128(b, rk[r]);
+        }
+        _mm512_mask_storeu_epi64(data, mask, _mm512_aesenclast_epi128(b, rk[roundCount]));
+        EAXSecureWipe(&b, sizeof(b));
+    }
+
+    EAXSecureWipe(rk, sizeof(rk));
+}
+
+/*
+ * Gathering the round keys of four different lanes costs three masked
+ * broadcasts per round and register, so up to sixteen blocks are taken
+ * at a time to keep the VAES unit busy. The last one to three blocks are
+ * processed with AESNI.
+ */
+VAES_TARGET void VAESEncryptLanes(const __m128i *const *keys, unsigned roundCount, uint8_t *const *blocks, size_t n)
+{
+    for (; n >= 16; n -= 16, keys += 16, blocks += 16) {
+        VAESEncryptLaneGroups<4>(keys, roundCount, blocks);
+    }
+    switch (n / 4) {
+    case 3:
+        VAESEncryptLaneGroups<3>(keys, roundCount, blocks);
+        break;
+    case 2:
+        VAESEncryptLaneGroups<2>(keys, roundCount, blocks);
+        break;
+    case 1:
+        VAESEncryptLaneGroups<1>(keys, roundCount, blocks);
+        break;
+    }
+    keys += (n / 4) * 4;
+    blocks += (n / 4) * 4;
+    n %= 4;
+
+    if (n > 0) {
+        AESNIEncryptLanes(keys, roundCount, blocks, n);
+    }
+}
+
+EAX_128_VAES::EAX_128_VAES(void)
+{
+    ClearSecretData(&mKey, sizeof(mKey));
+}
+
+EAX_128_VAES::~EAX_128_VAES(void)
+{
+    ClearSecretData(&mKey, sizeof(mKey));
+}
+
+void EAX_128_VAES::AESReset(void)
+{
+    ClearSecretData(&mKey, sizeof(mKey));
+}
+
+void EAX_128_VAES::AESSetKey(const uint8_t *key, size_t keyLen)
+{
+    assert(keyLen == kKeyLength);
+    AESNIExpandKey128(key, mKey);
+}
+
+void EAX_128_VAES::AESEncryptBlock(uint8_t *data)
+{
+    AESNIEncryptBlock(mKey, kRoundCount, data);
+}
+
+void EAX_128_VAES::AESEncryptBlocks(uint8_t *data, size_t nBlocks)
+{
+    VAESEncryptBlocks(mKey, kRoundCount, data, nBlocks);
+}
+
+EAX_256_VAES::EAX_256_VAES(void)
+{
+    ClearSecretData(&mKey, sizeof(mKey));
+}
+
+EAX_256_VAES::~EAX_256_VAES(void)
+{
+    ClearSecretData(&mKey, sizeof(mKey));
+}
+
+void EAX_256_VAES::AESReset(void)
+{
+    ClearSecretData(&mKey, sizeof(mKey));
+}
+
+void EAX_256_VAES::AESSetKey(const uint8_t *key, size_t keyLen)
+{
+    assert(keyLen == kKeyLength);
+    AESNIExpandKey256(key, mKey);
+}
+
+void EAX_256_VAES::AESEncryptBlock(uint8_t *data)
+{
+    AESNIEncryptBlock(mKey, kRoundCount, data);
+}
+
+void EAX_256_VAES::AESEncryptBlocks(uint8_t *data, size_t nBlocks)
+{
+    VAESEncryptBlocks(mKey, kRoundCount, data, nBlocks);
+}
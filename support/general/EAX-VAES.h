@@ -0,0 +1,316 @@
+/*
+ *    Copyright (c) 2021 Jay Logue
+ *    All rights reserved.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/**
+ *    @file
+ *      An implementation of the EAX authenticated encryption mode that uses
+ *      the VAES (vector AES) instructions of AVX-512 capable processors for
+ *      the underlying block cipher.
+ *
+ *      The VAES code is compiled for the VAES and AVX-512 instruction set
+ *      extensions via function attributes, so that this file may be built
+ *      into programs that also run on processors without them. The classes
+ *      declared here must only be instantiated if VAESSupported() returns
+ *      true (see also EAXFactory.h).
+ */
+
+#ifndef EAX_VAES_H_
+#define EAX_VAES_H_
+
+#include <EAX-AESNI.h>
+
+/** Returns true if the processor and operating system support the VAES
+ *  and AVX-512F instruction set extensions used by this file.
+ */
+extern bool VAESSupported(void);
+
+/** Encrypt nBlocks independent blocks in place with an expanded AES key,
+ *  four blocks per VAES instruction.
+ */
+extern void VAESEncryptBlocks(const __m128i *keys, unsigned roundCount, uint8_t *data, size_t nBlocks);
+
+/** Encrypt n independent blocks in place, block i with the expanded AES
+ *  key keys[i], four blocks per VAES instruction.
+ */
+extern void VAESEncryptLanes(const __m128i *const *keys, unsigned roundCount, uint8_t *const *blocks, size_t n);
+
+/** An implementation of EAX mode based on AES-128 using VAES instructions.
+ */
+class EAX_128_VAES final : public EAX
+{
+public:
+    EAX_128_VAES(void);
+    virtual ~EAX_128_VAES(void);
+
+protected:
+    virtual void AESReset(void);
+    virtual void AESSetKey(const uint8_t *key, size_t keyLen);
+    virtual void AESEncryptBlock(uint8_t *data);
+    virtual void AESEncryptBlocks(uint8_t *data, size_t nBlocks);
+
+private:
+    enum
+    {
+        kKeyLength      = 16,
+        kBlockLength    = 16,
+        kRoundCount     = 10
+    };
+
+    __m128i mKey[kRoundCount + 1];
+};
+
+/** An implementation of EAX mode based on AES-256 using VAES instructions.
+ */
+class EAX_256_VAES final : public EAX
+{
+public:
+    EAX_256_VAES(void);
+    virtual ~EAX_256_VAES(void);
+
+protected:
+    virtual void AESReset(void);
+    virtual void AESSetKey(const uint8_t *key, size_t keyLen);
+    virtual void AESEncryptBlock(uint8_t *data);
+    virtual void AESEncryptBlocks(uint8_t *data, size_t nBlocks);
+
+private:
+    enum
+    {
+        kKeyLength      = 32,
+        kBlockLength    = 16,
+        kRoundCount     = 14
+    };
+
+    __m128i mKey[kRoundCount + 1];
+};
+
+/** A devirtualized implementation of EAX mode based on AES-128 using VAES
+ *  instructions.
+ *
+ * Equivalent to EAX_128_VAES, but with the block cipher bound to the EAX
+ * engine at compile time. Also usable as an EAXBatch backend, in which case
+ * the blocks of several lanes are encrypted together with VAES.
+ *
+ * Policy selects the optional state of the engine (see EAXPolicy);
+ * EAXT_128_VAES is the engine with the default policy.
+ */
+template <class Policy = EAXPolicy<> >
+class EAXP_128_VAES final : public EAXT<EAXP_128_VAES<Policy>, Policy>
+{
+public:
+    EAXP_128_VAES(void);
+    ~EAXP_128_VAES(void);
+
+    /** Expanded key, as saved by SaveKey() and loaded by LoadKey()
+     */
+    struct AESKeySchedule
+    {
+        __m128i rk[11];
+    };
+
+private:
+    friend class EAXT<EAXP_128_VAES, Policy>;
+
+    enum
+    {
+        kKeyLength      = 16,
+        kBlockLength    = 16,
+        kRoundCount     = 10
+    };
+
+    __m128i mKey[kRoundCount + 1];
+
+    void AESReset(void);
+    void AESSetKey(const uint8_t *key, size_t keyLen);
+    void AESSaveKey(AESKeySchedule *sched) const;
+    void AESLoadKey(const AESKeySchedule *sched);
+    void AESEncryptBlock(uint8_t *data);
+    void AESEncryptBlocks(uint8_t *data, size_t nBlocks);
+    static void AESEncryptLanes(EAXP_128_VAES *const *lanes, uint8_t *const *blocks, size_t n);
+};
+
+typedef EAXP_128_VAES<> EAXT_128_VAES;
+
+/** A devirtualized implementation of EAX mode based on AES-256 using VAES
+ *  instructions. See EAXP_128_VAES for the Policy parameter.
+ */
+template <class Policy = EAXPolicy<> >
+class EAXP_256_VAES final : public EAXT<EAXP_256_VAES<Policy>, Policy>
+{
+public:
+    EAXP_256_VAES(void);
+    ~EAXP_256_VAES(void);
+
+    /** Expanded key, as saved by SaveKey() and loaded by LoadKey()
+     */
+    struct AESKeySchedule
+    {
+        __m128i rk[15];
+    };
+
+private:
+    friend class EAXT<EAXP_256_VAES, Policy>;
+
+    enum
+    {
+        kKeyLength      = 32,
+        kBlockLength    = 16,
+        kRoundCount     = 14
+    };
+
+    __m128i mKey[kRoundCount + 1];
+
+    void AESReset(void);
+    void AESSetKey(const uint8_t *key, size_t keyLen);
+    void AESSaveKey(AESKeySchedule *sched) const;
+    void AESLoadKey(const AESKeySchedule *sched);
+    void AESEncryptBlock(uint8_t *data);
+    void AESEncryptBlocks(uint8_t *data, size_t nBlocks);
+    static void AESEncryptLanes(EAXP_256_VAES *const *lanes, uint8_t *const *blocks, size_t n);
+};
+
+typedef EAXP_256_VAES<> EAXT_256_VAES;
+
+template <class Policy>
+inline EAXP_128_VAES<Policy>::EAXP_128_VAES(void)
+{
+    this->ClearSecretData(&mKey, sizeof(mKey));
+}
+
+template <class Policy>
+inline EAXP_128_VAES<Policy>::~EAXP_128_VAES(void)
+{
+    this->ClearSecretData(&mKey, sizeof(mKey));
+}
+
+template <class Policy>
+inline void EAXP_128_VAES<Policy>::AESReset(void)
+{
+    this->ClearSecretData(&mKey, sizeof(mKey));
+}
+
+template <class Policy>
+inline void EAXP_128_VAES<Policy>::AESSetKey(const uint8_t *key, size_t keyLen)
+{
+    assert(keyLen == kKeyLength);
+    AESNIExpandKey128(key, mKey);
+}
+
+template <class Policy>
+inline void EAXP_128_VAES<Policy>::AESSaveKey(AESKeySchedule *sched) const
+{
+    memcpy(sched->rk, mKey, sizeof(mKey));
+}
+
+template <class Policy>
+inline void EAXP_128_VAES<Policy>::AESLoadKey(const AESKeySchedule *sched)
+{
+    memcpy(mKey, sched->rk, sizeof(mKey));
+}
+
+template <class Policy>
+inline void EAXP_128_VAES<Policy>::AESEncryptBlock(uint8_t *data)
+{
+    AESNIEncryptBlock(mKey, kRoundCount, data);
+}
+
+template <class Policy>
+inline void EAXP_128_VAES<Policy>::AESEncryptBlocks(uint8_t *data, size_t nBlocks)
+{
+    VAESEncryptBlocks(mKey, kRoundCount, data, nBlocks);
+}
+
+template <class Policy>
+inline void EAXP_128_VAES<Policy>::AESEncryptLanes(EAXP_128_VAES *const *lanes, uint8_t *const *blocks, size_t n)
+{
+    const __m128i *keys[16];
+    size_t i, m;
+
+    for (; n > 0; n -= m, lanes += m, blocks += m) {
+        m = (n < 16) ? n : 16;
+        for (i = 0; i < m; i++) {
+            keys[i] = lanes[i]->mKey;
+        }
+        VAESEncryptLanes(keys, kRoundCount, blocks, m);
+    }
+}
+
+template <class Policy>
+inline EAXP_256_VAES<Policy>::EAXP_256_VAES(void)
+{
+    this->ClearSecretData(&mKey, sizeof(mKey));
+}
+
+template <class Policy>
+inline EAXP_256_VAES<Policy>::~EAXP_256_VAES(void)
+{
+    this->ClearSecretData(&mKey, sizeof(mKey));
+}
+
+template <class Policy>
+inline void EAXP_256_VAES<Policy>::AESReset(void)
+{
+    this->ClearSecretData(&mKey, sizeof(mKey));
+}
+
+template <class Policy>
+inline void EAXP_256_VAES<Policy>::AESSetKey(const uint8_t *key, size_t keyLen)
+{
+    assert(keyLen == kKeyLength);
+    AESNIExpandKey256(key, mKey);
+}
+
+template <class Policy>
+inline void EAXP_256_VAES<Policy>::AESSaveKey(AESKeySchedule *sched) const
+{
+    memcpy(sched->rk, mKey, sizeof(mKey));
+}
+
+template <class Policy>
+inline void EAXP_256_VAES<Policy>::AESLoadKey(const AESKeySchedule *sched)
+{
+    memcpy(mKey, sched->rk, sizeof(mKey));
+}
+
+template <class Policy>
+inline void EAXP_256_VAES<Policy>::AESEncryptBlock(uint8_t *data)
+{
+    AESNIEncryptBlock(mKey, kRoundCount, data);
+}
+
+template <class Policy>
+inline void EAXP_256_VAES<Policy>::AESEncryptBlocks(uint8_t *data, size_t nBlocks)
+{
+    VAESEncryptBlocks(mKey, kRoundCount, data, nBlocks);
+}
+
+template <class Policy>
+inline void EAXP_256_VAES<Policy>::AESEncryptLanes(EAXP_256_VAES *const *lanes, uint8_t *const *blocks, size_t n)
+{
+    const __m128i *keys[16];
+    size_t i, m;
+
+    for (; n > 0; n -= m, lanes += m, blocks += m) {
+        m = (n < 16) ? n : 16;
+        for (i = 0; i < m; i++) {
+            keys[i] = lanes[i]->mKey;
+        }
+        VAESEncryptLanes(keys, kRoundCount, blocks, m);
+    }
+}
+
+#endif // EAX_VAES_H_
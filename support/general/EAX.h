@@ -25,219 +25,34 @@
 #ifndef EAX_H_
 #define EAX_H_
 
-/* CONFIGURATION OPTIONS */
-
-/** CONFIG_EAX_NO_PAD_CACHE
- * 
- * If non-zero, then the internal "L1" value is not cached; this saves 16
- * bytes of RAM in the EAX class, but requires three extra AES block
- * invocations per message.
- */
-#ifndef CONFIG_EAX_NO_PAD_CACHE
-#define CONFIG_EAX_NO_PAD_CACHE 0
-#endif
-
-/** CONFIG_EAX_NO_CHUNK
- * 
- * If non-zero, then the EAX class expects non-chunked input of header
- * and payload: only a single InjectHeader() call, and a single
- * Encrypt() or Decrypt() call, may be used for a given message. This
- * constrains usage, but saves 32 bytes of RAM in the EAX class. There
- * is no CPU cost penalty.
- */
-#ifndef CONFIG_EAX_NO_CHUNK
-#define CONFIG_EAX_NO_CHUNK 0
-#endif
-
-class EAX;
-
-/** Contains saved message header processing state
- * 
- * An instance of EAXSaved can be filled with intermediate processing results,
- * so that several messages that use the same header and are encrypted or decrypted
- * with the same key can share some of the computational cost.
- * 
- * See EAX::SaveHeader() and EAX::StartSaved() for further details.
- */
-class EAXSaved
-{
-public:
-    EAXSaved(void);
-    ~EAXSaved(void);
-private:
-    enum {
-        kBlockLength = 16
-    };
-    uint8_t aad[kBlockLength];  // Saved OMAC^1(header)
-#if !CONFIG_EAX_NO_CHUNK
-    uint8_t om2[kBlockLength];  // Saved encryption of the OMAC^2 start block
-#endif
-    friend class EAX;
-    static inline void ClearSecretData(void * buf, size_t len) { memset(buf, 0, len); }
-};
+#include <EAXT.h>
 
 /** Abstract implementation of EAX block cipher mode
  * 
  * Abstract base class implementing the EAX block cipher mode.  Users
- * must subclass the class 
- *
- * API usage:
+ * must subclass the class and implement the AES block cipher methods.
  *
- *  - Use SetKey() to set the AES key. This must be done first. 
- *
- *  - Call Start() to start processing a new message. This method must
- *    follow a call to SetKey(). Nonce data is supplied as an optional
- *    argument to this call.
- *
- *  - Process header data with one or several calls to InjectHeader().
- *    This must follow a Start(), but must precede payload encryption
- *    or decryption. If InjectHeader() is not called, a zero-length
- *    header is assumed.
- *
- *  - Encrypt or decrypt the data, with one or several calls to
- *    Encrypt() or Decrypt(). Calls for a given message must be all
- *    encrypt or all decrypt. Encryption and decryption do not change
- *    the length of the data; chunks of arbitrary lengths can be used
- *    (even zero-length chunks).
- *
- *  - Finalize the computation of the authentication tag, and get it
- *    (with GetTag()) or check it (with CheckTag()). Encryption will
- *    typically use GetTag() (to obtain the tag value to send to the
- *    recipient) while decryption more naturally involves calling
- *    CheckTag() (to verify the tag value received from the sender).
- * 
- *  - Call Reset() to reset the internal encryption/decryption state
- *    and clear any secret data.  This may be called at any time.
- *    After a call to Reset(), the object may be reused for a subsequent
- *    encryption/decryption process by calling SetKey().
- * 
- *  - Destroying the object (via invocating of its distructor)
- *    automatically resets the internal state and clears any secret data.
+ * EAX is a thin adapter over the EAXT template (see EAXT.h), in which
+ * the block cipher backend methods are virtual.  This allows the block
+ * cipher implementation to be selected at run time, at the cost of an
+ * indirect call per AES invocation.  See EAXT.h for a description of the
+ * API.  Where the block cipher is known at compile time, deriving directly
+ * from EAXT allows the block cipher to be inlined into the EAX processing.
  */
-class EAX
+class EAX : public EAXT<EAX>
 {
 public:
-    enum {
-        kMinTagLength = 1,   // minimum tag length, in bytes
-        kMaxTagLength = 16   // maximum tag length, in bytes
-    };
-
-    /** Reset object
-     * 
-     * Clear this object from all secret key and data.
-     * 
-     * After a call to Reset(), the object may be reused for a subsequent
-     * encryption/decryption process.
-     */
-    void Reset(void);
-
-    /** Set encryption key
-     * 
-     * Set the AES key. The key size depends on the chosen concrete class.
-     */
-    void SetKey(const uint8_t *key, size_t keyLen);
-
-    /** Process header data for reuse
-     * 
-     * Process header data and fill the provided 'sav' object with the
-     * result. That object can then be reused with StartSaved()
-     * to process messages that share the same header value (and
-     * use the same key).
-     */
-    void SaveHeader(const uint8_t *header, size_t headerLen, EAXSaved *sav);
-
-    /** Start encrypting/decrypting a message
-     * 
-     * Start encrypting/decrypting a new message processing, with the given
-     * nonce. This must be immediately preceeded by a call to SetKey().
-     * After message processing is complete, Start() may be called again
-     * after a call to Reset() and SetKey().
-     * 
-     * Nonce length is arbitrary, but the same nonce value MUST
-     * NOT be reused with the same key for a different message.
-     */
-    void Start(const uint8_t *nonce, size_t nonceLen);
-
-    /** Start encrypting/decrypting a message using saved header data.
-     * 
-     * Start encrypting/decrypting a new message processing, with the given
-     * nonce and previously processed and saved header data (created via the
-     * SaveHeader() method).
-     * 
-     * The 'sav' object is not modified, and may be reused for other messages
-     * that use the same key and header.
-     */
-    void StartSaved(const uint8_t *nonce, size_t nonceLen, const EAXSaved *sav);
-
-    /** Process header data
-     *
-     * Process the given header data. The header data is not encrypted,
-     * but participates to the authentication tag. Header processing must
-     * occur after the call to Start(), but before processing the payload.
-     * If no header data is given, then a zero-length header is used.
-     *
-     * Unless CONFIG_EAX_NO_CHUNK is enabled, the header may be
-     * processed in several chunks, via several calls to InjectHeader() with
-     * arbitrary chunk lengths.
-     */
-    void InjectHeader(const uint8_t *header, size_t headerLen);
 
-    /** Encrypt message data
-     *
-     * Encrypt the provided payload. Input data (plaintext) is read from
-     * 'input' and has size 'inputLen' bytes; the corresponding data has
-     * the same length and is written in 'output'. The 'input' and 'output'
-     * buffers may overlap partially or totally.
-     *
-     * Unless CONFIG_EAX_NO_CHUNK is enabled, the payload may be
-     * processed in several chunks (several calls to Encrypt() with
-     * arbitrary chunk lengths).
-     */
-    void Encrypt(const uint8_t *input, size_t inputLen, uint8_t *output);
-
-    /** Encrypt message data in-place
-     *
-     * Variant of Encrypt() for in-place processing: the encrypted data
-     * replaces the plaintext data in the 'data' buffer.
-     */
-    void Encrypt(uint8_t *data, size_t dataLen);
-
-    /** Decrypt message data
-     *
-     * Identical to Encrypt(), except for decryption instead of encryption.
-     * Note that, for a given message, all chunks must be encrypted, or
-     * all chunks must be decrypted; mixing encryption and decryption for
-     * a single message is not permitted.
-     */
-    void Decrypt(const uint8_t *input, size_t inputLen, uint8_t *output);
-
-    /** Decrypt message data in-place
-     *
-     * Variant of Decrypt() for in-place processing: the decrypted data
-     * replaces the ciphertext data in the 'data' buffer.
-     */
-    void Decrypt(uint8_t *data, size_t dataLen);
-
-    /** Finalize encryption/decryption
+    /** Destroy the object and clear all state and secret data.
      * 
-     * Finalize encryption or decryption, and get the authentication tag.
-     * This may be called only once per message; after the tag has been
-     * obtained, only SetKey() and Start() may be called again on the
-     * instance.
-     *
-     * Tag length must be between 8 and 16 bytes. Normal EAX tag length is
-     * 16 bytes.
-     */
-    void GetTag(uint8_t *tag, size_t tagLen);
-
-    /** Finalize decryption and check tag
+     * IMPORTANT: Subclasses are *required* to override the destructor
+     * and clear any state or secrets associated with the underlying AES
+     * block encryptor.
      * 
-     * Variant of GetTag() that does not return the tag, but compares it
-     * with the provided tag value. This is meant to be used by recipient,
-     * to verify the tag on an incoming message. Returned value is true
-     * if the tags match, false otherwise. Comparison is constant-time.
+     * The destructor is public so that objects may be destroyed through
+     * an EAX pointer, e.g. those returned by CreateEAX() (see EAXFactory.h).
      */
-    bool CheckTag(const uint8_t *tag, size_t tagLen);
+    virtual ~EAX(void);
 
 protected:
     
@@ -245,14 +60,6 @@ protected:
      */
     EAX(void);
 
-    /** Destroy the object and clear all state and secret data.
-     * 
-     * IMPORTANT: Subclasses are *required* to override the destructor
-     * and clear any state or secrets associated with the underlying AES
-     * block encryptor.
-     */
-    virtual ~EAX(void);
-
     /** Reset the underlying AES block encryptor
      * 
      * ** THIS IS A PURE-VIRTUAL FUNCTION TO BE IMPLEMENTED BY THE SUBCLASS **
@@ -287,41 +94,57 @@ protected:
      */
     virtual void AESEncryptBlock(uint8_t *data) = 0;
 
-    static inline void ClearSecretData(void * buf, size_t len) { memset(buf, 0, len); }
+    /** AES Encrypt multiple blocks
+     * 
+     * Encrypt nBlocks consecutive 16-byte blocks pointed at by data, overwriting
+     * each with its cyphertext.  The blocks are independent of each other (ECB),
+     * which allows implementations to compute several of them in parallel.
+     * 
+     * The default implementation calls AESEncryptBlock() once per block.  Subclasses
+     * whose block cipher can be pipelined should override this method.
+     */
+    virtual void AESEncryptBlocks(uint8_t *data, size_t nBlocks);
 
-private:
-    enum {
-        kBlockLength = 16
-    };
+    /** Check for native CTR and CMAC modes
+     * 
+     * Subclasses whose block cipher has a high cost per call, and that
+     * implement the CTR and CMAC modes natively, should override this method
+     * to return true, along with AESCTR() and AESCMAC(). The default
+     * implementation returns false.
+     */
+    virtual bool AESModesSupported(void);
 
-#if !CONFIG_EAX_NO_PAD_CACHE
-    uint8_t L1[kBlockLength];
-#endif
-#if !CONFIG_EAX_NO_CHUNK
-    uint8_t buf[kBlockLength];
-    uint8_t cbcmac[kBlockLength];
-#endif
-    uint8_t ctr[kBlockLength];
-    uint8_t acc[kBlockLength];
-#if !CONFIG_EAX_NO_CHUNK
-    uint8_t ptr;
-#endif
-    uint8_t state;
+    /** AES CTR mode
+     * 
+     * Apply the CTR stream that starts with the 16-byte counter block ctr
+     * (incremented as a 128-bit big-endian integer) to len bytes of input,
+     * writing them to output; input and output may be equal. Only called
+     * if AESModesSupported() returns true.
+     */
+    virtual void AESCTR(const uint8_t *ctr, const uint8_t *input, uint8_t *output, size_t len);
 
-    void double_gf128(uint8_t *elt);
-    void xor_block(const uint8_t *src, uint8_t *dst);
-    void omac(unsigned val, const uint8_t *data, size_t len, uint8_t *mac);
-#if !CONFIG_EAX_NO_CHUNK
-    void omac_start(unsigned val);
-    void omac_process(const uint8_t *data, size_t len);
-    void omac_finish(unsigned val);
-    void aad_finish(void);
-#endif
-    void incr_ctr(void);
-    void payload_process(bool encrypt, uint8_t *data, size_t len);
-    void ClearState(void);
+    /** AES CMAC
+     * 
+     * Compute the 16-byte CMAC of the 16-byte block first followed by len
+     * bytes of data. Only called if AESModesSupported() returns true.
+     */
+    virtual void AESCMAC(const uint8_t *first, const uint8_t *data, size_t len, uint8_t *mac);
+
+    /** Clear block cipher temporaries
+     * 
+     * Clear any temporaries that the block cipher keeps in the object (e.g.
+     * parameter blocks of a hardware peripheral). Called once per message;
+     * see "Clearing of secret data" in EAXT.h. The default implementation
+     * does nothing.
+     */
+    virtual void AESWipeTemporaries(void);
+
+private:
+    friend class EAXT<EAX>;
 };
 
+extern template class EAXT<EAX>;
+
 /** Test a concrete implementation of the EAX class for AES-128 using
  *  standardized test vectors.
  * 
@@ -329,4 +152,13 @@ private:
  */
 extern void TestEAX128(EAX & eax);
 
-#endif /* AES_H_ */
+/** Check a concrete implementation of the EAX class against known-answer
+ *  vectors for the given key length (16 or 32 bytes).
+ *
+ *  Unlike TestEAX128(), the function does not assert(); it returns false on
+ *  any wrong result, so that it can be used to self-test backends at run
+ *  time, in any build.
+ */
+extern bool CheckEAXKnownAnswers(EAX & eax, size_t keyLen);
+
+#endif /* EAX_H_ */
@@ -0,0 +1,451 @@
+/*
+ *    Copyright (c) 2021 Jay Logue
+ *    All rights reserved.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/**
+ *    @file
+ *      Asynchronous EAX sealing and opening of messages on a pool of
+ *      worker threads (hosts only).
+ *
+ */
+
+#ifndef EAXASYNC_H_
+#define EAXASYNC_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+#if defined(__cpp_impl_coroutine) && __cpp_impl_coroutine >= 201902L
+#include <coroutine>
+#define EAXASYNC_COROUTINES 1
+#else
+#define EAXASYNC_COROUTINES 0
+#endif
+
+#include <EAXBatch.h>
+
+/** Asynchronous seal and open jobs, processed by a pool of worker threads
+ *
+ * EAXAsync lets an event-driven program (e.g. a server built around a
+ * reactor) hand messages over for sealing or opening, and carry on with
+ * its I/O while they are processed on other cores:
+ *
+ *  - Jobs are given to Submit(), and collected until Flush() is called,
+ *    typically once at the end of each reactor tick.
+ *
+ *  - Flush() groups the collected jobs into batches of up to N seal jobs
+ *    or N open jobs, each processed with EAXBatch, so that the messages of
+ *    a batch share multi-block backend calls (AESEncryptLanes()).
+ *
+ *  - Batches are spread over the per-worker queues. A worker takes the
+ *    most recent batch of its own queue; an idle worker steals the oldest
+ *    batch of another worker's queue.
+ *
+ *  - When a job is done, its 'result' is set and its callback is called,
+ *    on the worker thread. With C++20 coroutines, a job can instead be
+ *    awaited: co_await async.Run(&job) submits the job, and resumes the
+ *    coroutine on the worker thread once the job is done (after the next
+ *    Flush()).
+ *
+ * Each job refers to an expanded key (Key, filled by ExpandKey()), which
+ * may be shared by any number of jobs; keys, job objects and message
+ * buffers must remain valid until the job is done.
+ *
+ * Backend must be a concrete EAXT<> backend class that supports SaveKey()
+ * and LoadKey() (e.g. EAXT_128_AESNI).
+ *
+ * NB: Submit(), Run() and Flush() are not thread-safe: they must all be
+ * called from one thread (or with external locking), and not from the job
+ * callbacks or awaiting coroutines, which run on the worker threads. The
+ * destructor processes all submitted jobs before it returns.
+ */
+template <class Backend, size_t N = 8>
+class EAXAsync
+{
+public:
+    typedef Backend BackendType;
+
+    enum {
+        kMaxThreads = 64,
+        kBatchLength = N
+    };
+
+    /** Expanded key of a job
+     */
+    struct Key
+    {
+        typename Backend::AESKeySchedule sched;
+        uint8_t pads[Backend::kKeyPadsLength];
+    };
+
+    /** A seal or open job
+     *
+     * 'item' describes the message as for EAXBatch. For an open job,
+     * 'result' is set to true if the tag is valid (the plaintext of an
+     * invalid message must be discarded); for a seal job, it is set to
+     * true. 'callback', if not NULL, is called with the job and 'context'
+     * when the job is done.
+     */
+    struct Job
+    {
+        EAXBatchItem item;
+        const Key *key;
+        bool seal;
+        bool result;
+        void (*callback)(Job *job, void *context);
+        void *context;
+        Job *next;                  // used internally
+    };
+
+    /** Start the worker threads
+     *
+     * threadCount is the number of worker threads; zero means the number
+     * of processors.
+     */
+    EAXAsync(unsigned threadCount = 0);
+
+    /** Process all submitted jobs and stop the worker threads
+     */
+    ~EAXAsync(void);
+
+    /** Expand a key for use by jobs
+     */
+    static void ExpandKey(const uint8_t *key, size_t keyLen, Key *out);
+
+    /** Clear an expanded key
+     */
+    static void ClearKey(Key *key);
+
+    /** Add a job to the next batches
+     *
+     * The job is processed after the next call to Flush().
+     */
+    void Submit(Job *job);
+
+    /** Hand the submitted jobs over to the worker threads
+     */
+    void Flush(void);
+
+    /** Returns the number of worker threads.
+     */
+    unsigned GetThreadCount(void) const { return mThreadCount; }
+
+#if EAXASYNC_COROUTINES
+
+    /** Awaitable for a job (see Run())
+     */
+    class Awaiter
+    {
+    public:
+        bool await_ready(void) const { return false; }
+        void await_suspend(std::coroutine_handle<> handle);
+        bool await_resume(void) const { return mJob->result; }
+
+    private:
+        friend class EAXAsync;
+
+        Awaiter(EAXAsync *async, Job *job) : mAsync(async), mJob(job) { }
+        static void resume(Job *job, void *context);
+
+        EAXAsync *mAsync;
+        Job *mJob;
+    };
+
+    /** Submit a job, and wait for it in a coroutine
+     *
+     * co_await async.Run(&job) submits the job (its callback and context
+     * are overwritten) and suspends the coroutine, which is resumed on a
+     * worker thread when the job is done; the value of the co_await
+     * expression is job.result. As with Submit(), the job is processed
+     * after the next call to Flush().
+     */
+    Awaiter Run(Job *job) { return Awaiter(this, job); }
+
+#endif // EAXASYNC_COROUTINES
+
+private:
+    typedef EAXBatch<Backend, N> Batch;
+
+    /*
+     * Queue of batches of one worker. A batch is a chain of up to N jobs
+     * of the same kind, linked by Job::next.
+     */
+    struct WorkerQueue
+    {
+        std::mutex lock;
+        std::deque<Job *> batches;
+    };
+
+    unsigned mThreadCount;
+    std::thread mThreads[kMaxThreads];
+    WorkerQueue mQueues[kMaxThreads];
+    std::mutex mIdleLock;
+    std::condition_variable mIdle;
+    std::atomic<size_t> mQueued;    // number of batches in the queues
+    bool mStop;                     // protected by mIdleLock
+    Job *mPending[2];               // submitted jobs, by kind (open, seal), in reverse order
+    unsigned mNextQueue;            // queue of the next batch handed over by Flush()
+
+    void worker(unsigned index);
+    Job *take(unsigned index);
+    static void process(Batch & batch, Job *jobs);
+};
+
+template <class Backend, size_t N>
+EAXAsync<Backend, N>::EAXAsync(unsigned threadCount)
+{
+    unsigned i;
+
+    if (threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+        threadCount = (threadCount > 0) ? threadCount : 1;
+    }
+    mThreadCount = (threadCount < kMaxThreads) ? threadCount : (unsigned)kMaxThreads;
+    mQueued.store(0, std::memory_order_relaxed);
+    mStop = false;
+    mPending[0] = mPending[1] = NULL;
+    mNextQueue = 0;
+
+    for (i = 0; i < mThreadCount; i ++) {
+        mThreads[i] = std::thread(&EAXAsync::worker, this, i);
+    }
+}
+
+template <class Backend, size_t N>
+EAXAsync<Backend, N>::~EAXAsync(void)
+{
+    unsigned i;
+
+    Flush();
+    {
+        std::lock_guard<std::mutex> guard(mIdleLock);
+        mStop = true;
+    }
+    mIdle.notify_all();
+    for (i = 0; i < mThreadCount; i ++) {
+        mThreads[i].join();
+    }
+}
+
+template <class Backend, size_t N>
+void
+EAXAsync<Backend, N>::ExpandKey(const uint8_t *key, size_t keyLen, Key *out)
+{
+    Backend eax;
+
+    eax.SetKey(key, keyLen);
+    eax.SaveKey(&out->sched, out->pads);
+}
+
+template <class Backend, size_t N>
+void
+EAXAsync<Backend, N>::ClearKey(Key *key)
+{
+    EAXSecureWipe(key, sizeof(Key));
+}
+
+template <class Backend, size_t N>
+void
+EAXAsync<Backend, N>::Submit(Job *job)
+{
+    assert(job->key != NULL);
+
+    job->next = mPending[job->seal];
+    mPending[job->seal] = job;
+}
+
+/*
+ * Cut the pending jobs of each kind into batches of up to N, in order of
+ * submission, and give them to the queues in turn.
+ */
+template <class Backend, size_t N>
+void
+EAXAsync<Backend, N>::Flush(void)
+{
+    Job *jobs, *batch, *job;
+    size_t count, queued;
+    int kind;
+
+    queued = 0;
+    for (kind = 0; kind < 2; kind ++) {
+        jobs = NULL;
+        while (mPending[kind] != NULL) {
+            job = mPending[kind];
+            mPending[kind] = job->next;
+            job->next = jobs;
+            jobs = job;
+        }
+
+        while (jobs != NULL) {
+            batch = jobs;
+            for (count = 1; count < N && jobs->next != NULL; count ++) {
+                jobs = jobs->next;
+            }
+            job = jobs->next;
+            jobs->next = NULL;
+            jobs = job;
+
+            /*
+             * The count goes up first, so that it never goes below the
+             * number of batches in the queues.
+             */
+            WorkerQueue & q = mQueues[mNextQueue];
+            mQueued.fetch_add(1, std::memory_order_release);
+            {
+                std::lock_guard<std::mutex> guard(q.lock);
+                q.batches.push_back(batch);
+            }
+            mNextQueue = (mNextQueue + 1) % mThreadCount;
+            queued ++;
+        }
+    }
+
+    /*
+     * Idle workers check the count with mIdleLock held, up to the point
+     * where they wait; taking the lock here orders the wakeup after that.
+     */
+    if (queued > 0) {
+        {
+            std::lock_guard<std::mutex> guard(mIdleLock);
+        }
+        mIdle.notify_all();
+    }
+}
+
+/*
+ * Take the most recent batch of the worker's own queue, or else the oldest
+ * batch of another queue. Returns NULL if all queues are empty.
+ */
+template <class Backend, size_t N>
+typename EAXAsync<Backend, N>::Job *
+EAXAsync<Backend, N>::take(unsigned index)
+{
+    Job *batch = NULL;
+    unsigned i;
+
+    {
+        WorkerQueue & q = mQueues[index];
+        std::lock_guard<std::mutex> guard(q.lock);
+        if (!q.batches.empty()) {
+            batch = q.batches.back();
+            q.batches.pop_back();
+        }
+    }
+    for (i = 1; batch == NULL && i < mThreadCount; i ++) {
+        WorkerQueue & q = mQueues[(index + i) % mThreadCount];
+        std::lock_guard<std::mutex> guard(q.lock);
+        if (!q.batches.empty()) {
+            batch = q.batches.front();
+            q.batches.pop_front();
+        }
+    }
+    if (batch != NULL) {
+        mQueued.fetch_sub(1, std::memory_order_relaxed);
+    }
+    return batch;
+}
+
+template <class Backend, size_t N>
+void
+EAXAsync<Backend, N>::worker(unsigned index)
+{
+    Batch batch;
+    Job *jobs;
+
+    for (;;) {
+        jobs = take(index);
+        if (jobs != NULL) {
+            process(batch, jobs);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> guard(mIdleLock);
+        if (mQueued.load(std::memory_order_acquire) == 0) {
+            if (mStop) {
+                break;
+            }
+            mIdle.wait(guard);
+        }
+    }
+}
+
+/*
+ * Process a batch with the lanes of 'batch', clear the keys of the lanes,
+ * and report the results. The callbacks may reuse or free the jobs, so
+ * the chain is walked before.
+ */
+template <class Backend, size_t N>
+void
+EAXAsync<Backend, N>::process(Batch & batch, Job *jobs)
+{
+    EAXBatchItem items[N];
+    Job *batchJobs[N];
+    uint32_t valid;
+    size_t count, i;
+    bool seal = jobs->seal;
+
+    for (count = 0; jobs != NULL; count ++, jobs = jobs->next) {
+        batchJobs[count] = jobs;
+        items[count] = jobs->item;
+        batch.Lane(count).LoadKey(&jobs->key->sched, jobs->key->pads);
+    }
+
+    if (seal) {
+        batch.Seal(items, count);
+        valid = UINT32_MAX;
+    } else {
+        valid = batch.Open(items, count);
+    }
+
+    for (i = 0; i < count; i ++) {
+        batch.Lane(i).Reset();
+    }
+
+    for (i = 0; i < count; i ++) {
+        Job *job = batchJobs[i];
+
+        job->result = ((valid >> i) & 1) != 0;
+        if (job->callback != NULL) {
+            job->callback(job, job->context);
+        }
+    }
+}
+
+#if EAXASYNC_COROUTINES
+
+template <class Backend, size_t N>
+void
+EAXAsync<Backend, N>::Awaiter::await_suspend(std::coroutine_handle<> handle)
+{
+    mJob->callback = resume;
+    mJob->context = handle.address();
+    mAsync->Submit(mJob);
+}
+
+template <class Backend, size_t N>
+void
+EAXAsync<Backend, N>::Awaiter::resume(Job *job, void *context)
+{
+    (void)job;
+    std::coroutine_handle<>::from_address(context).resume();
+}
+
+#endif // EAXASYNC_COROUTINES
+
+#endif // EAXASYNC_H_
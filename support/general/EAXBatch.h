@@ -0,0 +1,417 @@
+/*
+ *    Copyright (c) 2021 Jay Logue
+ *    All rights reserved.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/**
+ *    @file
+ *      Multi-buffer EAX: encryption and decryption of several independent
+ *      messages in lockstep.
+ *
+ */
+
+#ifndef EAXBATCH_H_
+#define EAXBATCH_H_
+
+#include <EAXT.h>
+
+/** Describes one message processed by EAXBatch
+ *
+ * For sealing, 'input' is the plaintext, 'output' receives the ciphertext
+ * and 'tag' receives the authentication tag. For opening, 'input' is the
+ * ciphertext, 'output' receives the plaintext and 'tag' holds the tag to
+ * be verified. 'input' and 'output' may be equal (in-place processing) or
+ * disjoint, but must not overlap partially.
+ */
+struct EAXBatchItem
+{
+    const uint8_t *nonce;
+    size_t nonceLen;
+    const uint8_t *header;
+    size_t headerLen;
+    const uint8_t *input;
+    uint8_t *output;
+    size_t len;
+    uint8_t *tag;
+    size_t tagLen;
+};
+
+/** Multi-buffer EAX over N lanes
+ *
+ * Within a single message, EAX is bound by the latency of the OMAC
+ * (CBC-MAC) chain: each block must be encrypted before the next one can
+ * be processed. EAXBatch holds N independent EAX contexts ("lanes"),
+ * each with its own key, and advances up to N messages together: at each
+ * step, the next OMAC block and the next CTR stream block of every lane
+ * are gathered and encrypted with a single call to the backend's
+ * AESEncryptLanes() method. A pipelined backend can then keep up to 2N
+ * AES computations in flight where a single context would only have one.
+ *
+ * Backend must be a concrete EAXT<> backend class (e.g. EAXT_128_AESNI).
+ *
+ * API usage:
+ *
+ *  - Set the key of each lane with Lane(i).SetKey(). Lanes may be rekeyed
+ *    between batches with Lane(i).Reset() followed by Lane(i).SetKey().
+ *
+ *  - Call Seal() or Open() with up to N message descriptions; message i
+ *    is processed with the key of lane i. Lanes must have a key set. The
+ *    batch does not disturb a message being processed on a lane with the
+ *    single-message API.
+ *
+ * Messages in a batch may have arbitrary and different nonce, header and
+ * payload lengths; lanes whose message is shorter simply drop out of the
+ * remaining steps.
+ */
+template <class Backend, size_t N>
+class EAXBatch
+{
+public:
+    enum {
+        kLaneCount = N
+    };
+
+    /** Get the EAX context of a lane
+     */
+    Backend & Lane(size_t index);
+
+    /** Encrypt and authenticate a batch of messages
+     *
+     * Encrypt items[i], for i in 0..count-1, with the key of lane i, and
+     * write the ciphertext and tag as described in EAXBatchItem. count
+     * must not exceed N.
+     */
+    void Seal(const EAXBatchItem *items, size_t count);
+
+    /** Decrypt and verify a batch of messages
+     *
+     * Decrypt items[i], for i in 0..count-1, with the key of lane i, and
+     * verify its tag. The return value has bit i set if the tag of items[i]
+     * is valid. The plaintext of a message whose tag is invalid is still
+     * written to its output buffer, and must be discarded by the caller.
+     * Tag comparison is constant-time. count must not exceed N, and N must
+     * not exceed 32.
+     */
+    uint32_t Open(const EAXBatchItem *items, size_t count);
+
+private:
+    typedef EAXT<Backend, typename Backend::PolicyType> Engine;
+
+    enum {
+        kBlockLength = 16
+    };
+
+    enum {
+        CH_FIRST     = 0,
+        CH_DATA      = 1,
+        CH_LAST      = 2,
+        CH_DONE      = 3
+    };
+
+    /*
+     * State of one OMAC computation that is advanced one block at a time.
+     */
+    struct OMACChain
+    {
+        uint8_t mac[kBlockLength];
+        const uint8_t *data;
+        size_t len;
+        size_t pos;
+        uint8_t stage;
+    };
+
+    Backend mLanes[N];
+
+    void process(bool encrypt, const EAXBatchItem *items, size_t count, uint8_t (*tags)[kBlockLength]);
+    static void chain_init(OMACChain *c, Backend &lane, unsigned val, const uint8_t *data, size_t len);
+    static bool chain_next(OMACChain *c, Backend &lane);
+    static void next_ctr(uint8_t *ctr, uint8_t *ks);
+};
+
+/*
+ * Implementation Notes
+ * ====================
+ *
+ * Processing of a batch happens in two phases, each made of steps; at
+ * each step, every lane contributes the blocks it needs encrypted next,
+ * and all of them are encrypted with one AESEncryptLanes() call.
+ *
+ * Phase 1 computes OMAC^0(nonce) and OMAC^1(header). The two chains are
+ * independent, so each lane contributes up to two blocks per step.
+ *
+ * Phase 2 computes the CTR stream and OMAC^2(ciphertext). At step k, each
+ * lane contributes OMAC^2 block k (which covers ciphertext block k-1) and
+ * one CTR stream block. When encrypting, that is stream block k, which is
+ * XORed into the payload after the step, so that ciphertext block k is
+ * available to the OMAC chain at step k+1. When decrypting, the stream is
+ * one block behind (stream block k-1), so that ciphertext block k-1 has
+ * been read by the OMAC chain before the corresponding plaintext replaces
+ * it in in-place processing.
+ *
+ * An OMACChain walks through the same computation as EAXT::omac(): the
+ * initial block (skipped when it is the cached L1), then the data blocks,
+ * the last one being padded and XORed with the pad block. chain_next()
+ * prepares the next block to encrypt in mac[] and returns false once the
+ * chain is complete, in which case mac[] holds the OMAC value.
+ */
+
+template <class Backend, size_t N>
+inline Backend &
+EAXBatch<Backend, N>::Lane(size_t index)
+{
+    assert(index < N);
+    return mLanes[index];
+}
+
+template <class Backend, size_t N>
+void
+EAXBatch<Backend, N>::Seal(const EAXBatchItem *items, size_t count)
+{
+    uint8_t tags[N][kBlockLength];
+    size_t i;
+
+    process(true, items, count, tags);
+    for (i = 0; i < count; i ++) {
+        assert(items[i].tagLen >= Engine::kMinTagLength && items[i].tagLen <= Engine::kMaxTagLength);
+        memcpy(items[i].tag, tags[i], items[i].tagLen);
+    }
+    Engine::ClearSecretData(tags, sizeof tags);
+}
+
+template <class Backend, size_t N>
+uint32_t
+EAXBatch<Backend, N>::Open(const EAXBatchItem *items, size_t count)
+{
+    uint8_t tags[N][kBlockLength];
+    uint32_t result;
+    size_t i, u;
+
+    static_assert(N <= 32, "EAXBatch::Open() supports at most 32 lanes");
+
+    process(false, items, count, tags);
+    result = 0;
+    for (i = 0; i < count; i ++) {
+        unsigned z;
+
+        /*
+         * Invalid tag lengths are reported as a failed verification, since
+         * they might be triggered with crafted incoming data.
+         */
+        if (items[i].tagLen < Engine::kMinTagLength || items[i].tagLen > Engine::kMaxTagLength) {
+            continue;
+        }
+        z = 0;
+        for (u = 0; u < items[i].tagLen; u ++) {
+            z |= items[i].tag[u] ^ tags[i][u];
+        }
+        result |= (uint32_t)(z == 0) << i;
+    }
+    Engine::ClearSecretData(tags, sizeof tags);
+    return result;
+}
+
+/*
+ * Set up an OMAC^val computation over data[] for the given lane.
+ */
+template <class Backend, size_t N>
+void
+EAXBatch<Backend, N>::chain_init(OMACChain *c, Backend &lane, unsigned val, const uint8_t *data, size_t len)
+{
+    c->data = data;
+    c->len = len;
+    c->pos = 0;
+    if (len == 0) {
+        lane.get_pad(false, c->mac);
+        c->mac[kBlockLength - 1] ^= (uint8_t)val;
+        c->stage = CH_LAST;
+        return;
+    }
+    if (val == 0 && lane.pads_get_l1(c->mac)) {
+        c->stage = CH_DATA;
+        return;
+    }
+    memset(c->mac, 0, kBlockLength);
+    c->mac[kBlockLength - 1] = (uint8_t)val;
+    c->stage = CH_FIRST;
+}
+
+/*
+ * Prepare the next block of an OMAC computation in c->mac[]. Returns true
+ * if that block must now be encrypted, false if the computation is over.
+ */
+template <class Backend, size_t N>
+bool
+EAXBatch<Backend, N>::chain_next(OMACChain *c, Backend &lane)
+{
+    uint8_t pad[kBlockLength];
+    size_t u, v;
+
+    switch (c->stage) {
+    case CH_FIRST:
+        c->stage = CH_DATA;
+        return true;
+    case CH_DATA:
+        u = c->pos;
+        if ((u + kBlockLength) < c->len) {
+            Engine::xor_block(c->data + u, c->mac);
+            c->pos = u + kBlockLength;
+            return true;
+        }
+        for (v = 0; (u + v) < c->len; v ++) {
+            c->mac[v] ^= c->data[u + v];
+        }
+        if (v < kBlockLength) {
+            c->mac[v] ^= 0x80;
+        }
+        lane.get_pad(v < kBlockLength, pad);
+        Engine::xor_block(pad, c->mac);
+        Engine::ClearSecretData(pad, sizeof pad);
+        c->pos = c->len;
+        c->stage = CH_DONE;
+        return true;
+    case CH_LAST:
+        c->stage = CH_DONE;
+        return true;
+    default:
+        return false;
+    }
+}
+
+/*
+ * Copy the counter into ks[] and increment it (big-endian, full 128-bit
+ * width).
+ */
+template <class Backend, size_t N>
+inline void
+EAXBatch<Backend, N>::next_ctr(uint8_t *ctr, uint8_t *ks)
+{
+    uint64_t lo;
+
+    memcpy(ks, ctr, kBlockLength);
+    lo = Engine::load_be64(ctr + 8) + 1;
+    Engine::store_be64(ctr + 8, lo);
+    Engine::store_be64(ctr, Engine::load_be64(ctr) + (lo == 0));
+}
+
+/*
+ * Process a batch: tags[i] receives the full 16-byte tag of items[i].
+ */
+template <class Backend, size_t N>
+void
+EAXBatch<Backend, N>::process(bool encrypt, const EAXBatchItem *items, size_t count, uint8_t (*tags)[kBlockLength])
+{
+    OMACChain nonce[N], header[N], payload[N];
+    uint8_t ctr[N][kBlockLength], ks[N][kBlockLength];
+    size_t ksIndex[N], ksCount[N];
+    Backend *lanes[2 * N];
+    uint8_t *blocks[2 * N];
+    size_t i, n, step;
+
+    assert(count <= N);
+
+    /*
+     * Phase 1: OMAC^0(nonce) and OMAC^1(header).
+     */
+    for (i = 0; i < count; i ++) {
+        assert(mLanes[i].state != Engine::ST_EMPTY);
+        chain_init(&nonce[i], mLanes[i], 0, items[i].nonce, items[i].nonceLen);
+        chain_init(&header[i], mLanes[i], 1, items[i].header, items[i].headerLen);
+    }
+    for (;;) {
+        n = 0;
+        for (i = 0; i < count; i ++) {
+            if (chain_next(&nonce[i], mLanes[i])) {
+                lanes[n] = &mLanes[i];
+                blocks[n ++] = nonce[i].mac;
+            }
+            if (chain_next(&header[i], mLanes[i])) {
+                lanes[n] = &mLanes[i];
+                blocks[n ++] = header[i].mac;
+            }
+        }
+        if (n == 0) {
+            break;
+        }
+        Engine::encrypt_lanes(lanes, blocks, n);
+    }
+
+    /*
+     * Phase 2: CTR stream and OMAC^2(ciphertext). The counter starts at
+     * OMAC^0(nonce), and the tag accumulates in tags[].
+     */
+    for (i = 0; i < count; i ++) {
+        memcpy(ctr[i], nonce[i].mac, kBlockLength);
+        memcpy(tags[i], nonce[i].mac, kBlockLength);
+        Engine::xor_block(header[i].mac, tags[i]);
+        chain_init(&payload[i], mLanes[i], 2, encrypt ? items[i].output : items[i].input, items[i].len);
+        ksCount[i] = (items[i].len + kBlockLength - 1) / kBlockLength;
+    }
+    for (step = 0; ; step ++) {
+        n = 0;
+        for (i = 0; i < count; i ++) {
+            if (chain_next(&payload[i], mLanes[i])) {
+                lanes[n] = &mLanes[i];
+                blocks[n ++] = payload[i].mac;
+            }
+            /*
+             * When decrypting, there is no stream block at step 0; the
+             * index then wraps around and fails the check below.
+             */
+            ksIndex[i] = encrypt ? step : step - 1;
+            if (ksIndex[i] < ksCount[i]) {
+                next_ctr(ctr[i], ks[i]);
+                lanes[n] = &mLanes[i];
+                blocks[n ++] = ks[i];
+            }
+        }
+        if (n == 0) {
+            break;
+        }
+        Engine::encrypt_lanes(lanes, blocks, n);
+
+        for (i = 0; i < count; i ++) {
+            size_t off, u, len;
+
+            if (ksIndex[i] >= ksCount[i]) {
+                continue;
+            }
+            off = ksIndex[i] * kBlockLength;
+            len = items[i].len - off;
+            if (len >= kBlockLength) {
+                memcpy(items[i].output + off, items[i].input + off, kBlockLength);
+                Engine::xor_block(ks[i], items[i].output + off);
+            } else {
+                for (u = 0; u < len; u ++) {
+                    items[i].output[off + u] = items[i].input[off + u] ^ ks[i][u];
+                }
+            }
+        }
+    }
+
+    for (i = 0; i < count; i ++) {
+        Engine::xor_block(payload[i].mac, tags[i]);
+    }
+
+    Engine::ClearSecretData(nonce, sizeof nonce);
+    Engine::ClearSecretData(header, sizeof header);
+    Engine::ClearSecretData(payload, sizeof payload);
+    Engine::ClearSecretData(ctr, sizeof ctr);
+    Engine::ClearSecretData(ks, sizeof ks);
+    for (i = 0; i < count; i ++) {
+        mLanes[i].wipe_temporaries();
+    }
+}
+
+#endif /* EAXBATCH_H_ */
@@ -0,0 +1,314 @@
+/*
+ *    Copyright (c) 2021 Jay Logue
+ *    All rights reserved.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/**
+ *    @file
+ *      A stand-alone program for measuring the performance of the EAX
+ *      backends available on the host.
+ *
+ *      Build and run with 'make bench-eax' in this directory, which builds
+ *      the program for each EAX configuration (default, CONFIG_EAX_NO_PAD_CACHE,
+ *      CONFIG_EAX_NO_CHUNK, CONFIG_EAX_STATS and CONFIG_EAX_ZEROIZE_PER_BLOCK).
+ *      Or compile as follows:
+ *
+ *         c++ -O3 -maes -o bench-eax -I. EAX.cpp EAX-AESNI.cpp EAX-VAES.cpp EAX-Soft.cpp EAXFactory.cpp EAXTest.cpp EAXBench.cpp
+ *
+ *      Usage: bench-eax [--json] [--time <ms>] [--backend <name>]
+ *
+ *      For each backend and payload size, the following ways of processing
+ *      a message (16-byte nonce, 16 bytes of header, 16-byte tag) are
+ *      measured:
+ *
+ *         start      Start(), InjectHeader(), a single Encrypt(), GetTag()
+ *         chunked    as 'start', with the payload passed in 64-byte chunks
+ *                    (not in CONFIG_EAX_NO_CHUNK builds)
+ *         saved      StartSaved() with a header saved by SaveHeader()
+ *         oneshot    Seal()
+ *         rekey      as 'start', preceded by Reset() and SetKey()
+ *
+ *      Results are given in cycles per byte of payload (and per message),
+ *      messages per second and MB/s of payload. On x86, cycles are counted
+ *      with the time-stamp counter, which runs at a constant rate that may
+ *      differ from the actual core frequency; cycle counts are not
+ *      available on other hosts.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <time.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define EAX_BENCH_TSC 1
+#else
+#define EAX_BENCH_TSC 0
+#endif
+
+#include <EAXFactory.h>
+
+namespace {
+
+enum
+{
+    kDefaultBenchTimeMS = 50,
+    kChunkLength        = 64,
+    kMaxMsgLength       = 65536,
+    kTagLength          = 16
+};
+
+enum BenchMode
+{
+    kMode_Start = 0,
+    kMode_Chunked,
+    kMode_Saved,
+    kMode_OneShot,
+    kMode_Rekey,
+
+    kModeCount
+};
+
+const char * const sModeNames[kModeCount] = { "start", "chunked", "saved", "oneshot", "rekey" };
+
+const size_t sMsgLengths[] = { 0, 16, 64, 256, 1024, 4096, 16384, 65536 };
+
+#if CONFIG_EAX_NO_CHUNK
+const char sConfigName[] = "no-chunk";
+#elif CONFIG_EAX_NO_PAD_CACHE
+const char sConfigName[] = "no-pad-cache";
+#elif CONFIG_EAX_STATS
+const char sConfigName[] = "stats";
+#elif CONFIG_EAX_ZEROIZE_PER_BLOCK
+const char sConfigName[] = "zeroize-per-block";
+#else
+const char sConfigName[] = "default";
+#endif
+
+struct BenchResult
+{
+    double CyclesPerMsg;        // negative if not available
+    double MsgsPerSec;
+    double MBPerSec;
+};
+
+uint8_t sMsg[kMaxMsgLength + kTagLength];
+
+uint64_t GetTimeNS(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+uint64_t GetCycles(void)
+{
+#if EAX_BENCH_TSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Process one message of the given length in the given mode.
+ */
+void RunMessage(EAX & eax, BenchMode mode, const uint8_t *key, size_t keyLen, const uint8_t *nonce,
+                const EAXSaved *sav, size_t msgLen)
+{
+    uint8_t tag[kTagLength];
+
+    switch (mode) {
+    case kMode_Rekey:
+        eax.Reset();
+        eax.SetKey(key, keyLen);
+        // fall through
+    case kMode_Start:
+        eax.Start(nonce, 16);
+        eax.InjectHeader(nonce, 16);
+        eax.Encrypt(sMsg, msgLen);
+        eax.GetTag(tag, sizeof(tag));
+        break;
+    case kMode_Chunked:
+#if !CONFIG_EAX_NO_CHUNK
+        eax.Start(nonce, 16);
+        eax.InjectHeader(nonce, 16);
+        for (size_t off = 0; off < msgLen; off += kChunkLength) {
+            eax.Encrypt(sMsg + off, (msgLen - off < kChunkLength) ? msgLen - off : kChunkLength);
+        }
+        eax.GetTag(tag, sizeof(tag));
+#endif
+        break;
+    case kMode_Saved:
+        eax.StartSaved(nonce, 16, sav);
+        eax.Encrypt(sMsg, msgLen);
+        eax.GetTag(tag, sizeof(tag));
+        break;
+    case kMode_OneShot:
+        eax.Seal(nonce, 16, nonce, 16, sMsg, msgLen, sizeof(tag));
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+ * Process messages of the given length for at least benchTimeNS, after a
+ * short warm-up.
+ */
+BenchResult BenchEAX(EAX & eax, size_t keyLen, BenchMode mode, size_t msgLen, uint64_t benchTimeNS)
+{
+    uint8_t key[32], nonce[16];
+    EAXSaved sav;
+    uint64_t start, startCycles, elapsed, cycles;
+    size_t count = 0, batch;
+    BenchResult res;
+
+    memset(key, 0x5A, sizeof(key));
+    memset(nonce, 0xA5, sizeof(nonce));
+
+    eax.Reset();
+    eax.SetKey(key, keyLen);
+    eax.SaveHeader(nonce, sizeof(nonce), &sav);
+
+    /*
+     * Messages are processed in batches, sized so that reading the clock
+     * does not weigh on the results of small messages.
+     */
+    batch = (msgLen <= 1024) ? 64 : 4;
+    for (size_t i = 0; i < batch; i++) {
+        RunMessage(eax, mode, key, keyLen, nonce, &sav, msgLen);
+    }
+
+    start = GetTimeNS();
+    startCycles = GetCycles();
+    do {
+        for (size_t i = 0; i < batch; i++, count++) {
+            nonce[0] = (uint8_t)count;
+            RunMessage(eax, mode, key, keyLen, nonce, &sav, msgLen);
+        }
+        elapsed = GetTimeNS() - start;
+    } while (elapsed < benchTimeNS);
+    cycles = GetCycles() - startCycles;
+
+    eax.Reset();
+
+    res.CyclesPerMsg = EAX_BENCH_TSC ? (double)cycles / (double)count : -1.0;
+    res.MsgsPerSec = ((double)count * 1e9) / (double)elapsed;
+    res.MBPerSec = ((double)count * msgLen * 1000.0) / (double)elapsed;
+    return res;
+}
+
+void Usage(const char *prog)
+{
+    fprintf(stderr, "Usage: %s [--json] [--time <ms>] [--backend <name>]\n", prog);
+    exit(EXIT_FAILURE);
+}
+
+} // unnamed namespace
+
+int main(int argc, char *argv[])
+{
+    bool json = false, first = true;
+    uint64_t benchTimeNS = (uint64_t)kDefaultBenchTimeMS * 1000000;
+    const char *backendName = NULL;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--json") == 0) {
+            json = true;
+        } else if (strcmp(argv[i], "--time") == 0 && i + 1 < argc) {
+            benchTimeNS = strtoull(argv[++i], NULL, 10) * 1000000;
+        } else if (strcmp(argv[i], "--backend") == 0 && i + 1 < argc) {
+            backendName = argv[++i];
+        } else {
+            Usage(argv[0]);
+        }
+    }
+
+    if (json) {
+        printf("{\n  \"config\": \"%s\",\n  \"cycle_counter\": %s,\n  \"results\": [", sConfigName, EAX_BENCH_TSC ? "\"tsc\"" : "null");
+    } else {
+        printf("EAX configuration: %s\n\n", sConfigName);
+        printf("%-16s %-8s %8s %12s %12s %12s %10s\n", "backend", "mode", "bytes", "cycles/B", "cycles/msg", "msgs/s", "MB/s");
+    }
+
+    for (size_t b = 0; b < GetEAXBackendCount(); b++) {
+        const EAXBackendInfo * backend = GetEAXBackend(b);
+        EAX * eax;
+
+        if (backendName != NULL && strcmp(backendName, backend->Name) != 0) {
+            continue;
+        }
+        if (backend->IsAvailable != NULL && !backend->IsAvailable()) {
+            if (!json) {
+                printf("%-16s not available\n", backend->Name);
+            }
+            continue;
+        }
+
+        eax = backend->Create();
+        for (int mode = 0; mode < kModeCount; mode++) {
+#if CONFIG_EAX_NO_CHUNK
+            if (mode == kMode_Chunked) {
+                continue;
+            }
+#endif
+            for (size_t j = 0; j < sizeof(sMsgLengths) / sizeof(sMsgLengths[0]); j++) {
+                const size_t msgLen = sMsgLengths[j];
+                BenchResult res = BenchEAX(*eax, backend->KeyLength, (BenchMode)mode, msgLen, benchTimeNS);
+
+                if (json) {
+                    printf("%s\n    { \"backend\": \"%s\", \"mode\": \"%s\", \"bytes\": %zu, ", first ? "" : ",",
+                           backend->Name, sModeNames[mode], msgLen);
+                    if (res.CyclesPerMsg >= 0 && msgLen > 0) {
+                        printf("\"cycles_per_byte\": %.3f, ", res.CyclesPerMsg / msgLen);
+                    } else {
+                        printf("\"cycles_per_byte\": null, ");
+                    }
+                    if (res.CyclesPerMsg >= 0) {
+                        printf("\"cycles_per_msg\": %.1f, ", res.CyclesPerMsg);
+                    } else {
+                        printf("\"cycles_per_msg\": null, ");
+                    }
+                    printf("\"msgs_per_sec\": %.1f, \"mb_per_sec\": %.2f }", res.MsgsPerSec, res.MBPerSec);
+                    first = false;
+                } else {
+                    printf("%-16s %-8s %8zu ", backend->Name, sModeNames[mode], msgLen);
+                    if (res.CyclesPerMsg >= 0 && msgLen > 0) {
+                        printf("%12.2f ", res.CyclesPerMsg / msgLen);
+                    } else {
+                        printf("%12s ", "-");
+                    }
+                    if (res.CyclesPerMsg >= 0) {
+                        printf("%12.0f ", res.CyclesPerMsg);
+                    } else {
+                        printf("%12s ", "-");
+                    }
+                    printf("%12.0f %10.1f\n", res.MsgsPerSec, res.MBPerSec);
+                }
+                fflush(stdout);
+            }
+        }
+        delete eax;
+    }
+
+    if (json) {
+        printf("\n  ]\n}\n");
+    }
+    return 0;
+}
@@ -0,0 +1,363 @@
+/*
+ *    Copyright (c) 2021 Jay Logue
+ *    All rights reserved.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/**
+ *    @file
+ *      Registry of EAX implementations, and run-time selection of the
+ *      fastest implementation available on the host.
+ *
+ *      On x86 hosts, this file and EAX-AESNI.cpp must be compiled with
+ *      -maes; EAX-VAES.cpp enables the VAES and AVX-512 extensions for its
+ *      own functions. None of these instructions are executed unless the
+ *      processor supports them, so the resulting program runs on any x86
+ *      processor.
+ */
+
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include <EAXFactory.h>
+#include <EAX-Soft.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define EAX_FACTORY_X86 1
+#include <EAX-AESNI.h>
+#include <EAX-VAES.h>
+#else
+#define EAX_FACTORY_X86 0
+#endif
+
+namespace {
+
+enum
+{
+    kCalibrationMsgLength   = 256,
+    kCalibrationMsgCount    = 64,
+    kCalibrationPasses      = 3
+};
+
+const EAXBackendInfo sBuiltinBackends[] =
+{
+#if EAX_FACTORY_X86
+    { "vaes-128",       16, 300, VAESSupported,     NewEAXObject<EAX_128_VAES> },
+    { "vaes-256",       32, 300, VAESSupported,     NewEAXObject<EAX_256_VAES> },
+    { "aesni-128",      16, 200, AESNISupported,    NewEAXObject<EAX_128_AESNI> },
+    { "aesni-256",      32, 200, AESNISupported,    NewEAXObject<EAX_256_AESNI> },
+#endif
+    { "portable-128",   16, 0,   NULL,              NewEAXObject<EAX_128_Soft> },
+    { "portable-256",   32, 0,   NULL,              NewEAXObject<EAX_256_Soft> },
+};
+
+const EAXBackendInfo * sBackends[CONFIG_EAX_MAX_BACKENDS];
+size_t sBackendCount;
+bool sBuiltinsRegistered;
+const EAXBackendInfo * sCalibrated[2];
+
+void RegisterBuiltinEAXBackends(void)
+{
+    if (!sBuiltinsRegistered) {
+        sBuiltinsRegistered = true;
+        for (size_t i = 0; i < sizeof(sBuiltinBackends) / sizeof(sBuiltinBackends[0]); i++) {
+            RegisterEAXBackend(&sBuiltinBackends[i]);
+        }
+    }
+}
+
+bool IsUsable(const EAXBackendInfo * backend, size_t keyLen)
+{
+    return backend->KeyLength == keyLen && (backend->IsAvailable == NULL || backend->IsAvailable());
+}
+
+const EAXBackendInfo ** CalibratedSlot(size_t keyLen)
+{
+    return &sCalibrated[(keyLen == 16) ? 0 : 1];
+}
+
+/*
+ * Time a fixed workload of small messages, each with its own key setup, on
+ * the given EAX object. The best of several passes is returned, to filter
+ * out interference from other activity on the host.
+ */
+uint64_t TimeEAX(EAX & eax, size_t keyLen, EAXClockFunct clock)
+{
+    uint8_t key[32], nonce[16], msg[kCalibrationMsgLength], tag[16];
+    uint64_t best = UINT64_MAX;
+
+    memset(key, 0x5A, sizeof(key));
+    memset(nonce, 0xA5, sizeof(nonce));
+    memset(msg, 0, sizeof(msg));
+
+    for (int pass = 0; pass < kCalibrationPasses; pass++) {
+        uint64_t start = clock(), elapsed;
+
+        for (int i = 0; i < kCalibrationMsgCount; i++) {
+            nonce[0] = (uint8_t)i;
+            eax.Reset();
+            eax.SetKey(key, keyLen);
+            eax.Start(nonce, sizeof(nonce));
+            eax.InjectHeader(nonce, sizeof(nonce));
+            eax.Encrypt(msg, sizeof(msg));
+            eax.GetTag(tag, sizeof(tag));
+        }
+
+        elapsed = clock() - start;
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+
+    eax.Reset();
+    return best;
+}
+
+} // unnamed namespace
+
+bool RegisterEAXBackend(const EAXBackendInfo * backend)
+{
+    assert(backend != NULL && backend->Create != NULL);
+    assert(backend->KeyLength == 16 || backend->KeyLength == 32);
+
+    RegisterBuiltinEAXBackends();
+
+    if (sBackendCount >= CONFIG_EAX_MAX_BACKENDS) {
+        return false;
+    }
+    sBackends[sBackendCount++] = backend;
+    return true;
+}
+
+size_t GetEAXBackendCount(void)
+{
+    RegisterBuiltinEAXBackends();
+    return sBackendCount;
+}
+
+const EAXBackendInfo * GetEAXBackend(size_t index)
+{
+    RegisterBuiltinEAXBackends();
+    assert(index < sBackendCount);
+    return sBackends[index];
+}
+
+const EAXBackendInfo * SelectEAXBackend(size_t keyLen)
+{
+    const EAXBackendInfo * best = NULL;
+
+    RegisterBuiltinEAXBackends();
+
+    if (*CalibratedSlot(keyLen) != NULL) {
+        return *CalibratedSlot(keyLen);
+    }
+
+    for (size_t i = 0; i < sBackendCount; i++) {
+        if (IsUsable(sBackends[i], keyLen) && (best == NULL || sBackends[i]->Priority > best->Priority)) {
+            best = sBackends[i];
+        }
+    }
+    return best;
+}
+
+EAX * CreateEAX(size_t keyLen, const EAXBackendInfo ** backend)
+{
+    const EAXBackendInfo * selected = SelectEAXBackend(keyLen);
+
+    if (backend != NULL) {
+        *backend = selected;
+    }
+    return (selected != NULL) ? selected->Create() : NULL;
+}
+
+const EAXBackendInfo * CalibrateEAXBackends(size_t keyLen, EAXClockFunct clock)
+{
+    const EAXBackendInfo * best = NULL;
+    uint64_t bestTime = 0;
+
+    assert(clock != NULL);
+
+    RegisterBuiltinEAXBackends();
+
+    /*
+     * Candidates are visited in registration order, and those that fail the
+     * known-answer test are skipped. On equal timings, the backend with the
+     * higher priority wins.
+     */
+    for (size_t i = 0; i < sBackendCount; i++) {
+        const EAXBackendInfo * candidate = sBackends[i];
+        EAX * eax;
+        uint64_t time;
+
+        if (!IsUsable(candidate, keyLen)) {
+            continue;
+        }
+
+        eax = candidate->Create();
+        if (!CheckEAXKnownAnswers(*eax, keyLen)) {
+            delete eax;
+            continue;
+        }
+        time = TimeEAX(*eax, keyLen, clock);
+        delete eax;
+
+        if (best == NULL || time < bestTime || (time == bestTime && candidate->Priority > best->Priority)) {
+            best = candidate;
+            bestTime = time;
+        }
+    }
+
+    *CalibratedSlot(keyLen) = best;
+    return best;
+}
+
+//
+// Compile as follows to create a stand-alone program for testing all the
+// built-in EAX backends available on the host against the standard test
+// vectors and against each other, and for calibrating them.
+//
+//    c++ -O3 -maes -pthread -o test-eax-factory -I. -DUNIT_TEST_EAX_FACTORY EAX.cpp EAX-AESNI.cpp EAX-VAES.cpp EAX-Soft.cpp EAXFactory.cpp EAXTest.cpp
+//
+#ifdef UNIT_TEST_EAX_FACTORY
+
+#include <stdio.h>
+#include <time.h>
+#include <EAXTest.h>
+#if !CONFIG_EAX_NO_CHUNK
+#include <EAXParallel.h>
+#endif
+
+static uint64_t GetTimeNS(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// A backend with a broken (and fast) block cipher, which calibration must skip
+class EAX_128_Faulty final : public EAX
+{
+protected:
+    virtual void AESReset(void) { }
+    virtual void AESSetKey(const uint8_t *key, size_t keyLen) { }
+    virtual void AESEncryptBlock(uint8_t *data) { data[0] ^= 0x01; }
+};
+
+int main(int argc, char *argv[])
+{
+    uint8_t key[32], nonce[16], header[40], msg[1000], ref[1000 + 16], buf[1000 + 16];
+    const EAXBackendInfo * backend;
+
+    for (size_t i = 0; i < sizeof(key); i++) {
+        key[i] = (uint8_t)(i * 7 + 1);
+    }
+    for (size_t i = 0; i < sizeof(nonce); i++) {
+        nonce[i] = (uint8_t)(i * 13 + 5);
+    }
+    for (size_t i = 0; i < sizeof(header); i++) {
+        header[i] = (uint8_t)(i * 3 + 11);
+    }
+    for (size_t i = 0; i < sizeof(msg); i++) {
+        msg[i] = (uint8_t)(i * 31 + 17);
+    }
+
+    for (size_t b = 0; b < GetEAXBackendCount(); b++) {
+        backend = GetEAXBackend(b);
+
+        if (backend->IsAvailable != NULL && !backend->IsAvailable()) {
+            printf("Backend %s: not available\n", backend->Name);
+            continue;
+        }
+
+        {
+            EAX * eax = backend->Create();
+            assert(CheckEAXKnownAnswers(*eax, backend->KeyLength));
+            delete eax;
+        }
+
+        if (backend->KeyLength == 16) {
+            EAX * eax = backend->Create();
+            TestEAX128(*eax);
+            delete eax;
+#if CONFIG_EAX_STATS
+            // The default policy of the build enables the counters
+            eax = backend->Create();
+            TestEAX128Stats(*eax);
+            delete eax;
+#endif
+        }
+
+        // Check AES-256 against the portable implementation
+        else {
+            for (size_t msgLen = 0; msgLen <= sizeof(msg); msgLen += 97) {
+                EAX * eax = backend->Create();
+                EAX_256_Soft soft;
+
+                soft.SetKey(key, 32);
+                soft.Start(nonce, sizeof(nonce));
+                soft.InjectHeader(header, sizeof(header));
+                soft.Encrypt(msg, msgLen, ref);
+                soft.GetTag(ref + msgLen, 16);
+
+                eax->SetKey(key, 32);
+                eax->Start(nonce, sizeof(nonce));
+                eax->InjectHeader(header, sizeof(header));
+                eax->Encrypt(msg, msgLen, buf);
+                eax->GetTag(buf + msgLen, 16);
+                assert(memcmp(buf, ref, msgLen + 16) == 0);
+                delete eax;
+            }
+        }
+
+        printf("Backend %s: tests passed\n", backend->Name);
+    }
+
+    printf("Selected by priority: %s, %s\n", SelectEAXBackend(16)->Name, SelectEAXBackend(32)->Name);
+    printf("Selected by calibration: %s, %s\n", CalibrateEAXBackends(16, GetTimeNS)->Name, CalibrateEAXBackends(32, GetTimeNS)->Name);
+
+    {
+        static const EAXBackendInfo sFaulty = { "faulty-128", 16, -1, NULL, NewEAXObject<EAX_128_Faulty> };
+        EAX_128_Faulty faulty;
+
+        assert(!CheckEAXKnownAnswers(faulty, 16));
+        RegisterEAXBackend(&sFaulty);
+        assert(CalibrateEAXBackends(16, GetTimeNS) != &sFaulty);
+    }
+
+    {
+        EAX * eax = CreateEAX(16, &backend);
+        assert(eax != NULL && backend == SelectEAXBackend(16));
+        TestEAX128(*eax);
+        delete eax;
+    }
+
+#if EAX_FACTORY_X86
+    if (VAESSupported()) {
+        EAXBatch<EAXT_128_VAES, 8> batch;
+        TestEAX128Batch(batch);
+    }
+#if !CONFIG_EAX_NO_CHUNK
+    if (AESNISupported()) {
+        EAXParallel<EAXT_128_AESNI> par(3, 64, 0);
+        TestEAX128Parallel(par);
+    }
+#endif
+#endif
+
+    printf("All tests passed\n");
+}
+
+#endif // UNIT_TEST_EAX_FACTORY
@@ -0,0 +1,117 @@
+/*
+ *    Copyright (c) 2021 Jay Logue
+ *    All rights reserved.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/**
+ *    @file
+ *      Registry of EAX implementations, and run-time selection of the
+ *      fastest implementation available on the host.
+ *
+ */
+
+#ifndef EAX_FACTORY_H_
+#define EAX_FACTORY_H_
+
+#include <EAX.h>
+
+/* CONFIGURATION OPTIONS */
+
+/** CONFIG_EAX_MAX_BACKENDS
+ *
+ * Maximum number of EAX backends that can be registered, including the
+ * built-in ones.
+ */
+#ifndef CONFIG_EAX_MAX_BACKENDS
+#define CONFIG_EAX_MAX_BACKENDS 16
+#endif
+
+/** Describes an EAX implementation (backend)
+ */
+struct EAXBackendInfo
+{
+    const char * Name;          // printable name, e.g. "aesni-128"
+    size_t KeyLength;           // key length in bytes (16 or 32)
+    int Priority;               // higher values are preferred
+    bool (*IsAvailable)(void);  // returns true if usable on this host; NULL if always usable
+    EAX * (*Create)(void);      // allocates an instance with new
+};
+
+/** Allocate an instance of an EAX class; for use as EAXBackendInfo::Create.
+ */
+template <class T>
+EAX * NewEAXObject(void)
+{
+    return new T();
+}
+
+/** Type of the clock function used by CalibrateEAXBackends().
+ *
+ *  The function must return a monotonic time value, in any unit.
+ */
+typedef uint64_t (*EAXClockFunct)(void);
+
+/** Register an EAX backend
+ *
+ * The backend description is not copied, and must remain valid for the life
+ * of the program. Returns false if the registry is full.
+ *
+ * The built-in backends for the platform are registered automatically; on x86
+ * hosts these are the VAES, AESNI and portable backends, elsewhere the portable
+ * backend only. Platform code registers additional ones (e.g. see
+ * RegisterNRF5EAXBackends() in nRF5EAX.h).
+ *
+ * NB: The registry is not thread-safe. Backends should be registered, and
+ * calibration performed, at program startup.
+ */
+extern bool RegisterEAXBackend(const EAXBackendInfo * backend);
+
+/** Returns the number of registered EAX backends.
+ */
+extern size_t GetEAXBackendCount(void);
+
+/** Returns the registered EAX backend at the given index.
+ */
+extern const EAXBackendInfo * GetEAXBackend(size_t index);
+
+/** Select the EAX backend to use for the given key length.
+ *
+ * Returns the winner of the last calibration for that key length, if any, or
+ * else the available backend with the highest priority. Returns NULL if no
+ * backend is available for the key length.
+ */
+extern const EAXBackendInfo * SelectEAXBackend(size_t keyLen);
+
+/** Create an EAX object for the given key length, using the backend returned
+ *  by SelectEAXBackend().
+ *
+ * The object is allocated with new, and must be destroyed with delete. If
+ * backend is not NULL, it receives the backend that was chosen. Returns NULL
+ * if no backend is available for the key length.
+ */
+extern EAX * CreateEAX(size_t keyLen, const EAXBackendInfo ** backend = NULL);
+
+/** Calibrate the EAX backends for the given key length.
+ *
+ * Each available backend for the key length is self-tested with
+ * CheckEAXKnownAnswers(), and those that pass are timed over a short fixed
+ * workload using the given clock. The fastest one is returned, and is used by
+ * subsequent calls to SelectEAXBackend() and CreateEAX() for that key length.
+ * Returns NULL if no backend passes the self-test, in which case selection
+ * falls back to priorities.
+ */
+extern const EAXBackendInfo * CalibrateEAXBackends(size_t keyLen, EAXClockFunct clock);
+
+#endif // EAX_FACTORY_H_
@@ -0,0 +1,262 @@
+/*
+ *    Copyright (c) 2021 Jay Logue
+ *    All rights reserved.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/**
+ *    @file
+ *      A cache of saved EAX header states, for messages that share a small
+ *      set of header values.
+ *
+ */
+
+#ifndef EAXHEADERCACHE_H_
+#define EAXHEADERCACHE_H_
+
+#include <EAXT.h>
+
+/** Cache of saved header states, keyed by key id and header value
+ *
+ * EAXT::SaveHeader() and EAXT::StartSaved() let messages that share a
+ * header skip the OMAC of the header, but the caller has to keep track of
+ * the EAXSaved objects. EAXHeaderCache does that in front of the engine:
+ * Start() replaces a call to EAXT::Start() followed by EAXT::InjectHeader(),
+ * and starts the message with a saved header state whenever the same header
+ * has been seen before with the same key.
+ *
+ * Keys are identified by a caller-chosen 64-bit key id, which must change
+ * whenever the key of the EAX object changes (or ClearKey() be called):
+ * a saved state used with a different key gives wrong tags. The cache may
+ * be shared by several EAX objects, provided objects with different keys
+ * use different key ids.
+ *
+ * The cache holds up to N entries. When it is full, a new header evicts
+ * the least recently used entry, whose saved state is then cleared.
+ * Headers longer than MaxHeaderLength bytes are not cached (each entry
+ * keeps a copy of its header, to tell apart headers with the same hash).
+ *
+ * NB: The cache is not thread-safe.
+ */
+template <size_t N, size_t MaxHeaderLength = 32>
+class EAXHeaderCache
+{
+public:
+    enum {
+        kMaxHeaderLength = MaxHeaderLength
+    };
+
+    EAXHeaderCache(void);
+    ~EAXHeaderCache(void);
+
+    /** Start a message with the given nonce and header
+     *
+     * Equivalent to eax.Start() followed by eax.InjectHeader(). If the
+     * header is in the cache for keyId, the message is started with
+     * eax.StartSaved(); otherwise the header is processed with
+     * eax.SaveHeader() into a new entry first (unless it is longer than
+     * kMaxHeaderLength). The message continues with Encrypt() or Decrypt();
+     * no further header data may be injected.
+     *
+     * Returns true if a cached header state was used.
+     */
+    template <class Backend, class Policy>
+    bool Start(EAXT<Backend, Policy> & eax, uint64_t keyId, const uint8_t *nonce, size_t nonceLen,
+               const uint8_t *header, size_t headerLen);
+
+    /** Remove the entries of a key
+     *
+     * Must be called when the key that keyId stands for is changed, unless
+     * a new key id is used.
+     */
+    void ClearKey(uint64_t keyId);
+
+    /** Remove all entries
+     */
+    void Clear(void);
+
+    /** Returns the number of entries in the cache.
+     */
+    size_t GetCount(void) const;
+
+private:
+    struct Entry
+    {
+        uint64_t keyId;
+        uint32_t hash;
+        uint32_t lastUse;           // value of mClock when last used; 0 if the entry is free
+        size_t headerLen;
+        uint8_t header[MaxHeaderLength];
+        EAXSaved sav;
+    };
+
+    Entry mEntries[N];
+    uint32_t mClock;                // incremented on each use of an entry
+
+    static uint32_t hash(uint64_t keyId, const uint8_t *header, size_t headerLen);
+    void clear_entry(Entry & entry);
+    uint32_t tick(void);
+};
+
+template <size_t N, size_t MaxHeaderLength>
+EAXHeaderCache<N, MaxHeaderLength>::EAXHeaderCache(void)
+{
+    static_assert(N > 0, "Cache must hold at least one entry");
+
+    mClock = 0;
+    for (size_t i = 0; i < N; i++) {
+        mEntries[i].lastUse = 0;
+    }
+}
+
+template <size_t N, size_t MaxHeaderLength>
+EAXHeaderCache<N, MaxHeaderLength>::~EAXHeaderCache(void)
+{
+    Clear();
+}
+
+template <size_t N, size_t MaxHeaderLength>
+template <class Backend, class Policy>
+bool
+EAXHeaderCache<N, MaxHeaderLength>::Start(EAXT<Backend, Policy> & eax, uint64_t keyId, const uint8_t *nonce,
+                                          size_t nonceLen, const uint8_t *header, size_t headerLen)
+{
+    Entry *victim = &mEntries[0];
+    uint32_t h;
+    size_t i;
+
+    if (headerLen > kMaxHeaderLength) {
+        eax.Start(nonce, nonceLen);
+        eax.InjectHeader(header, headerLen);
+        return false;
+    }
+
+    /*
+     * Look for the header, and note the least recently used entry (a free
+     * one, if any) on the way.
+     */
+    h = hash(keyId, header, headerLen);
+    for (i = 0; i < N; i++) {
+        Entry & entry = mEntries[i];
+
+        if (entry.lastUse != 0 && entry.hash == h && entry.keyId == keyId && entry.headerLen == headerLen
+            && memcmp(entry.header, header, headerLen) == 0) {
+            entry.lastUse = tick();
+            eax.StartSaved(nonce, nonceLen, &entry.sav);
+            return true;
+        }
+        if (entry.lastUse < victim->lastUse) {
+            victim = &entry;
+        }
+    }
+
+    clear_entry(*victim);
+    eax.SaveHeader(header, headerLen, &victim->sav);
+    victim->keyId = keyId;
+    victim->hash = h;
+    victim->headerLen = headerLen;
+    memcpy(victim->header, header, headerLen);
+    victim->lastUse = tick();
+
+    eax.StartSaved(nonce, nonceLen, &victim->sav);
+    return false;
+}
+
+template <size_t N, size_t MaxHeaderLength>
+void
+EAXHeaderCache<N, MaxHeaderLength>::ClearKey(uint64_t keyId)
+{
+    for (size_t i = 0; i < N; i++) {
+        if (mEntries[i].lastUse != 0 && mEntries[i].keyId == keyId) {
+            clear_entry(mEntries[i]);
+        }
+    }
+}
+
+template <size_t N, size_t MaxHeaderLength>
+void
+EAXHeaderCache<N, MaxHeaderLength>::Clear(void)
+{
+    for (size_t i = 0; i < N; i++) {
+        clear_entry(mEntries[i]);
+    }
+    mClock = 0;
+}
+
+template <size_t N, size_t MaxHeaderLength>
+size_t
+EAXHeaderCache<N, MaxHeaderLength>::GetCount(void) const
+{
+    size_t i, count = 0;
+
+    for (i = 0; i < N; i++) {
+        count += (mEntries[i].lastUse != 0);
+    }
+    return count;
+}
+
+/*
+ * FNV-1a hash of the header, combined with the key id by Fibonacci hashing.
+ */
+template <size_t N, size_t MaxHeaderLength>
+inline uint32_t
+EAXHeaderCache<N, MaxHeaderLength>::hash(uint64_t keyId, const uint8_t *header, size_t headerLen)
+{
+    uint32_t h = 0x811C9DC5;
+    size_t i;
+
+    for (i = 0; i < headerLen; i++) {
+        h = (h ^ header[i]) * 0x01000193;
+    }
+    return h ^ (uint32_t)((keyId * 0x9E3779B97F4A7C15) >> 32);
+}
+
+template <size_t N, size_t MaxHeaderLength>
+void
+EAXHeaderCache<N, MaxHeaderLength>::clear_entry(Entry & entry)
+{
+    EAXSecureWipe((void *)&entry, sizeof(Entry));
+}
+
+/*
+ * Returns the next value of the use clock. When the clock wraps around,
+ * the entries are renumbered in their order of use, so that the LRU order
+ * is kept.
+ */
+template <size_t N, size_t MaxHeaderLength>
+uint32_t
+EAXHeaderCache<N, MaxHeaderLength>::tick(void)
+{
+    uint32_t rank[N];
+    size_t i, j;
+
+    if (mClock == UINT32_MAX) {
+        for (i = 0; i < N; i++) {
+            rank[i] = 0;
+            if (mEntries[i].lastUse == 0) {
+                continue;
+            }
+            for (j = 0; j < N; j++) {
+                rank[i] += (mEntries[j].lastUse != 0 && mEntries[j].lastUse <= mEntries[i].lastUse);
+            }
+        }
+        for (i = 0; i < N; i++) {
+            mEntries[i].lastUse = rank[i];
+        }
+        mClock = (uint32_t)N;
+    }
+    return ++mClock;
+}
+
+#endif // EAXHEADERCACHE_H_
@@ -0,0 +1,286 @@
+/*
+ *    Copyright (c) 2021 Jay Logue
+ *    All rights reserved.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/**
+ *    @file
+ *      A queue of precomputed EAX nonce states, for messages that use
+ *      counter-based nonces.
+ *
+ */
+
+#ifndef EAXNONCEQUEUE_H_
+#define EAXNONCEQUEUE_H_
+
+#include <atomic>
+
+#include <EAXT.h>
+
+/** Queue of precomputed start states for upcoming counter-based nonces
+ *
+ * When the nonce of each message is a record counter, the nonces of the
+ * next messages are known in advance, and so is most of the work done by
+ * EAXT::Start(): the OMAC of the nonce. EAXNonceQueue computes that work for
+ * up to K upcoming nonces at idle time (Fill()), so that StartNext() can
+ * start the next message without any block encryption.
+ *
+ * Nonces form a sequence: the n-th nonce is the initial nonce given to
+ * Init() plus n, interpreted as a big-endian integer of nonceLen bytes.
+ * StartNext() always starts the message with the next nonce in the sequence,
+ * whether or not its state has been precomputed, and returns that nonce to
+ * the caller.
+ *
+ * The sequence holds 2^(8 * nonceLen) distinct nonces; past that point, the
+ * addition would wrap around to nonces that have already been used, which
+ * breaks the security of CTR mode. StartNext() therefore fails once the
+ * sequence is exhausted, and the caller must change the key (and call
+ * Init() again). With nonces of 8 bytes or more, the sequence cannot be
+ * exhausted in practice.
+ *
+ * Fill() and StartNext() may be called from different threads (one of each)
+ * without further locking, in which case each thread must use its own EAX
+ * object, with the same key. A typical use on nRF5 is to call Fill() from
+ * the main loop before nrf_pwr_mgmt_run(), with the same EAX object as
+ * StartNext(); on a host, Fill() can run on a background thread.
+ *
+ * Init() must not be called while Fill() or StartNext() is running. Entries
+ * are tied to the key of the EAX object used to fill them: call Init()
+ * again after changing the key.
+ */
+template <size_t K>
+class EAXNonceQueue
+{
+public:
+    enum {
+        kMaxNonceLength = 16
+    };
+
+    EAXNonceQueue(void);
+    ~EAXNonceQueue(void);
+
+    /** Reset the queue, and set the first nonce of the sequence
+     */
+    void Init(const uint8_t *firstNonce, size_t nonceLen);
+
+    /** Precompute the states of up to maxCount upcoming nonces
+     *
+     * Stops when the queue is full. Returns the number of states computed.
+     */
+    template <class Backend, class Policy>
+    size_t Fill(EAXT<Backend, Policy> & eax, size_t maxCount = K);
+
+    /** Start a message with the next nonce in the sequence
+     *
+     * The nonce used is copied to 'nonce' (nonceLen bytes, as given to
+     * Init()). If 'sav' is not NULL, the message starts with a saved
+     * header, as with EAXT::StartSaved(). If 'precomputed' is not NULL, it
+     * is set to true if a precomputed state was used, or to false if the
+     * nonce was processed with EAXT::Start().
+     *
+     * Returns false, without starting a message, if the sequence of nonces
+     * is exhausted.
+     */
+    template <class Backend, class Policy>
+    bool StartNext(EAXT<Backend, Policy> & eax, uint8_t *nonce, const EAXSaved *sav = NULL,
+                   bool *precomputed = NULL);
+
+    /** Returns the number of precomputed states waiting in the queue
+     *
+     * Some of these may be stale, if StartNext() has overtaken Fill().
+     */
+    size_t GetCount(void) const;
+
+private:
+    struct Entry
+    {
+        uint64_t seq;
+        EAXNonceState state;
+    };
+
+    Entry mEntries[K];
+    uint8_t mFirstNonce[kMaxNonceLength];
+    size_t mNonceLen;
+    std::atomic<size_t> mHead;      // next entry to consume; written by StartNext()
+    std::atomic<size_t> mTail;      // next entry to fill; written by Fill()
+    std::atomic<uint64_t> mNextSeq; // sequence number of the next message; written by StartNext()
+    uint64_t mFillSeq;              // sequence number of the next entry to fill; Fill() only
+
+    bool seq_valid(uint64_t seq) const;
+    void make_nonce(uint64_t seq, uint8_t *nonce) const;
+};
+
+template <size_t K>
+EAXNonceQueue<K>::EAXNonceQueue(void)
+{
+    static_assert(K > 0, "Queue must hold at least one entry");
+
+    mNonceLen = 0;
+    mHead = 0;
+    mTail = 0;
+    mNextSeq = 0;
+    mFillSeq = 0;
+}
+
+template <size_t K>
+EAXNonceQueue<K>::~EAXNonceQueue(void)
+{
+    memset(mFirstNonce, 0, sizeof mFirstNonce);
+}
+
+template <size_t K>
+void
+EAXNonceQueue<K>::Init(const uint8_t *firstNonce, size_t nonceLen)
+{
+    assert(nonceLen > 0 && nonceLen <= kMaxNonceLength);
+
+    memcpy(mFirstNonce, firstNonce, nonceLen);
+    mNonceLen = nonceLen;
+    mHead.store(0, std::memory_order_relaxed);
+    mTail.store(0, std::memory_order_relaxed);
+    mNextSeq.store(0, std::memory_order_relaxed);
+    mFillSeq = 0;
+}
+
+template <size_t K>
+template <class Backend, class Policy>
+size_t
+EAXNonceQueue<K>::Fill(EAXT<Backend, Policy> & eax, size_t maxCount)
+{
+    uint8_t nonce[kMaxNonceLength];
+    size_t tail = mTail.load(std::memory_order_relaxed);
+    size_t count;
+    uint64_t nextSeq;
+
+    assert(mNonceLen != 0);
+
+    for (count = 0; count < maxCount; count++) {
+        if (tail - mHead.load(std::memory_order_acquire) >= K) {
+            break;
+        }
+
+        /*
+         * If StartNext() has overtaken the filling, skip the nonces that
+         * have already been used.
+         */
+        nextSeq = mNextSeq.load(std::memory_order_acquire);
+        if (mFillSeq < nextSeq) {
+            mFillSeq = nextSeq;
+        }
+        if (!seq_valid(mFillSeq)) {
+            break;
+        }
+
+        Entry & entry = mEntries[tail % K];
+        make_nonce(mFillSeq, nonce);
+        eax.PrecomputeNonce(nonce, mNonceLen, &entry.state);
+        entry.seq = mFillSeq++;
+        mTail.store(++tail, std::memory_order_release);
+    }
+
+    return count;
+}
+
+template <size_t K>
+template <class Backend, class Policy>
+bool
+EAXNonceQueue<K>::StartNext(EAXT<Backend, Policy> & eax, uint8_t *nonce, const EAXSaved *sav,
+                            bool *precomputed)
+{
+    size_t head = mHead.load(std::memory_order_relaxed);
+    uint64_t seq = mNextSeq.load(std::memory_order_relaxed);
+    bool found = false;
+
+    assert(mNonceLen != 0);
+
+    if (!seq_valid(seq)) {
+        return false;
+    }
+
+    make_nonce(seq, nonce);
+
+    /*
+     * Drop the stale entries (for nonces that were used before they could
+     * be precomputed) and use the entry for this nonce, if there is one.
+     */
+    while (head != mTail.load(std::memory_order_acquire)) {
+        const Entry & entry = mEntries[head % K];
+        if (entry.seq > seq) {
+            break;
+        }
+        if (entry.seq == seq) {
+            eax.StartPrecomputed(&entry.state, sav);
+            found = true;
+        }
+        mHead.store(++head, std::memory_order_release);
+        if (found) {
+            break;
+        }
+    }
+
+    if (!found) {
+        if (sav != NULL) {
+            eax.StartSaved(nonce, mNonceLen, sav);
+        } else {
+            eax.Start(nonce, mNonceLen);
+        }
+    }
+
+    mNextSeq.store(seq + 1, std::memory_order_release);
+    if (precomputed != NULL) {
+        *precomputed = found;
+    }
+    return true;
+}
+
+template <size_t K>
+size_t
+EAXNonceQueue<K>::GetCount(void) const
+{
+    return mTail.load(std::memory_order_acquire) - mHead.load(std::memory_order_acquire);
+}
+
+/*
+ * Returns true if the nonce of the given sequence number has not been used
+ * yet in this sequence, i.e. if seq < 2^(8 * nonceLen).
+ */
+template <size_t K>
+inline bool
+EAXNonceQueue<K>::seq_valid(uint64_t seq) const
+{
+    return mNonceLen >= sizeof(seq) || seq < ((uint64_t)1 << (8 * mNonceLen));
+}
+
+template <size_t K>
+void
+EAXNonceQueue<K>::make_nonce(uint64_t seq, uint8_t *nonce) const
+{
+    unsigned carry = 0;
+    size_t i = mNonceLen;
+
+    /*
+     * Big-endian addition of the sequence number to the first nonce,
+     * modulo 2^(8 * nonceLen); seq_valid() keeps the result distinct from
+     * the previous nonces.
+     */
+    while (i-- > 0) {
+        carry += mFirstNonce[i] + (unsigned)(seq & 0xFF);
+        nonce[i] = (uint8_t)carry;
+        carry >>= 8;
+        seq >>= 8;
+    }
+}
+
+#endif // EAXNONCEQUEUE_H_
@@ -0,0 +1,492 @@
+/*
+ *    Copyright (c) 2021 Jay Logue
+ *    All rights reserved.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/**
+ *    @file
+ *      Multi-threaded EAX payload processing for large buffers (hosts
+ *      only).
+ *
+ */
+
+#ifndef EAXPARALLEL_H_
+#define EAXPARALLEL_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include <EAXT.h>
+
+/** Two-stage, multi-threaded payload processing for an EAX message
+ *
+ * The payload of an EAX message goes through two computations: the CTR
+ * stream, whose blocks are independent of each other, and the OMAC of the
+ * ciphertext, which is a chain where each block depends on the previous
+ * one. For large payloads (firmware images, log bundles), EAXParallel
+ * splits these into two stages:
+ *
+ *  - The CTR stage is split into chunks, which are claimed by a set of
+ *    worker threads; each computes the stream for its chunks and XORs it
+ *    into the data.
+ *
+ *  - The OMAC stage runs on the calling thread, over chunks in order.
+ *    When encrypting, the workers hand chunks over as their ciphertext is
+ *    finished, by marking them in an array of kQueueLength slots, which
+ *    the calling thread polls (yielding between polls); a worker does not
+ *    start a chunk more than kQueueLength chunks ahead of the OMAC stage.
+ *    When decrypting, the OMAC is over the input, and the workers only
+ *    wait (polling in the same way) for the OMAC of a chunk when
+ *    processing in place.
+ *
+ * Encrypt() and Decrypt() are used in place of the same methods of the
+ * EAX object, for a message in progress, and give exactly the same result:
+ * they can be mixed with calls to the EAX object itself (e.g. for a short
+ * header or a last partial chunk). Payloads shorter than the minimum length
+ * given to the constructor are processed by the EAX object directly.
+ *
+ * Backend must be a concrete EAXT<> backend class that supports SaveKey()
+ * and LoadKey() (e.g. EAXT_128_AESNI); each worker thread uses its own
+ * object, loaded with the key of the message's EAX object.
+ *
+ * The worker threads are started by the constructor, and stopped by the
+ * destructor; between calls, they wait on a condition variable. An
+ * EAXParallel object holds no message state, and can be used with any
+ * number of EAX objects, but not from several threads at once.
+ */
+template <class Backend>
+class EAXParallel
+{
+public:
+    typedef Backend BackendType;
+
+    enum {
+        kMaxThreads = 64,
+        kQueueLength = 64,
+        kDefaultChunkLength = 16384,
+        kDefaultMinLength = 262144
+    };
+
+    /** Create a parallel processing object
+     *
+     * threadCount is the number of worker threads, in addition to the
+     * calling thread; zero means one less than the number of processors
+     * (but at least one). chunkLength (a multiple of 16) is the unit of
+     * work of the CTR stage. Payloads shorter than minLength bytes are not
+     * split.
+     */
+    EAXParallel(unsigned threadCount = 0, size_t chunkLength = kDefaultChunkLength,
+                size_t minLength = kDefaultMinLength);
+
+    /** Stop the worker threads.
+     */
+    ~EAXParallel(void);
+
+    /** Encrypt payload data for the message in progress on 'eax'
+     *
+     * Same as eax.Encrypt(input, inputLen, output).
+     */
+    void Encrypt(Backend & eax, const uint8_t *input, size_t inputLen, uint8_t *output);
+    void Encrypt(Backend & eax, uint8_t *data, size_t dataLen);
+
+    /** Decrypt payload data for the message in progress on 'eax'
+     *
+     * Same as eax.Decrypt(input, inputLen, output).
+     */
+    void Decrypt(Backend & eax, const uint8_t *input, size_t inputLen, uint8_t *output);
+    void Decrypt(Backend & eax, uint8_t *data, size_t dataLen);
+
+    /** Returns the number of worker threads.
+     */
+    unsigned GetThreadCount(void) const { return mThreadCount; }
+
+private:
+    typedef EAXT<Backend, typename Backend::PolicyType> Engine;
+
+    static_assert(Engine::PolicyType::kChunk, "EAXParallel requires an engine with chunked payload processing");
+
+    enum {
+        kBlockLength = Engine::kBlockLength,
+        kCTRBatchBlocks = Engine::kCTRBatchBlocks
+    };
+
+    /*
+     * State shared by the calling thread and the workers for one call.
+     */
+    struct Job
+    {
+        bool encrypt;
+        bool inPlace;
+        const uint8_t *in;
+        uint8_t *out;
+        size_t nBlocks;
+        size_t chunkBlocks;
+        size_t nChunks;
+        uint8_t ctr[kBlockLength];                  // counter of the first block
+        typename Backend::AESKeySchedule sched;
+        uint8_t pads[Backend::kKeyPadsLength];
+        std::atomic<size_t> nextChunk;              // next chunk to claim by a worker
+        std::atomic<size_t> macCount;               // number of chunks through OMAC
+        std::atomic<size_t> queue[kQueueLength];    // slots: chunk index + 1, once encrypted
+    };
+
+    unsigned mThreadCount;
+    size_t mChunkBlocks;
+    size_t mMinLength;
+    std::thread mThreads[kMaxThreads];
+    std::mutex mLock;
+    std::condition_variable mStart;     // signalled when a job is posted, or on stop
+    std::condition_variable mDone;      // signalled when the last worker leaves a job
+    Job *mJob;                          // current job; protected by mLock, like the fields below
+    uint64_t mJobNumber;                // number of jobs posted so far
+    unsigned mBusy;                     // number of workers not done with the current job
+    bool mStop;
+
+    void process(bool encrypt, Backend & eax, const uint8_t *in, uint8_t *out, size_t len);
+    void process_blocks(bool encrypt, Backend & eax, const uint8_t *in, uint8_t *out, size_t nBlocks);
+    void worker(void);
+    static void run_job(Job *job, Backend & w);
+    static void ctr_add(const uint8_t *ctr, uint64_t n, uint8_t *out);
+};
+
+template <class Backend>
+EAXParallel<Backend>::EAXParallel(unsigned threadCount, size_t chunkLength, size_t minLength)
+{
+    assert(chunkLength >= kBlockLength && (chunkLength % kBlockLength) == 0);
+
+    if (threadCount == 0) {
+        threadCount = std::thread::hardware_concurrency();
+        threadCount = (threadCount > 1) ? threadCount - 1 : 1;
+    }
+    mThreadCount = (threadCount < kMaxThreads) ? threadCount : (unsigned)kMaxThreads;
+    mChunkBlocks = chunkLength / kBlockLength;
+    mMinLength = minLength;
+    mJob = NULL;
+    mJobNumber = 0;
+    mBusy = 0;
+    mStop = false;
+
+    for (unsigned i = 0; i < mThreadCount; i ++) {
+        mThreads[i] = std::thread(&EAXParallel::worker, this);
+    }
+}
+
+template <class Backend>
+EAXParallel<Backend>::~EAXParallel(void)
+{
+    unsigned i;
+
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+        mStop = true;
+    }
+    mStart.notify_all();
+    for (i = 0; i < mThreadCount; i ++) {
+        mThreads[i].join();
+    }
+}
+
+template <class Backend>
+void
+EAXParallel<Backend>::Encrypt(Backend & eax, const uint8_t *input, size_t inputLen, uint8_t *output)
+{
+    eax.Encrypt(input, 0, output);
+    input = Engine::resolve_overlap(input, inputLen, output);
+    process(true, eax, input, output, inputLen);
+}
+
+template <class Backend>
+void
+EAXParallel<Backend>::Encrypt(Backend & eax, uint8_t *data, size_t dataLen)
+{
+    Encrypt(eax, data, dataLen, data);
+}
+
+template <class Backend>
+void
+EAXParallel<Backend>::Decrypt(Backend & eax, const uint8_t *input, size_t inputLen, uint8_t *output)
+{
+    eax.Decrypt(input, 0, output);
+    input = Engine::resolve_overlap(input, inputLen, output);
+    process(false, eax, input, output, inputLen);
+}
+
+template <class Backend>
+void
+EAXParallel<Backend>::Decrypt(Backend & eax, uint8_t *data, size_t dataLen)
+{
+    Decrypt(eax, data, dataLen, data);
+}
+
+/*
+ * Split the payload in three: a head that completes the block buffered by
+ * the EAX object, a run of full blocks that goes through the two stages,
+ * and a tail of 1 to 16 bytes. Head and tail are processed by the EAX
+ * object, which must always end with a non-empty buffer (the last block
+ * of the payload gets special padding when the tag is computed).
+ */
+template <class Backend>
+void
+EAXParallel<Backend>::process(bool encrypt, Backend & eax, const uint8_t *in, uint8_t *out, size_t len)
+{
+    Engine & e = eax;
+    size_t head, nBlocks;
+
+    if (len < mMinLength || len <= kBlockLength) {
+        if (encrypt) {
+            eax.Encrypt(in, len, out);
+        } else {
+            eax.Decrypt(in, len, out);
+        }
+        return;
+    }
+
+    /*
+     * Complete the buffered block, and use up any CTR stream cached ahead
+     * of time.
+     */
+    head = (e.ptr != 0) ? (kBlockLength - e.ptr) : 0;
+    head += (size_t)e.ks_cached() * kBlockLength;
+    if (head > 0) {
+        if (head > len - 1) {
+            head = len - 1;
+        }
+        if (encrypt) {
+            eax.Encrypt(in, head, out);
+        } else {
+            eax.Decrypt(in, head, out);
+        }
+        in += head;
+        out += head;
+        len -= head;
+    }
+
+    nBlocks = (len - 1) / kBlockLength;
+    if (nBlocks > 0 && (e.ptr == 0 || e.ptr == kBlockLength)) {
+        process_blocks(encrypt, eax, in, out, nBlocks);
+        in += nBlocks * kBlockLength;
+        out += nBlocks * kBlockLength;
+        len -= nBlocks * kBlockLength;
+    }
+
+    if (encrypt) {
+        eax.Encrypt(in, len, out);
+    } else {
+        eax.Decrypt(in, len, out);
+    }
+}
+
+/*
+ * Two-stage processing of nBlocks full blocks, with the EAX object's
+ * buffer full (ptr == 16) or in the post-StartSaved() state (ptr == 0).
+ * On return, all blocks have been through OMAC, the counter has been
+ * advanced past them, and the object is left with ptr == 0.
+ */
+template <class Backend>
+void
+EAXParallel<Backend>::process_blocks(bool encrypt, Backend & eax, const uint8_t *in, uint8_t *out, size_t nBlocks)
+{
+    Engine & e = eax;
+    Job job;
+    const uint8_t *mac;
+    size_t i, n;
+
+    /*
+     * The buffered block, if any, can now go through OMAC.
+     */
+    if (e.ptr == kBlockLength) {
+        e.mac_blocks(e.buf, 1);
+    }
+
+    job.encrypt = encrypt;
+    job.inPlace = (in == out);
+    job.in = in;
+    job.out = out;
+    job.nBlocks = nBlocks;
+    job.chunkBlocks = mChunkBlocks;
+    job.nChunks = (nBlocks + mChunkBlocks - 1) / mChunkBlocks;
+    memcpy(job.ctr, e.ctr, kBlockLength);
+    eax.SaveKey(&job.sched, job.pads);
+    job.nextChunk.store(0, std::memory_order_relaxed);
+    job.macCount.store(0, std::memory_order_relaxed);
+    for (i = 0; i < kQueueLength; i ++) {
+        job.queue[i].store(0, std::memory_order_relaxed);
+    }
+
+    {
+        std::lock_guard<std::mutex> guard(mLock);
+        mJob = &job;
+        mJobNumber ++;
+        mBusy = mThreadCount;
+    }
+    mStart.notify_all();
+
+    /*
+     * OMAC stage: chunks in order, as they are encrypted when encrypting.
+     */
+    mac = encrypt ? out : in;
+    for (i = 0; i < job.nChunks; i ++) {
+        if (encrypt) {
+            while (job.queue[i % kQueueLength].load(std::memory_order_acquire) != i + 1) {
+                std::this_thread::yield();
+            }
+        }
+        n = nBlocks - i * mChunkBlocks;
+        if (n > mChunkBlocks) {
+            n = mChunkBlocks;
+        }
+        e.mac_blocks(mac, n);
+        mac += n * kBlockLength;
+        job.macCount.store(i + 1, std::memory_order_release);
+    }
+
+    /*
+     * The job lives on this stack: wait until no worker refers to it.
+     */
+    {
+        std::unique_lock<std::mutex> guard(mLock);
+        while (mBusy > 0) {
+            mDone.wait(guard);
+        }
+        mJob = NULL;
+    }
+
+    ctr_add(job.ctr, nBlocks, e.ctr);
+    Engine::ClearSecretData(e.buf, sizeof e.buf);
+    e.ptr = 0;
+
+    Engine::ClearSecretData(job.ctr, sizeof job.ctr);
+    Engine::ClearSecretData(&job.sched, sizeof job.sched);
+    Engine::ClearSecretData(job.pads, sizeof job.pads);
+}
+
+/*
+ * Worker thread: wait for each job posted by process_blocks(), take part
+ * in it, and report when done. The key is cleared from the worker's EAX
+ * object after each job.
+ */
+template <class Backend>
+void
+EAXParallel<Backend>::worker(void)
+{
+    Backend w;
+    uint64_t jobNumber = 0;
+    Job *job;
+
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> guard(mLock);
+            while (!mStop && mJobNumber == jobNumber) {
+                mStart.wait(guard);
+            }
+            if (mStop) {
+                break;
+            }
+            jobNumber = mJobNumber;
+            job = mJob;
+        }
+
+        run_job(job, w);
+        w.Reset();
+
+        {
+            std::lock_guard<std::mutex> guard(mLock);
+            if (--mBusy == 0) {
+                mDone.notify_one();
+            }
+        }
+    }
+}
+
+/*
+ * CTR stage: claim chunks until there are none left. When encrypting, a
+ * chunk is only started once there is room for it in the slot array; when
+ * decrypting in place, only once its ciphertext has been through OMAC.
+ */
+template <class Backend>
+void
+EAXParallel<Backend>::run_job(Job *job, Backend & w)
+{
+    Engine & e = w;
+    uint8_t ks[kCTRBatchBlocks * kBlockLength];
+    size_t i, j, n, m, first;
+
+    w.LoadKey(&job->sched, job->pads);
+
+    for (;;) {
+        i = job->nextChunk.fetch_add(1, std::memory_order_relaxed);
+        if (i >= job->nChunks) {
+            break;
+        }
+
+        if (job->encrypt) {
+            while (i >= job->macCount.load(std::memory_order_acquire) + kQueueLength) {
+                std::this_thread::yield();
+            }
+        } else if (job->inPlace) {
+            while (i >= job->macCount.load(std::memory_order_acquire)) {
+                std::this_thread::yield();
+            }
+        }
+
+        first = i * job->chunkBlocks;
+        n = job->nBlocks - first;
+        if (n > job->chunkBlocks) {
+            n = job->chunkBlocks;
+        }
+        ctr_add(job->ctr, first, e.ctr);
+        for (j = 0; j < n; j += m) {
+            const uint8_t *in = job->in + (first + j) * kBlockLength;
+            uint8_t *out = job->out + (first + j) * kBlockLength;
+            size_t k;
+
+            m = n - j;
+            if (m > kCTRBatchBlocks) {
+                m = kCTRBatchBlocks;
+            }
+            e.ctr_generate(ks, m);
+            for (k = 0; k < m * kBlockLength; k += kBlockLength) {
+                if (in != out) {
+                    memcpy(out + k, in + k, kBlockLength);
+                }
+                Engine::xor_block(ks + k, out + k);
+            }
+        }
+
+        if (job->encrypt) {
+            job->queue[i % kQueueLength].store(i + 1, std::memory_order_release);
+        }
+    }
+
+    Engine::ClearSecretData(ks, sizeof ks);
+}
+
+/*
+ * Counter for block n of the stream: 128-bit big-endian addition.
+ */
+template <class Backend>
+void
+EAXParallel<Backend>::ctr_add(const uint8_t *ctr, uint64_t n, uint8_t *out)
+{
+    uint64_t lo;
+
+    lo = Engine::load_be64(ctr + 8) + n;
+    Engine::store_be64(out, Engine::load_be64(ctr) + (lo < n));
+    Engine::store_be64(out + 8, lo);
+}
+
+#endif // EAXPARALLEL_H_
@@ -0,0 +1,483 @@
+/*
+ *    Copyright (c) 2021 Jay Logue
+ *    All rights reserved.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/**
+ *    @file
+ *      A table of expanded EAX session keys, for hosts that switch between
+ *      a large number of keys.
+ *
+ */
+
+#ifndef EAXSESSIONTABLE_H_
+#define EAXSESSIONTABLE_H_
+
+#include <new>
+
+#include <EAXT.h>
+
+/** Table of expanded EAX keys, indexed by session id
+ *
+ * Setting a key on an EAX object expands it: the backend computes the AES
+ * round keys, and the engine encrypts the all-zero block to derive the
+ * OMAC pad blocks. When the key changes on almost every message (e.g. on
+ * a gateway serving many peers), this expansion is repeated for every
+ * message. EAXSessionTable expands each session key once, and keeps the
+ * result so that an EAX object can later be switched to that key with a
+ * simple copy (see EAXT::LoadKey()).
+ *
+ * Backend must be a concrete EAXT<> backend class that supports SaveKey()
+ * and LoadKey(), i.e. one that provides AESKeySchedule, AESSaveKey() and
+ * AESLoadKey(). Currently these are the AESNI and VAES EAXT classes
+ * (EAXT_128_AESNI, EAXT_256_AESNI, EAXT_128_VAES, EAXT_256_VAES and their
+ * EAXP_* policy variants). The virtual EAX classes, including the object
+ * returned by CreateEAX(), and the portable software backend do not
+ * support them and cannot be used with the table: a gateway has to select
+ * a supported backend itself (e.g. on AESNISupported()) and instantiate
+ * the table with it.
+ *
+ * The table has a fixed capacity, set by Init(). When it is full, adding
+ * a new session evicts the least recently used one (as updated by
+ * SetSessionKey() and BindSession()); the caller then has to supply the
+ * key of an evicted session again.
+ *
+ * Once the table outgrows the processor caches, the cost of BindSession()
+ * is that of the memory access to the key of the session, which is about
+ * that of AESNI key expansion. Callers that process messages in batches
+ * should call Prefetch() for the sessions of the next few messages, so
+ * that these accesses overlap with the processing of the current one.
+ *
+ * NB: The table is not thread-safe.
+ */
+template <class Backend>
+class EAXSessionTable
+{
+public:
+    typedef typename Backend::AESKeySchedule KeySchedule;
+
+    EAXSessionTable(void);
+    ~EAXSessionTable(void);
+
+    /** Allocate the table for the given number of sessions
+     *
+     * Returns false if memory could not be allocated.
+     */
+    bool Init(size_t capacity);
+
+    /** Clear all keys and release the memory used by the table
+     */
+    void Shutdown(void);
+
+    /** Set the key of a session
+     *
+     * Expand the key and store it under the given session id, replacing
+     * the previous key of the session, if any. If the table is full, the
+     * least recently used session is evicted.
+     */
+    void SetSessionKey(uint64_t id, const uint8_t *key, size_t keyLen);
+
+    /** Set the key of an EAX object to that of a session
+     *
+     * Load the expanded key of the given session into 'eax', without key
+     * expansion, as with EAXT::LoadKey(). Returns false if the session is
+     * not in the table (never set, removed or evicted), in which case
+     * 'eax' is left unchanged.
+     */
+    bool BindSession(uint64_t id, Backend & eax);
+
+    /** Start fetching the key of a session into the processor caches
+     *
+     * A hint for a later BindSession() with the same id; it has no effect
+     * on the contents of the table.
+     */
+    void Prefetch(uint64_t id) const;
+
+    /** Remove a session and clear its key
+     *
+     * Returns false if the session is not in the table.
+     */
+    bool RemoveSession(uint64_t id);
+
+    /** Returns the number of sessions in the table.
+     */
+    size_t GetSessionCount(void) const { return mCount; }
+
+    /** Returns the maximum number of sessions in the table.
+     */
+    size_t GetCapacity(void) const { return mCapacity; }
+
+private:
+    enum {
+        kPadsLength = Backend::kKeyPadsLength,
+        kCacheLineLength = 64
+    };
+
+    /*
+     * Index entry of a table position. The LRU links are position numbers;
+     * prev is kEmpty if the position is free.
+     */
+    struct Entry
+    {
+        uint64_t id;
+        uint32_t prev;      // previous (more recently used) position
+        uint32_t next;      // next (less recently used) position
+    };
+
+    struct alignas(kCacheLineLength) KeyEntry
+    {
+        KeySchedule sched;
+        uint8_t pads[kPadsLength];
+    };
+
+    static const uint32_t kNone = UINT32_MAX;
+    static const uint32_t kEmpty = UINT32_MAX - 1;
+
+    Entry *mEntries;        // index, one entry per position
+    KeyEntry *mKeys;        // expanded keys, one per position
+    uint8_t *mKeyMem;       // memory block of mKeys[]
+
+    size_t mCapacity;
+    size_t mCount;
+    uint32_t mSize;         // number of positions
+    uint32_t mLRUHead;      // most recently used position
+    uint32_t mLRUTail;      // least recently used position
+
+    Backend mScratch;       // used for key expansion
+
+    uint32_t home(uint64_t id) const;
+    uint32_t find(uint64_t id) const;
+    void remove(uint32_t pos);
+    void move(uint32_t from, uint32_t to);
+    void lru_unlink(uint32_t pos);
+    void lru_push_front(uint32_t pos);
+    void prefetch_key(uint32_t pos) const;
+};
+
+/*
+ * Implementation Notes
+ * ====================
+ *
+ * The table is an open-addressing hash table with linear probing. The key
+ * of a session is stored at the position of the session in the table, so
+ * that its location is known as soon as the id is hashed: the lookup
+ * starts fetching the key of the home position of the id while it probes
+ * the index, and a hit costs a single access to main memory, all cache
+ * lines of the key being fetched in parallel. Key entries are aligned on
+ * cache lines.
+ *
+ * The index entries (id and LRU links, 16 bytes per position) are kept in
+ * an array of their own, a small fraction of the size of the keys, which
+ * tends to stay in the processor caches. The table has 25% more positions
+ * than its capacity, so that probe sequences stay short.
+ *
+ * Removal uses backward-shift deletion: the entries that follow the removed
+ * one in its probe sequence are moved back, so that no tombstones are
+ * needed. Moved entries keep their place in the LRU list.
+ */
+
+template <class Backend>
+EAXSessionTable<Backend>::EAXSessionTable(void)
+{
+    mEntries = NULL;
+    mKeys = NULL;
+    mKeyMem = NULL;
+    mCapacity = 0;
+    mCount = 0;
+    mSize = 0;
+    mLRUHead = mLRUTail = kNone;
+}
+
+template <class Backend>
+EAXSessionTable<Backend>::~EAXSessionTable(void)
+{
+    Shutdown();
+}
+
+template <class Backend>
+bool
+EAXSessionTable<Backend>::Init(size_t capacity)
+{
+    size_t size, i;
+
+    assert(capacity > 0 && capacity < kEmpty / 2);
+    assert(mCapacity == 0);
+
+    size = capacity + capacity / 4 + 1;
+
+    mEntries = new (std::nothrow) Entry[size];
+    mKeyMem = new (std::nothrow) uint8_t[size * sizeof(KeyEntry) + kCacheLineLength];
+    mCapacity = capacity;
+    if (mEntries == NULL || mKeyMem == NULL) {
+        Shutdown();
+        return false;
+    }
+    mKeys = (KeyEntry *)(mKeyMem + (kCacheLineLength - ((uintptr_t)mKeyMem % kCacheLineLength)));
+
+    mSize = (uint32_t)size;
+    for (i = 0; i < size; i++) {
+        mEntries[i].id = 0;
+        mEntries[i].prev = kEmpty;
+        mEntries[i].next = kNone;
+    }
+    EAXSecureWipe(mKeys, size * sizeof(KeyEntry));
+    mCount = 0;
+    mLRUHead = mLRUTail = kNone;
+
+    return true;
+}
+
+template <class Backend>
+void
+EAXSessionTable<Backend>::Shutdown(void)
+{
+    if (mKeys != NULL) {
+        EAXSecureWipe(mKeys, mSize * sizeof(KeyEntry));
+    }
+
+    delete[] mEntries;
+    delete[] mKeyMem;
+
+    mEntries = NULL;
+    mKeys = NULL;
+    mKeyMem = NULL;
+    mCapacity = 0;
+    mCount = 0;
+    mSize = 0;
+    mLRUHead = mLRUTail = kNone;
+}
+
+template <class Backend>
+void
+EAXSessionTable<Backend>::SetSessionKey(uint64_t id, const uint8_t *key, size_t keyLen)
+{
+    uint32_t pos;
+
+    assert(mCapacity != 0);
+
+    pos = find(id);
+    if (pos != kNone) {
+        lru_unlink(pos);
+    } else {
+        /*
+         * Evict the least recently used session if the table is full,
+         * then take the first free position of the probe sequence.
+         */
+        if (mCount == mCapacity) {
+            remove(mLRUTail);
+        }
+        for (pos = home(id); mEntries[pos].prev != kEmpty; pos = (pos + 1 == mSize) ? 0 : pos + 1) {
+        }
+        mEntries[pos].id = id;
+        mCount++;
+    }
+    lru_push_front(pos);
+
+    mScratch.Reset();
+    mScratch.SetKey(key, keyLen);
+    mScratch.SaveKey(&mKeys[pos].sched, mKeys[pos].pads);
+    mScratch.Reset();
+}
+
+template <class Backend>
+bool
+EAXSessionTable<Backend>::BindSession(uint64_t id, Backend & eax)
+{
+    uint32_t pos;
+
+    pos = find(id);
+    if (pos == kNone) {
+        return false;
+    }
+
+    if (pos != mLRUHead) {
+        lru_unlink(pos);
+        lru_push_front(pos);
+    }
+    eax.LoadKey(&mKeys[pos].sched, mKeys[pos].pads);
+    return true;
+}
+
+/*
+ * The session is looked up in the index, so that its key is fetched from
+ * its actual position, along with the index entries of its LRU neighbours
+ * (which BindSession() updates).
+ */
+template <class Backend>
+void
+EAXSessionTable<Backend>::Prefetch(uint64_t id) const
+{
+    uint32_t pos;
+
+    pos = find(id);
+    if (pos != kNone) {
+        prefetch_key(pos);
+        if (mEntries[pos].prev != kNone) {
+            __builtin_prefetch(&mEntries[mEntries[pos].prev]);
+        }
+        if (mEntries[pos].next != kNone) {
+            __builtin_prefetch(&mEntries[mEntries[pos].next]);
+        }
+    }
+}
+
+template <class Backend>
+bool
+EAXSessionTable<Backend>::RemoveSession(uint64_t id)
+{
+    uint32_t pos;
+
+    pos = find(id);
+    if (pos == kNone) {
+        return false;
+    }
+
+    remove(pos);
+    return true;
+}
+
+/*
+ * Fibonacci hashing of the session id, mapped onto the positions by
+ * multiplication (the table size need not be a power of two).
+ */
+template <class Backend>
+inline uint32_t
+EAXSessionTable<Backend>::home(uint64_t id) const
+{
+    uint32_t h = (uint32_t)((id * 0x9E3779B97F4A7C15) >> 32);
+
+    return (uint32_t)(((uint64_t)h * mSize) >> 32);
+}
+
+template <class Backend>
+uint32_t
+EAXSessionTable<Backend>::find(uint64_t id) const
+{
+    uint32_t pos;
+
+    if (mCapacity == 0) {
+        return kNone;
+    }
+
+    pos = home(id);
+    prefetch_key(pos);
+    for (; mEntries[pos].prev != kEmpty; pos = (pos + 1 == mSize) ? 0 : pos + 1) {
+        if (mEntries[pos].id == id) {
+            return pos;
+        }
+    }
+    return kNone;
+}
+
+/*
+ * Remove the session at the given position, clearing its key.
+ */
+template <class Backend>
+void
+EAXSessionTable<Backend>::remove(uint32_t pos)
+{
+    uint32_t next, h;
+
+    lru_unlink(pos);
+    mEntries[pos].prev = kEmpty;
+    mCount--;
+
+    /*
+     * Backward-shift deletion: move back each following entry of the
+     * cluster whose home position is not between the free position and
+     * its own (cyclically), then free its position in turn.
+     */
+    for (next = (pos + 1 == mSize) ? 0 : pos + 1; mEntries[next].prev != kEmpty;
+         next = (next + 1 == mSize) ? 0 : next + 1) {
+        h = home(mEntries[next].id);
+        if ((next > pos) ? (h <= pos || h > next) : (h <= pos && h > next)) {
+            move(next, pos);
+            pos = next;
+        }
+    }
+
+    mEntries[pos].id = 0;
+    EAXSecureWipe(&mKeys[pos], sizeof(KeyEntry));
+}
+
+/*
+ * Move the session at position 'from' to the free position 'to', keeping
+ * its place in the LRU list. Position 'from' becomes free.
+ */
+template <class Backend>
+void
+EAXSessionTable<Backend>::move(uint32_t from, uint32_t to)
+{
+    Entry & entry = mEntries[to];
+
+    entry = mEntries[from];
+    if (entry.prev != kNone) {
+        mEntries[entry.prev].next = to;
+    } else {
+        mLRUHead = to;
+    }
+    if (entry.next != kNone) {
+        mEntries[entry.next].prev = to;
+    } else {
+        mLRUTail = to;
+    }
+    memcpy(&mKeys[to], &mKeys[from], sizeof(KeyEntry));
+    mEntries[from].prev = kEmpty;
+}
+
+template <class Backend>
+void
+EAXSessionTable<Backend>::lru_unlink(uint32_t pos)
+{
+    uint32_t prev = mEntries[pos].prev, next = mEntries[pos].next;
+
+    if (prev != kNone) {
+        mEntries[prev].next = next;
+    } else {
+        mLRUHead = next;
+    }
+    if (next != kNone) {
+        mEntries[next].prev = prev;
+    } else {
+        mLRUTail = prev;
+    }
+}
+
+template <class Backend>
+void
+EAXSessionTable<Backend>::lru_push_front(uint32_t pos)
+{
+    mEntries[pos].prev = kNone;
+    mEntries[pos].next = mLRUHead;
+    if (mLRUHead != kNone) {
+        mEntries[mLRUHead].prev = pos;
+    } else {
+        mLRUTail = pos;
+    }
+    mLRUHead = pos;
+}
+
+template <class Backend>
+inline void
+EAXSessionTable<Backend>::prefetch_key(uint32_t pos) const
+{
+    const char *p = (const char *)&mKeys[pos];
+
+    for (size_t i = 0; i < sizeof(KeyEntry); i += kCacheLineLength) {
+        __builtin_prefetch(p + i);
+    }
+}
+
+#endif // EAXSESSIONTABLE_H_
@@ -0,0 +1,378 @@
+/*
+ *    Copyright (c) 2021 Jay Logue
+ *    All rights reserved.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/**
+ *    @file
+ *      A segmented format for encrypting large files and streams with EAX,
+ *      with independent (parallel, random-access) processing of segments.
+ *
+ */
+
+#ifndef EAXSTREAM_H_
+#define EAXSTREAM_H_
+
+#include <EAXT.h>
+
+/** Segmented EAX encryption of a stream
+ *
+ * The plaintext is split into segments of a fixed length (the last one
+ * may be shorter, and is empty if the plaintext is), each sealed as a
+ * separate EAX message with a 16-byte tag. Segments can thus be sealed
+ * and opened independently of each other, in parallel, or just for the
+ * part of the stream that is needed.
+ *
+ * Following the STREAM construction, the nonce of a segment is made of a
+ * per-stream random prefix, the segment index and a flag that is set for
+ * the last segment only, so that segments can't be reordered, and the
+ * stream can't be truncated, without the change being detected.
+ *
+ * Sealed stream format (integers are big-endian):
+ *
+ *     Header (kHeaderLength bytes):
+ *         4 bytes      magic, "EAXS"
+ *         1 byte       format version (kVersion)
+ *         3 bytes      zero
+ *         4 bytes      segment length (plaintext bytes per segment)
+ *         8 bytes      nonce prefix
+ *     For each segment:
+ *         N bytes      ciphertext (N = segment length, except for the
+ *                      last segment)
+ *         16 bytes     tag
+ *
+ * The nonce of segment i is the nonce prefix, followed by i (4 bytes) and
+ * the last-segment flag (1 byte, 0 or 1). The header is the EAX header
+ * data of every segment; its processing is shared between all segments
+ * with EAXT::SaveHeader() and EAXT::StartSaved().
+ *
+ * EAXImpl is the EAX class (EAX or an EAXT<> backend) used for sealing
+ * and opening. Once initialized with InitSeal() or InitOpen(), the methods
+ * of an EAXStream object do not change it, so it can be shared by several
+ * threads; each thread must then use its own EAX object, with the same key
+ * as the one given to InitSeal() or InitOpen().
+ */
+template <class EAXImpl>
+class EAXStream
+{
+public:
+    enum {
+        kHeaderLength = 20,
+        kTagLength = 16,
+        kNoncePrefixLength = 8,
+        kNonceLength = kNoncePrefixLength + 5,
+        kVersion = 1
+    };
+
+    static const uint32_t kMaxSegmentLength = 1 << 24;
+
+    EAXStream(void);
+
+    /** Prepare for sealing a stream
+     *
+     * 'eax' must have the key set. The nonce prefix must be random, and
+     * must never be used twice with the same key. Returns false if the
+     * segment length is invalid, or if the plaintext would take more
+     * segments than 32-bit segment indexes can tell apart (which would
+     * reuse nonces).
+     */
+    bool InitSeal(EAXImpl & eax, const uint8_t *noncePrefix, uint32_t segmentLength, uint64_t plaintextLength);
+
+    /** Prepare for opening a sealed stream
+     *
+     * 'eax' must have the key set. Returns false if the header is invalid,
+     * or if the length of the sealed stream does not match a valid
+     * sequence of segments.
+     */
+    bool InitOpen(EAXImpl & eax, const uint8_t *header, uint64_t sealedLength);
+
+    /** Copy the stream header (kHeaderLength bytes) to 'header'.
+     */
+    void GetHeader(uint8_t *header) const { memcpy(header, mHeader, kHeaderLength); }
+
+    uint32_t GetSegmentLength(void) const { return mSegmentLength; }
+    uint64_t GetSegmentCount(void) const { return mSegmentCount; }
+    uint64_t GetPlaintextLength(void) const { return mPlaintextLength; }
+    uint64_t GetSealedLength(void) const;
+
+    /** Returns the plaintext length of a segment.
+     */
+    size_t GetSegmentPlaintextLength(uint64_t index) const;
+
+    /** Returns the offset of a segment in the sealed stream (header included).
+     */
+    uint64_t GetSegmentOffset(uint64_t index) const;
+
+    /** Returns the index of the segment that holds the given plaintext offset.
+     */
+    uint64_t GetSegmentIndex(uint64_t plaintextOffset) const;
+
+    /** Seal one segment
+     *
+     * Read the plaintext of segment 'index' from the whole plaintext
+     * 'plaintext', and write the ciphertext and tag at its place in the
+     * whole sealed stream 'sealed'. The two may not overlap.
+     */
+    void SealSegment(EAXImpl & eax, uint64_t index, const uint8_t *plaintext, uint8_t *sealed) const;
+
+    /** Open one segment
+     *
+     * Decrypt segment 'index' of the whole sealed stream 'sealed' into
+     * 'out' (GetSegmentPlaintextLength(index) bytes) and verify its tag.
+     * If the tag is invalid, 'out' is cleared and false is returned.
+     */
+    bool OpenSegment(EAXImpl & eax, uint64_t index, const uint8_t *sealed, uint8_t *out) const;
+
+    /** Open part of the stream
+     *
+     * Decrypt 'len' bytes of plaintext starting at 'offset' into 'out', by
+     * opening only the segments that hold them. 'segmentBuf' must have room
+     * for a segment (GetSegmentLength() bytes). If a tag is invalid, or the
+     * range extends past the end of the stream, 'out' is cleared and false
+     * is returned.
+     */
+    bool OpenRange(EAXImpl & eax, const uint8_t *sealed, uint64_t offset, size_t len, uint8_t *out,
+                   uint8_t *segmentBuf) const;
+
+private:
+    uint8_t mHeader[kHeaderLength];
+    EAXSaved mSaved;
+    uint32_t mSegmentLength;
+    uint64_t mSegmentCount;
+    uint64_t mPlaintextLength;
+
+    void make_nonce(uint64_t index, uint8_t *nonce) const;
+    static void store_be32(uint8_t *dst, uint32_t val);
+    static uint32_t load_be32(const uint8_t *src);
+};
+
+template <class EAXImpl>
+EAXStream<EAXImpl>::EAXStream(void)
+{
+    memset(mHeader, 0, sizeof mHeader);
+    mSegmentLength = 0;
+    mSegmentCount = 0;
+    mPlaintextLength = 0;
+}
+
+template <class EAXImpl>
+bool
+EAXStream<EAXImpl>::InitSeal(EAXImpl & eax, const uint8_t *noncePrefix, uint32_t segmentLength, uint64_t plaintextLength)
+{
+    uint64_t segmentCount;
+
+    if (segmentLength == 0 || segmentLength > kMaxSegmentLength) {
+        return false;
+    }
+
+    /*
+     * Segment indexes are 32-bit.
+     */
+    segmentCount = (plaintextLength == 0) ? 1 : (plaintextLength - 1) / segmentLength + 1;
+    if (segmentCount > UINT32_MAX) {
+        return false;
+    }
+
+    memcpy(mHeader, "EAXS", 4);
+    mHeader[4] = kVersion;
+    mHeader[5] = mHeader[6] = mHeader[7] = 0;
+    store_be32(mHeader + 8, segmentLength);
+    memcpy(mHeader + 12, noncePrefix, kNoncePrefixLength);
+
+    mSegmentLength = segmentLength;
+    mPlaintextLength = plaintextLength;
+    mSegmentCount = segmentCount;
+
+    eax.SaveHeader(mHeader, kHeaderLength, &mSaved);
+    return true;
+}
+
+template <class EAXImpl>
+bool
+EAXStream<EAXImpl>::InitOpen(EAXImpl & eax, const uint8_t *header, uint64_t sealedLength)
+{
+    uint64_t bodyLength, sealedSegment, nFull, rem;
+    uint32_t segmentLength;
+
+    if (sealedLength < kHeaderLength + kTagLength || memcmp(header, "EAXS", 4) != 0 || header[4] != kVersion ||
+        (header[5] | header[6] | header[7]) != 0) {
+        return false;
+    }
+    segmentLength = load_be32(header + 8);
+    if (segmentLength == 0 || segmentLength > kMaxSegmentLength) {
+        return false;
+    }
+
+    /*
+     * All segments but the last are full; the last one has at least the
+     * tag, and is full if its length is a multiple of the sealed segment
+     * length.
+     */
+    bodyLength = sealedLength - kHeaderLength;
+    sealedSegment = (uint64_t)segmentLength + kTagLength;
+    nFull = bodyLength / sealedSegment;
+    rem = bodyLength % sealedSegment;
+    if (rem != 0 && rem < kTagLength) {
+        return false;
+    }
+    mSegmentCount = nFull + (rem != 0);
+    if (mSegmentCount > UINT32_MAX) {
+        return false;
+    }
+    mSegmentLength = segmentLength;
+    mPlaintextLength = nFull * segmentLength + ((rem != 0) ? rem - kTagLength : 0);
+
+    memcpy(mHeader, header, kHeaderLength);
+    eax.SaveHeader(mHeader, kHeaderLength, &mSaved);
+    return true;
+}
+
+template <class EAXImpl>
+uint64_t
+EAXStream<EAXImpl>::GetSealedLength(void) const
+{
+    return kHeaderLength + mPlaintextLength + mSegmentCount * kTagLength;
+}
+
+template <class EAXImpl>
+size_t
+EAXStream<EAXImpl>::GetSegmentPlaintextLength(uint64_t index) const
+{
+    assert(index < mSegmentCount);
+
+    return (index + 1 < mSegmentCount) ? mSegmentLength : (size_t)(mPlaintextLength - index * mSegmentLength);
+}
+
+template <class EAXImpl>
+uint64_t
+EAXStream<EAXImpl>::GetSegmentOffset(uint64_t index) const
+{
+    return kHeaderLength + index * ((uint64_t)mSegmentLength + kTagLength);
+}
+
+template <class EAXImpl>
+uint64_t
+EAXStream<EAXImpl>::GetSegmentIndex(uint64_t plaintextOffset) const
+{
+    return plaintextOffset / mSegmentLength;
+}
+
+template <class EAXImpl>
+void
+EAXStream<EAXImpl>::SealSegment(EAXImpl & eax, uint64_t index, const uint8_t *plaintext, uint8_t *sealed) const
+{
+    uint8_t nonce[kNonceLength];
+    const size_t len = GetSegmentPlaintextLength(index);
+    uint8_t *out = sealed + GetSegmentOffset(index);
+
+    make_nonce(index, nonce);
+    eax.StartSaved(nonce, sizeof nonce, &mSaved);
+    eax.Encrypt(plaintext + index * mSegmentLength, len, out);
+    eax.GetTag(out + len, kTagLength);
+}
+
+template <class EAXImpl>
+bool
+EAXStream<EAXImpl>::OpenSegment(EAXImpl & eax, uint64_t index, const uint8_t *sealed, uint8_t *out) const
+{
+    uint8_t nonce[kNonceLength];
+    const size_t len = GetSegmentPlaintextLength(index);
+    const uint8_t *in = sealed + GetSegmentOffset(index);
+
+    make_nonce(index, nonce);
+    eax.StartSaved(nonce, sizeof nonce, &mSaved);
+    eax.Decrypt(in, len, out);
+    if (!eax.CheckTag(in + len, kTagLength)) {
+        memset(out, 0, len);
+        return false;
+    }
+    return true;
+}
+
+template <class EAXImpl>
+bool
+EAXStream<EAXImpl>::OpenRange(EAXImpl & eax, const uint8_t *sealed, uint64_t offset, size_t len, uint8_t *out,
+                              uint8_t *segmentBuf) const
+{
+    uint64_t index;
+    size_t done = 0;
+
+    if (offset > mPlaintextLength || len > mPlaintextLength - offset) {
+        memset(out, 0, len);
+        return false;
+    }
+
+    /*
+     * Whole segments are opened in place in 'out'; segments that are only
+     * partly in the range go through 'segmentBuf'.
+     */
+    for (index = GetSegmentIndex(offset); done < len; index++) {
+        const uint64_t segStart = index * mSegmentLength;
+        const size_t segLen = GetSegmentPlaintextLength(index);
+        const size_t skip = (size_t)(offset + done - segStart);
+        size_t n = segLen - skip;
+
+        if (n > len - done) {
+            n = len - done;
+        }
+        if (skip == 0 && n == segLen) {
+            if (!OpenSegment(eax, index, sealed, out + done)) {
+                break;
+            }
+        } else {
+            bool valid = OpenSegment(eax, index, sealed, segmentBuf);
+            memcpy(out + done, segmentBuf + skip, n);
+            memset(segmentBuf, 0, segLen);
+            if (!valid) {
+                break;
+            }
+        }
+        done += n;
+    }
+
+    if (done < len) {
+        memset(out, 0, len);
+        return false;
+    }
+    return true;
+}
+
+template <class EAXImpl>
+void
+EAXStream<EAXImpl>::make_nonce(uint64_t index, uint8_t *nonce) const
+{
+    memcpy(nonce, mHeader + 12, kNoncePrefixLength);
+    store_be32(nonce + kNoncePrefixLength, (uint32_t)index);
+    nonce[kNonceLength - 1] = (index + 1 == mSegmentCount) ? 1 : 0;
+}
+
+template <class EAXImpl>
+inline void
+EAXStream<EAXImpl>::store_be32(uint8_t *dst, uint32_t val)
+{
+    dst[0] = (uint8_t)(val >> 24);
+    dst[1] = (uint8_t)(val >> 16);
+    dst[2] = (uint8_t)(val >> 8);
+    dst[3] = (uint8_t)val;
+}
+
+template <class EAXImpl>
+inline uint32_t
+EAXStream<EAXImpl>::load_be32(const uint8_t *src)
+{
+    return ((uint32_t)src[0] << 24) | ((uint32_t)src[1] << 16) | ((uint32_t)src[2] << 8) | (uint32_t)src[3];
+}
+
+#endif // EAXSTREAM_H_
@@ -0,0 +1,362 @@
+/*
+ *    Copyright (c) 2021 Jay Logue
+ *    All rights reserved.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/**
+ *    @file
+ *      A command-line tool for sealing and opening files in the segmented
+ *      EAX stream format (see EAXStream.h), using all processors.
+ *
+ *      Build with 'make eax-stream' in this directory, or compile as follows:
+ *
+ *         c++ -O3 -maes -pthread -o eax-stream -I. EAX.cpp EAX-AESNI.cpp EAX-VAES.cpp EAX-Soft.cpp EAXFactory.cpp EAXTest.cpp EAXStreamTool.cpp
+ *
+ *      Usage:
+ *
+ *         eax-stream seal --key <hex> [--segment-size <bytes>] [--threads <n>] <input> <output>
+ *         eax-stream open --key <hex> [--threads <n>] [--offset <bytes> --length <bytes>] <input> <output>
+ *
+ *      The key is 16 or 32 bytes (AES-128 or AES-256), given in hex. With
+ *      --offset and --length, only the given range of the plaintext is
+ *      decrypted, and only the segments that hold it are read.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include <atomic>
+#include <thread>
+
+#include <EAXFactory.h>
+#include <EAXStream.h>
+
+namespace {
+
+typedef EAXStream<EAX> Stream;
+
+enum
+{
+    kDefaultSegmentLength   = 65536,
+    kMaxThreads             = 64
+};
+
+struct Options
+{
+    bool Seal;
+    uint8_t Key[32];
+    size_t KeyLen;
+    uint32_t SegmentLength;
+    unsigned ThreadCount;
+    bool Range;
+    uint64_t Offset;
+    uint64_t Length;
+    const char *Input;
+    const char *Output;
+};
+
+/*
+ * Work shared by the threads: segments are claimed in order from a
+ * common counter, and any failure stops the other threads.
+ */
+struct Job
+{
+    const Options *Opts;
+    const Stream *Strm;
+    const uint8_t *In;
+    uint8_t *Out;
+    uint64_t FirstSegment;
+    uint64_t EndSegment;
+    std::atomic<uint64_t> NextSegment;
+    std::atomic<bool> Failed;
+};
+
+void Usage(void)
+{
+    fprintf(stderr,
+            "Usage: eax-stream seal --key <hex> [--segment-size <bytes>] [--threads <n>] <input> <output>\n"
+            "       eax-stream open --key <hex> [--threads <n>] [--offset <bytes> --length <bytes>] <input> <output>\n");
+    exit(EXIT_FAILURE);
+}
+
+void Fail(const char *msg, const char *arg)
+{
+    fprintf(stderr, "eax-stream: %s%s%s\n", msg, (arg != NULL) ? ": " : "", (arg != NULL) ? arg : "");
+    exit(EXIT_FAILURE);
+}
+
+bool ParseHex(const char *hex, uint8_t *out, size_t maxLen, size_t *outLen)
+{
+    size_t len = strlen(hex);
+
+    if (len % 2 != 0 || len / 2 > maxLen) {
+        return false;
+    }
+    for (size_t i = 0; i < len / 2; i++) {
+        unsigned v;
+        if (sscanf(hex + 2 * i, "%2x", &v) != 1) {
+            return false;
+        }
+        out[i] = (uint8_t)v;
+    }
+    *outLen = len / 2;
+    return true;
+}
+
+void ParseArgs(int argc, char *argv[], Options & opts)
+{
+    const char *positional[2];
+    int nPositional = 0;
+
+    memset(&opts, 0, sizeof(opts));
+    opts.SegmentLength = kDefaultSegmentLength;
+
+    if (argc < 2) {
+        Usage();
+    }
+    if (strcmp(argv[1], "seal") == 0) {
+        opts.Seal = true;
+    } else if (strcmp(argv[1], "open") != 0) {
+        Usage();
+    }
+
+    for (int i = 2; i < argc; i++) {
+        if (strcmp(argv[i], "--key") == 0 && i + 1 < argc) {
+            if (!ParseHex(argv[++i], opts.Key, sizeof(opts.Key), &opts.KeyLen) || (opts.KeyLen != 16 && opts.KeyLen != 32)) {
+                Fail("key must be 16 or 32 bytes in hex", NULL);
+            }
+        } else if (strcmp(argv[i], "--segment-size") == 0 && i + 1 < argc) {
+            unsigned long v = strtoul(argv[++i], NULL, 0);
+            if (v == 0 || v > Stream::kMaxSegmentLength) {
+                Fail("invalid segment size", argv[i]);
+            }
+            opts.SegmentLength = (uint32_t)v;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            opts.ThreadCount = (unsigned)strtoul(argv[++i], NULL, 0);
+        } else if (strcmp(argv[i], "--offset") == 0 && i + 1 < argc) {
+            opts.Offset = strtoull(argv[++i], NULL, 0);
+            opts.Range = true;
+        } else if (strcmp(argv[i], "--length") == 0 && i + 1 < argc) {
+            opts.Length = strtoull(argv[++i], NULL, 0);
+            opts.Range = true;
+        } else if (argv[i][0] != '-' && nPositional < 2) {
+            positional[nPositional++] = argv[i];
+        } else {
+            Usage();
+        }
+    }
+
+    if (opts.KeyLen == 0 || nPositional != 2 || (opts.Seal && opts.Range)) {
+        Usage();
+    }
+    opts.Input = positional[0];
+    opts.Output = positional[1];
+
+    if (opts.ThreadCount == 0) {
+        opts.ThreadCount = std::thread::hardware_concurrency();
+    }
+    if (opts.ThreadCount == 0) {
+        opts.ThreadCount = 1;
+    } else if (opts.ThreadCount > kMaxThreads) {
+        opts.ThreadCount = kMaxThreads;
+    }
+}
+
+/*
+ * Map a file for reading. Empty files are given a valid (unused) address.
+ */
+const uint8_t * MapInput(const char *path, uint64_t & len)
+{
+    static const uint8_t sEmpty[1] = { 0 };
+    struct stat st;
+    void *p;
+    int fd;
+
+    fd = open(path, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        Fail(strerror(errno), path);
+    }
+    len = (uint64_t)st.st_size;
+    if (len == 0) {
+        close(fd);
+        return sEmpty;
+    }
+    p = mmap(NULL, len, PROT_READ, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        Fail(strerror(errno), path);
+    }
+    close(fd);
+    return (const uint8_t *)p;
+}
+
+/*
+ * Create a file of the given length, and map it for writing.
+ */
+uint8_t * MapOutput(const char *path, uint64_t len)
+{
+    static uint8_t sEmpty[1];
+    void *p;
+    int fd;
+
+    fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0 || ftruncate(fd, (off_t)len) != 0) {
+        Fail(strerror(errno), path);
+    }
+    if (len == 0) {
+        close(fd);
+        return sEmpty;
+    }
+    p = mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        Fail(strerror(errno), path);
+    }
+    close(fd);
+    return (uint8_t *)p;
+}
+
+void Worker(Job *job)
+{
+    const Options & opts = *job->Opts;
+    const Stream & strm = *job->Strm;
+    EAX *eax = CreateEAX(opts.KeyLen);
+    uint8_t *segmentBuf = NULL;
+    uint64_t index;
+
+    eax->SetKey(opts.Key, opts.KeyLen);
+    if (opts.Range) {
+        segmentBuf = new uint8_t[strm.GetSegmentLength()];
+    }
+
+    while (!job->Failed.load(std::memory_order_relaxed)) {
+        index = job->NextSegment.fetch_add(1, std::memory_order_relaxed);
+        if (index >= job->EndSegment) {
+            break;
+        }
+
+        if (opts.Seal) {
+            strm.SealSegment(*eax, index, job->In, job->Out);
+        } else if (!opts.Range) {
+            if (!strm.OpenSegment(*eax, index, job->In, job->Out + index * strm.GetSegmentLength())) {
+                job->Failed = true;
+            }
+        } else {
+            /*
+             * Each thread opens the part of the range that is in one
+             * segment.
+             */
+            uint64_t start = index * strm.GetSegmentLength(), end = start + strm.GetSegmentLength();
+
+            if (start < opts.Offset) {
+                start = opts.Offset;
+            }
+            if (end > opts.Offset + opts.Length) {
+                end = opts.Offset + opts.Length;
+            }
+            if (!strm.OpenRange(*eax, job->In, start, (size_t)(end - start), job->Out + (start - opts.Offset), segmentBuf)) {
+                job->Failed = true;
+            }
+        }
+    }
+
+    delete[] segmentBuf;
+    delete eax;
+}
+
+} // unnamed namespace
+
+int main(int argc, char *argv[])
+{
+    Options opts;
+    Stream strm;
+    Job job;
+    std::thread threads[kMaxThreads];
+    const uint8_t *in;
+    uint8_t *out;
+    uint64_t inLen, outLen;
+    EAX *eax;
+
+    ParseArgs(argc, argv, opts);
+
+    eax = CreateEAX(opts.KeyLen);
+    eax->SetKey(opts.Key, opts.KeyLen);
+    in = MapInput(opts.Input, inLen);
+
+    if (opts.Seal) {
+        uint8_t noncePrefix[Stream::kNoncePrefixLength];
+        FILE *rnd = fopen("/dev/urandom", "rb");
+
+        if (rnd == NULL || fread(noncePrefix, 1, sizeof(noncePrefix), rnd) != sizeof(noncePrefix)) {
+            Fail("unable to read /dev/urandom", NULL);
+        }
+        fclose(rnd);
+
+        if (!strm.InitSeal(*eax, noncePrefix, opts.SegmentLength, inLen)) {
+            Fail("input too large for the segment size", opts.Input);
+        }
+        outLen = strm.GetSealedLength();
+        out = MapOutput(opts.Output, outLen);
+        strm.GetHeader(out);
+        job.FirstSegment = 0;
+        job.EndSegment = strm.GetSegmentCount();
+    } else {
+        if (inLen < Stream::kHeaderLength || !strm.InitOpen(*eax, in, inLen)) {
+            Fail("not a valid sealed stream", opts.Input);
+        }
+        if (opts.Range) {
+            if (opts.Offset > strm.GetPlaintextLength() || opts.Length > strm.GetPlaintextLength() - opts.Offset) {
+                Fail("range extends past the end of the stream", NULL);
+            }
+            outLen = opts.Length;
+            job.FirstSegment = strm.GetSegmentIndex(opts.Offset);
+            job.EndSegment = (opts.Length > 0) ? strm.GetSegmentIndex(opts.Offset + opts.Length - 1) + 1 : job.FirstSegment;
+        } else {
+            outLen = strm.GetPlaintextLength();
+            job.FirstSegment = 0;
+            job.EndSegment = strm.GetSegmentCount();
+        }
+        out = MapOutput(opts.Output, outLen);
+    }
+    delete eax;
+
+    job.Opts = &opts;
+    job.Strm = &strm;
+    job.In = in;
+    job.Out = out;
+    job.NextSegment = job.FirstSegment;
+    job.Failed = false;
+
+    for (unsigned i = 0; i < opts.ThreadCount; i++) {
+        threads[i] = std::thread(Worker, &job);
+    }
+    for (unsigned i = 0; i < opts.ThreadCount; i++) {
+        threads[i].join();
+    }
+
+    if (outLen > 0) {
+        munmap(out, outLen);
+    }
+    if (job.Failed) {
+        unlink(opts.Output);
+        Fail("authentication failed", opts.Input);
+    }
+    return 0;
+}
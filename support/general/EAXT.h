@@ -0,0 +1,3192 @@
+/*
+ *    Copyright (c) 2021 Jay Logue
+ *    Copyright (c) 2013-2017 Nest Labs, Inc.
+ *    All rights reserved.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/**
+ *    @file
+ *      A template implementation of the EAX authenticated encryption mode,
+ *      parameterized by the underlying AES block cipher backend.
+ *
+ */
+
+#ifndef EAXT_H_
+#define EAXT_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+
+#include <type_traits>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/* CONFIGURATION OPTIONS
+ *
+ * The CONFIG_EAX_NO_PAD_CACHE, CONFIG_EAX_NO_CHUNK and
+ * CONFIG_EAX_KEYSTREAM_CACHE_BLOCKS options give the defaults of the
+ * EAXPolicy parameters (see below), i.e. the configuration of EAX objects
+ * that do not select a policy of their own, such as the EAX class.
+ */
+
+/** CONFIG_EAX_NO_PAD_CACHE
+ * 
+ * If non-zero, then the internal "L1" value, and the derived "L2" and "L4"
+ * pad values, are not cached; this saves 48 bytes of RAM in the EAX class,
+ * but requires three extra AES block invocations per message.
+ */
+#ifndef CONFIG_EAX_NO_PAD_CACHE
+#define CONFIG_EAX_NO_PAD_CACHE 0
+#endif
+
+/** CONFIG_EAX_NO_CHUNK
+ * 
+ * If non-zero, then the EAX class expects non-chunked input of header
+ * and payload: only a single InjectHeader() call, and a single
+ * Encrypt() or Decrypt() call, may be used for a given message. This
+ * constrains usage, but saves 32 bytes of RAM in the EAX class. There
+ * is no CPU cost penalty.
+ */
+#ifndef CONFIG_EAX_NO_CHUNK
+#define CONFIG_EAX_NO_CHUNK 0
+#endif
+
+/** CONFIG_EAX_CTR_BATCH_BLOCKS
+ * 
+ * Maximum number of CTR stream blocks that are generated with a single
+ * call to AESEncryptBlocks() during payload processing. Larger values
+ * give pipelined AES implementations more independent blocks to work on,
+ * at the cost of 16 bytes of stack per block.
+ */
+#ifndef CONFIG_EAX_CTR_BATCH_BLOCKS
+#define CONFIG_EAX_CTR_BATCH_BLOCKS 8
+#endif
+
+/** CONFIG_EAX_KEYSTREAM_CACHE_BLOCKS
+ * 
+ * If non-zero, the EAX class holds a cache of up to that many blocks of
+ * CTR stream, which can be filled ahead of time with PrefillKeystream()
+ * once a message has been started; payload processing then consumes the
+ * cached stream before encrypting new counter blocks. This costs 16 bytes
+ * of RAM per block in the EAX class. The default (0) disables the cache.
+ */
+#ifndef CONFIG_EAX_KEYSTREAM_CACHE_BLOCKS
+#define CONFIG_EAX_KEYSTREAM_CACHE_BLOCKS 0
+#endif
+
+/** CONFIG_EAX_STATS
+ * 
+ * If non-zero, the EAX class keeps instrumentation counters: block
+ * encryptions by processing phase, bytes processed, reuse of saved
+ * headers, tag check failures and, given a clock, the time spent in the
+ * AES backend (see EAXStats). This costs about 110 bytes of RAM in the
+ * EAX class, and a few additions per backend call. The default (0)
+ * disables the counters, at no cost.
+ */
+#ifndef CONFIG_EAX_STATS
+#define CONFIG_EAX_STATS 0
+#endif
+
+/** CONFIG_EAX_ZEROIZE_PER_BLOCK
+ * 
+ * If non-zero, the block cipher functions clear their temporaries after
+ * every block, as well as at the end of each message. By default (0),
+ * temporaries are cleared once per message, or once per multi-block call
+ * (see "Clearing of secret data" below).
+ */
+#ifndef CONFIG_EAX_ZEROIZE_PER_BLOCK
+#define CONFIG_EAX_ZEROIZE_PER_BLOCK 0
+#endif
+
+/** CONFIG_EAX_WIPE_STACK_BYTES
+ * 
+ * Size of the stack area that is cleared at the end of each message, below
+ * the frame of the EAX method, to clear the temporaries left there by the
+ * block cipher calls of the message. 0 disables the stack clearing.
+ * 
+ * The clearing is a best-effort measure (see EAXWipeStack()): the default
+ * of 512 bytes is an estimate of the deepest call chain from an EAX method
+ * to the block cipher, not a measured bound. Platforms that depend on it
+ * should check the stack usage of their backend (e.g. with -fstack-usage)
+ * and set this option accordingly.
+ */
+#ifndef CONFIG_EAX_WIPE_STACK_BYTES
+#define CONFIG_EAX_WIPE_STACK_BYTES 512
+#endif
+
+/*
+ * Clearing of secret data
+ * =======================
+ * 
+ * Keys, pads, saved states and buffers of the EAX objects, and the
+ * temporaries of their methods, are cleared with EAXSecureWipe(), which the
+ * compiler cannot remove as a dead store:
+ * 
+ *  - Key material (the key schedule and the OMAC pads) is cleared by
+ *    Reset() and by the destructor.
+ * 
+ *  - Temporaries of the EAX methods (CTR stream batches, MAC and pad
+ *    blocks, the computed tag in CheckTag()) are cleared on every return
+ *    path of the method that declares them.
+ * 
+ *  - Temporaries of the block cipher (the cipher state in the AES
+ *    functions, the parameter block of the SoftDevice, the ECB descriptors)
+ *    are cleared once per message, when the tag is computed (or the
+ *    header saved, or the nonce precomputed): the backend clears the ones
+ *    it keeps in the object with AESWipeTemporaries(), and the stack area
+ *    below the EAX method is swept with EAXWipeStack(). Multi-block
+ *    calls clear their own temporaries once per call.
+ * 
+ * With CONFIG_EAX_ZEROIZE_PER_BLOCK, the block cipher temporaries are also
+ * cleared after each block, with EAXWipeBlockTemp(). Values that the
+ * compiler keeps in registers are not covered.
+ * 
+ * Only the clearing of named buffers is guaranteed. The stack sweep is
+ * best-effort: it relies on the stack layout chosen by the compiler, and
+ * does not reach temporaries deeper than CONFIG_EAX_WIPE_STACK_BYTES, nor
+ * those spilled by an interrupt or signal handler.
+ */
+
+/** Clear a buffer of secret data
+ * 
+ * Unlike a plain memset(), the clearing is not removed by the compiler
+ * when the buffer is not read again.
+ */
+inline void EAXSecureWipe(void * buf, size_t len)
+{
+#if defined(__GNUC__)
+    memset(buf, 0, len);
+    __asm__ __volatile__("" : : "r"(buf) : "memory");
+#else
+    volatile uint8_t *p = (volatile uint8_t *)buf;
+
+    while (len-- > 0) {
+        *p++ = 0;
+    }
+#endif
+}
+
+/** Clear a per-block temporary of a block cipher function
+ * 
+ * Does nothing, unless CONFIG_EAX_ZEROIZE_PER_BLOCK is set; the temporary
+ * is then cleared by EAXWipeStack() at the end of the message, or by the
+ * multi-block function at the end of the call.
+ */
+inline void EAXWipeBlockTemp(void * buf, size_t len)
+{
+#if CONFIG_EAX_ZEROIZE_PER_BLOCK
+    EAXSecureWipe(buf, len);
+#else
+    (void)buf;
+    (void)len;
+#endif
+}
+
+/** Clear the stack area below the caller
+ * 
+ * Clears CONFIG_EAX_WIPE_STACK_BYTES bytes of stack below the frame of the
+ * caller, where the frames of the functions it called before lie.
+ * 
+ * This is best-effort, not a guarantee: the language does not define where
+ * the area is placed, so the sweep may miss part of those frames (e.g. if
+ * the compiler reorders or pads the frame, or if the calls went deeper
+ * than CONFIG_EAX_WIPE_STACK_BYTES).
+ */
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+inline void EAXWipeStack(void)
+{
+#if CONFIG_EAX_WIPE_STACK_BYTES > 0
+    uint8_t area[CONFIG_EAX_WIPE_STACK_BYTES];
+
+    EAXSecureWipe(area, sizeof area);
+#endif
+}
+
+/** Compile-time options of an EAX engine
+ * 
+ * EAXPolicy is the second template parameter of EAXT. It selects the
+ * features of an EAX object, and with them the state that the object
+ * holds, so that objects with different trade-offs can be used in the
+ * same program (e.g. small per-session contexts alongside a chunked one
+ * for bulk data):
+ * 
+ *  - PadCache: cache the "L1" value, and the derived "L2" and "L4" pad
+ *    values (48 bytes), rather than compute them with three extra AES
+ *    block invocations per message.
+ * 
+ *  - Chunk: accept the header and payload in several chunks (33 bytes).
+ *    If false, only a single InjectHeader() call, and a single Encrypt()
+ *    or Decrypt() call, may be used for a given message, and the
+ *    scatter-gather methods are not available. There is no CPU cost
+ *    penalty.
+ * 
+ *  - MaxTagLength: the longest tag accepted by GetTag(), CheckTag(),
+ *    Seal() and Open(), at most 16 bytes.
+ * 
+ *  - KeystreamCacheBlocks: size of the CTR stream cache filled by
+ *    PrefillKeystream(), in blocks (16 bytes each, plus 2 bytes); 0
+ *    disables the cache.
+ * 
+ *  - Stats: keep the instrumentation counters returned by GetStats()
+ *    (see EAXStats).
+ */
+template <bool PadCache = !CONFIG_EAX_NO_PAD_CACHE,
+          bool Chunk = !CONFIG_EAX_NO_CHUNK,
+          size_t MaxTagLength = 16,
+          size_t KeystreamCacheBlocks = CONFIG_EAX_KEYSTREAM_CACHE_BLOCKS,
+          bool Stats = CONFIG_EAX_STATS>
+struct EAXPolicy
+{
+    static const bool kPadCache = PadCache;
+    static const bool kChunk = Chunk;
+    static const size_t kMaxTagLength = MaxTagLength;
+    static const size_t kKeystreamCacheBlocks = KeystreamCacheBlocks;
+    static const bool kStats = Stats;
+};
+
+template <class Backend, class Policy = EAXPolicy<> > class EAXT;
+template <class Backend, size_t N> class EAXBatch;
+template <class Backend> class EAXParallel;
+
+/** Describes one segment of a scatter-gather input buffer
+ *
+ * See EAXT::InjectHeaderSegments(), EAXT::EncryptSegments() and
+ * EAXT::DecryptSegments().
+ */
+struct EAXSegment
+{
+    const uint8_t *data;
+    size_t len;
+};
+
+/** Describes one segment of a scatter-gather output (or in-place) buffer
+ */
+struct EAXOutSegment
+{
+    uint8_t *data;
+    size_t len;
+};
+
+/** Processing phases of a message, as counted in EAXStats
+ */
+enum EAXPhase
+{
+    kEAXPhaseKey = 0,       // SetKey()
+    kEAXPhaseNonce,         // Start() and its variants, PrecomputeNonce()
+    kEAXPhaseHeader,        // InjectHeader(), SaveHeader()
+    kEAXPhasePayload,       // Encrypt(), Decrypt(), PrefillKeystream()
+    kEAXPhaseFinish,        // GetTag(), CheckTag()
+    kEAXPhaseCount
+};
+
+/** Clock used to measure the time spent in the AES backend
+ * 
+ * Returns a free-running count in arbitrary units, e.g. CPU cycles (the
+ * DWT cycle counter on Cortex-M, rdtsc on x86). Only differences between
+ * two readings are used.
+ */
+typedef uint64_t (*EAXClock)(void);
+
+/** Instrumentation counters of an EAX object
+ * 
+ * See EAXT::GetStats(). The counts are cumulative since the object was
+ * created, or since the last call to ResetStats(). Seal(), Open() and
+ * OpenVerifyFirst() are counted phase by phase like the equivalent
+ * chunked calls, with the OMAC of the ciphertext in the payload phase.
+ * Work done by EAXBatch for its lanes is not counted.
+ */
+struct EAXStats
+{
+    uint64_t Messages;                  // messages started
+    uint64_t Blocks[kEAXPhaseCount];    // AES block encryptions, by phase
+    uint64_t BackendCalls;              // calls to the AES backend
+    uint64_t HeaderBytes;               // header bytes processed, including by SaveHeader()
+    uint64_t PayloadBytes;              // payload bytes encrypted or decrypted
+    uint64_t SavedHeaders;              // headers processed with SaveHeader()
+    uint64_t SavedHeaderHits;           // messages started with a saved header
+    uint64_t TagFailures;               // failed CheckTag(), Open() and OpenVerifyFirst() calls
+    uint64_t BackendTime;               // time spent in the AES backend, in units of the clock
+};
+
+/** Contains saved message header processing state
+ * 
+ * An instance of EAXSaved can be filled with intermediate processing results,
+ * so that several messages that use the same header and are encrypted or decrypted
+ * with the same key can share some of the computational cost.
+ * 
+ * See EAXT::SaveHeader() and EAXT::StartSaved() for further details, and
+ * EAXHeaderCache (EAXHeaderCache.h) for managing saved headers automatically.
+ */
+class EAXSaved
+{
+public:
+    EAXSaved(void);
+    ~EAXSaved(void);
+private:
+    enum {
+        kBlockLength = 16
+    };
+    uint8_t aad[kBlockLength];  // Saved OMAC^1(header)
+#if !CONFIG_EAX_NO_CHUNK
+    uint8_t om2[kBlockLength];  // Saved encryption of the OMAC^2 start block
+#endif
+    template <class Backend, class Policy> friend class EAXT;
+    static inline void ClearSecretData(void * buf, size_t len) { EAXSecureWipe(buf, len); }
+};
+
+inline EAXSaved::EAXSaved(void)
+{
+}
+
+inline EAXSaved::~EAXSaved(void)
+{
+    ClearSecretData(aad, sizeof aad);
+#if !CONFIG_EAX_NO_CHUNK
+    ClearSecretData(om2, sizeof om2);
+#endif
+}
+
+/** Contains precomputed nonce processing state
+ * 
+ * An instance of EAXNonceState holds the result of processing a nonce,
+ * computed ahead of time, so that a message using that nonce can be started
+ * without any block encryption on the critical path.
+ * 
+ * See EAXT::PrecomputeNonce() and EAXT::StartPrecomputed() for further
+ * details, and EAXNonceQueue (EAXNonceQueue.h) for precomputing the states
+ * of upcoming counter-based nonces.
+ */
+class EAXNonceState
+{
+public:
+    EAXNonceState(void);
+    ~EAXNonceState(void);
+private:
+    enum {
+        kBlockLength = 16
+    };
+    uint8_t om0[kBlockLength];  // Saved OMAC^0(nonce), also the initial counter
+    template <class Backend, class Policy> friend class EAXT;
+    static inline void ClearSecretData(void * buf, size_t len) { EAXSecureWipe(buf, len); }
+};
+
+inline EAXNonceState::EAXNonceState(void)
+{
+}
+
+inline EAXNonceState::~EAXNonceState(void)
+{
+    ClearSecretData(om0, sizeof om0);
+}
+
+/*
+ * Parts of the EAXT state that depend on the policy. Each part is a private
+ * base class of EAXT, specialized as an empty class when the corresponding
+ * feature is disabled, so that it takes no room in the object. The methods
+ * only move data; the ones of the empty specializations do nothing, and
+ * report that nothing is cached.
+ */
+template <bool PadCache>
+struct EAXPadCacheState
+{
+    enum {
+        kBlockLength = 16
+    };
+
+    uint8_t L1[kBlockLength];
+    uint8_t L2[kBlockLength];
+    uint8_t L4[kBlockLength];
+
+    void pads_clear(void)
+    {
+        ClearSecretData(L1, sizeof L1);
+        ClearSecretData(L2, sizeof L2);
+        ClearSecretData(L4, sizeof L4);
+    }
+    void pads_save(uint8_t *pads) const
+    {
+        memcpy(pads, L1, kBlockLength);
+        memcpy(pads + kBlockLength, L2, kBlockLength);
+        memcpy(pads + 2 * kBlockLength, L4, kBlockLength);
+    }
+    void pads_load(const uint8_t *pads)
+    {
+        memcpy(L1, pads, kBlockLength);
+        memcpy(L2, pads + kBlockLength, kBlockLength);
+        memcpy(L4, pads + 2 * kBlockLength, kBlockLength);
+    }
+    bool pads_get(bool partial, uint8_t *pad) const
+    {
+        memcpy(pad, partial ? L4 : L2, kBlockLength);
+        return true;
+    }
+    bool pads_get_l1(uint8_t *block) const
+    {
+        memcpy(block, L1, kBlockLength);
+        return true;
+    }
+    static inline void ClearSecretData(void * buf, size_t len) { EAXSecureWipe(buf, len); }
+};
+
+template <>
+struct EAXPadCacheState<false>
+{
+    void pads_clear(void) { }
+    void pads_save(uint8_t *pads) const { memset(pads, 0, 3 * 16); }
+    void pads_load(const uint8_t *pads) { (void)pads; }
+    bool pads_get(bool partial, uint8_t *pad) const { (void)partial; (void)pad; return false; }
+    bool pads_get_l1(uint8_t *block) const { (void)block; return false; }
+};
+
+template <bool Chunk>
+struct EAXChunkState
+{
+    enum {
+        kBlockLength = 16
+    };
+
+    uint8_t buf[kBlockLength];
+    uint8_t cbcmac[kBlockLength];
+    uint8_t ptr;
+
+    void chunk_clear(void)
+    {
+        ClearSecretData(buf, sizeof buf);
+        ClearSecretData(cbcmac, sizeof cbcmac);
+    }
+    static inline void ClearSecretData(void * buf, size_t len) { EAXSecureWipe(buf, len); }
+};
+
+template <>
+struct EAXChunkState<false>
+{
+    void chunk_clear(void) { }
+};
+
+template <size_t Blocks>
+struct EAXKeystreamCacheState
+{
+    enum {
+        kBlockLength = 16
+    };
+
+    uint8_t kscache[Blocks * kBlockLength];
+    uint8_t kspos;
+    uint8_t kscount;
+
+    EAXKeystreamCacheState(void)
+    {
+        static_assert(Blocks <= UINT8_MAX, "Keystream cache too large");
+        kspos = kscount = 0;
+    }
+
+    /*
+     * Drop and clear the cached CTR stream.
+     */
+    void ks_discard(void)
+    {
+        if (kscount > 0) {
+            ClearSecretData(kscache, (size_t)kscount * kBlockLength);
+            kspos = kscount = 0;
+        }
+    }
+
+    /*
+     * Number of cached stream blocks not used yet.
+     */
+    size_t ks_cached(void) const
+    {
+        return kscount - kspos;
+    }
+
+    /*
+     * Copy up to nBlocks cached stream blocks into ks[]; returns the
+     * number of blocks copied.
+     */
+    size_t ks_take(uint8_t *ks, size_t nBlocks)
+    {
+        size_t n;
+
+        n = kscount - kspos;
+        if (n > nBlocks) {
+            n = nBlocks;
+        }
+        memcpy(ks, kscache + kspos * kBlockLength, n * kBlockLength);
+        kspos += (uint8_t)n;
+        return n;
+    }
+
+    /*
+     * Make room at the end of the cache for up to maxBlocks new stream
+     * blocks, moving the unused blocks to the start of the cache and
+     * clearing the used ones. Returns the number of blocks that may be
+     * stored at *dst, to be confirmed with ks_commit().
+     */
+    size_t ks_reserve(size_t maxBlocks, uint8_t **dst)
+    {
+        size_t n;
+
+        if (kspos > 0) {
+            n = kscount - kspos;
+            memmove(kscache, kscache + kspos * kBlockLength, n * kBlockLength);
+            ClearSecretData(kscache + n * kBlockLength, (size_t)kspos * kBlockLength);
+            kscount = (uint8_t)n;
+            kspos = 0;
+        }
+        n = Blocks - kscount;
+        if (n > maxBlocks) {
+            n = maxBlocks;
+        }
+        *dst = kscache + kscount * kBlockLength;
+        return n;
+    }
+
+    void ks_commit(size_t nBlocks)
+    {
+        kscount += (uint8_t)nBlocks;
+    }
+
+    static inline void ClearSecretData(void * buf, size_t len) { EAXSecureWipe(buf, len); }
+};
+
+template <>
+struct EAXKeystreamCacheState<0>
+{
+    void ks_discard(void) { }
+    size_t ks_cached(void) const { return 0; }
+    size_t ks_take(uint8_t *ks, size_t nBlocks) { (void)ks; (void)nBlocks; return 0; }
+    size_t ks_reserve(size_t maxBlocks, uint8_t **dst) { (void)maxBlocks; *dst = NULL; return 0; }
+    void ks_commit(size_t nBlocks) { (void)nBlocks; }
+};
+
+template <bool Stats>
+struct EAXStatsState
+{
+    EAXStats stats;
+    EAXClock clock;
+    uint8_t phase;
+
+    EAXStatsState(void)
+    {
+        stats_reset();
+        clock = NULL;
+        phase = kEAXPhaseKey;
+    }
+
+    void stats_reset(void)
+    {
+        memset(&stats, 0, sizeof stats);
+    }
+
+    /*
+     * Set the phase that subsequent block encryptions are counted in.
+     */
+    void stats_phase(unsigned p)
+    {
+        phase = (uint8_t)p;
+    }
+
+    void stats_add(uint64_t EAXStats::*counter, uint64_t n)
+    {
+        stats.*counter += n;
+    }
+
+    /*
+     * Read the clock before a backend call, and account for the call
+     * after it.
+     */
+    uint64_t stats_time(void) const
+    {
+        return (clock != NULL) ? clock() : 0;
+    }
+
+    void stats_backend(size_t nBlocks, uint64_t start)
+    {
+        stats.Blocks[phase] += nBlocks;
+        stats.BackendCalls ++;
+        if (clock != NULL) {
+            stats.BackendTime += clock() - start;
+        }
+    }
+};
+
+template <>
+struct EAXStatsState<false>
+{
+    void stats_reset(void) { }
+    void stats_phase(unsigned p) { (void)p; }
+    void stats_add(uint64_t EAXStats::*counter, uint64_t n) { (void)counter; (void)n; }
+    uint64_t stats_time(void) const { return 0; }
+    void stats_backend(size_t nBlocks, uint64_t start) { (void)nBlocks; (void)start; }
+};
+
+/** Template implementation of EAX block cipher mode
+ * 
+ * EAXT implements the EAX block cipher mode on top of an AES block cipher
+ * backend that is supplied at compile time.  The backend is the class
+ * deriving from EAXT (the "curiously recurring template pattern"): e.g.
+ * 
+ *     class MyEAX final : public EAXT<MyEAX> { ... };
+ * 
+ * Because the backend is known at compile time, calls to the block cipher
+ * can be inlined into the OMAC and CTR processing loops, and the whole
+ * per-message path is specialized for the backend.
+ * 
+ * The backend class must provide the following methods, which may be
+ * non-public provided that EAXT<Backend> is declared a friend:
+ * 
+ *  - void AESReset(void)
+ *      Reset the block cipher and clear any secret data, including the key.
+ *      May be called at any time.
+ * 
+ *  - void AESSetKey(const uint8_t *key, size_t keyLen)
+ *      Set the encryption key. Must verify the key length and fail (assert)
+ *      if it is incorrect.
+ * 
+ *  - void AESEncryptBlock(uint8_t *data)
+ *      Encrypt the 16-byte block pointed at by data in place.
+ * 
+ * Optionally, the backend may also provide:
+ * 
+ *  - void AESEncryptBlocks(uint8_t *data, size_t nBlocks)
+ *      Encrypt nBlocks consecutive, independent 16-byte blocks in place.
+ *      If not provided, a default implementation calling AESEncryptBlock()
+ *      once per block is used.
+ * 
+ *  - static void AESEncryptLanes(Backend *const *lanes, uint8_t *const *blocks, size_t n)
+ *      Encrypt n independent 16-byte blocks in place, block i with the key
+ *      of lanes[i]. This is used by EAXBatch (see EAXBatch.h) to advance
+ *      several messages under different keys together. If not provided,
+ *      a default implementation calling AESEncryptBlock() on each lane is
+ *      used.
+ * 
+ *  - enum { kAESQueueDepth = N }, void AESSubmitBlock(uint8_t *data) and
+ *    void AESWaitBlocks(size_t maxPending)
+ *      Queue the 16-byte block pointed at by data for encryption in place,
+ *      and return before it is encrypted; wait until at most maxPending of
+ *      the submitted blocks are still in flight. Blocks complete in the
+ *      order they were submitted, and EAXT does not touch a block until it
+ *      is complete. With N >= 2, the payload is processed with the next
+ *      CTR stream block and the current OMAC block in flight together, and
+ *      the XOR work is done while they are being encrypted. EAXT calls the
+ *      other block methods only when no block is in flight. If not
+ *      provided, N is 0 and blocks are submitted with AESEncryptBlock().
+ * 
+ *  - bool AESModesSupported(void),
+ *    void AESCTR(const uint8_t *ctr, const uint8_t *in, uint8_t *out, size_t len)
+ *    and void AESCMAC(const uint8_t *first, const uint8_t *data, size_t len, uint8_t *mac)
+ *      Native CTR and CMAC modes of the block cipher, for implementations
+ *      with a high cost per call (e.g. a crypto accelerator). If
+ *      AESModesSupported() returns true, the one-shot OMAC computations
+ *      and payload passes use them: AESCTR() applies the CTR stream that
+ *      starts with counter block ctr to len bytes, and AESCMAC() computes
+ *      the CMAC of the 16-byte block first followed by len bytes of data.
+ *      Chunked processing still works block by block. If not provided,
+ *      AESModesSupported() returns false.
+ * 
+ *  - void AESWipeTemporaries(void)
+ *      Clear the temporaries that the block cipher keeps in the object
+ *      between calls (e.g. buffers shared with a peripheral), but not the
+ *      key. This is called once at the end of each message, with no block
+ *      in flight. If not provided, a default implementation that does
+ *      nothing is used.
+ * 
+ *  - struct AESKeySchedule (public), void AESSaveKey(AESKeySchedule *sched) const
+ *    and void AESLoadKey(const AESKeySchedule *sched)
+ *      Copy the expanded AES key out of, or into, the backend. These are
+ *      only needed for SaveKey() and LoadKey(), which are used by
+ *      EAXSessionTable (see EAXSessionTable.h) to switch keys without
+ *      re-expanding them. The EAX class does not provide them, so
+ *      SaveKey() and LoadKey() are not available through it.
+ * 
+ * The EAX class (see EAX.h) is the instantiation of this template whose
+ * backend methods are virtual, and is used where the block cipher
+ * implementation must be chosen at run time.
+ *
+ * The Policy parameter (see EAXPolicy) selects the optional features, and
+ * defaults to the configuration given by the CONFIG_EAX_* options. Each
+ * policy gets its own code, and state that is not needed by the policy
+ * takes no room in the object.
+ *
+ * API usage:
+ *
+ *  - Use SetKey() to set the AES key. This must be done first. 
+ *
+ *  - Call Start() to start processing a new message. This method must
+ *    follow a call to SetKey(). Nonce data is supplied as an optional
+ *    argument to this call.
+ *
+ *  - Process header data with one or several calls to InjectHeader().
+ *    This must follow a Start(), but must precede payload encryption
+ *    or decryption. If InjectHeader() is not called, a zero-length
+ *    header is assumed.
+ *
+ *  - Encrypt or decrypt the data, with one or several calls to
+ *    Encrypt() or Decrypt(). Calls for a given message must be all
+ *    encrypt or all decrypt. Encryption and decryption do not change
+ *    the length of the data; chunks of arbitrary lengths can be used
+ *    (even zero-length chunks).
+ *
+ *  - Unless chunking is disabled by the policy, header and payload data
+ *    held in several non-contiguous buffers can be processed with
+ *    InjectHeaderSegments(), EncryptSegments() and DecryptSegments(),
+ *    which take arrays of {pointer, length} segments.
+ *
+ *  - Finalize the computation of the authentication tag, and get it
+ *    (with GetTag()) or check it (with CheckTag()). Encryption will
+ *    typically use GetTag() (to obtain the tag value to send to the
+ *    recipient) while decryption more naturally involves calling
+ *    CheckTag() (to verify the tag value received from the sender).
+ * 
+ *  - Alternatively, Seal() and Open() process a whole message, held
+ *    in a single buffer with the tag following the payload, in one
+ *    call. OpenVerifyFirst() checks the tag before decrypting, so that
+ *    forged messages are rejected with less work.
+ *
+ *  - Call Reset() to reset the internal encryption/decryption state
+ *    and clear any secret data.  This may be called at any time.
+ *    After a call to Reset(), the object may be reused for a subsequent
+ *    encryption/decryption process by calling SetKey().
+ * 
+ *  - Destroying the object (via invocating of its distructor)
+ *    automatically resets the internal state and clears any secret data.
+ */
+template <class Backend, class Policy>
+class EAXT :
+    private EAXPadCacheState<Policy::kPadCache>,
+    private EAXChunkState<Policy::kChunk>,
+    private EAXKeystreamCacheState<Policy::kKeystreamCacheBlocks>,
+    private EAXStatsState<Policy::kStats>
+{
+public:
+    typedef Policy PolicyType;
+
+    enum {
+        kMinTagLength = 1,   // minimum tag length, in bytes
+        kMaxTagLength = Policy::kMaxTagLength,  // maximum tag length, in bytes
+        kKeyPadsLength = 48, // length of the pad blocks saved by SaveKey()
+        kExportStateLength = 68 // length of the state written by ExportState()
+    };
+
+    /** Reset object
+     * 
+     * Clear this object from all secret key and data.
+     * 
+     * After a call to Reset(), the object may be reused for a subsequent
+     * encryption/decryption process.
+     */
+    void Reset(void);
+
+    /** Set encryption key
+     * 
+     * Set the AES key. The key size depends on the chosen concrete class.
+     */
+    void SetKey(const uint8_t *key, size_t keyLen);
+
+    /** Save the expanded key
+     * 
+     * Copy the current key, in expanded form, into 'sched' (the backend's
+     * AES key schedule, of type Backend::AESKeySchedule) and 'pads' (the
+     * OMAC pad blocks, kKeyPadsLength bytes). The object must have a key
+     * set. The saved key can be loaded into any object of the same class
+     * with LoadKey().
+     * 
+     * The saved values are secret, and must be cleared by the caller when
+     * no longer needed.
+     */
+    template <class Schedule>
+    void SaveKey(Schedule *sched, uint8_t *pads) const;
+
+    /** Load an expanded key
+     * 
+     * Set the key from values saved with SaveKey(). This is equivalent to
+     * Reset() followed by SetKey(), but involves no key expansion and no
+     * block encryption: the expanded key is only copied. Any ongoing
+     * message processing is abandoned.
+     */
+    template <class Schedule>
+    void LoadKey(const Schedule *sched, const uint8_t *pads);
+
+    /** Process header data for reuse
+     * 
+     * Process header data and fill the provided 'sav' object with the
+     * result. That object can then be reused with StartSaved()
+     * to process messages that share the same header value (and
+     * use the same key).
+     */
+    void SaveHeader(const uint8_t *header, size_t headerLen, EAXSaved *sav);
+
+    /** Start encrypting/decrypting a message
+     * 
+     * Start encrypting/decrypting a new message processing, with the given
+     * nonce. A key must have been set with SetKey(). Start() may be called
+     * again at any time to process another message with the same key; any
+     * message processing in progress is abandoned.
+     * 
+     * Nonce length is arbitrary, but the same nonce value MUST
+     * NOT be reused with the same key for a different message.
+     */
+    void Start(const uint8_t *nonce, size_t nonceLen);
+
+    /** Start encrypting/decrypting a message using saved header data.
+     * 
+     * Start encrypting/decrypting a new message processing, with the given
+     * nonce and previously processed and saved header data (created via the
+     * SaveHeader() method).
+     * 
+     * The 'sav' object is not modified, and may be reused for other messages
+     * that use the same key and header.
+     */
+    void StartSaved(const uint8_t *nonce, size_t nonceLen, const EAXSaved *sav);
+
+    /** Process a nonce ahead of time
+     * 
+     * Process the given nonce and fill the provided 'ns' object with the
+     * result. That object can then be used with StartPrecomputed() to
+     * start a message with that nonce (and the same key) without any block
+     * encryption. The object must have a key set; any message processing in
+     * progress is not affected.
+     */
+    void PrecomputeNonce(const uint8_t *nonce, size_t nonceLen, EAXNonceState *ns);
+
+    /** Start encrypting/decrypting a message using a precomputed nonce.
+     * 
+     * Equivalent to Start() (or StartSaved(), if 'sav' is not NULL) with the
+     * nonce that was processed into 'ns' by PrecomputeNonce(). This takes
+     * constant time, and involves no block encryption.
+     */
+    void StartPrecomputed(const EAXNonceState *ns, const EAXSaved *sav = NULL);
+
+    /** Generate CTR stream for the current message ahead of time
+     * 
+     * Encrypt up to maxBlocks of the next counter blocks of the message in
+     * progress, and keep the result in the keystream cache, so that the
+     * corresponding payload bytes only have to be XORed and MACed when they
+     * arrive. This is meant to be called at idle time, between Start() (or
+     * one of its variants) and the Encrypt() or Decrypt() calls, possibly
+     * several times. Returns the number of blocks generated, which is zero
+     * once the cache is full.
+     * 
+     * Any cached stream that is left unused is discarded when the tag is
+     * computed or another message is started.
+     * 
+     * The size of the cache is given by the policy; if it is zero, this
+     * does nothing and returns zero.
+     */
+    size_t PrefillKeystream(size_t maxBlocks = Policy::kKeystreamCacheBlocks);
+
+    /** Process header data
+     *
+     * Process the given header data. The header data is not encrypted,
+     * but participates to the authentication tag. Header processing must
+     * occur after the call to Start(), but before processing the payload.
+     * If no header data is given, then a zero-length header is used.
+     *
+     * Unless chunking is disabled by the policy, the header may be
+     * processed in several chunks, via several calls to InjectHeader() with
+     * arbitrary chunk lengths.
+     */
+    void InjectHeader(const uint8_t *header, size_t headerLen);
+
+    /** Process scatter-gather header data
+     *
+     * Variant of InjectHeader() for a header made of segCount segments,
+     * processed in order. Segment lengths are arbitrary (including zero);
+     * partial blocks that span segments are handled internally, without
+     * first copying the header into a contiguous buffer.
+     *
+     * This is not available when chunking is disabled by the policy.
+     */
+    template <bool C = Policy::kChunk>
+    void InjectHeaderSegments(const EAXSegment *segs, size_t segCount);
+
+    /** Encrypt message data
+     *
+     * Encrypt the provided payload. Input data (plaintext) is read from
+     * 'input' and has size 'inputLen' bytes; the corresponding data has
+     * the same length and is written in 'output'. The 'input' and 'output'
+     * buffers may overlap partially or totally.
+     *
+     * Unless chunking is disabled by the policy, the payload may be
+     * processed in several chunks (several calls to Encrypt() with
+     * arbitrary chunk lengths).
+     */
+    void Encrypt(const uint8_t *input, size_t inputLen, uint8_t *output);
+
+    /** Encrypt message data in-place
+     *
+     * Variant of Encrypt() for in-place processing: the encrypted data
+     * replaces the plaintext data in the 'data' buffer.
+     */
+    void Encrypt(uint8_t *data, size_t dataLen);
+
+    /** Encrypt scatter-gather message data
+     *
+     * Variant of Encrypt() for a plaintext made of inCount input segments,
+     * written as ciphertext to outCount output segments. The total lengths
+     * of the input and output segments must be equal, but the segment
+     * boundaries may differ. Each output segment must either be disjoint
+     * from all input segments, or coincide with the input bytes that are
+     * encrypted into it.
+     *
+     * This is not available when chunking is disabled by the policy.
+     */
+    template <bool C = Policy::kChunk>
+    void EncryptSegments(const EAXSegment *in, size_t inCount, const EAXOutSegment *out, size_t outCount);
+
+    /** Encrypt scatter-gather message data in-place
+     */
+    template <bool C = Policy::kChunk>
+    void EncryptSegments(const EAXOutSegment *segs, size_t segCount);
+
+    /** Decrypt message data
+     *
+     * Identical to Encrypt(), except for decryption instead of encryption.
+     * Note that, for a given message, all chunks must be encrypted, or
+     * all chunks must be decrypted; mixing encryption and decryption for
+     * a single message is not permitted.
+     */
+    void Decrypt(const uint8_t *input, size_t inputLen, uint8_t *output);
+
+    /** Decrypt message data in-place
+     *
+     * Variant of Decrypt() for in-place processing: the decrypted data
+     * replaces the ciphertext data in the 'data' buffer.
+     */
+    void Decrypt(uint8_t *data, size_t dataLen);
+
+    /** Decrypt scatter-gather message data
+     *
+     * Identical to EncryptSegments(), except for decryption instead of
+     * encryption.
+     */
+    template <bool C = Policy::kChunk>
+    void DecryptSegments(const EAXSegment *in, size_t inCount, const EAXOutSegment *out, size_t outCount);
+
+    /** Decrypt scatter-gather message data in-place
+     */
+    template <bool C = Policy::kChunk>
+    void DecryptSegments(const EAXOutSegment *segs, size_t segCount);
+
+    /** Export the state of the message in progress
+     *
+     * Write the state of the current message (after Start(), and before
+     * the tag is computed) into kExportStateLength bytes at 'out'. The
+     * message can later be continued from that point by any object with
+     * the same key, with ImportState(), e.g. on another thread or after a
+     * restart. This object is not modified.
+     *
+     * The exported state includes the CBC-MAC values and unused CTR stream
+     * bytes: it must be kept as secret as the payload. Its integrity
+     * matters as much as its secrecy: a state whose counter has been rolled
+     * back (or an old copy imported again) reuses CTR stream, which reveals
+     * the XOR of two payloads, and leaked CBC-MAC values allow forged
+     * messages to be spliced onto the authenticated prefix. A state that
+     * leaves the object's memory must therefore be stored with
+     * authenticated encryption (e.g. sealed with EAX under another key), or
+     * at least with a MAC and a record of which states have been imported.
+     *
+     * The format starts with a version byte, and is independent of the
+     * backend and of the policy, except that chunking must be enabled.
+     */
+    template <bool C = Policy::kChunk>
+    void ExportState(uint8_t *out) const;
+
+    /** Continue a message from an exported state
+     *
+     * Load the state written by ExportState() from 'in' (inLen bytes). A
+     * key must have been set, and must be the one of the object the state
+     * was exported from; any message in progress is abandoned. Returns
+     * false, and leaves the object ready for a new message, if the state
+     * is malformed or of an unknown version.
+     *
+     * The checks cover the format only: a well-formed state that has been
+     * modified or replayed is accepted. The caller must authenticate the
+     * state before importing it (see ExportState()).
+     *
+     * This is not available when chunking is disabled by the policy.
+     */
+    template <bool C = Policy::kChunk>
+    bool ImportState(const uint8_t *in, size_t inLen);
+
+    /** Finalize encryption/decryption
+     * 
+     * Finalize encryption or decryption, and get the authentication tag.
+     * This may be called only once per message; after the tag has been
+     * obtained, only SetKey() and Start() may be called again on the
+     * instance.
+     *
+     * Tag length must be between 8 and 16 bytes. Normal EAX tag length is
+     * 16 bytes.
+     */
+    void GetTag(uint8_t *tag, size_t tagLen);
+
+    /** Finalize decryption and check tag
+     * 
+     * Variant of GetTag() that does not return the tag, but compares it
+     * with the provided tag value. This is meant to be used by recipient,
+     * to verify the tag on an incoming message. Returned value is true
+     * if the tags match, false otherwise. Comparison is constant-time.
+     */
+    bool CheckTag(const uint8_t *tag, size_t tagLen);
+
+    /** Encrypt and authenticate a message in one call
+     *
+     * Encrypt the len bytes of plaintext in 'data' in place, with the given
+     * nonce and header ('aad'), and write the tagLen bytes of the tag
+     * directly after the ciphertext, i.e. at data[len..len+tagLen-1]. The
+     * buffer must therefore have room for len + tagLen bytes.
+     *
+     * This is equivalent to calling Start(), InjectHeader(), Encrypt() and
+     * GetTag(), but the message is processed in a single pass without
+     * buffering. A key must have been set with SetKey(); Seal() may be
+     * called any number of times with the same key, and may be mixed with
+     * the other message processing methods.
+     */
+    void Seal(const uint8_t *nonce, size_t nonceLen, const uint8_t *aad, size_t aadLen,
+              uint8_t *data, size_t len, size_t tagLen);
+
+    /** Decrypt and verify a message in one call
+     *
+     * Counterpart of Seal(): 'data' holds len bytes of ciphertext followed
+     * by tagLen bytes of tag. The ciphertext is decrypted in place, and the
+     * tag is verified. Returned value is true if the tag is valid; tag
+     * comparison is constant-time. If the tag is invalid, false is returned
+     * and the decrypted data is cleared. If tagLen is not a valid tag
+     * length, false is returned and the data is left untouched.
+     */
+    bool Open(const uint8_t *nonce, size_t nonceLen, const uint8_t *aad, size_t aadLen,
+              uint8_t *data, size_t len, size_t tagLen);
+
+    /** Verify, then decrypt a message in one call
+     *
+     * Same as Open(), but in two passes over the data: the tag is first
+     * computed over the ciphertext and checked, and the ciphertext is
+     * decrypted only if the tag is valid. A message that fails
+     * authentication thus costs about half the AES computations of Open(),
+     * and 'data' is left untouched. For valid messages, this is somewhat
+     * slower than Open() since the data is read twice.
+     */
+    bool OpenVerifyFirst(const uint8_t *nonce, size_t nonceLen, const uint8_t *aad, size_t aadLen,
+                         uint8_t *data, size_t len, size_t tagLen);
+
+    /** Get the instrumentation counters
+     * 
+     * Copy the counters of this object (see EAXStats) into 'stats', e.g. at
+     * the end of a message, or of a series of messages of the same class.
+     * The counters are kept across Reset() and SetKey().
+     * 
+     * This is only available when the policy enables Stats.
+     */
+    template <bool S = Policy::kStats>
+    void GetStats(EAXStats & stats) const;
+
+    /** Reset the instrumentation counters
+     * 
+     * This is only available when the policy enables Stats.
+     */
+    template <bool S = Policy::kStats>
+    void ResetStats(void);
+
+    /** Set the clock used to measure backend time
+     * 
+     * Once a clock is set, the clock is read before and after each call to
+     * the AES backend, and the difference is added to the BackendTime
+     * counter. NULL (the initial value) disables the measurement.
+     * 
+     * This is only available when the policy enables Stats.
+     */
+    template <bool S = Policy::kStats>
+    void SetStatsClock(EAXClock clock);
+
+protected:
+
+    /** Initialize the object and prepare it for use.
+     */
+    EAXT(void);
+
+    /** Destroy the object and clear all state and secret data.
+     * 
+     * Backends are responsible for clearing any state or secrets associated
+     * with the underlying AES block encryptor in their own destructor.
+     */
+    ~EAXT(void);
+
+    /** Default multi-block encryption
+     * 
+     * Encrypt nBlocks consecutive 16-byte blocks by calling the backend's
+     * AESEncryptBlock() once per block. This is used for backends that do
+     * not provide their own AESEncryptBlocks() method.
+     */
+    void AESEncryptBlocks(uint8_t *data, size_t nBlocks);
+
+    /** Default multi-lane encryption
+     * 
+     * Encrypt blocks[i] with the key of lanes[i], for i in 0..n-1, by calling
+     * AESEncryptBlock() on each lane in turn. This is used for backends that
+     * do not provide their own AESEncryptLanes() method.
+     */
+    static void AESEncryptLanes(Backend *const *lanes, uint8_t *const *blocks, size_t n);
+
+    /** Default depth of the backend's queue of blocks in flight
+     * 
+     * Zero, since the default AESSubmitBlock() is synchronous.
+     */
+    enum {
+        kAESQueueDepth = 0
+    };
+
+    /** Default block submission
+     * 
+     * Encrypt the 16-byte block pointed at by data in place, by calling the
+     * backend's AESEncryptBlock(). This is used for backends that do not
+     * queue blocks for asynchronous encryption.
+     */
+    void AESSubmitBlock(uint8_t *data);
+
+    /** Default wait for submitted blocks
+     * 
+     * Does nothing, since the default AESSubmitBlock() is synchronous.
+     */
+    void AESWaitBlocks(size_t maxPending);
+
+    /** Default check for native CTR and CMAC modes
+     * 
+     * Returns false: the modes are computed block by block with
+     * AESEncryptBlock() and AESEncryptBlocks().
+     */
+    bool AESModesSupported(void);
+
+    /** Default native CTR mode
+     * 
+     * Never called, since the default AESModesSupported() returns false.
+     */
+    void AESCTR(const uint8_t *ctr, const uint8_t *in, uint8_t *out, size_t len);
+
+    /** Default native CMAC
+     * 
+     * Never called, since the default AESModesSupported() returns false.
+     */
+    void AESCMAC(const uint8_t *first, const uint8_t *data, size_t len, uint8_t *mac);
+
+    /** Default clearing of the block cipher temporaries
+     * 
+     * Does nothing: the default backend keeps no temporaries in the object.
+     */
+    void AESWipeTemporaries(void);
+
+    static inline void ClearSecretData(void * buf, size_t len) { EAXSecureWipe(buf, len); }
+
+private:
+    enum {
+        kBlockLength = 16,
+        kCTRBatchBlocks = CONFIG_EAX_CTR_BATCH_BLOCKS
+    };
+
+    enum {
+        ST_EMPTY     = 0,
+        ST_KEYED     = 1,
+        ST_AAD       = 2,
+        ST_PAYLOAD   = 3,
+        ST_ENCRYPT   = 4,
+        ST_DECRYPT   = 5,
+        ST_TAG       = 6
+    };
+
+    /*
+     * L1[], L2[] and L4[] (if PadCache), buf[], cbcmac[] and ptr (if
+     * Chunk), kscache[], kspos and kscount (if KeystreamCacheBlocks is
+     * non-zero), and stats, clock and phase (if Stats) are in the base
+     * classes.
+     */
+    uint8_t ctr[kBlockLength];
+    uint8_t acc[kBlockLength];
+    uint8_t state;
+
+    template <class B, size_t N> friend class EAXBatch;
+    template <class B> friend class EAXParallel;
+    template <class B> friend class CMACT;
+
+    Backend & backend(void) { return *static_cast<Backend *>(this); }
+
+    /*
+     * Calls to the backend's block cipher, with instrumentation.
+     */
+    void aes_block(uint8_t *data);
+    void aes_blocks(uint8_t *data, size_t nBlocks);
+    void aes_submit(uint8_t *data);
+    void aes_wait(size_t maxPending);
+    void aes_ctr(const uint8_t *ctr, const uint8_t *in, uint8_t *out, size_t len);
+    void aes_cmac(const uint8_t *first, const uint8_t *data, size_t len, uint8_t *mac);
+    bool aes_modes(void);
+    void wipe_temporaries(void);
+
+    static void double_gf128(uint8_t *elt);
+    static void xor_block(const uint8_t *src, uint8_t *dst);
+    static void ctr_mac_block(bool encrypt, const uint8_t *in, uint8_t *out, const uint8_t *ks, uint8_t *mac);
+    static uint64_t load_be64(const uint8_t *src);
+    static void store_be64(uint8_t *dst, uint64_t val);
+    void get_pad(bool partial, uint8_t *pad);
+    void omac(unsigned val, const uint8_t *data, size_t len, uint8_t *mac);
+    void incr_ctr(void);
+    void ctr_generate(uint8_t *ks, size_t nBlocks);
+    void ctr_stream(uint8_t *ks, size_t nBlocks);
+    static void encrypt_lanes(Backend *const *lanes, uint8_t *const *blocks, size_t n);
+    void ctr_mac_blocks(bool encrypt, const uint8_t *in, uint8_t *out, size_t nBlocks, uint8_t *mac, uint8_t *tailKS);
+    bool ctr_submit(uint8_t *ks);
+    void ctr_mac_blocks_queued(bool encrypt, const uint8_t *in, uint8_t *out, size_t nBlocks, uint8_t *mac, uint8_t *tailKS);
+    void payload_oneshot(bool encrypt, const uint8_t *in, uint8_t *out, size_t len);
+    void message_oneshot(bool encrypt, const uint8_t *nonce, size_t nonceLen, const uint8_t *aad, size_t aadLen,
+                         uint8_t *data, size_t len);
+    void ctr_only(uint8_t *data, size_t len);
+    static const uint8_t *resolve_overlap(const uint8_t *input, size_t len, uint8_t *output);
+    void ClearState(void);
+
+    /*
+     * Steps of message processing that differ with chunking, in two
+     * variants, of which only the one for the policy is instantiated.
+     */
+    template <bool C = Policy::kChunk> typename std::enable_if<C>::type aad_start(void);
+    template <bool C = Policy::kChunk> typename std::enable_if<!C>::type aad_start(void);
+    template <bool C = Policy::kChunk> typename std::enable_if<C>::type saved_start(const EAXSaved *sav);
+    template <bool C = Policy::kChunk> typename std::enable_if<!C>::type saved_start(const EAXSaved *sav);
+    template <bool C = Policy::kChunk> typename std::enable_if<C>::type header_process(const uint8_t *header, size_t headerLen);
+    template <bool C = Policy::kChunk> typename std::enable_if<!C>::type header_process(const uint8_t *header, size_t headerLen);
+    template <bool C = Policy::kChunk> typename std::enable_if<C>::type payload_enter(unsigned st);
+    template <bool C = Policy::kChunk> typename std::enable_if<!C>::type payload_enter(unsigned st);
+    template <bool C = Policy::kChunk> typename std::enable_if<C>::type payload_process(bool encrypt, const uint8_t *in, uint8_t *out, size_t len);
+    template <bool C = Policy::kChunk> typename std::enable_if<!C>::type payload_process(bool encrypt, const uint8_t *in, uint8_t *out, size_t len);
+    template <bool C = Policy::kChunk> typename std::enable_if<C>::type tag_finish(void);
+    template <bool C = Policy::kChunk> typename std::enable_if<!C>::type tag_finish(void);
+
+    /*
+     * Buffered OMAC processing, used only with chunking.
+     */
+    template <bool C = Policy::kChunk> typename std::enable_if<C>::type omac_start(unsigned val);
+    template <bool C = Policy::kChunk> typename std::enable_if<C>::type omac_process(const uint8_t *data, size_t len);
+    template <bool C = Policy::kChunk> typename std::enable_if<C>::type omac_finish(unsigned val);
+    template <bool C = Policy::kChunk> typename std::enable_if<C>::type aad_finish(void);
+    template <bool C = Policy::kChunk> typename std::enable_if<C>::type mac_blocks(const uint8_t *data, size_t nBlocks);
+    template <bool C = Policy::kChunk> typename std::enable_if<C>::type payload_segments(bool encrypt, const EAXSegment *in, size_t inCount, const EAXOutSegment *out, size_t outCount);
+};
+
+/*
+ * The 'state' variable maintains current status of the object:
+ *
+ *   ST_EMPTY     Created, no key set yet
+ *   ST_KEYED     Key is set, ready for a new message (Start() call)
+ *   ST_AAD       Start() was called, waiting for AAD
+ *   ST_ENCRYPT   Payload is being encrypted
+ *   ST_DECRYPT   Payload is being decrypted
+ *   ST_PAYLOAD   AAD finished, ready for payload
+ *   ST_TAG       Tag was computed in acc[]
+ *
+ * Calls and transitions:
+ *   SetKey()        goes to ST_KEYED; cancels any ongoing computation
+ *   LoadKey()       goes to ST_KEYED; cancels any ongoing computation
+ *   Start()         requires not ST_EMPTY; goes to ST_AAD; cancels ongoing
+ *   StartPrecomputed()  same as Start(), or StartSaved() with a saved header
+ *   PrefillKeystream()  requires ST_AAD, ST_PAYLOAD, ST_ENCRYPT or ST_DECRYPT
+ *   Seal(), Open(), OpenVerifyFirst()
+ *                   require not ST_EMPTY; go to ST_TAG; cancel ongoing
+ *   InjectHeader()  requires ST_AAD
+ *   Encrypt()       requires ST_AAD, ST_ENCRYPT or ST_PAYLOAD;
+ *                   goes to ST_ENCRYPT
+ *   Decrypt()       requires ST_AAD, ST_DECRYPT or ST_PAYLOAD;
+ *                   goes to ST_DECRYPT
+ *   GetTag()        requires ST_ADD, ST_ENCRYPT, ST_DECRYPT or ST_PAYLOAD;
+ *                   goes to ST_TAG
+ *   CheckTag()      requires ST_ADD, ST_ENCRYPT, ST_DECRYPT or ST_PAYLOAD;
+ *                   goes to ST_TAG
+ *
+ * The ST_PAYLOAD is a special case for when the AAD was injected from a
+ * saved state object (EAXSaved).
+ *
+ * The assert() macro is used to react on violations. Such cases
+ * happen only if the calling code is wrong, not because of invalid
+ * data from the outside.
+ *
+ * When chunking is disabled by the policy, ST_ENCRYPT and ST_DECRYPT
+ * are not used; instead, AAD processing leads to ST_PAYLOAD state, and
+ * calling Encrypt() or Decrypt() brings to ST_TAG.
+ */
+
+/*
+ * Implementation Notes
+ * ====================
+ *
+ * L1[] contains the encryption of the all-zero block. This is used when
+ * processing the nonce; the pad blocks for OMAC also use it (pad blocks
+ * use either L2 or L4, where L2 is the double of L1 in GF(2^128), and
+ * L4 is the double of L2 in GF(2^128)). L2[] and L4[] are computed once,
+ * when the key is set, and cached alongside L1[] (if the policy enables
+ * PadCache; otherwise, they are recomputed for each message).
+ *
+ * buf[] is an all-purpose buffer:
+ *
+ *  - When using OMAC only (processing of nonce and header), it contains
+ *    ptr unprocessed bytes. That value ranges from 1 to 16 (inclusive).
+ *
+ *  - When using both OMAC and CTR (processing of payload):
+ *      The first ptr bytes must still be processed with OMAC.
+ *      The remaining 16-ptr bytes are CTR stream bytes to be XORed into
+ *      the next 16-ptr payload bytes.
+ *    Again, ptr ranges from 1 to 16.
+ *
+ * cbcmac[] is the OMAC buffer. It contains the current CBC-MAC value.
+ *
+ * ctr[] is the counter for CTR encryption/decryption. It contains the
+ * counter value for the next invocation of AES/CTR.
+ *
+ * When the policy enables the keystream cache, kscache[] holds CTR
+ * stream blocks that were generated ahead of time by PrefillKeystream().
+ * Blocks kspos to kscount-1 have not been used yet; they come before the
+ * block for ctr[] in the stream (i.e. ctr[] was advanced when they were
+ * generated).
+ *
+ * acc[] is the buffer that accumulates the tag value:
+ *  - It first receives a copy of OMAC^0(nonce).
+ *  - OMAC^1(header) is XORed into it.
+ *  - OMAC^2(ciphertext) is XORed into it.
+ *
+ * When the policy enables chunking, the 'ptr' field is
+ * present and normally has a value between 1 and 16 (inclusive). There
+ * is a special case where ptr == 0: when StartSaved() has been used.
+ * In that case, the first OMAC^2 block, already encrypted, has been
+ * saved in cbcmac[]. Code in this class defensively assumes that ptr
+ * may be zero at all times.
+ */
+
+template <class Backend, class Policy>
+EAXT<Backend, Policy>::EAXT(void)
+{
+    static_assert(kMaxTagLength >= kMinTagLength && (size_t)kMaxTagLength <= (size_t)kBlockLength, "Invalid maximum tag length");
+    state = ST_EMPTY;
+}
+
+template <class Backend, class Policy>
+EAXT<Backend, Policy>::~EAXT(void)
+{
+    ClearState();
+}
+
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::AESEncryptBlocks(uint8_t *data, size_t nBlocks)
+{
+    size_t i;
+
+    for (i = 0; i < nBlocks; i ++) {
+        backend().AESEncryptBlock(data + i * kBlockLength);
+    }
+}
+
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::AESEncryptLanes(Backend *const *lanes, uint8_t *const *blocks, size_t n)
+{
+    size_t i;
+
+    for (i = 0; i < n; i ++) {
+        lanes[i]->AESEncryptBlock(blocks[i]);
+    }
+}
+
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::AESSubmitBlock(uint8_t *data)
+{
+    backend().AESEncryptBlock(data);
+}
+
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::AESWaitBlocks(size_t maxPending)
+{
+    (void)maxPending;
+}
+
+template <class Backend, class Policy>
+bool
+EAXT<Backend, Policy>::AESModesSupported(void)
+{
+    return false;
+}
+
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::AESCTR(const uint8_t *ctr, const uint8_t *in, uint8_t *out, size_t len)
+{
+    (void)ctr;
+    (void)in;
+    (void)out;
+    (void)len;
+    assert(false);
+}
+
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::AESCMAC(const uint8_t *first, const uint8_t *data, size_t len, uint8_t *mac)
+{
+    (void)first;
+    (void)data;
+    (void)len;
+    (void)mac;
+    assert(false);
+}
+
+/*
+ * Dispatch to the backend's multi-lane encryption. The call is resolved
+ * against Backend, so that a backend's own AESEncryptLanes() hides the
+ * default one above.
+ */
+template <class Backend, class Policy>
+inline void
+EAXT<Backend, Policy>::encrypt_lanes(Backend *const *lanes, uint8_t *const *blocks, size_t n)
+{
+    Backend::AESEncryptLanes(lanes, blocks, n);
+}
+
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::AESWipeTemporaries(void)
+{
+}
+
+template <class Backend, class Policy>
+inline void
+EAXT<Backend, Policy>::aes_block(uint8_t *data)
+{
+    uint64_t t = this->stats_time();
+
+    backend().AESEncryptBlock(data);
+    this->stats_backend(1, t);
+}
+
+template <class Backend, class Policy>
+inline void
+EAXT<Backend, Policy>::aes_blocks(uint8_t *data, size_t nBlocks)
+{
+    uint64_t t = this->stats_time();
+
+    backend().AESEncryptBlocks(data, nBlocks);
+    this->stats_backend(nBlocks, t);
+}
+
+template <class Backend, class Policy>
+inline void
+EAXT<Backend, Policy>::aes_submit(uint8_t *data)
+{
+    uint64_t t = this->stats_time();
+
+    backend().AESSubmitBlock(data);
+    this->stats_backend(1, t);
+}
+
+template <class Backend, class Policy>
+inline void
+EAXT<Backend, Policy>::aes_wait(size_t maxPending)
+{
+    uint64_t t = this->stats_time();
+
+    backend().AESWaitBlocks(maxPending);
+    this->stats_backend(0, t);
+}
+
+template <class Backend, class Policy>
+inline void
+EAXT<Backend, Policy>::aes_ctr(const uint8_t *ctr, const uint8_t *in, uint8_t *out, size_t len)
+{
+    uint64_t t = this->stats_time();
+
+    backend().AESCTR(ctr, in, out, len);
+    this->stats_backend((len + kBlockLength - 1) / kBlockLength, t);
+}
+
+template <class Backend, class Policy>
+inline void
+EAXT<Backend, Policy>::aes_cmac(const uint8_t *first, const uint8_t *data, size_t len, uint8_t *mac)
+{
+    uint64_t t = this->stats_time();
+
+    backend().AESCMAC(first, data, len, mac);
+    this->stats_backend(1 + (len + kBlockLength - 1) / kBlockLength, t);
+}
+
+template <class Backend, class Policy>
+inline bool
+EAXT<Backend, Policy>::aes_modes(void)
+{
+    return backend().AESModesSupported();
+}
+
+/*
+ * Clear the block cipher temporaries of the message that just ended (see
+ * "Clearing of secret data" above).
+ */
+template <class Backend, class Policy>
+inline void
+EAXT<Backend, Policy>::wipe_temporaries(void)
+{
+    backend().AESWipeTemporaries();
+    EAXWipeStack();
+}
+
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::Reset(void)
+{
+    ClearState();
+    backend().AESReset();
+}
+
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::ClearState(void)
+{
+    this->pads_clear();
+    this->chunk_clear();
+    ClearSecretData(ctr, sizeof ctr);
+    ClearSecretData(acc, sizeof acc);
+    this->ks_discard();
+
+    state = ST_EMPTY;
+}
+
+/*
+ * Double a value in finite field GF(2^128), with modulus X^128+X^7+X^2+X+1.
+ * Value bytes are in big-endian order: elt[15] is the byte corresponding
+ * to 1, X, X^2,... X^7. Within each byte, numerical encoding is used, i.e.
+ * X^7 is the most significant bit in elt[15].
+ */
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::double_gf128(uint8_t *elt)
+{
+    unsigned cc;
+    int i;
+
+    /*
+     * 'cc' is a constant-time extraction of the top bit, promoted to the
+     * effect of the field modulus (0x87 is the encoding for X^7+X^2+X+1).
+     */
+    cc = 0x87 & -((unsigned)elt[0] >> 7);
+    for (i = kBlockLength - 1; i >= 0; i --) {
+        unsigned z;
+
+        z = (elt[i] << 1) ^ cc;
+        cc = z >> 8;
+        elt[i] = (uint8_t)z;
+    }
+}
+
+/*
+ * XOR a block (16 bytes) into another.
+ *
+ * The XOR is performed on the widest convenient unit: a single 128-bit
+ * lane on x86 with SSE2, otherwise machine words. memcpy() is used for
+ * the word loads and stores so that unaligned buffers are handled; the
+ * compiler turns these into plain (unaligned) loads and stores on
+ * architectures that support them, such as x86 and Cortex-M4.
+ */
+template <class Backend, class Policy>
+inline void
+EAXT<Backend, Policy>::xor_block(const uint8_t *src, uint8_t *dst)
+{
+#if defined(__SSE2__)
+    __m128i x;
+
+    x = _mm_xor_si128(_mm_loadu_si128((const __m128i *)src), _mm_loadu_si128((const __m128i *)dst));
+    _mm_storeu_si128((__m128i *)dst, x);
+#else
+    uintptr_t s[kBlockLength / sizeof(uintptr_t)], d[kBlockLength / sizeof(uintptr_t)];
+    size_t u;
+
+    memcpy(s, src, kBlockLength);
+    memcpy(d, dst, kBlockLength);
+    for (u = 0; u < kBlockLength / sizeof(uintptr_t); u ++) {
+        d[u] ^= s[u];
+    }
+    memcpy(dst, d, kBlockLength);
+#endif
+}
+
+/*
+ * Fused CTR and CBC-MAC step for one full block: XOR the CTR stream
+ * block ks[] into the input block, write the result to out[], and XOR
+ * the ciphertext block (the output when encrypting, the input when
+ * decrypting) into mac[]. The input block is read in full before out[]
+ * is written, so in and out may be equal. The caller must then encrypt
+ * mac[].
+ */
+template <class Backend, class Policy>
+inline void
+EAXT<Backend, Policy>::ctr_mac_block(bool encrypt, const uint8_t *in, uint8_t *out, const uint8_t *ks, uint8_t *mac)
+{
+#if defined(__SSE2__)
+    __m128i x, y, m;
+
+    x = _mm_loadu_si128((const __m128i *)in);
+    m = _mm_loadu_si128((const __m128i *)mac);
+    y = _mm_xor_si128(x, _mm_loadu_si128((const __m128i *)ks));
+    m = _mm_xor_si128(m, encrypt ? y : x);
+    _mm_storeu_si128((__m128i *)out, y);
+    _mm_storeu_si128((__m128i *)mac, m);
+#else
+    uintptr_t x[kBlockLength / sizeof(uintptr_t)], k[kBlockLength / sizeof(uintptr_t)], m[kBlockLength / sizeof(uintptr_t)];
+    size_t u;
+
+    memcpy(x, in, kBlockLength);
+    memcpy(k, ks, kBlockLength);
+    memcpy(m, mac, kBlockLength);
+    for (u = 0; u < kBlockLength / sizeof(uintptr_t); u ++) {
+        uintptr_t y;
+
+        y = x[u] ^ k[u];
+        m[u] ^= encrypt ? y : x[u];
+        x[u] = y;
+    }
+    memcpy(out, x, kBlockLength);
+    memcpy(mac, m, kBlockLength);
+#endif
+}
+
+/*
+ * Big-endian 64-bit load and store, used for counter arithmetic.
+ */
+template <class Backend, class Policy>
+inline uint64_t
+EAXT<Backend, Policy>::load_be64(const uint8_t *src)
+{
+    return ((uint64_t)src[0] << 56) | ((uint64_t)src[1] << 48)
+         | ((uint64_t)src[2] << 40) | ((uint64_t)src[3] << 32)
+         | ((uint64_t)src[4] << 24) | ((uint64_t)src[5] << 16)
+         | ((uint64_t)src[6] << 8) | (uint64_t)src[7];
+}
+
+template <class Backend, class Policy>
+inline void
+EAXT<Backend, Policy>::store_be64(uint8_t *dst, uint64_t val)
+{
+    dst[0] = (uint8_t)(val >> 56);
+    dst[1] = (uint8_t)(val >> 48);
+    dst[2] = (uint8_t)(val >> 40);
+    dst[3] = (uint8_t)(val >> 32);
+    dst[4] = (uint8_t)(val >> 24);
+    dst[5] = (uint8_t)(val >> 16);
+    dst[6] = (uint8_t)(val >> 8);
+    dst[7] = (uint8_t)val;
+}
+
+/*
+ * Get the OMAC pad block: L2 if the last block of the input is complete
+ * (or the input is empty), L4 if it is partial and had to be padded.
+ */
+template <class Backend, class Policy>
+inline void
+EAXT<Backend, Policy>::get_pad(bool partial, uint8_t *pad)
+{
+    if (!this->pads_get(partial, pad)) {
+        memset(pad, 0, kBlockLength);
+        aes_block(pad);
+        double_gf128(pad);
+        if (partial) {
+            double_gf128(pad);
+        }
+    }
+}
+
+/*
+ * This method computes OMAC^val on data[], result in mac[] (16 bytes).
+ * This handles non-chunked input, with no buffering.
+ *
+ * If val == 0 and len != 0, then the first block to be encrypted will
+ * be the all-zero block. If the policy enables PadCache, the
+ * encryption of the all-zero block is available in the L1[] array,
+ * and it is automatically reused by this function.
+ */
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::omac(unsigned val, const uint8_t *data, size_t len, uint8_t *mac)
+{
+    /*
+     * There are three situations:
+     *
+     *  - Data is empty; the pad block is L2, XORed into the initial
+     *    OMAC^2 block (0000...0002).
+     *
+     *  - Data has length multiple of 16 and is not empty; pad block
+     *    is L2, XORed into the last block.
+     *
+     *  - Data has length not multiple of 16; last partial block is
+     *    padded with 0x80 then zeros, and XORed with the pad block,
+     *    which is L4.
+     */
+    uint8_t pad[kBlockLength];
+    size_t u, v;
+
+    /*
+     * OMAC^t(data) is the CMAC of the initial block followed by the data.
+     */
+    if (aes_modes()) {
+        memset(pad, 0, sizeof pad);
+        pad[kBlockLength - 1] = (uint8_t)val;
+        aes_cmac(pad, data, len, mac);
+        return;
+    }
+
+    /*
+     * Note: we wanted to test whether len was a multiple of the
+     * block length (16 bytes), but divisions are expensive. Here,
+     * we used the fact that the block length is a power of two,
+     * which allows for using a faster bitwise AND.
+     */
+    get_pad((len & (kBlockLength - 1)) != 0, pad);
+
+    /*
+     * The following cases may happen:
+     *
+     *  - If len == 0, then the output is the encryption of the XOR of
+     *    the first block (all-zero except the last byte) with the pad
+     *    block.
+     *
+     *  - If len != 0 and val == 0 and the policy enables PadCache,
+     *    then the first block to be encrypted is the all-zero
+     *    block, and it already is in L1[], so we reuse it.
+     *
+     *  - Otherwise, the first block to be encrypted is not the all-zero
+     *    block (or we don't have L1); the first block must be assembled
+     *    and used as starting point.
+     */
+    if (len == 0) {
+        memcpy(mac, pad, sizeof pad);
+        mac[kBlockLength - 1] ^= (uint8_t)val;
+        aes_block(mac);
+    } else {
+        if (val != 0 || !this->pads_get_l1(mac)) {
+            memset(mac, 0, kBlockLength);
+            mac[kBlockLength - 1] = (uint8_t)val;
+            aes_block(mac);
+        }
+        for (u = 0; (u + kBlockLength) < len; u += kBlockLength) {
+            xor_block(data + u, mac);
+            aes_block(mac);
+        }
+        for (v = 0; (u + v) < len; v ++) {
+            mac[v] ^= data[u + v];
+        }
+        if (v < kBlockLength) {
+            mac[v] ^= 0x80;
+        }
+        xor_block(pad, mac);
+        aes_block(mac);
+    }
+    ClearSecretData(pad, sizeof pad);
+}
+
+/*
+ * Start OMAC processing: buffer is set to the initial block whose last
+ * byte has value 'val' (normally, 0 for the nonce, 1 for the header,
+ * 2 for the ciphertext).
+ */
+template <class Backend, class Policy>
+template <bool C>
+typename std::enable_if<C>::type
+EAXT<Backend, Policy>::omac_start(unsigned val)
+{
+    memset(this->cbcmac, 0, sizeof this->cbcmac);
+    memset(this->buf, 0, sizeof this->buf);
+    this->buf[kBlockLength - 1] = val;
+    this->ptr = kBlockLength;
+}
+
+/*
+ * Continue OMAC processing on the provided data.
+ */
+template <class Backend, class Policy>
+template <bool C>
+typename std::enable_if<C>::type
+EAXT<Backend, Policy>::omac_process(const uint8_t *data, size_t len)
+{
+    if (len == 0) {
+        return;
+    }
+
+    /*
+     * Make sure that buf[] is full, and that there still are bytes to
+     * process after that.
+     */
+    if (this->ptr != kBlockLength) {
+        size_t clen;
+
+        clen = kBlockLength - this->ptr;
+        if (clen >= len) {
+            memcpy(this->buf + this->ptr, data, len);
+            this->ptr += len;
+            return;
+        }
+        memcpy(this->buf + this->ptr, data, clen);
+        data += clen;
+        len -= clen;
+    }
+
+    /*
+     * buf[] is full and there are remaining bytes to process, so we
+     * can compute one block.
+     */
+    xor_block(this->buf, this->cbcmac);
+    aes_block(this->cbcmac);
+
+    /*
+     * Process full blocks, as long as at least one unprocessed byte
+     * remains afterwards.
+     */
+    while (len > kBlockLength) {
+        xor_block(data, this->cbcmac);
+        aes_block(this->cbcmac);
+        data += kBlockLength;
+        len -= kBlockLength;
+    }
+
+    /*
+     * Buffer unprocessed bytes.
+     */
+    memcpy(this->buf, data, len);
+    this->ptr = len;
+}
+
+/*
+ * Finish OMAC. The MAC value is in cbcmac[]. The 'val' parameter is the
+ * type of OMAC (1 for AAD, 2 for ciphertext): it is used if ptr == 0
+ * (meaning that the first block must be rebuilt and subject to padding).
+ */
+template <class Backend, class Policy>
+template <bool C>
+typename std::enable_if<C>::type
+EAXT<Backend, Policy>::omac_finish(unsigned val)
+{
+    uint8_t pad[kBlockLength];
+
+    /*
+     * If the total input size is a multiple of the block size, then
+     * the last block (still in buf[] at that point) is XORed with L1;
+     * otherwise, padding is applied (0x80, then 0x00 bytes up to the
+     * next block boundary) and L4 is XORed in.
+     */
+    get_pad(this->ptr != 0 && this->ptr != kBlockLength, pad);
+    if (this->ptr == 0) {
+        memcpy(this->cbcmac, pad, sizeof pad);
+        this->cbcmac[kBlockLength - 1] ^= (uint8_t)val;
+    } else {
+        if (this->ptr != kBlockLength) {
+            this->buf[this->ptr ++] = 0x80;
+            memset(this->buf + this->ptr, 0x00, kBlockLength - this->ptr);
+        }
+        xor_block(this->buf, this->cbcmac);
+        xor_block(pad, this->cbcmac);
+    }
+    aes_block(this->cbcmac);
+    ClearSecretData(pad, sizeof pad);
+}
+
+/*
+ * Finish the OMAC^1 on AAD, and prepare things for payload processing.
+ * This does NOT set the 'state' value.
+ */
+template <class Backend, class Policy>
+template <bool C>
+typename std::enable_if<C>::type
+EAXT<Backend, Policy>::aad_finish(void)
+{
+    omac_finish(1);
+    xor_block(this->cbcmac, acc);
+    omac_start(2);
+}
+
+/*
+ * Process nBlocks full blocks with CBC-MAC into cbcmac[]. This bypasses
+ * buf[]: the caller is responsible for the buffered data, if any.
+ */
+template <class Backend, class Policy>
+template <bool C>
+typename std::enable_if<C>::type
+EAXT<Backend, Policy>::mac_blocks(const uint8_t *data, size_t nBlocks)
+{
+    size_t i;
+
+    for (i = 0; i < nBlocks; i ++) {
+        xor_block(data + i * kBlockLength, this->cbcmac);
+        aes_block(this->cbcmac);
+    }
+}
+
+/*
+ * Increment the CTR counter.
+ *
+ * Counter encoding is big-endian with the full 128-bit width; since the
+ * starting point is the OMAC^0(nonce) value, it cannot be assumed that
+ * the leftmost bytes will remain untouched. The counter is handled as two
+ * 64-bit halves, with the carry out of the low half propagated without
+ * branching.
+ */
+template <class Backend, class Policy>
+inline void
+EAXT<Backend, Policy>::incr_ctr(void)
+{
+    uint64_t lo;
+
+    lo = load_be64(ctr + 8) + 1;
+    store_be64(ctr + 8, lo);
+    store_be64(ctr, load_be64(ctr) + (lo == 0));
+}
+
+/*
+ * Encrypt the next nBlocks counter blocks into ks[], advancing the counter
+ * accordingly.
+ *
+ * In the common case where the low 64 bits of the counter cannot wrap
+ * within the batch, the counter blocks are built with a plain 64-bit add
+ * from a single load of the counter. Otherwise, the full 128-bit
+ * increment is used for each block.
+ */
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::ctr_generate(uint8_t *ks, size_t nBlocks)
+{
+    uint64_t lo;
+    size_t i;
+
+    lo = load_be64(ctr + 8);
+    if (lo <= UINT64_MAX - nBlocks) {
+        for (i = 0; i < nBlocks; i ++) {
+            memcpy(ks + i * kBlockLength, ctr, kBlockLength / 2);
+            store_be64(ks + i * kBlockLength + kBlockLength / 2, lo + i);
+        }
+        store_be64(ctr + 8, lo + nBlocks);
+    } else {
+        for (i = 0; i < nBlocks; i ++) {
+            memcpy(ks + i * kBlockLength, ctr, sizeof ctr);
+            incr_ctr();
+        }
+    }
+    aes_blocks(ks, nBlocks);
+}
+
+/*
+ * Produce the next nBlocks blocks of the CTR stream into ks[]: cached
+ * stream blocks first, if any, then newly generated ones.
+ */
+template <class Backend, class Policy>
+inline void
+EAXT<Backend, Policy>::ctr_stream(uint8_t *ks, size_t nBlocks)
+{
+    size_t n;
+
+    n = this->ks_take(ks, nBlocks);
+    if (n < nBlocks) {
+        ctr_generate(ks + n * kBlockLength, nBlocks - n);
+    }
+}
+
+template <class Backend, class Policy>
+size_t
+EAXT<Backend, Policy>::PrefillKeystream(size_t maxBlocks)
+{
+    uint8_t *ks;
+    size_t n;
+
+    /*
+     * A message must be in progress, with payload processing not
+     * finished.
+     */
+    assert(state == ST_AAD || state == ST_PAYLOAD || state == ST_ENCRYPT || state == ST_DECRYPT);
+
+    this->stats_phase(kEAXPhasePayload);
+    n = this->ks_reserve(maxBlocks, &ks);
+    if (n > 0) {
+        ctr_generate(ks, n);
+        this->ks_commit(n);
+    }
+    return n;
+}
+
+/*
+ * Fused CTR encryption/decryption and CBC-MAC over nBlocks full blocks,
+ * in a single pass over the data. The MAC state is in mac[] and must have
+ * been brought up to date (i.e. encrypted) by the caller.
+ *
+ * The CTR stream is generated in batches of up to kCTRBatchBlocks blocks
+ * with AESEncryptBlocks(), so that a pipelined backend can keep several
+ * AES computations in flight. One additional CTR stream block is
+ * generated as part of the last batch and copied into tailKS[]; callers
+ * use it for the final (partial or complete) block of the payload, which
+ * is subject to special handling.
+ *
+ * CBC-MAC is inherently sequential and is interleaved with the XOR of
+ * each block.
+ */
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::ctr_mac_blocks(bool encrypt, const uint8_t *in, uint8_t *out, size_t nBlocks, uint8_t *mac, uint8_t *tailKS)
+{
+    uint8_t ks[kCTRBatchBlocks * kBlockLength];
+    size_t remaining;
+
+    if (Backend::kAESQueueDepth >= 2) {
+        ctr_mac_blocks_queued(encrypt, in, out, nBlocks, mac, tailKS);
+        return;
+    }
+
+    remaining = nBlocks + 1;
+    for (;;) {
+        size_t n, i;
+
+        n = remaining;
+        if (n > kCTRBatchBlocks) {
+            n = kCTRBatchBlocks;
+        }
+        ctr_stream(ks, n);
+        remaining -= n;
+
+        for (i = 0; i < n; i ++) {
+            if (remaining == 0 && i == n - 1) {
+                memcpy(tailKS, ks + i * kBlockLength, kBlockLength);
+                ClearSecretData(ks, sizeof ks);
+                return;
+            }
+            ctr_mac_block(encrypt, in, out, ks + i * kBlockLength, mac);
+            aes_block(mac);
+            in += kBlockLength;
+            out += kBlockLength;
+        }
+    }
+}
+
+/*
+ * Produce the next CTR stream block into ks[]: a cached stream block if
+ * there is one, or else the next counter block, submitted for encryption
+ * with AESSubmitBlock(). Returns true in the latter case.
+ */
+template <class Backend, class Policy>
+inline bool
+EAXT<Backend, Policy>::ctr_submit(uint8_t *ks)
+{
+    if (this->ks_take(ks, 1) == 1) {
+        return false;
+    }
+    memcpy(ks, ctr, sizeof ctr);
+    incr_ctr();
+    aes_submit(ks);
+    return true;
+}
+
+/*
+ * Variant of ctr_mac_blocks() for backends that queue blocks for
+ * asynchronous encryption (kAESQueueDepth >= 2). The CTR stream block of
+ * the next data block is queued ahead of the CBC-MAC block of the current
+ * one, and the XOR of each data block with its stream block is done while
+ * the previous CBC-MAC block is being encrypted:
+ *
+ *     AES:        MAC(i-1)  CTR(i+1)  MAC(i)    CTR(i+2)  ...
+ *     processor:  XOR(i)              XOR(i+1)            ...
+ *
+ * The ciphertext of each block is kept in c[] until it can be added to the
+ * CBC-MAC, since in-place decryption overwrites it.
+ */
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::ctr_mac_blocks_queued(bool encrypt, const uint8_t *in, uint8_t *out, size_t nBlocks, uint8_t *mac, uint8_t *tailKS)
+{
+    uint8_t ks[2][kBlockLength], c[kBlockLength];
+    size_t i;
+    unsigned u;
+    bool queued;
+
+    ctr_submit(ks[0]);
+    for (i = 0; i < nBlocks; i ++) {
+        const uint8_t *cur = ks[i & 1];
+
+        /*
+         * Wait for CTR(i); MAC(i-1), if any, is queued behind it.
+         */
+        aes_wait((i > 0) ? 1 : 0);
+        if (encrypt) {
+            for (u = 0; u < kBlockLength; u ++) {
+                c[u] = in[u] ^ cur[u];
+                out[u] = c[u];
+            }
+        } else {
+            memcpy(c, in, kBlockLength);
+            for (u = 0; u < kBlockLength; u ++) {
+                out[u] = c[u] ^ cur[u];
+            }
+        }
+
+        /*
+         * Queue CTR(i+1), then wait for MAC(i-1) and queue MAC(i).
+         */
+        queued = ctr_submit(ks[(i + 1) & 1]);
+        aes_wait(queued ? 1 : 0);
+        xor_block(c, mac);
+        aes_submit(mac);
+        in += kBlockLength;
+        out += kBlockLength;
+    }
+    aes_wait(0);
+    memcpy(tailKS, ks[nBlocks & 1], kBlockLength);
+    ClearSecretData(ks, sizeof ks);
+    ClearSecretData(c, sizeof c);
+}
+
+/*
+ * Unbuffered payload processing: the whole payload is processed in one go,
+ * computing the AES/CTR stream XOR and the OMAC^2 of the ciphertext in a
+ * single pass, and OMAC^2 is XORed into acc[]. Data is read from 'in' and
+ * the result is written to 'out'; the two may be equal or disjoint, but
+ * must not overlap partially. This is the payload processing of
+ * engines whose policy disables chunking, and of Seal() and Open() in all
+ * engines.
+ */
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::payload_oneshot(bool encrypt, const uint8_t *in, uint8_t *out, size_t len)
+{
+    uint8_t tmp[kBlockLength], mac[kBlockLength], pad[kBlockLength];
+    size_t u, nFull;
+
+    /*
+     * With native modes, the payload takes one CTR pass and one OMAC^2
+     * pass, the latter always over the ciphertext. Cached CTR stream
+     * blocks, if any, are used by the block-by-block code below.
+     */
+    if (this->ks_cached() == 0 && aes_modes()) {
+        if (encrypt) {
+            aes_ctr(ctr, in, out, len);
+            omac(2, out, len, mac);
+        } else {
+            omac(2, in, len, mac);
+            aes_ctr(ctr, in, out, len);
+        }
+        xor_block(mac, acc);
+        ClearSecretData(mac, sizeof mac);
+        return;
+    }
+
+    get_pad((len & (kBlockLength - 1)) != 0, pad);
+
+    if (len == 0) {
+        /*
+         * Empty ciphertext: the OMAC^2 value is the encryption of the
+         * pad block XORed with the initial block (0000...0002).
+         */
+        memcpy(mac, pad, sizeof pad);
+        mac[kBlockLength - 1] ^= 2;
+        aes_block(mac);
+        xor_block(mac, acc);
+        ClearSecretData(mac, sizeof mac);
+        ClearSecretData(pad, sizeof pad);
+        return;
+    }
+
+    memset(mac, 0, sizeof mac);
+    mac[kBlockLength - 1] = 2;
+    aes_block(mac);
+
+    /*
+     * All blocks but the last (which has between 1 and 16 bytes) go
+     * through the fused CTR/CBC-MAC kernel.
+     */
+    nFull = (len - 1) / kBlockLength;
+    ctr_mac_blocks(encrypt, in, out, nFull, mac, tmp);
+    in += nFull * kBlockLength;
+    out += nFull * kBlockLength;
+    len -= nFull * kBlockLength;
+
+    /*
+     * Last block: XOR with the CTR stream, then pad and finish OMAC^2.
+     */
+    if (encrypt) {
+        for (u = 0; u < len; u ++) {
+            out[u] = in[u] ^ tmp[u];
+            mac[u] ^= out[u];
+        }
+    } else {
+        for (u = 0; u < len; u ++) {
+            unsigned z;
+
+            z = in[u];
+            mac[u] ^= z;
+            out[u] = z ^ tmp[u];
+        }
+    }
+    if (len < kBlockLength) {
+        mac[len] ^= 0x80;
+    }
+    xor_block(pad, mac);
+    aes_block(mac);
+    xor_block(mac, acc);
+
+    ClearSecretData(tmp, sizeof tmp);
+    ClearSecretData(mac, sizeof mac);
+    ClearSecretData(pad, sizeof pad);
+}
+
+/*
+ * Payload processing. Data is read from 'in' and the result is written
+ * to 'out'; the two may be equal (in-place processing) or disjoint, but
+ * must not overlap partially. This method assumes that the 'state' has
+ * already been checked.
+ */
+template <class Backend, class Policy>
+template <bool C>
+typename std::enable_if<!C>::type
+EAXT<Backend, Policy>::payload_process(bool encrypt, const uint8_t *in, uint8_t *out, size_t len)
+{
+    /*
+     * In non-buffering mode, we process the whole payload in one go, and
+     * the message is then complete.
+     */
+    payload_oneshot(encrypt, in, out, len);
+    state = ST_TAG;
+}
+
+template <class Backend, class Policy>
+template <bool C>
+typename std::enable_if<C>::type
+EAXT<Backend, Policy>::payload_process(bool encrypt, const uint8_t *in, uint8_t *out, size_t len)
+{
+    uint8_t tmp[kBlockLength];
+    size_t u, nFull;
+
+    /*
+     * Complete current block, if applicable.
+     * If ptr == 0, this is a special case: the previous OMAC block
+     * has been encrypted, but the next CTR block has not been generated.
+     */
+    if (this->ptr < kBlockLength) {
+        size_t clen;
+
+        if (this->ptr == 0) {
+            if (len == 0) {
+                return;
+            }
+            ctr_stream(this->buf, 1);
+        }
+        clen = kBlockLength - this->ptr;
+        if (clen > len) {
+            clen = len;
+        }
+        if (encrypt) {
+            for (u = 0; u < clen; u ++) {
+                out[u] = in[u] ^ this->buf[this->ptr + u];
+                this->buf[this->ptr + u] = out[u];
+            }
+        } else {
+            for (u = 0; u < clen; u ++) {
+                unsigned z;
+
+                z = in[u];
+                out[u] = z ^ this->buf[this->ptr + u];
+                this->buf[this->ptr + u] = z;
+            }
+        }
+        in += clen;
+        out += clen;
+        this->ptr += clen;
+        len -= clen;
+    }
+
+    if (len == 0) {
+        return;
+    }
+
+    /*
+     * At that point, the buffer is full, and some data remains afterwards.
+     * Therefore, we can process the buffered block with OMAC.
+     */
+    xor_block(this->buf, this->cbcmac);
+    aes_block(this->cbcmac);
+
+    /*
+     * We now have an empty buffer; we MUST exit this function with a
+     * non-empty buffer, so we process full blocks without buffering
+     * only as long as there remain more than 16 bytes.
+     */
+    nFull = (len - 1) / kBlockLength;
+    ctr_mac_blocks(encrypt, in, out, nFull, this->cbcmac, tmp);
+    in += nFull * kBlockLength;
+    out += nFull * kBlockLength;
+    len -= nFull * kBlockLength;
+
+    /*
+     * Now there are between 1 and 16 bytes that need to be processed.
+     * We need to put the 'len' ciphertext bytes in buf[], along with
+     * the remainder of the CTR stream block.
+     */
+    if (encrypt) {
+        for (u = 0; u < len; u ++) {
+            out[u] = in[u] ^ tmp[u];
+            this->buf[u] = out[u];
+        }
+    } else {
+        for (u = 0; u < len; u ++) {
+            unsigned z;
+
+            z = in[u];
+            out[u] = z ^ tmp[u];
+            this->buf[u] = z;
+        }
+    }
+    memcpy(this->buf + len, tmp + len, kBlockLength - len);
+    this->ptr = len;
+    ClearSecretData(tmp, sizeof tmp);
+}
+
+/*
+ * Payload processing supports in-place and disjoint buffers. If the input
+ * and output buffers overlap partially, the input is first moved to the
+ * output buffer, and processing is done in place.
+ */
+template <class Backend, class Policy>
+inline const uint8_t *
+EAXT<Backend, Policy>::resolve_overlap(const uint8_t *input, size_t len, uint8_t *output)
+{
+    uintptr_t i = (uintptr_t)input, o = (uintptr_t)output;
+
+    if (i != o && i < o + len && o < i + len) {
+        memmove(output, input, len);
+        return output;
+    }
+    return input;
+}
+
+/*
+ * Steps of the public methods that depend on whether the policy enables
+ * chunking. Without chunking, OMAC^1 and OMAC^2 are computed in one go
+ * when the header or payload is provided; with chunking, they run
+ * incrementally over cbcmac[] and buf[].
+ */
+template <class Backend, class Policy>
+template <bool C>
+inline typename std::enable_if<!C>::type
+EAXT<Backend, Policy>::aad_start(void)
+{
+}
+
+template <class Backend, class Policy>
+template <bool C>
+inline typename std::enable_if<C>::type
+EAXT<Backend, Policy>::aad_start(void)
+{
+    /*
+     * Start OMAC^1 for the AAD (header).
+     */
+    omac_start(1);
+}
+
+template <class Backend, class Policy>
+template <bool C>
+inline typename std::enable_if<!C>::type
+EAXT<Backend, Policy>::saved_start(const EAXSaved *sav)
+{
+    (void)sav;
+}
+
+template <class Backend, class Policy>
+template <bool C>
+inline typename std::enable_if<C>::type
+EAXT<Backend, Policy>::saved_start(const EAXSaved *sav)
+{
+#if CONFIG_EAX_NO_CHUNK
+    /*
+     * EAXSaved does not hold the first block of OMAC^2 in this build, so
+     * it is computed here.
+     */
+    (void)sav;
+    memset(this->cbcmac, 0, sizeof this->cbcmac);
+    this->cbcmac[kBlockLength - 1] = 2;
+    aes_block(this->cbcmac);
+#else
+    memcpy(this->cbcmac, sav->om2, sizeof sav->om2);
+#endif
+    this->ptr = 0;
+}
+
+template <class Backend, class Policy>
+template <bool C>
+inline typename std::enable_if<!C>::type
+EAXT<Backend, Policy>::header_process(const uint8_t *header, size_t headerLen)
+{
+    uint8_t mac[kBlockLength];
+
+    omac(1, header, headerLen, mac);
+    xor_block(mac, acc);
+    ClearSecretData(mac, sizeof mac);
+    state = ST_PAYLOAD;
+}
+
+template <class Backend, class Policy>
+template <bool C>
+inline typename std::enable_if<C>::type
+EAXT<Backend, Policy>::header_process(const uint8_t *header, size_t headerLen)
+{
+    omac_process(header, headerLen);
+}
+
+template <class Backend, class Policy>
+template <bool C>
+inline typename std::enable_if<!C>::type
+EAXT<Backend, Policy>::payload_enter(unsigned st)
+{
+    (void)st;
+    if (state == ST_AAD) {
+        InjectHeader(NULL, 0);
+    } else {
+        assert(state == ST_PAYLOAD);
+    }
+}
+
+template <class Backend, class Policy>
+template <bool C>
+inline typename std::enable_if<C>::type
+EAXT<Backend, Policy>::payload_enter(unsigned st)
+{
+    if (state == ST_AAD) {
+        aad_finish();
+        state = st;
+    } else if (state == ST_PAYLOAD) {
+        state = st;
+    } else {
+        assert(state == st);
+    }
+}
+
+template <class Backend, class Policy>
+template <bool C>
+inline typename std::enable_if<!C>::type
+EAXT<Backend, Policy>::tag_finish(void)
+{
+    if (state == ST_AAD || state == ST_PAYLOAD) {
+        /*
+         * If we are not at ST_TAG yet, then the payload and possibly
+         * the AAD have not been provided, which means they are empty.
+         * Calling Encrypt() will set things right.
+         */
+        Encrypt(NULL, 0);
+    } else {
+        assert(state == ST_TAG);
+    }
+}
+
+template <class Backend, class Policy>
+template <bool C>
+inline typename std::enable_if<C>::type
+EAXT<Backend, Policy>::tag_finish(void)
+{
+    if (state == ST_AAD || state == ST_PAYLOAD) {
+        /*
+         * If we are still in ST_AAD, then this means that the
+         * payload is empty. We temporarily claim encryption.
+         */
+        Encrypt(NULL, 0);
+    }
+    if (state == ST_ENCRYPT || state == ST_DECRYPT) {
+        /*
+         * We have to finish OMAC^2.
+         */
+        omac_finish(2);
+        xor_block(this->cbcmac, acc);
+        state = ST_TAG;
+    } else {
+        assert(state == ST_TAG);
+    }
+}
+
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::SetKey(const uint8_t *key, size_t keyLen)
+{
+    /*
+     * Must be in the initial state.
+     */
+    assert(state == ST_EMPTY);
+
+    this->stats_phase(kEAXPhaseKey);
+    backend().AESSetKey(key, keyLen);
+
+    if (Policy::kPadCache) {
+        uint8_t pads[kKeyPadsLength];
+
+        /*
+         * We encrypt the all-zero block, and derive the OMAC pad blocks.
+         */
+        memset(pads, 0, kBlockLength);
+        aes_block(pads);
+        memcpy(pads + kBlockLength, pads, kBlockLength);
+        double_gf128(pads + kBlockLength);
+        memcpy(pads + 2 * kBlockLength, pads + kBlockLength, kBlockLength);
+        double_gf128(pads + 2 * kBlockLength);
+        this->pads_load(pads);
+        ClearSecretData(pads, sizeof pads);
+        wipe_temporaries();
+    }
+
+    state = ST_KEYED;
+}
+
+template <class Backend, class Policy>
+template <class Schedule>
+void
+EAXT<Backend, Policy>::SaveKey(Schedule *sched, uint8_t *pads) const
+{
+    /*
+     * A key must have been set.
+     */
+    assert(state != ST_EMPTY);
+
+    static_cast<const Backend *>(this)->AESSaveKey(sched);
+    this->pads_save(pads);
+}
+
+template <class Backend, class Policy>
+template <class Schedule>
+void
+EAXT<Backend, Policy>::LoadKey(const Schedule *sched, const uint8_t *pads)
+{
+    ClearState();
+    backend().AESLoadKey(sched);
+    this->pads_load(pads);
+    state = ST_KEYED;
+}
+
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::SaveHeader(const uint8_t *header, size_t headerLen, EAXSaved *sav)
+{
+    this->stats_phase(kEAXPhaseHeader);
+    this->stats_add(&EAXStats::SavedHeaders, 1);
+    this->stats_add(&EAXStats::HeaderBytes, headerLen);
+
+    /*
+     * We compute OMAC^1(header) and save it.
+     */
+    omac(1, header, headerLen, sav->aad);
+
+#if !CONFIG_EAX_NO_CHUNK
+    /*
+     * We also pre-process the first block of OMAC^2 (it will be used to
+     * speed up the processing of the ciphertext, except in the
+     * pathological case of an empty ciphertext).
+     */
+    memset(sav->om2, 0, sizeof sav->om2);
+    sav->om2[kBlockLength - 1] = 2;
+    aes_block(sav->om2);
+#endif
+    wipe_temporaries();
+}
+
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::Start(const uint8_t *nonce, size_t nonceLen)
+{
+    /*
+     * A key must have been set.
+     */
+    assert(state != ST_EMPTY);
+
+    this->stats_phase(kEAXPhaseNonce);
+    this->stats_add(&EAXStats::Messages, 1);
+
+    /*
+     * Process the nonce with OMAC^0.
+     * Result is both one of the three values that make up the tag, but
+     * also the initial counter value for CTR encryption.
+     */
+    omac(0, nonce, nonceLen, acc);
+    memcpy(ctr, acc, sizeof acc);
+    this->ks_discard();
+
+    aad_start();
+    state = ST_AAD;
+}
+
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::StartSaved(const uint8_t *nonce, size_t nonceLen, const EAXSaved *sav)
+{
+    Start(nonce, nonceLen);
+    this->stats_add(&EAXStats::SavedHeaderHits, 1);
+    xor_block(sav->aad, acc);
+    saved_start(sav);
+    state = ST_PAYLOAD;
+}
+
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::PrecomputeNonce(const uint8_t *nonce, size_t nonceLen, EAXNonceState *ns)
+{
+    /*
+     * A key must have been set.
+     */
+    assert(state != ST_EMPTY);
+
+    this->stats_phase(kEAXPhaseNonce);
+    omac(0, nonce, nonceLen, ns->om0);
+    wipe_temporaries();
+}
+
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::StartPrecomputed(const EAXNonceState *ns, const EAXSaved *sav)
+{
+    /*
+     * A key must have been set.
+     */
+    assert(state != ST_EMPTY);
+
+    this->stats_add(&EAXStats::Messages, 1);
+
+    memcpy(acc, ns->om0, sizeof acc);
+    memcpy(ctr, ns->om0, sizeof ctr);
+    this->ks_discard();
+
+    if (sav != NULL) {
+        this->stats_add(&EAXStats::SavedHeaderHits, 1);
+        xor_block(sav->aad, acc);
+        saved_start(sav);
+        state = ST_PAYLOAD;
+    } else {
+        aad_start();
+        state = ST_AAD;
+    }
+}
+
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::InjectHeader(const uint8_t *header, size_t headerLen)
+{
+    /*
+     * We can inject AAD only in ST_AAD state.
+     */
+    assert(state == ST_AAD);
+
+    this->stats_phase(kEAXPhaseHeader);
+    this->stats_add(&EAXStats::HeaderBytes, headerLen);
+    header_process(header, headerLen);
+}
+
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::Encrypt(const uint8_t *input, size_t inputLen, uint8_t *output)
+{
+    payload_enter(ST_ENCRYPT);
+    this->stats_phase(kEAXPhasePayload);
+    this->stats_add(&EAXStats::PayloadBytes, inputLen);
+    input = resolve_overlap(input, inputLen, output);
+    payload_process(true, input, output, inputLen);
+}
+
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::Encrypt(uint8_t *data, size_t dataLen)
+{
+    Encrypt(data, dataLen, data);
+}
+
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::Decrypt(const uint8_t *input, size_t inputLen, uint8_t *output)
+{
+    payload_enter(ST_DECRYPT);
+    this->stats_phase(kEAXPhasePayload);
+    this->stats_add(&EAXStats::PayloadBytes, inputLen);
+    input = resolve_overlap(input, inputLen, output);
+    payload_process(false, input, output, inputLen);
+}
+
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::Decrypt(uint8_t *data, size_t dataLen)
+{
+    Decrypt(data, dataLen, data);
+}
+
+template <class Backend, class Policy>
+template <bool C>
+void
+EAXT<Backend, Policy>::InjectHeaderSegments(const EAXSegment *segs, size_t segCount)
+{
+    size_t i;
+
+    static_assert(C, "Segmented processing requires chunking");
+
+    for (i = 0; i < segCount; i ++) {
+        InjectHeader(segs[i].data, segs[i].len);
+    }
+}
+
+/*
+ * Scatter-gather payload processing. The input and output segment lists
+ * are walked in parallel, and each run of bytes that lies within a single
+ * input segment and a single output segment is passed to the chunked
+ * Encrypt() or Decrypt(). Partial blocks at run boundaries are carried
+ * over in buf[], as for any other chunked processing, so the payload is
+ * never gathered into a contiguous buffer.
+ */
+template <class Backend, class Policy>
+template <bool C>
+typename std::enable_if<C>::type
+EAXT<Backend, Policy>::payload_segments(bool encrypt, const EAXSegment *in, size_t inCount, const EAXOutSegment *out, size_t outCount)
+{
+    size_t inOff = 0, outOff = 0;
+
+    /*
+     * Process an empty chunk first, so that the state transition happens
+     * even if all segments are empty.
+     */
+    if (encrypt) {
+        Encrypt(NULL, 0, NULL);
+    } else {
+        Decrypt(NULL, 0, NULL);
+    }
+
+    for (;;) {
+        size_t len;
+
+        while (inCount > 0 && inOff == in->len) {
+            in ++;
+            inCount --;
+            inOff = 0;
+        }
+        while (outCount > 0 && outOff == out->len) {
+            out ++;
+            outCount --;
+            outOff = 0;
+        }
+        if (inCount == 0 || outCount == 0) {
+            break;
+        }
+
+        len = in->len - inOff;
+        if (len > out->len - outOff) {
+            len = out->len - outOff;
+        }
+        if (encrypt) {
+            Encrypt(in->data + inOff, len, out->data + outOff);
+        } else {
+            Decrypt(in->data + inOff, len, out->data + outOff);
+        }
+        inOff += len;
+        outOff += len;
+    }
+
+    /*
+     * The input and output must have the same total length.
+     */
+    assert(inCount == 0 && outCount == 0);
+}
+
+template <class Backend, class Policy>
+template <bool C>
+void
+EAXT<Backend, Policy>::EncryptSegments(const EAXSegment *in, size_t inCount, const EAXOutSegment *out, size_t outCount)
+{
+    static_assert(C, "Segmented processing requires chunking");
+    payload_segments(true, in, inCount, out, outCount);
+}
+
+template <class Backend, class Policy>
+template <bool C>
+void
+EAXT<Backend, Policy>::EncryptSegments(const EAXOutSegment *segs, size_t segCount)
+{
+    size_t i;
+
+    static_assert(C, "Segmented processing requires chunking");
+    Encrypt(NULL, 0, NULL);
+    for (i = 0; i < segCount; i ++) {
+        Encrypt(segs[i].data, segs[i].len, segs[i].data);
+    }
+}
+
+template <class Backend, class Policy>
+template <bool C>
+void
+EAXT<Backend, Policy>::DecryptSegments(const EAXSegment *in, size_t inCount, const EAXOutSegment *out, size_t outCount)
+{
+    static_assert(C, "Segmented processing requires chunking");
+    payload_segments(false, in, inCount, out, outCount);
+}
+
+template <class Backend, class Policy>
+template <bool C>
+void
+EAXT<Backend, Policy>::DecryptSegments(const EAXOutSegment *segs, size_t segCount)
+{
+    size_t i;
+
+    static_assert(C, "Segmented processing requires chunking");
+    Decrypt(NULL, 0, NULL);
+    for (i = 0; i < segCount; i ++) {
+        Decrypt(segs[i].data, segs[i].len, segs[i].data);
+    }
+}
+
+/*
+ * Exported state, version 1:
+ *
+ *   0       version (1)
+ *   1       message state: 1 header, 2 payload not started, 3 encrypting,
+ *           4 decrypting
+ *   2       ptr
+ *   3       zero
+ *   4..19   buf[]
+ *   20..35  cbcmac[]
+ *   36..51  ctr[]
+ *   52..67  acc[]
+ *
+ * Cached CTR stream blocks are not exported: ctr[] is moved back by the
+ * number of unused blocks, so that they are generated again after import.
+ */
+template <class Backend, class Policy>
+template <bool C>
+void
+EAXT<Backend, Policy>::ExportState(uint8_t *out) const
+{
+    uint64_t lo, n;
+
+    static_assert(C, "Exporting the state requires chunking");
+
+    switch (state) {
+    case ST_AAD:
+        out[1] = 1;
+        break;
+    case ST_PAYLOAD:
+        out[1] = 2;
+        break;
+    case ST_ENCRYPT:
+        out[1] = 3;
+        break;
+    case ST_DECRYPT:
+        out[1] = 4;
+        break;
+    default:
+        assert(false);
+        return;
+    }
+    out[0] = 1;
+    out[2] = this->ptr;
+    out[3] = 0;
+    memcpy(out + 4, this->buf, kBlockLength);
+    memcpy(out + 20, this->cbcmac, kBlockLength);
+    memcpy(out + 52, acc, kBlockLength);
+
+    n = this->ks_cached();
+    lo = load_be64(ctr + 8);
+    store_be64(out + 36 + 8, lo - n);
+    store_be64(out + 36, load_be64(ctr) - (lo < n));
+}
+
+template <class Backend, class Policy>
+template <bool C>
+bool
+EAXT<Backend, Policy>::ImportState(const uint8_t *in, size_t inLen)
+{
+    static const uint8_t sStates[] = { ST_AAD, ST_PAYLOAD, ST_ENCRYPT, ST_DECRYPT };
+
+    static_assert(C, "Importing the state requires chunking");
+
+    /*
+     * A key must have been set.
+     */
+    assert(state != ST_EMPTY);
+
+    this->ks_discard();
+    state = ST_KEYED;
+
+    /*
+     * The state may come from storage, so it is checked rather than
+     * asserted. ptr is zero only in the payload states (after
+     * StartSaved()).
+     */
+    if (inLen != kExportStateLength || in[0] != 1 || in[1] < 1 || in[1] > 4 || in[3] != 0
+        || in[2] > kBlockLength || (in[2] == 0 && in[1] == 1)) {
+        return false;
+    }
+
+    this->ptr = in[2];
+    memcpy(this->buf, in + 4, kBlockLength);
+    memcpy(this->cbcmac, in + 20, kBlockLength);
+    memcpy(ctr, in + 36, kBlockLength);
+    memcpy(acc, in + 52, kBlockLength);
+    state = sStates[in[1] - 1];
+    return true;
+}
+
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::GetTag(uint8_t *tag, size_t tagLen)
+{
+    /*
+     * Sanity check on tag length.
+     */
+    assert(tagLen >= kMinTagLength && tagLen <= kMaxTagLength);
+
+    this->stats_phase(kEAXPhaseFinish);
+    tag_finish();
+
+    /* At that point, the tag is in acc[] and state is ST_TAG. */
+    this->ks_discard();
+    memcpy(tag, acc, tagLen);
+    wipe_temporaries();
+}
+
+template <class Backend, class Policy>
+bool
+EAXT<Backend, Policy>::CheckTag(const uint8_t *tag, size_t tagLen)
+{
+    uint8_t tmp[kMaxTagLength];
+    unsigned z;
+    size_t u;
+
+    /*
+     * Invalid tag lengths are reported with false, since that might be
+     * triggered with crafted incoming data.
+     */
+    if (tagLen < kMinTagLength || tagLen > kMaxTagLength) {
+        this->stats_add(&EAXStats::TagFailures, 1);
+        return false;
+    }
+
+    /*
+     * Get the tag and compare it with the provided value. The loop
+     * below performs a constant-time equality comparison.
+     */
+    GetTag(tmp, tagLen);
+    z = 0;
+    for (u = 0; u < tagLen; u ++) {
+        z |= tag[u] ^ tmp[u];
+    }
+    ClearSecretData(tmp, tagLen);
+    this->stats_add(&EAXStats::TagFailures, z != 0);
+    return z == 0;
+}
+
+/*
+ * One-shot processing of a whole message, in place. OMAC^0(nonce) and
+ * OMAC^1(header) are computed without buffering, and the payload goes
+ * through the same single-pass CTR/OMAC^2 code as engines without
+ * chunking. On return, the tag is in acc[].
+ */
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::message_oneshot(bool encrypt, const uint8_t *nonce, size_t nonceLen, const uint8_t *aad, size_t aadLen,
+                               uint8_t *data, size_t len)
+{
+    uint8_t mac[kBlockLength];
+
+    /*
+     * A key must have been set.
+     */
+    assert(state != ST_EMPTY);
+
+    this->stats_phase(kEAXPhaseNonce);
+    this->stats_add(&EAXStats::Messages, 1);
+    omac(0, nonce, nonceLen, acc);
+    memcpy(ctr, acc, sizeof acc);
+    this->ks_discard();
+    this->stats_phase(kEAXPhaseHeader);
+    this->stats_add(&EAXStats::HeaderBytes, aadLen);
+    omac(1, aad, aadLen, mac);
+    xor_block(mac, acc);
+    this->stats_phase(kEAXPhasePayload);
+    this->stats_add(&EAXStats::PayloadBytes, len);
+    payload_oneshot(encrypt, data, data, len);
+    ClearSecretData(mac, sizeof mac);
+    wipe_temporaries();
+    state = ST_TAG;
+}
+
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::Seal(const uint8_t *nonce, size_t nonceLen, const uint8_t *aad, size_t aadLen,
+                    uint8_t *data, size_t len, size_t tagLen)
+{
+    /*
+     * Sanity check on tag length.
+     */
+    assert(tagLen >= kMinTagLength && tagLen <= kMaxTagLength);
+
+    message_oneshot(true, nonce, nonceLen, aad, aadLen, data, len);
+    memcpy(data + len, acc, tagLen);
+}
+
+template <class Backend, class Policy>
+bool
+EAXT<Backend, Policy>::Open(const uint8_t *nonce, size_t nonceLen, const uint8_t *aad, size_t aadLen,
+                    uint8_t *data, size_t len, size_t tagLen)
+{
+    unsigned z;
+    size_t u;
+
+    /*
+     * Invalid tag lengths are reported with false, since that might be
+     * triggered with crafted incoming data.
+     */
+    if (tagLen < kMinTagLength || tagLen > kMaxTagLength) {
+        this->stats_add(&EAXStats::TagFailures, 1);
+        return false;
+    }
+
+    /*
+     * Decrypt, then compare the tag (constant-time). The plaintext of a
+     * message that fails authentication is not returned to the caller.
+     */
+    message_oneshot(false, nonce, nonceLen, aad, aadLen, data, len);
+    z = 0;
+    for (u = 0; u < tagLen; u ++) {
+        z |= data[len + u] ^ acc[u];
+    }
+    if (z != 0) {
+        this->stats_add(&EAXStats::TagFailures, 1);
+        ClearSecretData(data, len);
+    }
+    return z == 0;
+}
+
+/*
+ * Apply the CTR stream to len bytes of data, in place, without any MAC
+ * computation. The stream is generated in batches of kCTRBatchBlocks
+ * blocks, as in ctr_mac_blocks().
+ */
+template <class Backend, class Policy>
+void
+EAXT<Backend, Policy>::ctr_only(uint8_t *data, size_t len)
+{
+    uint8_t ks[kCTRBatchBlocks * kBlockLength];
+
+    if (this->ks_cached() == 0 && aes_modes()) {
+        aes_ctr(ctr, data, data, len);
+        return;
+    }
+
+    while (len > 0) {
+        size_t n, u;
+
+        n = (len + kBlockLength - 1) / kBlockLength;
+        if (n > kCTRBatchBlocks) {
+            n = kCTRBatchBlocks;
+        }
+        ctr_stream(ks, n);
+        for (u = 0; u < n * kBlockLength && u < len; u ++) {
+            data[u] ^= ks[u];
+        }
+        data += u;
+        len -= u;
+    }
+    ClearSecretData(ks, sizeof ks);
+}
+
+template <class Backend, class Policy>
+bool
+EAXT<Backend, Policy>::OpenVerifyFirst(const uint8_t *nonce, size_t nonceLen, const uint8_t *aad, size_t aadLen,
+                               uint8_t *data, size_t len, size_t tagLen)
+{
+    uint8_t mac[kBlockLength];
+    unsigned z;
+    size_t u;
+
+    if (tagLen < kMinTagLength || tagLen > kMaxTagLength) {
+        this->stats_add(&EAXStats::TagFailures, 1);
+        return false;
+    }
+
+    /*
+     * A key must have been set.
+     */
+    assert(state != ST_EMPTY);
+
+    /*
+     * First pass: tag = OMAC^0(nonce) ^ OMAC^1(header) ^ OMAC^2(ciphertext),
+     * compared with the received tag (constant-time).
+     */
+    this->stats_phase(kEAXPhaseNonce);
+    this->stats_add(&EAXStats::Messages, 1);
+    omac(0, nonce, nonceLen, acc);
+    memcpy(ctr, acc, sizeof acc);
+    this->ks_discard();
+    this->stats_phase(kEAXPhaseHeader);
+    this->stats_add(&EAXStats::HeaderBytes, aadLen);
+    omac(1, aad, aadLen, mac);
+    xor_block(mac, acc);
+    this->stats_phase(kEAXPhasePayload);
+    this->stats_add(&EAXStats::PayloadBytes, len);
+    omac(2, data, len, mac);
+    xor_block(mac, acc);
+    state = ST_TAG;
+
+    z = 0;
+    for (u = 0; u < tagLen; u ++) {
+        z |= data[len + u] ^ acc[u];
+    }
+    ClearSecretData(mac, sizeof mac);
+    if (z != 0) {
+        this->stats_add(&EAXStats::TagFailures, 1);
+        wipe_temporaries();
+        return false;
+    }
+
+    /*
+     * Second pass, only for authentic messages: decryption.
+     */
+    ctr_only(data, len);
+    wipe_temporaries();
+    return true;
+}
+
+template <class Backend, class Policy>
+template <bool S>
+void
+EAXT<Backend, Policy>::GetStats(EAXStats & stats) const
+{
+    static_assert(S, "Instrumentation requires the Stats policy");
+    stats = this->EAXStatsState<S>::stats;
+}
+
+template <class Backend, class Policy>
+template <bool S>
+void
+EAXT<Backend, Policy>::ResetStats(void)
+{
+    static_assert(S, "Instrumentation requires the Stats policy");
+    this->stats_reset();
+}
+
+template <class Backend, class Policy>
+template <bool S>
+void
+EAXT<Backend, Policy>::SetStatsClock(EAXClock clock)
+{
+    static_assert(S, "Instrumentation requires the Stats policy");
+    this->EAXStatsState<S>::clock = clock;
+}
+
+#endif /* EAXT_H_ */
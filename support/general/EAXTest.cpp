@@ -27,24 +27,10 @@
 #include <inttypes.h>
 #include <assert.h>
 
-#include "EAX.h"
+#include "EAXTest.h"
 
 namespace {
 
-struct TestVector
-{
-    const uint8_t * MSG;
-    size_t MSGLen;
-    const uint8_t * KEY;
-    size_t KEYLen;
-    const uint8_t * NONCE;
-    size_t NONCELen;
-    const uint8_t * HEADER;
-    size_t HEADERLen;
-    const uint8_t * CIPHER;
-    size_t CIPHERLen;
-};
-
 /*
  * Test Vectors for EAX using AES-128 block cipher.
  *
@@ -104,7 +90,9 @@ uint8_t sTV9_NONCE[] = { 0x22, 0xE7, 0xAD, 0xD9, 0x3C, 0xFC, 0x63, 0x93, 0xC5, 0
 uint8_t sTV9_HEADER[] = { 0x12, 0x67, 0x35, 0xFC, 0xC3, 0x20, 0xD2, 0x5A };
 uint8_t sTV9_CIPHER[] = { 0xCB, 0x89, 0x20, 0xF8, 0x7A, 0x6C, 0x75, 0xCF, 0xF3, 0x96, 0x27, 0xB5, 0x6E, 0x3E, 0xD1, 0x97, 0xC5, 0x52, 0xD2, 0x95, 0xA7, 0xCF, 0xC4, 0x6A, 0xFC, 0x25, 0x3B, 0x46, 0x52, 0xB1, 0xAF, 0x37, 0x95, 0xB1, 0x24, 0xAB, 0x6E };
 
-static TestVector sTestVectors_EAX128[] = {
+}
+
+const EAXTestVector gEAX128TestVectors[] = {
     {
         .MSG = sTV0_MSG,
         .MSGLen = 0,
@@ -227,138 +215,145 @@ static TestVector sTestVectors_EAX128[] = {
     },
 };
 
-size_t sNumTestVectors_EAX128 = sizeof(sTestVectors_EAX128) / sizeof(TestVector);
+const size_t gNumEAX128TestVectors = sizeof(gEAX128TestVectors) / sizeof(EAXTestVector);
+
+namespace {
+
+/*
+ * Known-answer vectors for EAX using the AES-256 block cipher.
+ *
+ * There are no published EAX vectors for AES-256. These were computed with
+ * an independent reference implementation of AES (checked against FIPS-197,
+ * appendix C.3), CMAC and EAX (checked against the vectors above).
+ */
+
+uint8_t s256TV0_MSG[] = {  };
+uint8_t s256TV0_KEY[] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F };
+uint8_t s256TV0_NONCE[] = { 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F };
+uint8_t s256TV0_HEADER[] = { 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27 };
+uint8_t s256TV0_CIPHER[] = { 0x8D, 0xA1, 0xA1, 0x11, 0xD3, 0x83, 0xFD, 0xC0, 0xED, 0xB4, 0x56, 0x59, 0x2E, 0x75, 0x29, 0x39 };
+uint8_t s256TV1_MSG[] = { 0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49, 0x4A, 0x4B, 0x4C, 0x4D, 0x4E, 0x4F, 0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5A, 0x5B, 0x5C, 0x5D, 0x5E, 0x5F, 0x60, 0x61, 0x62, 0x63, 0x64 };
+uint8_t s256TV1_KEY[] = { 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F, 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F };
+uint8_t s256TV1_NONCE[] = { 0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17, 0x18, 0x19, 0x1A, 0x1B, 0x1C, 0x1D, 0x1E, 0x1F };
+uint8_t s256TV1_HEADER[] = { 0x20, 0x21, 0x22, 0x23, 0x24, 0x25, 0x26, 0x27 };
+uint8_t s256TV1_CIPHER[] = { 0x00, 0xD4, 0x88, 0xF5, 0x43, 0x55, 0xF3, 0xF4, 0x51, 0x0D, 0x76, 0x96, 0xA8, 0x8C, 0xCE, 0x0C, 0xE6, 0x28, 0xDB, 0xEE, 0x35, 0x91, 0xCC, 0xCB, 0x7B, 0x6C, 0xC2, 0xE9, 0x58, 0xEE, 0xCA, 0x5D, 0x07, 0x92, 0x53, 0xF3, 0x1C, 0xA8, 0x77, 0x2F, 0x68, 0x4C, 0x4E, 0x08, 0xB3, 0x71, 0xE6, 0x45, 0x6D, 0xAF, 0x46, 0x13, 0xBA };
+uint8_t s256TV2_MSG[] = { 0x01, 0x06, 0x0B, 0x10, 0x15, 0x1A, 0x1F, 0x24, 0x29, 0x2E, 0x33, 0x38, 0x3D, 0x42, 0x47, 0x4C };
+uint8_t s256TV2_KEY[] = { 0x07, 0x24, 0x41, 0x5E, 0x7B, 0x98, 0xB5, 0xD2, 0xEF, 0x0C, 0x29, 0x46, 0x63, 0x80, 0x9D, 0xBA, 0xD7, 0xF4, 0x11, 0x2E, 0x4B, 0x68, 0x85, 0xA2, 0xBF, 0xDC, 0xF9, 0x16, 0x33, 0x50, 0x6D, 0x8A };
+uint8_t s256TV2_NONCE[] = { 0x03, 0x0E, 0x19, 0x24, 0x2F, 0x3A, 0x45, 0x50, 0x5B, 0x66, 0x71, 0x7C };
+uint8_t s256TV2_HEADER[] = {  };
+uint8_t s256TV2_CIPHER[] = { 0x66, 0x55, 0xA0, 0x53, 0x89, 0x49, 0xC0, 0x07, 0x93, 0xC1, 0xFE, 0x23, 0x6A, 0xC5, 0xB7, 0x4E, 0xE6, 0x81, 0xAC, 0xBE, 0x03, 0xEC, 0xF0, 0x2E, 0xFE, 0x58, 0xFC, 0x63, 0xCB, 0xCB, 0x3F, 0xC6 };
+
+}
+
+const EAXTestVector gEAX256TestVectors[] = {
+    {
+        .MSG = s256TV0_MSG,
+        .MSGLen = 0,
+        .KEY = s256TV0_KEY,
+        .KEYLen = 32,
+        .NONCE = s256TV0_NONCE,
+        .NONCELen = 16,
+        .HEADER = s256TV0_HEADER,
+        .HEADERLen = 8,
+        .CIPHER = s256TV0_CIPHER,
+        .CIPHERLen = 16
+    },
+    {
+        .MSG = s256TV1_MSG,
+        .MSGLen = 37,
+        .KEY = s256TV1_KEY,
+        .KEYLen = 32,
+        .NONCE = s256TV1_NONCE,
+        .NONCELen = 16,
+        .HEADER = s256TV1_HEADER,
+        .HEADERLen = 8,
+        .CIPHER = s256TV1_CIPHER,
+        .CIPHERLen = 53
+    },
+    {
+        .MSG = s256TV2_MSG,
+        .MSGLen = 16,
+        .KEY = s256TV2_KEY,
+        .KEYLen = 32,
+        .NONCE = s256TV2_NONCE,
+        .NONCELen = 12,
+        .HEADER = s256TV2_HEADER,
+        .HEADERLen = 0,
+        .CIPHER = s256TV2_CIPHER,
+        .CIPHERLen = 32
+    }
+};
+
+const size_t gNumEAX256TestVectors = sizeof(gEAX256TestVectors) / sizeof(EAXTestVector);
+
+namespace {
+
+/*
+ * Test Vectors for AES-CMAC with a 128-bit key.
+ *
+ * These are taken from RFC 4493, "The AES-CMAC Algorithm", section 4.
+ */
+
+uint8_t sCMACKey[] = { 0x2B, 0x7E, 0x15, 0x16, 0x28, 0xAE, 0xD2, 0xA6, 0xAB, 0xF7, 0x15, 0x88, 0x09, 0xCF, 0x4F, 0x3C };
+uint8_t sCMACMsg[] = {
+    0x6B, 0xC1, 0xBE, 0xE2, 0x2E, 0x40, 0x9F, 0x96, 0xE9, 0x3D, 0x7E, 0x11, 0x73, 0x93, 0x17, 0x2A,
+    0xAE, 0x2D, 0x8A, 0x57, 0x1E, 0x03, 0xAC, 0x9C, 0x9E, 0xB7, 0x6F, 0xAC, 0x45, 0xAF, 0x8E, 0x51,
+    0x30, 0xC8, 0x1C, 0x46, 0xA3, 0x5C, 0xE4, 0x11, 0xE5, 0xFB, 0xC1, 0x19, 0x1A, 0x0A, 0x52, 0xEF,
+    0xF6, 0x9F, 0x24, 0x45, 0xDF, 0x4F, 0x9B, 0x17, 0xAD, 0x2B, 0x41, 0x7B, 0xE6, 0x6C, 0x37, 0x10
+};
+uint8_t sCMACTV0_MAC[] = { 0xBB, 0x1D, 0x69, 0x29, 0xE9, 0x59, 0x37, 0x28, 0x7F, 0xA3, 0x7D, 0x12, 0x9B, 0x75, 0x67, 0x46 };
+uint8_t sCMACTV1_MAC[] = { 0x07, 0x0A, 0x16, 0xB4, 0x6B, 0x4D, 0x41, 0x44, 0xF7, 0x9B, 0xDD, 0x9D, 0xD0, 0x4A, 0x28, 0x7C };
+uint8_t sCMACTV2_MAC[] = { 0xDF, 0xA6, 0x67, 0x47, 0xDE, 0x9A, 0xE6, 0x30, 0x30, 0xCA, 0x32, 0x61, 0x14, 0x97, 0xC8, 0x27 };
+uint8_t sCMACTV3_MAC[] = { 0x51, 0xF0, 0xBE, 0xBF, 0x7E, 0x3B, 0x9D, 0x92, 0xFC, 0x49, 0x74, 0x17, 0x79, 0x36, 0x3C, 0xFE };
 
 }
 
+const CMACTestVector gCMAC128TestVectors[] = {
+    { .MSG = sCMACMsg, .MSGLen = 0, .KEY = sCMACKey, .MAC = sCMACTV0_MAC },
+    { .MSG = sCMACMsg, .MSGLen = 16, .KEY = sCMACKey, .MAC = sCMACTV1_MAC },
+    { .MSG = sCMACMsg, .MSGLen = 40, .KEY = sCMACKey, .MAC = sCMACTV2_MAC },
+    { .MSG = sCMACMsg, .MSGLen = 64, .KEY = sCMACKey, .MAC = sCMACTV3_MAC },
+};
+
+const size_t gNumCMAC128TestVectors = sizeof(gCMAC128TestVectors) / sizeof(CMACTestVector);
+
 void TestEAX128(EAX & eax)
 {
-    for (size_t i = 0; i < sNumTestVectors_EAX128; i++)
+    TestEAX128<EAX>(eax);
+}
+
+bool CheckEAXKnownAnswers(EAX & eax, size_t keyLen)
+{
+    const EAXTestVector * vectors = (keyLen == 16) ? gEAX128TestVectors : gEAX256TestVectors;
+    const size_t count = (keyLen == 16) ? gNumEAX128TestVectors : gNumEAX256TestVectors;
+    uint8_t buf[64];
+    bool ok = true;
+
+    for (size_t i = 0; i < count && ok; i++)
     {
-        const TestVector & tv = sTestVectors_EAX128[i];
-        uint8_t buf[tv.CIPHERLen];
+        const EAXTestVector & tv = vectors[i];
         const uint8_t * const tag = tv.CIPHER + tv.MSGLen;
         const size_t tagLen = tv.CIPHERLen - tv.MSGLen;
 
-        if (i > 0)
+        if (tv.CIPHERLen > sizeof(buf))
         {
-            eax.Reset();
+            return false;
         }
 
-        // Test encryption
+        eax.Reset();
         eax.SetKey(tv.KEY, tv.KEYLen);
         eax.Start(tv.NONCE, tv.NONCELen);
         eax.InjectHeader(tv.HEADER, tv.HEADERLen);
         eax.Encrypt(tv.MSG, tv.MSGLen, buf);
-        assert(memcmp(buf, tv.CIPHER, tv.MSGLen) == 0);
-        if (tagLen > 0)
-        {
-            eax.GetTag(buf, tagLen);
-            assert(memcmp(buf, tag, tagLen) == 0);
-            assert(eax.CheckTag(tag, tagLen) == true);
-        }
+        eax.GetTag(buf + tv.MSGLen, tagLen);
+        ok = (memcmp(buf, tv.CIPHER, tv.CIPHERLen) == 0);
 
-        // Test decryption
-        eax.Reset();
-        eax.SetKey(tv.KEY, tv.KEYLen);
         eax.Start(tv.NONCE, tv.NONCELen);
         eax.InjectHeader(tv.HEADER, tv.HEADERLen);
         eax.Decrypt(tv.CIPHER, tv.MSGLen, buf);
-        assert(memcmp(buf, tv.MSG, tv.MSGLen) == 0);
-        if (tagLen > 0)
-        {
-            eax.GetTag(buf, tagLen);
-            assert(memcmp(buf, tag, tagLen) == 0);
-            assert(eax.CheckTag(tag, tagLen) == true);
-        }
-
-#if !CONFIG_EAX_NO_CHUNK
-
-        // Test chunking of the plain/ciphertext
-        for (size_t chunkLen = 1; chunkLen < tv.MSGLen; chunkLen++)
-        {
-            // Encryption
-            eax.Reset();
-            eax.SetKey(tv.KEY, tv.KEYLen);
-            eax.Start(tv.NONCE, tv.NONCELen);
-            eax.InjectHeader(tv.HEADER, tv.HEADERLen);
-            for (size_t remainingLen = tv.MSGLen; remainingLen > 0; )
-            {
-                size_t len = (remainingLen < chunkLen) ? remainingLen : chunkLen;
-                eax.Encrypt(tv.MSG + tv.MSGLen - remainingLen, len, buf + tv.MSGLen - remainingLen);
-                remainingLen -= len;
-            }
-            assert(memcmp(buf, tv.CIPHER, tv.MSGLen) == 0);
-            if (tagLen > 0)
-            {
-                eax.GetTag(buf, tagLen);
-                assert(memcmp(buf, tag, tagLen) == 0);
-                assert(eax.CheckTag(tag, tagLen) == true);
-            }
-
-            // Decryption
-            eax.Reset();
-            eax.SetKey(tv.KEY, tv.KEYLen);
-            eax.Start(tv.NONCE, tv.NONCELen);
-            eax.InjectHeader(tv.HEADER, tv.HEADERLen);
-            for (size_t remainingLen = tv.MSGLen; remainingLen > 0; )
-            {
-                size_t len = (remainingLen < chunkLen) ? remainingLen : chunkLen;
-                eax.Decrypt(tv.CIPHER + tv.MSGLen - remainingLen, len, buf + tv.MSGLen - remainingLen);
-                remainingLen -= len;
-            }
-            assert(memcmp(buf, tv.MSG, tv.MSGLen) == 0);
-            if (tagLen > 0)
-            {
-                eax.GetTag(buf, tagLen);
-                assert(memcmp(buf, tag, tagLen) == 0);
-                assert(eax.CheckTag(tag, tagLen) == true);
-            }
-        }
-
-        // Test chunking of the header
-        for (size_t chunkLen = 1; chunkLen < tv.HEADERLen; chunkLen++)
-        {
-            // Encryption
-            eax.Reset();
-            eax.SetKey(tv.KEY, tv.KEYLen);
-            eax.Start(tv.NONCE, tv.NONCELen);
-            for (size_t remainingLen = tv.HEADERLen; remainingLen > 0; )
-            {
-                size_t len = (remainingLen < chunkLen) ? remainingLen : chunkLen;
-                eax.InjectHeader(tv.HEADER + tv.HEADERLen - remainingLen, len);
-                remainingLen -= len;
-            }
-            eax.Encrypt(tv.MSG, tv.MSGLen, buf);
-            assert(memcmp(buf, tv.CIPHER, tv.MSGLen) == 0);
-            if (tagLen > 0)
-            {
-                eax.GetTag(buf, tagLen);
-                assert(memcmp(buf, tag, tagLen) == 0);
-                assert(eax.CheckTag(tag, tagLen) == true);
-            }
-
-            // Decryption
-            eax.Reset();
-            eax.SetKey(tv.KEY, tv.KEYLen);
-            eax.Start(tv.NONCE, tv.NONCELen);
-            for (size_t remainingLen = tv.HEADERLen; remainingLen > 0; )
-            {
-                size_t len = (remainingLen < chunkLen) ? remainingLen : chunkLen;
-                eax.InjectHeader(tv.HEADER + tv.HEADERLen - remainingLen, len);
-                remainingLen -= len;
-            }
-            eax.Decrypt(tv.CIPHER, tv.MSGLen, buf);
-            assert(memcmp(buf, tv.MSG, tv.MSGLen) == 0);
-            if (tagLen > 0)
-            {
-                eax.GetTag(buf, tagLen);
-                assert(memcmp(buf, tag, tagLen) == 0);
-                assert(eax.CheckTag(tag, tagLen) == true);
-            }
-        }
-
-#endif // !CONFIG_EAX_NO_CHUNK
-
+        ok = ok && (memcmp(buf, tv.MSG, tv.MSGLen) == 0) && eax.CheckTag(tag, tagLen);
     }
+
+    eax.Reset();
+    return ok;
 }
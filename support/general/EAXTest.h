@@ -0,0 +1,1327 @@
+/*
+ *
+ *    Copyright (c) 2021 Jay Logue
+ *    Copyright (c) 2017 Nest Labs, Inc.
+ *    All rights reserved.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/**
+ *    @file
+ *      Code for testing EAX implementations.
+ *
+ *      The test vectors are defined in EAXTest.cpp.  The test function is
+ *      a template so that it can be used both with the EAX class and with
+ *      devirtualized EAXT<> implementations.  TestEAX128Batch() tests the
+ *      multi-buffer EAXBatch<> class with the same vectors,
+ *      TestEAX128SessionTable() the EAXSessionTable<> class,
+ *      TestEAX128HeaderCache() the EAXHeaderCache<> class,
+ *      TestCMAC128() the CMACT<> class with the backend of an EAX class,
+ *      TestEAX128NonceQueue() the EAXNonceQueue<> class,
+ *      TestEAX128Stream() the EAXStream<> segmented format, and
+ *      TestEAX128Parallel() the EAXParallel<> class and TestEAX128Async()
+ *      the EAXAsync<> class (which the caller must include, as they
+ *      require thread support; TestEAX128Async() is only defined when
+ *      __STDCPP_THREADS__ is).
+ */
+
+#ifndef EAXTEST_H_
+#define EAXTEST_H_
+
+#include <string.h>
+#include <inttypes.h>
+#include <assert.h>
+
+#include <type_traits>
+#if __STDCPP_THREADS__
+#include <condition_variable>
+#include <mutex>
+#endif
+
+#include "EAX.h"
+#include "EAXBatch.h"
+#include "EAXSessionTable.h"
+#include "EAXHeaderCache.h"
+#include "CMACT.h"
+#include "EAXNonceQueue.h"
+#include "EAXStream.h"
+
+struct EAXTestVector
+{
+    const uint8_t * MSG;
+    size_t MSGLen;
+    const uint8_t * KEY;
+    size_t KEYLen;
+    const uint8_t * NONCE;
+    size_t NONCELen;
+    const uint8_t * HEADER;
+    size_t HEADERLen;
+    const uint8_t * CIPHER;
+    size_t CIPHERLen;
+};
+
+/** Standardized test vectors for EAX using the AES-128 block cipher.
+ */
+extern const EAXTestVector gEAX128TestVectors[];
+extern const size_t gNumEAX128TestVectors;
+
+/** Known-answer test vectors for EAX using the AES-256 block cipher.
+ */
+extern const EAXTestVector gEAX256TestVectors[];
+extern const size_t gNumEAX256TestVectors;
+
+struct CMACTestVector
+{
+    const uint8_t * MSG;
+    size_t MSGLen;
+    const uint8_t * KEY;        // 16 bytes
+    const uint8_t * MAC;        // 16 bytes
+};
+
+/** Standardized test vectors for AES-CMAC with a 128-bit key.
+ */
+extern const CMACTestVector gCMAC128TestVectors[];
+extern const size_t gNumCMAC128TestVectors;
+
+/*
+ * Chunked and scatter-gather processing tests of TestEAX128(), for engines
+ * whose policy enables chunking. The segment methods do not compile for
+ * other engines, so the tests are selected at compile time.
+ */
+template <class EAXImpl>
+void TestEAX128Chunking(EAXImpl & eax, const EAXTestVector & tv, uint8_t * buf, std::true_type)
+{
+    const uint8_t * const tag = tv.CIPHER + tv.MSGLen;
+    const size_t tagLen = tv.CIPHERLen - tv.MSGLen;
+
+    // Test chunking of the plain/ciphertext
+    for (size_t chunkLen = 1; chunkLen < tv.MSGLen; chunkLen++)
+    {
+        // Encryption
+        eax.Reset();
+        eax.SetKey(tv.KEY, tv.KEYLen);
+        eax.Start(tv.NONCE, tv.NONCELen);
+        eax.InjectHeader(tv.HEADER, tv.HEADERLen);
+        for (size_t remainingLen = tv.MSGLen; remainingLen > 0; )
+        {
+            size_t len = (remainingLen < chunkLen) ? remainingLen : chunkLen;
+            eax.Encrypt(tv.MSG + tv.MSGLen - remainingLen, len, buf + tv.MSGLen - remainingLen);
+            remainingLen -= len;
+        }
+        assert(memcmp(buf, tv.CIPHER, tv.MSGLen) == 0);
+        if (tagLen > 0)
+        {
+            eax.GetTag(buf, tagLen);
+            assert(memcmp(buf, tag, tagLen) == 0);
+            assert(eax.CheckTag(tag, tagLen) == true);
+        }
+
+        // Decryption
+        eax.Reset();
+        eax.SetKey(tv.KEY, tv.KEYLen);
+        eax.Start(tv.NONCE, tv.NONCELen);
+        eax.InjectHeader(tv.HEADER, tv.HEADERLen);
+        for (size_t remainingLen = tv.MSGLen; remainingLen > 0; )
+        {
+            size_t len = (remainingLen < chunkLen) ? remainingLen : chunkLen;
+            eax.Decrypt(tv.CIPHER + tv.MSGLen - remainingLen, len, buf + tv.MSGLen - remainingLen);
+            remainingLen -= len;
+        }
+        assert(memcmp(buf, tv.MSG, tv.MSGLen) == 0);
+        if (tagLen > 0)
+        {
+            eax.GetTag(buf, tagLen);
+            assert(memcmp(buf, tag, tagLen) == 0);
+            assert(eax.CheckTag(tag, tagLen) == true);
+        }
+    }
+
+    // Test chunking of the header
+    for (size_t chunkLen = 1; chunkLen < tv.HEADERLen; chunkLen++)
+    {
+        // Encryption
+        eax.Reset();
+        eax.SetKey(tv.KEY, tv.KEYLen);
+        eax.Start(tv.NONCE, tv.NONCELen);
+        for (size_t remainingLen = tv.HEADERLen; remainingLen > 0; )
+        {
+            size_t len = (remainingLen < chunkLen) ? remainingLen : chunkLen;
+            eax.InjectHeader(tv.HEADER + tv.HEADERLen - remainingLen, len);
+            remainingLen -= len;
+        }
+        eax.Encrypt(tv.MSG, tv.MSGLen, buf);
+        assert(memcmp(buf, tv.CIPHER, tv.MSGLen) == 0);
+        if (tagLen > 0)
+        {
+            eax.GetTag(buf, tagLen);
+            assert(memcmp(buf, tag, tagLen) == 0);
+            assert(eax.CheckTag(tag, tagLen) == true);
+        }
+
+        // Decryption
+        eax.Reset();
+        eax.SetKey(tv.KEY, tv.KEYLen);
+        eax.Start(tv.NONCE, tv.NONCELen);
+        for (size_t remainingLen = tv.HEADERLen; remainingLen > 0; )
+        {
+            size_t len = (remainingLen < chunkLen) ? remainingLen : chunkLen;
+            eax.InjectHeader(tv.HEADER + tv.HEADERLen - remainingLen, len);
+            remainingLen -= len;
+        }
+        eax.Decrypt(tv.CIPHER, tv.MSGLen, buf);
+        assert(memcmp(buf, tv.MSG, tv.MSGLen) == 0);
+        if (tagLen > 0)
+        {
+            eax.GetTag(buf, tagLen);
+            assert(memcmp(buf, tag, tagLen) == 0);
+            assert(eax.CheckTag(tag, tagLen) == true);
+        }
+    }
+
+    // Test scatter-gather processing, with different segment boundaries
+    // for the header, the input and the output
+    for (size_t split = 0; split <= tv.MSGLen; split++)
+    {
+        const size_t hsplit = split % (tv.HEADERLen + 1);
+        const size_t osplit = tv.MSGLen - split;
+        const EAXSegment hdrSegs[] = {
+            { tv.HEADER, hsplit },
+            { tv.HEADER + hsplit, tv.HEADERLen - hsplit }
+        };
+        const EAXSegment msgSegs[] = {
+            { tv.MSG, split },
+            { NULL, 0 },
+            { tv.MSG + split, tv.MSGLen - split }
+        };
+        const EAXOutSegment bufSegs[] = {
+            { buf, osplit },
+            { buf + osplit, tv.MSGLen - osplit }
+        };
+
+        // Encryption
+        eax.Reset();
+        eax.SetKey(tv.KEY, tv.KEYLen);
+        eax.Start(tv.NONCE, tv.NONCELen);
+        eax.InjectHeaderSegments(hdrSegs, 2);
+        eax.EncryptSegments(msgSegs, 3, bufSegs, 2);
+        assert(memcmp(buf, tv.CIPHER, tv.MSGLen) == 0);
+        if (tagLen > 0)
+        {
+            assert(eax.CheckTag(tag, tagLen) == true);
+        }
+
+        // In-place decryption
+        eax.Reset();
+        eax.SetKey(tv.KEY, tv.KEYLen);
+        eax.Start(tv.NONCE, tv.NONCELen);
+        eax.InjectHeaderSegments(hdrSegs, 2);
+        eax.DecryptSegments(bufSegs, 2);
+        assert(memcmp(buf, tv.MSG, tv.MSGLen) == 0);
+        if (tagLen > 0)
+        {
+            assert(eax.CheckTag(tag, tagLen) == true);
+        }
+    }
+
+    // Test export and import of the state in the middle of the header and
+    // of the payload; the object is rekeyed and used for another message
+    // in between, and some CTR stream is generated ahead of the export
+    for (size_t split = 0; split <= tv.MSGLen; split++)
+    {
+        const size_t hsplit = split % (tv.HEADERLen + 1);
+        uint8_t state[EAXImpl::kExportStateLength];
+
+        // Encryption, exported in the header
+        eax.Reset();
+        eax.SetKey(tv.KEY, tv.KEYLen);
+        eax.Start(tv.NONCE, tv.NONCELen);
+        eax.InjectHeader(tv.HEADER, hsplit);
+        eax.ExportState(state);
+        eax.Reset();
+        eax.SetKey(tv.NONCE, 16);
+        eax.Start(tv.HEADER, tv.HEADERLen);
+        eax.Reset();
+        eax.SetKey(tv.KEY, tv.KEYLen);
+        assert(eax.ImportState(state, sizeof state) == true);
+        eax.InjectHeader(tv.HEADER + hsplit, tv.HEADERLen - hsplit);
+
+        // ... and in the payload
+        eax.Encrypt(tv.MSG, split, buf);
+        eax.PrefillKeystream();
+        eax.ExportState(state);
+        eax.Start(tv.NONCE, tv.NONCELen);
+        assert(eax.ImportState(state, sizeof state) == true);
+        eax.Encrypt(tv.MSG + split, tv.MSGLen - split, buf + split);
+        assert(memcmp(buf, tv.CIPHER, tv.MSGLen) == 0);
+        if (tagLen > 0)
+        {
+            assert(eax.CheckTag(tag, tagLen) == true);
+        }
+
+        // Decryption
+        eax.Start(tv.NONCE, tv.NONCELen);
+        eax.InjectHeader(tv.HEADER, tv.HEADERLen);
+        eax.Decrypt(tv.CIPHER, split, buf);
+        eax.ExportState(state);
+        eax.Reset();
+        eax.SetKey(tv.KEY, tv.KEYLen);
+        assert(eax.ImportState(state, sizeof state) == true);
+        eax.Decrypt(tv.CIPHER + split, tv.MSGLen - split, buf + split);
+        assert(memcmp(buf, tv.MSG, tv.MSGLen) == 0);
+        if (tagLen > 0)
+        {
+            assert(eax.CheckTag(tag, tagLen) == true);
+        }
+
+        // Malformed states are rejected
+        eax.Start(tv.NONCE, tv.NONCELen);
+        eax.ExportState(state);
+        assert(eax.ImportState(state, sizeof state - 1) == false);
+        state[0] ^= 0x80;
+        assert(eax.ImportState(state, sizeof state) == false);
+        state[0] ^= 0x80;
+        state[2] = 17;
+        assert(eax.ImportState(state, sizeof state) == false);
+    }
+}
+
+template <class EAXImpl>
+void TestEAX128Chunking(EAXImpl & eax, const EAXTestVector & tv, uint8_t * buf, std::false_type)
+{
+    (void)eax;
+    (void)tv;
+    (void)buf;
+}
+
+/** Test an implementation of EAX for AES-128 using standardized test vectors.
+ * 
+ *  The function will assert() on error.
+ */
+template <class EAXImpl>
+void TestEAX128(EAXImpl & eax)
+{
+    for (size_t i = 0; i < gNumEAX128TestVectors; i++)
+    {
+        const EAXTestVector & tv = gEAX128TestVectors[i];
+        uint8_t buf[tv.CIPHERLen];
+        const uint8_t * const tag = tv.CIPHER + tv.MSGLen;
+        const size_t tagLen = tv.CIPHERLen - tv.MSGLen;
+
+        if (i > 0)
+        {
+            eax.Reset();
+        }
+
+        // Test encryption
+        eax.SetKey(tv.KEY, tv.KEYLen);
+        eax.Start(tv.NONCE, tv.NONCELen);
+        eax.InjectHeader(tv.HEADER, tv.HEADERLen);
+        eax.Encrypt(tv.MSG, tv.MSGLen, buf);
+        assert(memcmp(buf, tv.CIPHER, tv.MSGLen) == 0);
+        if (tagLen > 0)
+        {
+            eax.GetTag(buf, tagLen);
+            assert(memcmp(buf, tag, tagLen) == 0);
+            assert(eax.CheckTag(tag, tagLen) == true);
+        }
+
+        // Test decryption
+        eax.Reset();
+        eax.SetKey(tv.KEY, tv.KEYLen);
+        eax.Start(tv.NONCE, tv.NONCELen);
+        eax.InjectHeader(tv.HEADER, tv.HEADERLen);
+        eax.Decrypt(tv.CIPHER, tv.MSGLen, buf);
+        assert(memcmp(buf, tv.MSG, tv.MSGLen) == 0);
+        if (tagLen > 0)
+        {
+            eax.GetTag(buf, tagLen);
+            assert(memcmp(buf, tag, tagLen) == 0);
+            assert(eax.CheckTag(tag, tagLen) == true);
+        }
+
+        // Test one-shot Seal() and Open(), with the tag following the
+        // payload in the same buffer. The previous message is left
+        // unfinished, to check that it is abandoned.
+        eax.Reset();
+        eax.SetKey(tv.KEY, tv.KEYLen);
+        eax.Start(tv.NONCE, tv.NONCELen);
+        if (tagLen > 0)
+        {
+            memcpy(buf, tv.MSG, tv.MSGLen);
+            eax.Seal(tv.NONCE, tv.NONCELen, tv.HEADER, tv.HEADERLen, buf, tv.MSGLen, tagLen);
+            assert(memcmp(buf, tv.CIPHER, tv.CIPHERLen) == 0);
+            assert(eax.Open(tv.NONCE, tv.NONCELen, tv.HEADER, tv.HEADERLen, buf, tv.MSGLen, tagLen) == true);
+            assert(memcmp(buf, tv.MSG, tv.MSGLen) == 0);
+
+            memcpy(buf, tv.CIPHER, tv.CIPHERLen);
+            buf[tv.CIPHERLen - 1] ^= 0x01;
+            assert(eax.Open(tv.NONCE, tv.NONCELen, tv.HEADER, tv.HEADERLen, buf, tv.MSGLen, tagLen) == false);
+
+            // Test OpenVerifyFirst(), which must leave the data untouched
+            // when the tag is invalid
+            memcpy(buf, tv.CIPHER, tv.CIPHERLen);
+            buf[tv.CIPHERLen - 1] ^= 0x01;
+            assert(eax.OpenVerifyFirst(tv.NONCE, tv.NONCELen, tv.HEADER, tv.HEADERLen, buf, tv.MSGLen, tagLen) == false);
+            assert(buf[tv.CIPHERLen - 1] == (tv.CIPHER[tv.CIPHERLen - 1] ^ 0x01));
+            assert(memcmp(buf, tv.CIPHER, tv.CIPHERLen - 1) == 0);
+            buf[tv.CIPHERLen - 1] ^= 0x01;
+            assert(eax.OpenVerifyFirst(tv.NONCE, tv.NONCELen, tv.HEADER, tv.HEADERLen, buf, tv.MSGLen, tagLen) == true);
+            assert(memcmp(buf, tv.MSG, tv.MSGLen) == 0);
+        }
+
+        // Test chunked and scatter-gather processing, if the engine
+        // supports it
+        TestEAX128Chunking(eax, tv, buf, std::integral_constant<bool, EAXImpl::PolicyType::kChunk>());
+
+        // Test CTR stream generated ahead of time, with a varying number of
+        // cached blocks, and the cache refilled between chunks
+        for (size_t prefillLen = 0; prefillLen <= EAXImpl::PolicyType::kKeystreamCacheBlocks; prefillLen++)
+        {
+            const size_t firstLen = tv.MSGLen / 2;
+
+            // Encryption
+            eax.Reset();
+            eax.SetKey(tv.KEY, tv.KEYLen);
+            eax.Start(tv.NONCE, tv.NONCELen);
+            assert(eax.PrefillKeystream(prefillLen) == prefillLen);
+            eax.InjectHeader(tv.HEADER, tv.HEADERLen);
+            if (EAXImpl::PolicyType::kChunk)
+            {
+                eax.Encrypt(tv.MSG, firstLen, buf);
+                eax.PrefillKeystream();
+                eax.Encrypt(tv.MSG + firstLen, tv.MSGLen - firstLen, buf + firstLen);
+            }
+            else
+            {
+                eax.Encrypt(tv.MSG, tv.MSGLen, buf);
+            }
+            assert(memcmp(buf, tv.CIPHER, tv.MSGLen) == 0);
+            if (tagLen > 0)
+            {
+                eax.GetTag(buf, tagLen);
+                assert(memcmp(buf, tag, tagLen) == 0);
+            }
+
+            // Decryption
+            eax.Start(tv.NONCE, tv.NONCELen);
+            eax.InjectHeader(tv.HEADER, tv.HEADERLen);
+            assert(eax.PrefillKeystream(prefillLen) == prefillLen);
+            eax.Decrypt(tv.CIPHER, tv.MSGLen, buf);
+            assert(memcmp(buf, tv.MSG, tv.MSGLen) == 0);
+            if (tagLen > 0)
+            {
+                assert(eax.CheckTag(tag, tagLen) == true);
+            }
+        }
+    }
+}
+
+/** Test a multi-buffer EAX implementation for AES-128 using standardized
+ *  test vectors.
+ *
+ *  The test vectors are processed in batches of N, each vector in its own
+ *  lane, so that lanes with different keys and message lengths are
+ *  exercised together. The function will assert() on error.
+ */
+template <class Backend, size_t N>
+void TestEAX128Batch(EAXBatch<Backend, N> & batch)
+{
+    enum { kMaxMsgLen = 64 };
+
+    for (size_t first = 0; first < gNumEAX128TestVectors; first += N)
+    {
+        const size_t count = (gNumEAX128TestVectors - first < N) ? gNumEAX128TestVectors - first : N;
+        uint8_t buf[N][kMaxMsgLen], tag[N][Backend::kMaxTagLength];
+        EAXBatchItem items[N];
+
+        for (size_t i = 0; i < count; i++)
+        {
+            const EAXTestVector & tv = gEAX128TestVectors[first + i];
+
+            assert(tv.MSGLen <= kMaxMsgLen);
+            assert(tv.CIPHERLen - tv.MSGLen == Backend::kMaxTagLength);
+
+            batch.Lane(i).Reset();
+            batch.Lane(i).SetKey(tv.KEY, tv.KEYLen);
+
+            items[i].nonce = tv.NONCE;
+            items[i].nonceLen = tv.NONCELen;
+            items[i].header = tv.HEADER;
+            items[i].headerLen = tv.HEADERLen;
+            items[i].input = tv.MSG;
+            items[i].output = buf[i];
+            items[i].len = tv.MSGLen;
+            items[i].tag = tag[i];
+            items[i].tagLen = Backend::kMaxTagLength;
+        }
+
+        // Test encryption
+        batch.Seal(items, count);
+        for (size_t i = 0; i < count; i++)
+        {
+            const EAXTestVector & tv = gEAX128TestVectors[first + i];
+
+            assert(memcmp(buf[i], tv.CIPHER, tv.MSGLen) == 0);
+            assert(memcmp(tag[i], tv.CIPHER + tv.MSGLen, sizeof(tag[i])) == 0);
+        }
+
+        // Test in-place decryption
+        for (size_t i = 0; i < count; i++)
+        {
+            items[i].input = buf[i];
+        }
+        assert(batch.Open(items, count) == (uint32_t)((1UL << count) - 1));
+        for (size_t i = 0; i < count; i++)
+        {
+            const EAXTestVector & tv = gEAX128TestVectors[first + i];
+
+            assert(memcmp(buf[i], tv.MSG, tv.MSGLen) == 0);
+        }
+
+        // Test rejection of a corrupted tag in the first lane
+        for (size_t i = 0; i < count; i++)
+        {
+            const EAXTestVector & tv = gEAX128TestVectors[first + i];
+
+            items[i].input = tv.CIPHER;
+        }
+        tag[0][0] ^= 0x01;
+        assert(batch.Open(items, count) == (uint32_t)((1UL << count) - 2));
+    }
+}
+
+/** Test an EAX session table for AES-128 using standardized test vectors.
+ *
+ *  Each test vector key is stored as a session, in a table with fewer
+ *  slots than there are test vectors, so that sessions are evicted in
+ *  LRU order. Messages are then encrypted and decrypted with keys bound
+ *  from the table.
+ *
+ *  The function will assert() on error.
+ */
+template <class Backend>
+void TestEAX128SessionTable(void)
+{
+    enum { kCapacity = 4, kMaxMsgLen = 64 };
+    EAXSessionTable<Backend> table;
+    Backend eax;
+    uint8_t buf[kMaxMsgLen + (size_t)Backend::kMaxTagLength];
+
+    assert(gNumEAX128TestVectors > kCapacity);
+    assert(table.Init(kCapacity));
+
+    for (size_t i = 0; i < gNumEAX128TestVectors; i++)
+    {
+        const EAXTestVector & tv = gEAX128TestVectors[i];
+        const size_t tagLen = tv.CIPHERLen - tv.MSGLen;
+
+        assert(tv.MSGLen <= kMaxMsgLen);
+
+        table.SetSessionKey(1000 + i, tv.KEY, tv.KEYLen);
+        assert(table.GetSessionCount() == ((i < kCapacity) ? i + 1 : (size_t)kCapacity));
+
+        // Keep the first session in use, so that it is never evicted
+        assert(table.BindSession(1000, eax));
+
+        // Encrypt with the key of the new session, bound to a context
+        // that was last used with a different key
+        table.Prefetch(1000 + i);
+        assert(table.BindSession(1000 + i, eax));
+        memcpy(buf, tv.MSG, tv.MSGLen);
+        eax.Seal(tv.NONCE, tv.NONCELen, tv.HEADER, tv.HEADERLen, buf, tv.MSGLen, tagLen);
+        assert(memcmp(buf, tv.CIPHER, tv.CIPHERLen) == 0);
+        assert(eax.Open(tv.NONCE, tv.NONCELen, tv.HEADER, tv.HEADERLen, buf, tv.MSGLen, tagLen) == true);
+        assert(memcmp(buf, tv.MSG, tv.MSGLen) == 0);
+
+        // Check that the least recently used session was evicted
+        if (i >= kCapacity)
+        {
+            assert(!table.BindSession(1000 + i - kCapacity + 1, eax));
+        }
+    }
+
+    // Re-keying an existing session replaces its key
+    {
+        const EAXTestVector & tv = gEAX128TestVectors[0];
+
+        table.SetSessionKey(1000 + gNumEAX128TestVectors - 1, tv.KEY, tv.KEYLen);
+        assert(table.GetSessionCount() == kCapacity);
+        assert(table.BindSession(1000 + gNumEAX128TestVectors - 1, eax));
+        memcpy(buf, tv.MSG, tv.MSGLen);
+        eax.Seal(tv.NONCE, tv.NONCELen, tv.HEADER, tv.HEADERLen, buf, tv.MSGLen, tv.CIPHERLen - tv.MSGLen);
+        assert(memcmp(buf, tv.CIPHER, tv.CIPHERLen) == 0);
+    }
+
+    assert(table.RemoveSession(1000));
+    assert(!table.RemoveSession(1000));
+    assert(!table.BindSession(1000, eax));
+    assert(table.GetSessionCount() == kCapacity - 1);
+}
+
+/** Test the header cache (EAXHeaderCache<>) using standardized test
+ *  vectors, including eviction of the least recently used header, removal
+ *  of the entries of a key and uncached long headers.
+ *
+ *  The function will assert() on error.
+ */
+template <class EAXImpl>
+void TestEAX128HeaderCache(EAXImpl & eax)
+{
+    enum { kCapacity = 3, kMaxMsgLen = 64 };
+    EAXHeaderCache<kCapacity, 16> cache;
+    uint8_t buf[kMaxMsgLen + 16];
+
+    assert(gNumEAX128TestVectors > kCapacity);
+
+    for (size_t i = 0; i < gNumEAX128TestVectors; i++)
+    {
+        const EAXTestVector & tv = gEAX128TestVectors[i];
+        const size_t tagLen = tv.CIPHERLen - tv.MSGLen;
+
+        assert(tv.MSGLen <= kMaxMsgLen && tv.HEADERLen <= 16);
+
+        eax.Reset();
+        eax.SetKey(tv.KEY, tv.KEYLen);
+
+        // First use of the header saves it, the following ones use it
+        for (int pass = 0; pass < 2; pass++)
+        {
+            assert(cache.Start(eax, i, tv.NONCE, tv.NONCELen, tv.HEADER, tv.HEADERLen) == (pass != 0));
+            eax.Encrypt(tv.MSG, tv.MSGLen, buf);
+            eax.GetTag(buf + tv.MSGLen, tagLen);
+            assert(memcmp(buf, tv.CIPHER, tv.CIPHERLen) == 0);
+        }
+        assert(cache.Start(eax, i, tv.NONCE, tv.NONCELen, tv.HEADER, tv.HEADERLen));
+        eax.Decrypt(tv.CIPHER, tv.MSGLen, buf);
+        assert(eax.CheckTag(tv.CIPHER + tv.MSGLen, tagLen));
+        assert(memcmp(buf, tv.MSG, tv.MSGLen) == 0);
+        assert(cache.GetCount() == ((i < kCapacity) ? i + 1 : (size_t)kCapacity));
+
+        // The same header under another key id is a different entry
+        if (i >= kCapacity)
+        {
+            assert(cache.Start(eax, i - kCapacity, tv.NONCE, tv.NONCELen, tv.HEADER, tv.HEADERLen) == false);
+            cache.ClearKey(i - kCapacity);
+        }
+    }
+
+    // The least recently used entries have been evicted; the last ones,
+    // and their saved states, are still there
+    {
+        const size_t last = gNumEAX128TestVectors - 1;
+        const EAXTestVector & tv = gEAX128TestVectors[last];
+
+        assert(cache.GetCount() == kCapacity - 1);
+        assert(cache.Start(eax, last, tv.NONCE, tv.NONCELen, tv.HEADER, tv.HEADERLen));
+        eax.Encrypt(tv.MSG, tv.MSGLen, buf);
+        eax.GetTag(buf + tv.MSGLen, tv.CIPHERLen - tv.MSGLen);
+        assert(memcmp(buf, tv.CIPHER, tv.CIPHERLen) == 0);
+        cache.ClearKey(last);
+        assert(cache.GetCount() == kCapacity - 2);
+        assert(cache.Start(eax, last, tv.NONCE, tv.NONCELen, tv.HEADER, tv.HEADERLen) == false);
+    }
+
+    // Headers too long for the cache are processed directly
+    {
+        const EAXTestVector & tv = gEAX128TestVectors[0];
+        uint8_t ref[kMaxMsgLen + 16];
+        uint8_t longHeader[17];
+
+        memset(longHeader, 0x5A, sizeof longHeader);
+        eax.Reset();
+        eax.SetKey(tv.KEY, tv.KEYLen);
+        eax.Start(tv.NONCE, tv.NONCELen);
+        eax.InjectHeader(longHeader, sizeof longHeader);
+        eax.Encrypt(tv.MSG, tv.MSGLen, ref);
+        eax.GetTag(ref + tv.MSGLen, 16);
+        for (int pass = 0; pass < 2; pass++)
+        {
+            assert(cache.Start(eax, 100, tv.NONCE, tv.NONCELen, longHeader, sizeof longHeader) == false);
+            eax.Encrypt(tv.MSG, tv.MSGLen, buf);
+            eax.GetTag(buf + tv.MSGLen, 16);
+            assert(memcmp(buf, ref, tv.MSGLen + 16) == 0);
+        }
+    }
+
+    cache.Clear();
+    assert(cache.GetCount() == 0);
+}
+
+/** Test AES-CMAC (CMACT<>) over the block cipher of an EAX class using
+ *  standardized test vectors: one-shot, chunked and lockstep computation,
+ *  and verification.
+ *
+ *  The function will assert() on error.
+ */
+template <class Backend>
+void TestCMAC128(void)
+{
+    typedef CMACT<Backend> CMAC;
+    CMAC cmac;
+    EAXSegment msgs[CMAC::kMaxMultiCount] = { };
+    uint8_t macs[CMAC::kMaxMultiCount][16];
+    uint8_t mac[16];
+
+    assert(gNumCMAC128TestVectors <= (size_t)CMAC::kMaxMultiCount);
+
+    for (size_t i = 0; i < gNumCMAC128TestVectors; i++)
+    {
+        const CMACTestVector & tv = gCMAC128TestVectors[i];
+
+        cmac.Reset();
+        cmac.SetKey(tv.KEY, 16);
+
+        // One-shot
+        cmac.Compute(tv.MSG, tv.MSGLen, mac);
+        assert(memcmp(mac, tv.MAC, 16) == 0);
+
+        // Chunked, with every chunk length, and a truncated MAC
+        for (size_t chunkLen = 1; chunkLen <= tv.MSGLen; chunkLen++)
+        {
+            cmac.Start();
+            for (size_t pos = 0; pos < tv.MSGLen; pos += chunkLen)
+            {
+                cmac.Update(tv.MSG + pos, (tv.MSGLen - pos < chunkLen) ? tv.MSGLen - pos : chunkLen);
+            }
+            cmac.Finish(mac, 8);
+            assert(memcmp(mac, tv.MAC, 8) == 0);
+        }
+
+        // Verification
+        assert(cmac.Verify(tv.MSG, tv.MSGLen, tv.MAC) == true);
+        assert(cmac.Verify(tv.MSG, tv.MSGLen, tv.MAC, 4) == true);
+        assert(cmac.Verify(tv.MSG, tv.MSGLen, tv.MAC, 0) == false);
+        memcpy(mac, tv.MAC, 16);
+        mac[15] ^= 0x01;
+        assert(cmac.Verify(tv.MSG, tv.MSGLen, mac) == false);
+
+        msgs[i].data = tv.MSG;
+        msgs[i].len = tv.MSGLen;
+    }
+
+    // Lockstep computation of messages of different lengths
+    cmac.ComputeMulti(msgs, gNumCMAC128TestVectors, macs);
+    for (size_t i = 0; i < gNumCMAC128TestVectors; i++)
+    {
+        assert(memcmp(macs[i], gCMAC128TestVectors[i].MAC, 16) == 0);
+    }
+}
+
+/** Test precomputed nonce states (EAXNonceQueue<>) using standardized
+ *  test vectors, and against messages started without precomputation.
+ *
+ *  The function will assert() on error.
+ */
+template <class EAXImpl>
+void TestEAX128NonceQueue(EAXImpl & eax)
+{
+    enum { kDepth = 3, kMaxMsgLen = 64, kMessageCount = 12 };
+    EAXNonceQueue<kDepth> queue;
+    uint8_t nonce[EAXNonceQueue<kDepth>::kMaxNonceLength];
+    uint8_t expected[EAXNonceQueue<kDepth>::kMaxNonceLength];
+    uint8_t buf[kMaxMsgLen + 16], ref[kMaxMsgLen + 16];
+    bool precomputed;
+
+    for (size_t i = 0; i < gNumEAX128TestVectors; i++)
+    {
+        const EAXTestVector & tv = gEAX128TestVectors[i];
+        const size_t tagLen = tv.CIPHERLen - tv.MSGLen;
+
+        assert(tv.MSGLen <= kMaxMsgLen);
+
+        eax.Reset();
+        eax.SetKey(tv.KEY, tv.KEYLen);
+        queue.Init(tv.NONCE, tv.NONCELen);
+        memcpy(expected, tv.NONCE, tv.NONCELen);
+
+        // The first nonce of the sequence is that of the test vector
+        assert(queue.Fill(eax) == kDepth);
+        assert(queue.Fill(eax) == 0);
+        assert(queue.StartNext(eax, nonce, NULL, &precomputed) && precomputed);
+        assert(memcmp(nonce, tv.NONCE, tv.NONCELen) == 0);
+        eax.InjectHeader(tv.HEADER, tv.HEADERLen);
+        eax.Encrypt(tv.MSG, tv.MSGLen, buf);
+        eax.GetTag(buf + tv.MSGLen, tagLen);
+        assert(memcmp(buf, tv.CIPHER, tv.CIPHERLen) == 0);
+
+        // Following nonces, with the queue partially filled or empty, and
+        // filled while a message is in progress
+        for (size_t n = 1; n < kMessageCount; n++)
+        {
+            const bool expectPrecomputed = (queue.GetCount() > 0);
+
+            // Nonces are big-endian counters
+            for (size_t j = tv.NONCELen; j-- > 0 && ++expected[j] == 0; )
+            {
+            }
+
+            assert(queue.StartNext(eax, nonce, NULL, &precomputed));
+            assert(precomputed == expectPrecomputed);
+            assert(memcmp(nonce, expected, tv.NONCELen) == 0);
+            eax.InjectHeader(tv.HEADER, tv.HEADERLen);
+            queue.Fill(eax, n % 3);
+            eax.Encrypt(tv.MSG, tv.MSGLen, buf);
+            eax.GetTag(buf + tv.MSGLen, tagLen);
+
+            eax.Start(nonce, tv.NONCELen);
+            eax.InjectHeader(tv.HEADER, tv.HEADERLen);
+            eax.Encrypt(tv.MSG, tv.MSGLen, ref);
+            eax.GetTag(ref + tv.MSGLen, tagLen);
+            assert(memcmp(buf, ref, tv.CIPHERLen) == 0);
+        }
+
+        // Precomputed nonce with a saved header
+        {
+            EAXSaved sav;
+
+            eax.SaveHeader(tv.HEADER, tv.HEADERLen, &sav);
+            queue.Fill(eax);
+            assert(queue.StartNext(eax, nonce, &sav, &precomputed) && precomputed);
+            eax.Encrypt(tv.MSG, tv.MSGLen, buf);
+            eax.GetTag(buf + tv.MSGLen, tagLen);
+
+            eax.StartSaved(nonce, tv.NONCELen, &sav);
+            eax.Encrypt(tv.MSG, tv.MSGLen, ref);
+            eax.GetTag(ref + tv.MSGLen, tagLen);
+            assert(memcmp(buf, ref, tv.CIPHERLen) == 0);
+        }
+    }
+
+    // A sequence of 1-byte nonces holds 256 of them, wrapping around from
+    // the first one, and then fails
+    {
+        const uint8_t first = 0xF0;
+
+        queue.Init(&first, 1);
+        for (unsigned n = 0; n < 256; n++)
+        {
+            queue.Fill(eax, n % 2);
+            assert(queue.StartNext(eax, nonce));
+            assert(nonce[0] == (uint8_t)(first + n));
+            eax.GetTag(buf, 16);
+        }
+        assert(queue.Fill(eax) == 0);
+        assert(!queue.StartNext(eax, nonce));
+    }
+}
+
+/** Test the segmented stream format (EAXStream<>): round trip, range
+ *  decryption, and detection of modified, reordered and truncated streams.
+ *
+ *  The function will assert() on error.
+ */
+template <class EAXImpl>
+void TestEAX128Stream(EAXImpl & eax)
+{
+    typedef EAXStream<EAXImpl> Stream;
+    enum { kSegmentLength = 40, kMaxMsgLen = 200, kMaxSealedLen = Stream::kHeaderLength + kMaxMsgLen + 6 * 16 };
+    const EAXTestVector & tv = gEAX128TestVectors[0];
+    uint8_t msg[kMaxMsgLen], sealed[kMaxSealedLen], buf[kMaxMsgLen], segmentBuf[kSegmentLength];
+    uint8_t noncePrefix[Stream::kNoncePrefixLength];
+
+    for (size_t u = 0; u < kMaxMsgLen; u++)
+    {
+        msg[u] = (uint8_t)(u * 29 + 3);
+    }
+    memset(noncePrefix, 0x6B, sizeof(noncePrefix));
+
+    eax.Reset();
+    eax.SetKey(tv.KEY, tv.KEYLen);
+
+    for (size_t msgLen = 0; msgLen <= kMaxMsgLen; msgLen += (msgLen < 2 * kSegmentLength) ? 1 : 37)
+    {
+        Stream sealer, opener;
+        size_t sealedLen;
+
+        assert(sealer.InitSeal(eax, noncePrefix, kSegmentLength, msgLen));
+        sealedLen = (size_t)sealer.GetSealedLength();
+        assert(sealedLen <= kMaxSealedLen);
+        assert(sealer.GetSegmentCount() == ((msgLen == 0) ? 1 : (msgLen + kSegmentLength - 1) / kSegmentLength));
+
+        // Seal the segments in reverse order; the result doesn't depend on it
+        sealer.GetHeader(sealed);
+        for (uint64_t i = sealer.GetSegmentCount(); i-- > 0; )
+        {
+            sealer.SealSegment(eax, i, msg, sealed);
+        }
+
+        // Open the whole stream
+        assert(opener.InitOpen(eax, sealed, sealedLen));
+        assert(opener.GetPlaintextLength() == msgLen);
+        assert(opener.GetSegmentCount() == sealer.GetSegmentCount());
+        for (uint64_t i = 0; i < opener.GetSegmentCount(); i++)
+        {
+            assert(opener.OpenSegment(eax, i, sealed, buf + i * kSegmentLength));
+        }
+        assert(memcmp(buf, msg, msgLen) == 0);
+
+        // Open ranges
+        for (size_t offset = 0; offset <= msgLen; offset += 7)
+        {
+            size_t len = (msgLen - offset) / 2 + 1;
+            if (len > msgLen - offset)
+            {
+                len = msgLen - offset;
+            }
+            memset(buf, 0, sizeof(buf));
+            assert(opener.OpenRange(eax, sealed, offset, len, buf, segmentBuf));
+            assert(memcmp(buf, msg + offset, len) == 0);
+        }
+        assert(!opener.OpenRange(eax, sealed, msgLen, 1, buf, segmentBuf));
+
+        // Modified ciphertext
+        sealed[sealedLen - 1] ^= 0x01;
+        assert(!opener.OpenSegment(eax, opener.GetSegmentCount() - 1, sealed, buf));
+        sealed[sealedLen - 1] ^= 0x01;
+
+        // Modified header
+        sealed[Stream::kHeaderLength - 1] ^= 0x01;
+        assert(opener.InitOpen(eax, sealed, sealedLen));
+        assert(!opener.OpenSegment(eax, 0, sealed, buf));
+        sealed[Stream::kHeaderLength - 1] ^= 0x01;
+
+        if (sealer.GetSegmentCount() >= 2)
+        {
+            // Truncated after a full segment: the new last segment was not
+            // sealed as the last one
+            assert(opener.InitOpen(eax, sealed, sealer.GetSegmentOffset(1)));
+            assert(!opener.OpenSegment(eax, 0, sealed, buf));
+
+            // Swapped segments
+            uint8_t tmp[kSegmentLength + 16];
+            uint8_t * const seg0 = sealed + sealer.GetSegmentOffset(0);
+            uint8_t * const seg1 = sealed + sealer.GetSegmentOffset(1);
+            if (sealer.GetSegmentPlaintextLength(1) == kSegmentLength)
+            {
+                memcpy(tmp, seg0, sizeof(tmp));
+                memcpy(seg0, seg1, sizeof(tmp));
+                memcpy(seg1, tmp, sizeof(tmp));
+                assert(opener.InitOpen(eax, sealed, sealedLen));
+                assert(!opener.OpenSegment(eax, 0, sealed, buf));
+                assert(!opener.OpenSegment(eax, 1, sealed, buf));
+            }
+        }
+    }
+
+    // Invalid sealed lengths and headers
+    {
+        Stream sealer, opener;
+
+        assert(sealer.InitSeal(eax, noncePrefix, kSegmentLength, 0));
+        sealer.GetHeader(sealed);
+        assert(!opener.InitOpen(eax, sealed, Stream::kHeaderLength + 15));
+        assert(!opener.InitOpen(eax, sealed, Stream::kHeaderLength + (size_t)kSegmentLength + 16 + 15));
+        sealed[4] ^= 0x80;
+        assert(!opener.InitOpen(eax, sealed, Stream::kHeaderLength + 16));
+    }
+
+    // Invalid segment lengths, and more segments than indexes
+    {
+        Stream sealer;
+
+        assert(!sealer.InitSeal(eax, noncePrefix, 0, 100));
+        assert(!sealer.InitSeal(eax, noncePrefix, Stream::kMaxSegmentLength + 1, 100));
+        assert(sealer.InitSeal(eax, noncePrefix, 1, UINT32_MAX));
+        assert(sealer.GetSegmentCount() == UINT32_MAX);
+        assert(!sealer.InitSeal(eax, noncePrefix, 1, (uint64_t)UINT32_MAX + 1));
+        assert(!sealer.InitSeal(eax, noncePrefix, 16, (uint64_t)UINT32_MAX * 16 + 1));
+    }
+}
+
+/** Clock for TestEAX128Stats(), which advances by one at each reading.
+ */
+inline uint64_t EAXTestClock(void)
+{
+    static uint64_t sNow;
+    return ++sNow;
+}
+
+/** Test the instrumentation counters (EAXT::GetStats()) of an
+ *  implementation whose policy enables Stats.
+ *
+ *  The function will assert() on error.
+ */
+template <class EAXImpl>
+void TestEAX128Stats(EAXImpl & eax)
+{
+    enum { kHeaderLen = 20, kMsgLen = 100, kTagLen = 16 };
+    const EAXTestVector & tv = gEAX128TestVectors[0];
+    uint8_t header[kHeaderLen], buf[kMsgLen + kTagLen], ref[kMsgLen + kTagLen];
+    EAXStats seal, chunked, stats;
+    EAXSaved sav;
+
+    memset(header, 0x5A, sizeof(header));
+    for (size_t u = 0; u < kMsgLen; u++)
+    {
+        ref[u] = (uint8_t)(u * 7 + 1);
+    }
+
+    eax.Reset();
+    eax.ResetStats();
+    eax.SetStatsClock(EAXTestClock);
+    eax.GetStats(stats);
+    assert(stats.Messages == 0 && stats.BackendCalls == 0 && stats.BackendTime == 0);
+
+    eax.SetKey(tv.KEY, tv.KEYLen);
+    eax.GetStats(stats);
+    assert(stats.Blocks[kEAXPhaseKey] == (EAXImpl::PolicyType::kPadCache ? 1u : 0u));
+
+    // One-shot message: the work is split by phase
+    eax.ResetStats();
+    memcpy(buf, ref, kMsgLen);
+    eax.Seal(tv.NONCE, tv.NONCELen, header, kHeaderLen, buf, kMsgLen, kTagLen);
+    eax.GetStats(seal);
+    assert(seal.Messages == 1);
+    assert(seal.HeaderBytes == kHeaderLen && seal.PayloadBytes == kMsgLen);
+    assert(seal.Blocks[kEAXPhaseKey] == 0);
+    assert(seal.Blocks[kEAXPhaseNonce] >= 1);
+    assert(seal.Blocks[kEAXPhaseHeader] >= 2);
+    assert(seal.Blocks[kEAXPhasePayload] >= 2 * ((kMsgLen + 15) / 16));
+    assert(seal.Blocks[kEAXPhaseFinish] == 0);
+
+    // Each backend call reads the clock twice, one tick apart
+    assert(seal.BackendCalls > 0 && seal.BackendTime == seal.BackendCalls);
+
+    // The same message, processed in chunks, takes the same number of
+    // block encryptions, with the last OMAC block in the finish phase
+    eax.ResetStats();
+    eax.Start(tv.NONCE, tv.NONCELen);
+    eax.InjectHeader(header, kHeaderLen);
+    eax.Encrypt(ref, kMsgLen);
+    eax.GetTag(ref + kMsgLen, kTagLen);
+    eax.GetStats(chunked);
+    assert(memcmp(buf, ref, kMsgLen + kTagLen) == 0);
+    assert(chunked.Messages == 1);
+    assert(chunked.HeaderBytes == kHeaderLen && chunked.PayloadBytes == kMsgLen);
+    assert(chunked.Blocks[kEAXPhaseNonce] == seal.Blocks[kEAXPhaseNonce]);
+    assert(chunked.Blocks[kEAXPhaseHeader] == seal.Blocks[kEAXPhaseHeader]);
+    assert(chunked.Blocks[kEAXPhasePayload] + chunked.Blocks[kEAXPhaseFinish] == seal.Blocks[kEAXPhasePayload]);
+
+    // Messages started with a saved header skip the header phase
+    eax.ResetStats();
+    eax.SaveHeader(header, kHeaderLen, &sav);
+    eax.GetStats(stats);
+    assert(stats.SavedHeaders == 1 && stats.HeaderBytes == kHeaderLen);
+    for (int i = 0; i < 3; i++)
+    {
+        eax.StartSaved(tv.NONCE, tv.NONCELen, &sav);
+        eax.Decrypt(buf, kMsgLen, ref);
+        assert(eax.CheckTag(buf + kMsgLen, kTagLen) == true);
+    }
+    eax.GetStats(stats);
+    assert(stats.Messages == 3 && stats.SavedHeaderHits == 3);
+    assert(stats.HeaderBytes == kHeaderLen && stats.PayloadBytes == 3 * kMsgLen);
+    assert(stats.TagFailures == 0);
+
+    // Tag failures, from all the verification methods
+    eax.ResetStats();
+    buf[kMsgLen] ^= 1;
+    eax.Start(tv.NONCE, tv.NONCELen);
+    eax.InjectHeader(header, kHeaderLen);
+    eax.Decrypt(buf, kMsgLen, ref);
+    assert(eax.CheckTag(buf + kMsgLen, kTagLen) == false);
+    assert(eax.OpenVerifyFirst(tv.NONCE, tv.NONCELen, header, kHeaderLen, buf, kMsgLen, kTagLen) == false);
+    assert(eax.Open(tv.NONCE, tv.NONCELen, header, kHeaderLen, buf, kMsgLen, kTagLen) == false);
+    assert(eax.Open(tv.NONCE, tv.NONCELen, header, kHeaderLen, buf, kMsgLen, 0) == false);
+    eax.GetStats(stats);
+    assert(stats.TagFailures == 4 && stats.Messages == 3);
+
+    // Without a clock, backend time is not measured
+    eax.ResetStats();
+    eax.SetStatsClock(NULL);
+    eax.Seal(tv.NONCE, tv.NONCELen, header, kHeaderLen, buf, kMsgLen, kTagLen);
+    eax.GetStats(stats);
+    assert(stats.BackendCalls > 0 && stats.BackendTime == 0);
+}
+
+/** Test multi-threaded payload processing (EAXParallel<>) using standardized
+ *  test vectors, and against single-threaded processing of random messages.
+ *
+ *  'par' should have a small chunk length and minimum length, so that the
+ *  test vectors go through the threaded code.
+ *
+ *  The function will assert() on error.
+ */
+template <class ParallelImpl>
+void TestEAX128Parallel(ParallelImpl & par)
+{
+    typedef typename ParallelImpl::BackendType Backend;
+    enum { kMaxMsgLen = 20000, kRandomTestCount = 40 };
+    static uint8_t msg[kMaxMsgLen], ref[kMaxMsgLen], buf[kMaxMsgLen];
+    Backend eax, refEAX;
+    uint8_t tag[16], refTag[16];
+    uint32_t rnd = 0x12345678;
+
+    for (size_t i = 0; i < gNumEAX128TestVectors; i++)
+    {
+        const EAXTestVector & tv = gEAX128TestVectors[i];
+        const uint8_t * const tvTag = tv.CIPHER + tv.MSGLen;
+        const size_t tagLen = tv.CIPHERLen - tv.MSGLen;
+
+        eax.Reset();
+        eax.SetKey(tv.KEY, tv.KEYLen);
+
+        // Encryption
+        eax.Start(tv.NONCE, tv.NONCELen);
+        eax.InjectHeader(tv.HEADER, tv.HEADERLen);
+        par.Encrypt(eax, tv.MSG, tv.MSGLen, buf);
+        assert(memcmp(buf, tv.CIPHER, tv.MSGLen) == 0);
+        if (tagLen > 0)
+        {
+            assert(eax.CheckTag(tvTag, tagLen) == true);
+        }
+
+        // In-place decryption
+        eax.Start(tv.NONCE, tv.NONCELen);
+        eax.InjectHeader(tv.HEADER, tv.HEADERLen);
+        par.Decrypt(eax, buf, tv.MSGLen);
+        assert(memcmp(buf, tv.MSG, tv.MSGLen) == 0);
+        if (tagLen > 0)
+        {
+            assert(eax.CheckTag(tvTag, tagLen) == true);
+        }
+    }
+
+    // Random messages, keys and split points, against single-threaded
+    // processing; part of the payload is given to the EAX object directly.
+    for (size_t i = 0; i < kRandomTestCount; i++)
+    {
+        uint8_t key[16], nonce[16];
+        size_t msgLen, headLen, tailLen, u;
+
+        for (u = 0; u < kMaxMsgLen; u++)
+        {
+            rnd ^= rnd << 13; rnd ^= rnd >> 17; rnd ^= rnd << 5;
+            msg[u] = (uint8_t)rnd;
+        }
+        memcpy(key, msg, sizeof(key));
+        memcpy(nonce, msg + sizeof(key), sizeof(nonce));
+        msgLen = rnd % kMaxMsgLen;
+        headLen = (msgLen > 0) ? (rnd >> 16) % 40 % (msgLen + 1) : 0;
+        tailLen = (msgLen - headLen > 0) ? (rnd >> 8) % 40 % (msgLen - headLen + 1) : 0;
+
+        refEAX.Reset();
+        refEAX.SetKey(key, sizeof(key));
+        refEAX.Start(nonce, sizeof(nonce));
+        refEAX.InjectHeader(msg, i);
+        refEAX.Encrypt(msg, msgLen, ref);
+        refEAX.GetTag(refTag, sizeof(refTag));
+
+        eax.Reset();
+        eax.SetKey(key, sizeof(key));
+
+        // Encryption, with every other message started from a saved header
+        if ((i & 1) == 0)
+        {
+            eax.Start(nonce, sizeof(nonce));
+            eax.InjectHeader(msg, i);
+        }
+        else
+        {
+            EAXSaved sav;
+
+            eax.SaveHeader(msg, i, &sav);
+            eax.StartSaved(nonce, sizeof(nonce), &sav);
+        }
+        eax.Encrypt(msg, headLen, buf);
+        par.Encrypt(eax, msg + headLen, msgLen - headLen - tailLen, buf + headLen);
+        eax.Encrypt(msg + msgLen - tailLen, tailLen, buf + msgLen - tailLen);
+        eax.GetTag(tag, sizeof(tag));
+        assert(memcmp(buf, ref, msgLen) == 0);
+        assert(memcmp(tag, refTag, sizeof(tag)) == 0);
+
+        // Decryption, in place and to a separate buffer
+        eax.Start(nonce, sizeof(nonce));
+        eax.InjectHeader(msg, i);
+        par.Decrypt(eax, buf, msgLen);
+        assert(memcmp(buf, msg, msgLen) == 0);
+        assert(eax.CheckTag(refTag, sizeof(refTag)) == true);
+
+        eax.Start(nonce, sizeof(nonce));
+        eax.InjectHeader(msg, i);
+        eax.Decrypt(ref, headLen, buf);
+        par.Decrypt(eax, ref + headLen, msgLen - headLen, buf + headLen);
+        assert(memcmp(buf, msg, msgLen) == 0);
+        assert(eax.CheckTag(refTag, sizeof(refTag)) == true);
+    }
+}
+
+#if __STDCPP_THREADS__
+
+/*
+ * Count of the jobs done in TestEAX128Async(), which the test thread waits
+ * on.
+ */
+struct EAXTestJobCount
+{
+    std::mutex lock;
+    std::condition_variable cond;
+    size_t done;
+
+    EAXTestJobCount(void) : done(0) { }
+
+    void Add(void)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        done++;
+        cond.notify_all();
+    }
+
+    void Wait(size_t count)
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        while (done != count)
+        {
+            cond.wait(guard);
+        }
+        done = 0;
+    }
+};
+
+#if EAXASYNC_COROUTINES
+
+/*
+ * Coroutine that awaits one job of an EAXAsync<> object, checks its result
+ * and counts it as done.
+ */
+struct EAXTestTask
+{
+    struct promise_type
+    {
+        EAXTestTask get_return_object(void) { return EAXTestTask(); }
+        std::suspend_never initial_suspend(void) { return std::suspend_never(); }
+        std::suspend_never final_suspend(void) noexcept { return std::suspend_never(); }
+        void return_void(void) { }
+        void unhandled_exception(void) { }
+    };
+};
+
+template <class AsyncImpl>
+EAXTestTask EAXTestAwaitJob(AsyncImpl & async, typename AsyncImpl::Job * job, bool expected, EAXTestJobCount * done)
+{
+    bool result = co_await async.Run(job);
+    assert(result == expected);
+    done->Add();
+}
+
+#endif // EAXASYNC_COROUTINES
+
+/*
+ * Completion callback of TestEAX128Async(): counts the jobs done.
+ */
+template <class AsyncImpl>
+void EAXTestJobDone(typename AsyncImpl::Job * job, void * context)
+{
+    (void)job;
+    static_cast<EAXTestJobCount *>(context)->Add();
+}
+
+/** Test asynchronous jobs (EAXAsync<>) using standardized test vectors:
+ *  seal jobs, open jobs with valid and invalid tags, more jobs than fit
+ *  in a batch, and jobs awaited by coroutines when these are available.
+ *
+ *  The function will assert() on error.
+ */
+template <class AsyncImpl>
+void TestEAX128Async(AsyncImpl & async)
+{
+    typedef typename AsyncImpl::Job Job;
+    typedef typename AsyncImpl::Key Key;
+    enum { kMaxVectors = 16, kMaxMsgLen = 64, kJobsPerVector = 3 };
+    static Key keys[kMaxVectors];
+    static Job jobs[kMaxVectors][kJobsPerVector];
+    static uint8_t bufs[kMaxVectors][kJobsPerVector][kMaxMsgLen + 16];
+    EAXTestJobCount done;
+    size_t i, j;
+
+    assert(gNumEAX128TestVectors <= kMaxVectors);
+
+    for (i = 0; i < gNumEAX128TestVectors; i++)
+    {
+        const EAXTestVector & tv = gEAX128TestVectors[i];
+        const size_t tagLen = tv.CIPHERLen - tv.MSGLen;
+
+        assert(tv.MSGLen <= kMaxMsgLen);
+        AsyncImpl::ExpandKey(tv.KEY, tv.KEYLen, &keys[i]);
+
+        // Seal, open, and open with an invalid tag
+        memcpy(bufs[i][1], tv.CIPHER, tv.CIPHERLen);
+        memcpy(bufs[i][2], tv.CIPHER, tv.CIPHERLen);
+        bufs[i][2][tv.CIPHERLen - 1] ^= 0x01;
+        for (j = 0; j < kJobsPerVector; j++)
+        {
+            Job & job = jobs[i][j];
+
+            job.item.nonce = tv.NONCE;
+            job.item.nonceLen = tv.NONCELen;
+            job.item.header = tv.HEADER;
+            job.item.headerLen = tv.HEADERLen;
+            job.item.input = (j == 0) ? tv.MSG : bufs[i][j];
+            job.item.output = bufs[i][j];
+            job.item.len = tv.MSGLen;
+            job.item.tag = bufs[i][j] + tv.MSGLen;
+            job.item.tagLen = tagLen;
+            job.key = &keys[i];
+            job.seal = (j == 0);
+            job.result = (j == 2);
+            job.callback = EAXTestJobDone<AsyncImpl>;
+            job.context = &done;
+            async.Submit(&job);
+        }
+    }
+    async.Flush();
+    done.Wait(gNumEAX128TestVectors * kJobsPerVector);
+
+    for (i = 0; i < gNumEAX128TestVectors; i++)
+    {
+        const EAXTestVector & tv = gEAX128TestVectors[i];
+
+        assert(jobs[i][0].result == true);
+        assert(memcmp(bufs[i][0], tv.CIPHER, tv.CIPHERLen) == 0);
+        assert(jobs[i][1].result == true);
+        assert(memcmp(bufs[i][1], tv.MSG, tv.MSGLen) == 0);
+        assert(jobs[i][2].result == false);
+    }
+
+#if EAXASYNC_COROUTINES
+    // The same open jobs, awaited by coroutines
+    for (i = 0; i < gNumEAX128TestVectors; i++)
+    {
+        const EAXTestVector & tv = gEAX128TestVectors[i];
+
+        for (j = 1; j < kJobsPerVector; j++)
+        {
+            memcpy(bufs[i][j], tv.CIPHER, tv.CIPHERLen);
+            bufs[i][j][tv.CIPHERLen - 1] ^= (uint8_t)(j - 1);
+            EAXTestAwaitJob(async, &jobs[i][j], j == 1, &done);
+        }
+    }
+    async.Flush();
+    done.Wait(gNumEAX128TestVectors * (kJobsPerVector - 1));
+
+    for (i = 0; i < gNumEAX128TestVectors; i++)
+    {
+        assert(memcmp(bufs[i][1], gEAX128TestVectors[i].MSG, gEAX128TestVectors[i].MSGLen) == 0);
+    }
+#endif // EAXASYNC_COROUTINES
+
+    for (i = 0; i < gNumEAX128TestVectors; i++)
+    {
+        AsyncImpl::ClearKey(&keys[i]);
+    }
+}
+
+#endif // __STDCPP_THREADS__
+
+#endif // EAXTEST_H_
@@ -40,6 +40,10 @@
 #include <FunctExitUtils.h>
 #include <LESCOOB.h>
 
+#if NRF_CRYPTO_ENABLED
+#include <EAXT.h>
+#endif // NRF_CRYPTO_ENABLED
+
 namespace {
 
 void ToHexString(uint8_t * data, size_t dataLen, char * outBuf, size_t outBufSize)
@@ -121,6 +125,10 @@ ret_code_t ComputeLESCOOBConfirmationValue(const uint8_t * pkx, const uint8_t *
     // the purposes of this computation.  Likewise, the resultant confirmation value is also
     // byte reversed relative to the output of the AES-CMAC function.
     //
+    // The MAC is computed directly with the CMAC mode of nrf_crypto (a single key setup
+    // on CC310), rather than with CMACT<>, which would also derive the CMAC pads with the
+    // block cipher, and could not report errors of the nrf_crypto calls to the caller.
+    //
 
     // Clear the output buffer.
     memset(c, 0, kBLELESCOOBConfirmLength);
@@ -156,8 +164,8 @@ ret_code_t ComputeLESCOOBConfirmationValue(const uint8_t * pkx, const uint8_t *
 
 exit:
     // Clear potentially sensitive data from the stack.
-    memset(&macCtx, 0, sizeof(macCtx));
-    memset(buf, 0, sizeof(buf));
+    EAXSecureWipe(&macCtx, sizeof(macCtx));
+    EAXSecureWipe(buf, sizeof(buf));
 
     return res;
 }
@@ -0,0 +1,243 @@
+/*
+ *
+ *    Copyright (c) 2021 Jay Logue
+ *    All rights reserved.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/**
+ *   @file
+ *         Host-side mock of the nrf_crypto AES API (see nRF5Mock.h).
+ *
+ *         Like the CC310 backend of nrf_crypto, update calls take whole
+ *         blocks only; the trailing partial block of a CTR or CMAC
+ *         computation must be passed to finalize. Input that is not in RAM
+ *         (see nrfx_is_in_ram()), which the CC310 cannot read by DMA, is
+ *         rejected with NRF_ERROR_CRYPTO_INPUT_LOCATION.
+ */
+
+#include <string.h>
+#include <assert.h>
+
+#include <nrf_crypto.h>
+#include <nrfx.h>
+#include <EAX-Soft.h>
+
+const nrf_crypto_aes_info_t g_nrf_crypto_aes_ecb_128_info = { NRF_CRYPTO_AES_MODE_ECB, 128 };
+const nrf_crypto_aes_info_t g_nrf_crypto_aes_ecb_256_info = { NRF_CRYPTO_AES_MODE_ECB, 256 };
+const nrf_crypto_aes_info_t g_nrf_crypto_aes_ctr_128_info = { NRF_CRYPTO_AES_MODE_CTR, 128 };
+const nrf_crypto_aes_info_t g_nrf_crypto_aes_cmac_128_info = { NRF_CRYPTO_AES_MODE_CMAC, 128 };
+
+NRFMockCryptoStats gNRFMockCryptoStats;
+
+namespace {
+
+enum {
+    kBlockLength = NRF_CRYPTO_AES_BLOCK_SIZE
+};
+
+static_assert(sizeof(((nrf_crypto_aes_context_t *)0)->round_keys) >= SOFT_AES_KEY_WORDS(14) * sizeof(uint64_t),
+              "nrf_crypto_aes_context_t too small for an AES-256 key schedule");
+
+void EncryptBlock(const nrf_crypto_aes_context_t *ctx, uint8_t *data)
+{
+    SoftAESEncryptBlock(ctx->round_keys, (ctx->p_info->key_size == 256) ? 14 : 10, data);
+}
+
+void IncrCounter(uint8_t *ctr)
+{
+    for (int i = kBlockLength - 1; i >= 0 && ++ctr[i] == 0; i--)
+        ;
+}
+
+void XorBlock(const uint8_t *in, uint8_t *out, size_t len)
+{
+    for (size_t i = 0; i < len; i++) {
+        out[i] ^= in[i];
+    }
+}
+
+/*
+ * CTR and ECB both process data in place, from a copy of the input.
+ */
+void ProcessData(nrf_crypto_aes_context_t *ctx, const uint8_t *in, size_t len, uint8_t *out)
+{
+    uint8_t ks[kBlockLength];
+
+    memmove(out, in, len);
+    while (len > 0) {
+        size_t n = (len < kBlockLength) ? len : (size_t)kBlockLength;
+
+        if (ctx->p_info->mode == NRF_CRYPTO_AES_MODE_ECB) {
+            EncryptBlock(ctx, out);
+        } else {
+            memcpy(ks, ctx->iv, kBlockLength);
+            EncryptBlock(ctx, ks);
+            IncrCounter(ctx->iv);
+            XorBlock(ks, out, n);
+        }
+        out += n;
+        len -= n;
+        gNRFMockCryptoStats.Blocks++;
+    }
+    memset(ks, 0, sizeof(ks));
+}
+
+/*
+ * Fold whole blocks into the CMAC chaining value, which is kept in iv[].
+ */
+void CMACBlocks(nrf_crypto_aes_context_t *ctx, const uint8_t *in, size_t nBlocks)
+{
+    for (; nBlocks > 0; nBlocks--, in += kBlockLength) {
+        XorBlock(in, ctx->iv, kBlockLength);
+        EncryptBlock(ctx, ctx->iv);
+        gNRFMockCryptoStats.Blocks++;
+    }
+}
+
+void DoubleBlock(uint8_t *b)
+{
+    uint8_t carry = b[0] >> 7;
+
+    for (int i = 0; i < kBlockLength - 1; i++) {
+        b[i] = (uint8_t)((b[i] << 1) | (b[i + 1] >> 7));
+    }
+    b[kBlockLength - 1] = (uint8_t)((b[kBlockLength - 1] << 1) ^ (carry * 0x87));
+}
+
+} // unnamed namespace
+
+ret_code_t nrf_crypto_aes_init(nrf_crypto_aes_context_t * const p_context,
+                               nrf_crypto_aes_info_t const * p_info,
+                               nrf_crypto_operation_t operation)
+{
+    if (p_context == NULL || p_info == NULL) {
+        return NRF_ERROR_CRYPTO_INVALID_PARAM;
+    }
+    if ((p_info->mode == NRF_CRYPTO_AES_MODE_CMAC) != (operation == NRF_CRYPTO_MAC_CALCULATE)) {
+        return NRF_ERROR_CRYPTO_INVALID_PARAM;
+    }
+    memset(p_context, 0, sizeof(*p_context));
+    p_context->p_info = p_info;
+    p_context->operation = operation;
+    return NRF_SUCCESS;
+}
+
+ret_code_t nrf_crypto_aes_uninit(nrf_crypto_aes_context_t * const p_context)
+{
+    memset(p_context, 0, sizeof(*p_context));
+    return NRF_SUCCESS;
+}
+
+ret_code_t nrf_crypto_aes_key_set(nrf_crypto_aes_context_t * const p_context, uint8_t * p_key)
+{
+    if (p_context->p_info == NULL) {
+        return NRF_ERROR_CRYPTO_INVALID_PARAM;
+    }
+    SoftAESExpandKey(p_key, p_context->p_info->key_size / 8, p_context->round_keys);
+    p_context->key_set = true;
+    return NRF_SUCCESS;
+}
+
+ret_code_t nrf_crypto_aes_iv_set(nrf_crypto_aes_context_t * const p_context, uint8_t * p_iv)
+{
+    if (p_context->p_info == NULL || p_context->p_info->mode != NRF_CRYPTO_AES_MODE_CTR) {
+        return NRF_ERROR_CRYPTO_INVALID_PARAM;
+    }
+    memcpy(p_context->iv, p_iv, kBlockLength);
+    return NRF_SUCCESS;
+}
+
+ret_code_t nrf_crypto_aes_update(nrf_crypto_aes_context_t * const p_context,
+                                 uint8_t * p_data_in, size_t data_size, uint8_t * p_data_out)
+{
+    if (p_context->p_info == NULL || !p_context->key_set) {
+        return NRF_ERROR_CRYPTO_INVALID_PARAM;
+    }
+    if (data_size % kBlockLength != 0) {
+        return NRF_ERROR_CRYPTO_INPUT_LENGTH;
+    }
+    if (data_size > 0 && !nrfx_is_in_ram(p_data_in)) {
+        return NRF_ERROR_CRYPTO_INPUT_LOCATION;
+    }
+    gNRFMockCryptoStats.Calls++;
+
+    if (p_context->p_info->mode == NRF_CRYPTO_AES_MODE_CMAC) {
+        CMACBlocks(p_context, p_data_in, data_size / kBlockLength);
+    } else {
+        ProcessData(p_context, p_data_in, data_size, p_data_out);
+    }
+    p_context->updated = true;
+    return NRF_SUCCESS;
+}
+
+ret_code_t nrf_crypto_aes_finalize(nrf_crypto_aes_context_t * const p_context,
+                                   uint8_t * p_data_in, size_t data_size,
+                                   uint8_t * p_data_out, size_t * p_data_out_size)
+{
+    uint8_t last[kBlockLength], subkey[kBlockLength];
+    size_t nFull;
+
+    if (p_context->p_info == NULL || !p_context->key_set || p_data_out_size == NULL) {
+        return NRF_ERROR_CRYPTO_INVALID_PARAM;
+    }
+    if (data_size > 0 && !nrfx_is_in_ram(p_data_in)) {
+        return NRF_ERROR_CRYPTO_INPUT_LOCATION;
+    }
+
+    if (p_context->p_info->mode != NRF_CRYPTO_AES_MODE_CMAC) {
+        if (p_context->p_info->mode == NRF_CRYPTO_AES_MODE_ECB && data_size % kBlockLength != 0) {
+            return NRF_ERROR_CRYPTO_INPUT_LENGTH;
+        }
+        if (*p_data_out_size < data_size) {
+            return NRF_ERROR_CRYPTO_INVALID_PARAM;
+        }
+        gNRFMockCryptoStats.Calls++;
+        ProcessData(p_context, p_data_in, data_size, p_data_out);
+        *p_data_out_size = data_size;
+        return NRF_SUCCESS;
+    }
+
+    /*
+     * The last block of a CMAC computation is masked with a subkey, so it
+     * cannot have been passed to update already.
+     */
+    if ((data_size == 0 && p_context->updated) || *p_data_out_size < kBlockLength) {
+        return NRF_ERROR_CRYPTO_INPUT_LENGTH;
+    }
+    gNRFMockCryptoStats.Calls++;
+
+    nFull = (data_size > 0) ? (data_size - 1) / kBlockLength : 0;
+    CMACBlocks(p_context, p_data_in, nFull);
+    p_data_in += nFull * kBlockLength;
+    data_size -= nFull * kBlockLength;
+
+    memset(subkey, 0, sizeof(subkey));
+    EncryptBlock(p_context, subkey);
+    DoubleBlock(subkey);
+    memset(last, 0, sizeof(last));
+    memcpy(last, p_data_in, data_size);
+    if (data_size < kBlockLength) {
+        last[data_size] = 0x80;
+        DoubleBlock(subkey);
+    }
+    XorBlock(subkey, last, kBlockLength);
+    CMACBlocks(p_context, last, 1);
+
+    memcpy(p_data_out, p_context->iv, kBlockLength);
+    *p_data_out_size = kBlockLength;
+    memset(last, 0, sizeof(last));
+    memset(subkey, 0, sizeof(subkey));
+    return NRF_SUCCESS;
+}
@@ -0,0 +1,210 @@
+/*
+ *
+ *    Copyright (c) 2021 Jay Logue
+ *    All rights reserved.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/**
+ *   @file
+ *         Host-side mock of the nRF5 ECB peripheral and of the SoftDevice
+ *         ECB API (see nRF5Mock.h).
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include <sdk_common.h>
+#include <nrf_soc.h>
+#include <nrfx.h>
+#include <EAX-Soft.h>
+
+NRF_ECB_Type gNRFMockECB;
+unsigned gNRFMockECBLatency = 4;
+unsigned gNRFMockECBErrorInterval = 0;
+NRFMockECBStats gNRFMockECBStats;
+
+namespace {
+
+enum {
+    kRoundCount = 10
+};
+
+bool sBusy;
+bool sFail;
+unsigned sRemaining;
+uint64_t sOpCount;
+
+/*
+ * Key and cleartext, as read by EasyDMA when the operation was started.
+ */
+nrf_ecb_hal_data_t sLatched;
+
+void EncryptBlock(const uint8_t *key, const uint8_t *in, uint8_t *out)
+{
+    uint64_t roundKeys[SOFT_AES_KEY_WORDS(kRoundCount)];
+
+    SoftAESExpandKey(key, SOC_ECB_KEY_LENGTH, roundKeys);
+    memcpy(out, in, SOC_ECB_CLEARTEXT_LENGTH);
+    SoftAESEncryptBlock(roundKeys, kRoundCount, out);
+    memset(roundKeys, 0, sizeof(roundKeys));
+}
+
+void Complete(void)
+{
+    nrf_ecb_hal_data_t *desc = (nrf_ecb_hal_data_t *)gNRFMockECB.ECBDATAPTR;
+
+    sBusy = false;
+    if (sFail) {
+        gNRFMockECB.EVENTS_ERRORECB = 1;
+        gNRFMockECBStats.Errors++;
+        return;
+    }
+
+    /*
+     * The descriptor must not be changed while it is in use; this would
+     * be a bug in the queue management of the caller.
+     */
+    assert(memcmp(desc->key, sLatched.key, sizeof(desc->key)) == 0);
+    assert(memcmp(desc->cleartext, sLatched.cleartext, sizeof(desc->cleartext)) == 0);
+
+    EncryptBlock(sLatched.key, sLatched.cleartext, desc->ciphertext);
+    gNRFMockECB.EVENTS_ENDECB = 1;
+    gNRFMockECBStats.Blocks++;
+}
+
+} // unnamed namespace
+
+void NRFMockECBTask::operator=(uint32_t val)
+{
+    if (val == 0) {
+        return;
+    }
+
+    if (this == &gNRFMockECB.TASKS_STOPECB) {
+        sBusy = false;
+        return;
+    }
+
+    const nrf_ecb_hal_data_t *desc = (const nrf_ecb_hal_data_t *)gNRFMockECB.ECBDATAPTR;
+
+    assert(this == &gNRFMockECB.TASKS_STARTECB);
+    assert(!sBusy);
+    assert(desc != NULL);
+
+    memcpy(sLatched.key, desc->key, sizeof(sLatched.key));
+    memcpy(sLatched.cleartext, desc->cleartext, sizeof(sLatched.cleartext));
+    sOpCount++;
+    sFail = (gNRFMockECBErrorInterval != 0 && sOpCount % gNRFMockECBErrorInterval == 0);
+    sRemaining = gNRFMockECBLatency;
+    sBusy = true;
+    if (sRemaining == 0) {
+        Complete();
+    }
+}
+
+NRFMockECBEvent::operator uint32_t(void)
+{
+    NRFMockECBTick();
+    return mValue;
+}
+
+void NRFMockECBTick(void)
+{
+    if (!sBusy) {
+        return;
+    }
+    gNRFMockECBStats.BusyPolls++;
+    if (--sRemaining == 0) {
+        Complete();
+    }
+}
+
+void NRFMockECBReset(void)
+{
+    sBusy = false;
+    sOpCount = 0;
+    gNRFMockECB.EVENTS_ENDECB = 0;
+    gNRFMockECB.EVENTS_ERRORECB = 0;
+    gNRFMockECB.ECBDATAPTR = 0;
+    memset(&sLatched, 0, sizeof(sLatched));
+    memset(&gNRFMockECBStats, 0, sizeof(gNRFMockECBStats));
+}
+
+/*
+ * Read-only mappings of the process, read once from /proc/self/maps: the
+ * mappings of a program do not change after it is loaded, and constant
+ * data is never in the heap.
+ */
+namespace {
+
+enum {
+    kMaxReadOnlyRanges = 64
+};
+
+struct AddressRange
+{
+    uintptr_t start;
+    uintptr_t end;
+};
+
+AddressRange sReadOnlyRanges[kMaxReadOnlyRanges];
+size_t sReadOnlyRangeCount;
+bool sReadOnlyRangesLoaded;
+
+void LoadReadOnlyRanges(void)
+{
+    FILE *maps;
+    char line[512];
+    unsigned long start, end;
+    char perms[5];
+
+    maps = fopen("/proc/self/maps", "r");
+    assert(maps != NULL);
+    while (fgets(line, sizeof(line), maps) != NULL) {
+        if (sscanf(line, "%lx-%lx %4s", &start, &end, perms) == 3 && perms[1] != 'w') {
+            assert(sReadOnlyRangeCount < kMaxReadOnlyRanges);
+            sReadOnlyRanges[sReadOnlyRangeCount].start = start;
+            sReadOnlyRanges[sReadOnlyRangeCount].end = end;
+            sReadOnlyRangeCount++;
+        }
+    }
+    fclose(maps);
+    sReadOnlyRangesLoaded = true;
+}
+
+} // unnamed namespace
+
+bool nrfx_is_in_ram(void const * p_object)
+{
+    uintptr_t p = (uintptr_t)p_object;
+
+    if (!sReadOnlyRangesLoaded) {
+        LoadReadOnlyRanges();
+    }
+    for (size_t i = 0; i < sReadOnlyRangeCount; i++) {
+        if (p >= sReadOnlyRanges[i].start && p < sReadOnlyRanges[i].end) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t sd_ecb_block_encrypt(nrf_ecb_hal_data_t * p_ecb_data)
+{
+    EncryptBlock(p_ecb_data->key, p_ecb_data->cleartext, p_ecb_data->ciphertext);
+    gNRFMockECBStats.SDBlocks++;
+    return NRF_SUCCESS;
+}
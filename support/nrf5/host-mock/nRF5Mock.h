@@ -0,0 +1,122 @@
+/*
+ *
+ *    Copyright (c) 2021 Jay Logue
+ *    All rights reserved.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/**
+ *   @file
+ *         Host-side mock of the nRF5 ECB peripheral, of the SoftDevice
+ *         ECB API and of the nrf_crypto AES API, for building and testing
+ *         the nRF5 EAX code on Linux.
+ *
+ *         The headers in this directory (nrf.h, nrf_soc.h, nrf_crypto.h,
+ *         nrfx.h, sdk_common.h) stand in for the nRF5 SDK ones; put the
+ *         directory first on the include path. Constant data of the host
+ *         program stands for data in flash (see nrfx_is_in_ram()). AES is computed with the portable software
+ *         implementation (EAX-Soft.cpp), which must be linked in.
+ */
+
+#ifndef NRF5MOCK_H_
+#define NRF5MOCK_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+/** A task register of the mock ECB peripheral
+ *
+ * Writing 1 triggers the task.
+ */
+class NRFMockECBTask
+{
+public:
+    void operator=(uint32_t val);
+};
+
+/** An event register of the mock ECB peripheral
+ *
+ * Each read of the register is one poll of the peripheral, and advances
+ * the encryption in progress (see gNRFMockECBLatency).
+ */
+class NRFMockECBEvent
+{
+public:
+    NRFMockECBEvent(void) : mValue(0) { }
+    void operator=(uint32_t val) { mValue = val; }
+    operator uint32_t(void);
+
+private:
+    uint32_t mValue;
+};
+
+/** Register layout of the mock ECB peripheral
+ *
+ * Only the registers used by the EAX code are present. Unlike on the nRF5,
+ * ECBDATAPTR is pointer-sized.
+ */
+struct NRF_ECB_Type
+{
+    NRFMockECBTask TASKS_STARTECB;
+    NRFMockECBTask TASKS_STOPECB;
+    NRFMockECBEvent EVENTS_ENDECB;
+    NRFMockECBEvent EVENTS_ERRORECB;
+    uintptr_t ECBDATAPTR;
+};
+
+extern NRF_ECB_Type gNRFMockECB;
+
+/** Number of polls of an event register that an ECB operation lasts.
+ */
+extern unsigned gNRFMockECBLatency;
+
+/** If non-zero, every Nth ECB operation is aborted with ERRORECB, as when
+ *  a higher-priority peripheral takes over the AES core.
+ */
+extern unsigned gNRFMockECBErrorInterval;
+
+/** Statistics of the mock ECB peripheral
+ */
+struct NRFMockECBStats
+{
+    uint64_t Blocks;        // number of blocks encrypted
+    uint64_t Errors;        // number of operations aborted with ERRORECB
+    uint64_t BusyPolls;     // polls made while an operation was in progress
+    uint64_t SDBlocks;      // number of blocks encrypted with sd_ecb_block_encrypt()
+};
+
+extern NRFMockECBStats gNRFMockECBStats;
+
+/** Stop any operation in progress, and clear the events and statistics.
+ */
+extern void NRFMockECBReset(void);
+
+/** Advance the operation in progress by one poll.
+ */
+extern void NRFMockECBTick(void);
+
+/** Statistics of the mock nrf_crypto AES API
+ *
+ * With the CC310 backend, each update and finalize call is a round trip
+ * to the crypto accelerator.
+ */
+struct NRFMockCryptoStats
+{
+    uint64_t Calls;         // number of update and finalize calls
+    uint64_t Blocks;        // number of blocks processed
+};
+
+extern NRFMockCryptoStats gNRFMockCryptoStats;
+
+#endif // NRF5MOCK_H_
@@ -0,0 +1,31 @@
+/*
+ *
+ *    Copyright (c) 2021 Jay Logue
+ *    All rights reserved.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/**
+ *   @file
+ *         Host-side stand-in for the nRF5 MDK device header (see nRF5Mock.h).
+ */
+
+#ifndef NRF_H
+#define NRF_H
+
+#include <nRF5Mock.h>
+
+#define NRF_ECB (&gNRFMockECB)
+
+#endif // NRF_H
@@ -0,0 +1,87 @@
+/*
+ *
+ *    Copyright (c) 2021 Jay Logue
+ *    All rights reserved.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/**
+ *   @file
+ *         Host-side stand-in for the nRF5 SDK nrf_crypto AES API header
+ *         (see nRF5Mock.h). Only the ECB, CTR and CMAC modes are provided,
+ *         with the input length and location rules of the CC310 backend.
+ */
+
+#ifndef NRF_CRYPTO_H__
+#define NRF_CRYPTO_H__
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <sdk_common.h>
+
+#define NRF_CRYPTO_AES_BLOCK_SIZE       (16)
+
+#define NRF_ERROR_CRYPTO_INPUT_LENGTH   (0x8503)
+#define NRF_ERROR_CRYPTO_INPUT_LOCATION (0x8504)
+#define NRF_ERROR_CRYPTO_INVALID_PARAM  (0x8505)
+
+typedef enum
+{
+    NRF_CRYPTO_DECRYPT      = 0,
+    NRF_CRYPTO_ENCRYPT      = 1,
+    NRF_CRYPTO_MAC_CALCULATE = 2
+} nrf_crypto_operation_t;
+
+typedef enum
+{
+    NRF_CRYPTO_AES_MODE_ECB,
+    NRF_CRYPTO_AES_MODE_CTR,
+    NRF_CRYPTO_AES_MODE_CMAC
+} nrf_crypto_aes_mode_t;
+
+typedef struct
+{
+    nrf_crypto_aes_mode_t mode;
+    uint32_t key_size;          // in bits
+} nrf_crypto_aes_info_t;
+
+typedef struct
+{
+    const nrf_crypto_aes_info_t * p_info;
+    nrf_crypto_operation_t operation;
+    bool key_set;
+    bool updated;
+    uint64_t round_keys[30];    // bitsliced AES-256 key schedule (see EAX-Soft.h)
+    uint8_t iv[NRF_CRYPTO_AES_BLOCK_SIZE];
+} nrf_crypto_aes_context_t;
+
+extern const nrf_crypto_aes_info_t g_nrf_crypto_aes_ecb_128_info;
+extern const nrf_crypto_aes_info_t g_nrf_crypto_aes_ecb_256_info;
+extern const nrf_crypto_aes_info_t g_nrf_crypto_aes_ctr_128_info;
+extern const nrf_crypto_aes_info_t g_nrf_crypto_aes_cmac_128_info;
+
+extern ret_code_t nrf_crypto_aes_init(nrf_crypto_aes_context_t * const p_context,
+                                      nrf_crypto_aes_info_t const * p_info,
+                                      nrf_crypto_operation_t operation);
+extern ret_code_t nrf_crypto_aes_uninit(nrf_crypto_aes_context_t * const p_context);
+extern ret_code_t nrf_crypto_aes_key_set(nrf_crypto_aes_context_t * const p_context, uint8_t * p_key);
+extern ret_code_t nrf_crypto_aes_iv_set(nrf_crypto_aes_context_t * const p_context, uint8_t * p_iv);
+extern ret_code_t nrf_crypto_aes_update(nrf_crypto_aes_context_t * const p_context,
+                                        uint8_t * p_data_in, size_t data_size, uint8_t * p_data_out);
+extern ret_code_t nrf_crypto_aes_finalize(nrf_crypto_aes_context_t * const p_context,
+                                          uint8_t * p_data_in, size_t data_size,
+                                          uint8_t * p_data_out, size_t * p_data_out_size);
+
+#endif // NRF_CRYPTO_H__
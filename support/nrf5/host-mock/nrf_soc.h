@@ -0,0 +1,51 @@
+/*
+ *
+ *    Copyright (c) 2021 Jay Logue
+ *    All rights reserved.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/**
+ *   @file
+ *         Host-side stand-in for the SoftDevice SoC API header (see
+ *         nRF5Mock.h). Only the ECB functions are provided.
+ */
+
+#ifndef NRF_SOC_H__
+#define NRF_SOC_H__
+
+#include <stdint.h>
+
+#define SOC_ECB_KEY_LENGTH          (16)
+#define SOC_ECB_CLEARTEXT_LENGTH    (16)
+#define SOC_ECB_CIPHERTEXT_LENGTH   (SOC_ECB_CLEARTEXT_LENGTH)
+
+typedef uint8_t soc_ecb_key_t[SOC_ECB_KEY_LENGTH];
+typedef uint8_t soc_ecb_cleartext_t[SOC_ECB_CLEARTEXT_LENGTH];
+typedef uint8_t soc_ecb_ciphertext_t[SOC_ECB_CIPHERTEXT_LENGTH];
+
+/** AES ECB parameter block, also the EasyDMA layout of the ECB peripheral
+ */
+typedef struct
+{
+    soc_ecb_key_t key;
+    soc_ecb_cleartext_t cleartext;
+    soc_ecb_ciphertext_t ciphertext;
+} nrf_ecb_hal_data_t;
+
+/** Encrypt a block with AES-128, synchronously.
+ */
+extern uint32_t sd_ecb_block_encrypt(nrf_ecb_hal_data_t * p_ecb_data);
+
+#endif // NRF_SOC_H__
@@ -0,0 +1,40 @@
+/*
+ *
+ *    Copyright (c) 2021 Jay Logue
+ *    All rights reserved.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *        http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+/**
+ *   @file
+ *         Host-side stand-in for the nrfx driver header (see nRF5Mock.h).
+ *         Only nrfx_is_in_ram() is provided.
+ */
+
+#ifndef NRFX_H__
+#define NRFX_H__
+
+#include <stdbool.h>
+
+#include <nRF5Mock.h>
+
+/** Check whether an object is in RAM, where EasyDMA and the CC310 can
+ *  read it.
+ *
+ * On the host, the read-only mappings of the process (code and constant
+ * data, which the device keeps in flash) count as outside RAM.
+ */
+extern bool nrfx_is_in_ram(void const * p_object);
+
+#endif // NRFX_H__
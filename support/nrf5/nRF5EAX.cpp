@@ -26,10 +26,12 @@
 
 #include <inttypes.h>
 #include <stdio.h>
+#include <string.h>
 #include <assert.h>
 
 #if NRF_CRYPTO_ENABLED
 #include <nrf_crypto.h>
+#include <nrfx.h>
 #endif // NRF_CRYPTO_ENABLED
 
 #include <nrf_soc.h>
@@ -38,11 +40,16 @@
 
 #if NRF_CRYPTO_ENABLED
 
-EAX_nrfcrypto_base::EAX_nrfcrypto_base(const nrf_crypto_aes_info_t * aesInfo)
+EAX_nrfcrypto_base::EAX_nrfcrypto_base(const nrf_crypto_aes_info_t * aesInfo,
+                                       const nrf_crypto_aes_info_t * ctrInfo,
+                                       const nrf_crypto_aes_info_t * cmacInfo)
 {
     ret_code_t res;
 
     mAESInfo = aesInfo;
+    mCTRInfo = ctrInfo;
+    mCMACInfo = cmacInfo;
+    memset(mKey, 0, sizeof(mKey));
 
     res = nrf_crypto_aes_init(&mAESCtx, aesInfo, NRF_CRYPTO_ENCRYPT);
     assert(res == NRF_SUCCESS);
@@ -51,6 +58,7 @@ EAX_nrfcrypto_base::EAX_nrfcrypto_base(const nrf_crypto_aes_info_t * aesInfo)
 EAX_nrfcrypto_base::~EAX_nrfcrypto_base()
 {
     nrf_crypto_aes_uninit(&mAESCtx);
+    ClearSecretData(mKey, sizeof(mKey));
 }
 
 void EAX_nrfcrypto_base::AESReset(void)
@@ -58,6 +66,7 @@ void EAX_nrfcrypto_base::AESReset(void)
     ret_code_t res;
 
     nrf_crypto_aes_uninit(&mAESCtx);
+    ClearSecretData(mKey, sizeof(mKey));
 
     res = nrf_crypto_aes_init(&mAESCtx, mAESInfo, NRF_CRYPTO_ENCRYPT);
     assert(res == NRF_SUCCESS);
@@ -71,6 +80,9 @@ void EAX_nrfcrypto_base::AESSetKey(const uint8_t *key, size_t keyLen)
 
     res = nrf_crypto_aes_key_set(&mAESCtx, (uint8_t *)key);
     assert(res == NRF_SUCCESS);
+
+    // The CTR and CMAC contexts are set up for each message, and need the key.
+    memcpy(mKey, key, keyLen);
 }
 
 void EAX_nrfcrypto_base::AESEncryptBlock(uint8_t * data)
@@ -81,8 +93,129 @@ void EAX_nrfcrypto_base::AESEncryptBlock(uint8_t * data)
     assert(res == NRF_SUCCESS);
 }
 
+bool EAX_nrfcrypto_base::AESModesSupported(void)
+{
+    return mCTRInfo != NULL && mCMACInfo != NULL;
+}
+
+/*
+ * Pass whole blocks of input to nrf_crypto_aes_update() on the mode context.
+ * Input that is not in RAM, which the CC310 cannot read, is copied to RAM
+ * kBounceLength bytes at a time.
+ */
+void EAX_nrfcrypto_base::ModeUpdate(const uint8_t * input, size_t len, uint8_t * output)
+{
+    ret_code_t res;
+    uint8_t bounce[kBounceLength];
+
+    if (len == 0) {
+        return;
+    }
+
+    if (nrfx_is_in_ram(input)) {
+        res = nrf_crypto_aes_update(&mModeCtx, (uint8_t *)input, len, output);
+        assert(res == NRF_SUCCESS);
+        return;
+    }
+
+    while (len > 0) {
+        size_t n = (len < kBounceLength) ? len : (size_t)kBounceLength;
+
+        memcpy(bounce, input, n);
+        res = nrf_crypto_aes_update(&mModeCtx, bounce, n, output);
+        assert(res == NRF_SUCCESS);
+        input += n;
+        if (output != NULL) {
+            output += n;
+        }
+        len -= n;
+    }
+    ClearSecretData(bounce, sizeof(bounce));
+}
+
+/*
+ * Return input of at most one block that the CC310 can read: the input
+ * itself if it is in RAM, or else a copy in buf[].
+ */
+const uint8_t * EAX_nrfcrypto_base::ModeInput(const uint8_t * input, size_t len, uint8_t * buf)
+{
+    if (len == 0 || nrfx_is_in_ram(input)) {
+        return input;
+    }
+    memcpy(buf, input, len);
+    return buf;
+}
+
+void EAX_nrfcrypto_base::AESCTR(const uint8_t * ctr, const uint8_t * input, uint8_t * output, size_t len)
+{
+    ret_code_t res;
+    uint8_t iv[NRF_CRYPTO_AES_BLOCK_SIZE], last[NRF_CRYPTO_AES_BLOCK_SIZE];
+    size_t bodyLen, outLen;
+
+    if (len == 0) {
+        return;
+    }
+
+    // nrf_crypto takes a non-const IV, and may advance it.
+    memcpy(iv, ctr, sizeof(iv));
+
+    res = nrf_crypto_aes_init(&mModeCtx, mCTRInfo, NRF_CRYPTO_ENCRYPT);
+    assert(res == NRF_SUCCESS);
+    res = nrf_crypto_aes_key_set(&mModeCtx, mKey);
+    assert(res == NRF_SUCCESS);
+    res = nrf_crypto_aes_iv_set(&mModeCtx, iv);
+    assert(res == NRF_SUCCESS);
+
+    // A single call processes the whole payload, including any partial block,
+    // if it is in RAM. Otherwise, whole blocks are staged through RAM, and the
+    // last block (1 to 16 bytes) is passed to finalize.
+    bodyLen = nrfx_is_in_ram(input) ? 0 : ((len - 1) / NRF_CRYPTO_AES_BLOCK_SIZE) * NRF_CRYPTO_AES_BLOCK_SIZE;
+    ModeUpdate(input, bodyLen, output);
+    outLen = len - bodyLen;
+    res = nrf_crypto_aes_finalize(&mModeCtx, (uint8_t *)ModeInput(input + bodyLen, len - bodyLen, last),
+                                  len - bodyLen, output + bodyLen, &outLen);
+    assert(res == NRF_SUCCESS && outLen == len - bodyLen);
+
+    nrf_crypto_aes_uninit(&mModeCtx);
+    ClearSecretData(iv, sizeof(iv));
+    ClearSecretData(last, sizeof(last));
+}
+
+void EAX_nrfcrypto_base::AESCMAC(const uint8_t * first, const uint8_t * data, size_t len, uint8_t * mac)
+{
+    ret_code_t res;
+    uint8_t block[NRF_CRYPTO_AES_BLOCK_SIZE];
+    size_t macLen = NRF_CRYPTO_AES_BLOCK_SIZE;
+
+    res = nrf_crypto_aes_init(&mModeCtx, mCMACInfo, NRF_CRYPTO_MAC_CALCULATE);
+    assert(res == NRF_SUCCESS);
+    res = nrf_crypto_aes_key_set(&mModeCtx, mKey);
+    assert(res == NRF_SUCCESS);
+
+    if (len == 0) {
+        res = nrf_crypto_aes_finalize(&mModeCtx, (uint8_t *)ModeInput(first, NRF_CRYPTO_AES_BLOCK_SIZE, block),
+                                      NRF_CRYPTO_AES_BLOCK_SIZE, mac, &macLen);
+        assert(res == NRF_SUCCESS);
+    }
+    else {
+        // Updates take whole blocks only, and the last block (1 to 16 bytes)
+        // must be left for finalize, which applies the CMAC subkey to it.
+        size_t bodyLen = ((len - 1) / NRF_CRYPTO_AES_BLOCK_SIZE) * NRF_CRYPTO_AES_BLOCK_SIZE;
+
+        ModeUpdate(first, NRF_CRYPTO_AES_BLOCK_SIZE, NULL);
+        ModeUpdate(data, bodyLen, NULL);
+        res = nrf_crypto_aes_finalize(&mModeCtx, (uint8_t *)ModeInput(data + bodyLen, len - bodyLen, block),
+                                      len - bodyLen, mac, &macLen);
+        assert(res == NRF_SUCCESS);
+    }
+    assert(macLen == NRF_CRYPTO_AES_BLOCK_SIZE);
+
+    nrf_crypto_aes_uninit(&mModeCtx);
+    ClearSecretData(block, sizeof(block));
+}
+
 EAX_128_nrfcrypto::EAX_128_nrfcrypto(void)
-: EAX_nrfcrypto_base(&g_nrf_crypto_aes_ecb_128_info)
+: EAX_nrfcrypto_base(&g_nrf_crypto_aes_ecb_128_info, &g_nrf_crypto_aes_ctr_128_info, &g_nrf_crypto_aes_cmac_128_info)
 {
 }
 
@@ -124,11 +257,16 @@ void EAX_128_SD::AESSetKey(const uint8_t *key, size_t keyLen)
 }
 
 void EAX_128_SD::AESEncryptBlock(uint8_t * data)
+{
+    SDECBEncryptBlock(mKey, data);
+}
+
+void SDECBEncryptBlock(const uint8_t * key, uint8_t * data)
 {
     ret_code_t res;
     nrf_ecb_hal_data_t ecbData;
 
-    memcpy(ecbData.key, mKey, SOC_ECB_CLEARTEXT_LENGTH);
+    memcpy(ecbData.key, key, SOC_ECB_CLEARTEXT_LENGTH);
     memcpy(ecbData.cleartext, data, SOC_ECB_CLEARTEXT_LENGTH);
 
     res = sd_ecb_block_encrypt(&ecbData);
@@ -136,7 +274,168 @@ void EAX_128_SD::AESEncryptBlock(uint8_t * data)
 
     memcpy(data, ecbData.ciphertext, SOC_ECB_CIPHERTEXT_LENGTH);
 
-    ClearSecretData(&ecbData, sizeof(ecbData));
+    EAXWipeBlockTemp(&ecbData, sizeof(ecbData));
 }
 
 #endif // defined(SOFTDEVICE_PRESENT) && SOFTDEVICE_PRESENT
+
+//
+// Compile as follows to create a stand-alone program, running on the host
+// with the mock ECB peripheral and SoftDevice API (host-mock/nRF5Mock.h),
+// for testing the nRF5 EAX classes against the standard test vectors:
+//
+//    c++ -O2 -pthread -o test-nrf5-eax -Ihost-mock -I. -I../general -DSOFTDEVICE_PRESENT=1 -DNRF_CRYPTO_ENABLED=1 -DUNIT_TEST_NRF5_EAX nRF5EAX.cpp host-mock/nRF5Mock.cpp host-mock/nRF5CryptoMock.cpp ../general/EAX.cpp ../general/EAX-Soft.cpp ../general/EAXTest.cpp
+//
+#ifdef UNIT_TEST_NRF5_EAX
+
+#include <EAX-Soft.h>
+#include <EAXTest.h>
+
+/*
+ * Seal messages of many lengths with the given engine and with the
+ * portable software implementation, and compare the results. This runs
+ * the payload through more blocks than the test vectors do.
+ */
+template <class EAXImpl>
+static void CompareWithSoft(EAXImpl & eax)
+{
+    enum { kMaxMsgLen = 300, kTagLen = 16 };
+    static const uint8_t key[16] = { 0x0f, 0x1e, 0x2d, 0x3c, 0x4b, 0x5a, 0x69, 0x78, 0x87, 0x96, 0xa5, 0xb4, 0xc3, 0xd2, 0xe1, 0xf0 };
+    static const uint8_t nonce[12] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12 };
+    static const uint8_t aad[5] = { 'h', 'e', 'l', 'l', 'o' };
+    uint8_t buf[kMaxMsgLen + kTagLen], ref[kMaxMsgLen + kTagLen];
+    EAX_128_Soft soft;
+
+    eax.Reset();
+    eax.SetKey(key, sizeof(key));
+    soft.SetKey(key, sizeof(key));
+
+    for (size_t len = 0; len <= kMaxMsgLen; len += 7)
+    {
+        for (size_t i = 0; i < len; i++)
+        {
+            buf[i] = ref[i] = (uint8_t)(i * 31 + len);
+        }
+        eax.Seal(nonce, sizeof(nonce), aad, sizeof(aad), buf, len, kTagLen);
+        soft.Seal(nonce, sizeof(nonce), aad, sizeof(aad), ref, len, kTagLen);
+        assert(memcmp(buf, ref, len + kTagLen) == 0);
+        assert(eax.Open(nonce, sizeof(nonce), aad, sizeof(aad), buf, len, kTagLen) == true);
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    NRFMockECBReset();
+    {
+        EAX_128_SD eax;
+        TestEAX128(eax);
+    }
+    {
+        EAXT_128_SD eax;
+        TestEAX128(eax);
+        CompareWithSoft(eax);
+    }
+    TestCMAC128<EAXT_128_SD>();
+    assert(gNRFMockECBStats.SDBlocks > 0 && gNRFMockECBStats.Blocks == 0);
+
+    static const unsigned kLatencies[] = { 0, 1, 4, 20 };
+    for (size_t i = 0; i < sizeof(kLatencies) / sizeof(kLatencies[0]); i++)
+    {
+        NRFMockECBReset();
+        gNRFMockECBLatency = kLatencies[i];
+        {
+            EAXT_128_ECB eax;
+            TestEAX128(eax);
+            CompareWithSoft(eax);
+        }
+        {
+            EAXP_128_ECB<EAXPolicy<false, false> > eax;
+            TestEAX128(eax);
+            CompareWithSoft(eax);
+        }
+        {
+            EAXP_128_ECB<EAXPolicy<true, true, 16, 4> > eax;
+            TestEAX128(eax);
+            CompareWithSoft(eax);
+        }
+        TestCMAC128<EAXT_128_ECB>();
+        assert(gNRFMockECBStats.Blocks > 0 && gNRFMockECBStats.SDBlocks == 0);
+    }
+
+    // Operations aborted by the peripheral must be restarted
+    NRFMockECBReset();
+    gNRFMockECBLatency = 3;
+    gNRFMockECBErrorInterval = 5;
+    {
+        EAXT_128_ECB eax;
+        TestEAX128(eax);
+        CompareWithSoft(eax);
+    }
+    assert(gNRFMockECBStats.Errors > 0);
+
+#if NRF_CRYPTO_ENABLED
+    // One-shot operations make a few calls to nrf_crypto per message,
+    // whatever its length: two for each OMAC of the nonce and header, one
+    // for the CTR pass and three for the OMAC of the ciphertext
+    {
+        static const uint8_t key[16] = { 0 };
+        uint8_t buf[256 + 16] = { 0 };
+        EAX_128_nrfcrypto eax;
+
+        TestEAX128(eax);
+        CompareWithSoft(eax);
+
+        eax.Reset();
+        eax.SetKey(key, sizeof(key));
+        gNRFMockCryptoStats = NRFMockCryptoStats();
+        eax.Seal(key, 12, key, 16, buf, 256, 16);
+        assert(gNRFMockCryptoStats.Calls <= 8);
+        assert(gNRFMockCryptoStats.Blocks >= 256 / 16 * 2);
+    }
+    TestCMAC128<EAX_128_nrfcrypto>();
+
+    // The CC310 only reads RAM: a nonce and a header longer than the bounce
+    // buffer, in flash, go through RAM
+    {
+        static const uint8_t key[16] = { 7 };
+        static const uint8_t header[200] = { 1, 2, 3 };
+        uint8_t buf[100 + 16] = { 0 }, ref[100 + 16] = { 0 };
+        EAX_128_nrfcrypto eax;
+        EAX_128_Soft soft;
+
+        assert(!nrfx_is_in_ram(header) && nrfx_is_in_ram(buf));
+        eax.SetKey(key, sizeof(key));
+        soft.SetKey(key, sizeof(key));
+        for (size_t headerLen = 0; headerLen <= sizeof(header); headerLen += 25)
+        {
+            eax.Seal(header + 1, 13, header, headerLen, buf, 100, 16);
+            soft.Seal(header + 1, 13, header, headerLen, ref, 100, 16);
+            assert(memcmp(buf, ref, sizeof(buf)) == 0);
+            assert(eax.Open(header + 1, 13, header, headerLen, buf, 100, 16) == true);
+            assert(soft.Open(header + 1, 13, header, headerLen, ref, 100, 16) == true);
+        }
+    }
+
+    {
+        static const uint8_t key[32] = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15, 16, 17 };
+        uint8_t buf[100 + 16], ref[100 + 16];
+        EAX_256_nrfcrypto eax;
+        EAX_256_Soft soft;
+
+        for (size_t i = 0; i < 100; i++)
+        {
+            buf[i] = ref[i] = (uint8_t)i;
+        }
+        eax.SetKey(key, sizeof(key));
+        soft.SetKey(key, sizeof(key));
+        eax.Seal(key, 12, key, 20, buf, 100, 16);
+        soft.Seal(key, 12, key, 20, ref, 100, 16);
+        assert(memcmp(buf, ref, sizeof(buf)) == 0);
+        assert(eax.Open(key, 12, key, 20, buf, 100, 16) == true);
+    }
+#endif // NRF_CRYPTO_ENABLED
+
+    printf("All tests passed\n");
+}
+
+#endif // UNIT_TEST_NRF5_EAX
@@ -29,24 +29,52 @@
 #include <nrf_crypto.h>
 #endif // NRF_CRYPTO_ENABLED
 
+#include <nrf.h>
+
 #include <EAX.h>
+#include <EAXFactory.h>
 
 #if NRF_CRYPTO_ENABLED
 
 /** Base class for EAX-AES mode implemented using the Nordic nrf_crypto library.
+ *
+ * If CTR and CMAC infos are given, the one-shot operations (Seal, Open,
+ * EncryptMessage, etc.) use the native CTR and CMAC modes of nrf_crypto,
+ * which cost a few calls per message instead of one per block. Chunked
+ * operations always use ECB mode.
+ *
+ * The CC310 reads the input of the CTR and CMAC modes by DMA, from RAM
+ * only; input elsewhere (e.g. a header or nonce in flash) is staged
+ * through a RAM buffer of kBounceLength bytes.
  */
 class EAX_nrfcrypto_base : public EAX
 {
 protected:
-    EAX_nrfcrypto_base(const nrf_crypto_aes_info_t * aesInfo);
+    EAX_nrfcrypto_base(const nrf_crypto_aes_info_t * aesInfo,
+                       const nrf_crypto_aes_info_t * ctrInfo = NULL,
+                       const nrf_crypto_aes_info_t * cmacInfo = NULL);
     virtual ~EAX_nrfcrypto_base(void);
     virtual void AESReset(void);
     virtual void AESSetKey(const uint8_t * key, size_t keyLen);
     virtual void AESEncryptBlock(uint8_t * data);
+    virtual bool AESModesSupported(void);
+    virtual void AESCTR(const uint8_t * ctr, const uint8_t * input, uint8_t * output, size_t len);
+    virtual void AESCMAC(const uint8_t * first, const uint8_t * data, size_t len, uint8_t * mac);
 
 private:
+    enum {
+        kBounceLength = 64
+    };
+
+    void ModeUpdate(const uint8_t * input, size_t len, uint8_t * output);
+    const uint8_t * ModeInput(const uint8_t * input, size_t len, uint8_t * buf);
+
     const nrf_crypto_aes_info_t * mAESInfo;
+    const nrf_crypto_aes_info_t * mCTRInfo;
+    const nrf_crypto_aes_info_t * mCMACInfo;
     nrf_crypto_aes_context_t mAESCtx;
+    nrf_crypto_aes_context_t mModeCtx;
+    uint8_t mKey[32];
 };
 
 /** Implementation of EAX mode for AES-128 using the Nordic nrf_crypto library.
@@ -59,6 +87,9 @@ public:
 };
 
 /** Implementation of EAX mode for AES-256 using the Nordic nrf_crypto library.
+ *
+ * The CC310 supports the CTR and CMAC modes with 128-bit keys only, so
+ * this class always uses ECB mode.
  */
 class EAX_256_nrfcrypto final : public EAX_nrfcrypto_base
 {
@@ -95,13 +126,295 @@ private:
     uint8_t mKey[kKeyLength];
 };
 
+/** Devirtualized implementation of EAX mode for AES-128 using the Nordic
+ *  SoftDevice API.
+ *
+ *  Equivalent to EAX_128_SD, but with the block cipher bound to the EAX
+ *  engine at compile time, avoiding a virtual call per AES block.
+ *
+ *  Policy selects the optional state of the engine (see EAXPolicy); e.g.
+ *  EAXP_128_SD<EAXPolicy<false, false> > is the smallest context, for
+ *  keeping many sessions in RAM. EAXT_128_SD uses the default policy.
+ */
+template <class Policy = EAXPolicy<> >
+class EAXP_128_SD final : public EAXT<EAXP_128_SD<Policy>, Policy>
+{
+public:
+    EAXP_128_SD(void);
+    ~EAXP_128_SD(void);
+
+private:
+    friend class EAXT<EAXP_128_SD, Policy>;
+
+    enum {
+        kKeyLength = 16
+    };
+    uint8_t mKey[kKeyLength];
+
+    void AESReset(void);
+    void AESSetKey(const uint8_t * key, size_t keyLen);
+    void AESEncryptBlock(uint8_t * data);
+};
+
+typedef EAXP_128_SD<> EAXT_128_SD;
+
+/** Encrypt a single block in place with AES-128 using sd_ecb_block_encrypt().
+ */
+extern void SDECBEncryptBlock(const uint8_t * key, uint8_t * data);
+
+template <class Policy>
+inline EAXP_128_SD<Policy>::EAXP_128_SD(void)
+{
+}
+
+template <class Policy>
+inline EAXP_128_SD<Policy>::~EAXP_128_SD(void)
+{
+    this->ClearSecretData(mKey, sizeof(mKey));
+}
+
+template <class Policy>
+inline void EAXP_128_SD<Policy>::AESReset(void)
+{
+    this->ClearSecretData(mKey, sizeof(mKey));
+}
+
+template <class Policy>
+inline void EAXP_128_SD<Policy>::AESSetKey(const uint8_t *key, size_t keyLen)
+{
+    assert(keyLen == kKeyLength);
+    memcpy(mKey, key, kKeyLength);
+}
+
+template <class Policy>
+inline void EAXP_128_SD<Policy>::AESEncryptBlock(uint8_t * data)
+{
+    SDECBEncryptBlock(mKey, data);
+}
+
+#endif // defined(SOFTDEVICE_PRESENT) && SOFTDEVICE_PRESENT
+
+/** Devirtualized implementation of EAX mode for AES-128 that drives the
+ *  nRF5 ECB peripheral directly, without waiting for each block.
+ *
+ *  Blocks are queued in a ring of EasyDMA descriptors, which the ECB
+ *  peripheral works through while EAX processing continues with the blocks
+ *  that are done: the XOR of each payload block overlaps the encryption of
+ *  the next CTR stream and OMAC blocks (see kAESQueueDepth in EAXT.h). The
+ *  key is written into the descriptors once, by SetKey(), rather than for
+ *  every block.
+ *
+ *  The queue advances when the object polls the peripheral; no interrupt
+ *  is used. Only one object at a time may use the ECB peripheral, and the
+ *  peripheral is not available to the application while the SoftDevice is
+ *  enabled (use EAXT_128_SD then).
+ *
+ *  Policy selects the optional state of the engine (see EAXPolicy);
+ *  EAXT_128_ECB uses the default policy.
+ */
+template <class Policy = EAXPolicy<> >
+class EAXP_128_ECB final : public EAXT<EAXP_128_ECB<Policy>, Policy>
+{
+public:
+    EAXP_128_ECB(void);
+    ~EAXP_128_ECB(void);
+
+private:
+    friend class EAXT<EAXP_128_ECB, Policy>;
+
+    enum {
+        kKeyLength = 16,
+        kBlockLength = 16,
+        kAESQueueDepth = 4
+    };
+
+    /* EasyDMA data structure of the ECB peripheral */
+    struct ECBData
+    {
+        uint8_t key[kKeyLength];
+        uint8_t cleartext[kBlockLength];
+        uint8_t ciphertext[kBlockLength];
+    };
+
+    ECBData mDesc[kAESQueueDepth];      // descriptors, each with a copy of the key
+    uint8_t * mDest[kAESQueueDepth];    // where to copy the ciphertext of each descriptor
+    uint8_t mHead;                      // index of the oldest block in flight
+    uint8_t mPending;                   // number of blocks in flight
+
+    void AESReset(void);
+    void AESSetKey(const uint8_t * key, size_t keyLen);
+    void AESEncryptBlock(uint8_t * data);
+    void AESEncryptBlocks(uint8_t * data, size_t nBlocks);
+    void AESSubmitBlock(uint8_t * data);
+    void AESWaitBlocks(size_t maxPending);
+    void AESWipeTemporaries(void);
+    void ecb_start(void);
+    void ecb_poll(void);
+};
+
+typedef EAXP_128_ECB<> EAXT_128_ECB;
+
+template <class Policy>
+inline EAXP_128_ECB<Policy>::EAXP_128_ECB(void)
+{
+    mHead = 0;
+    mPending = 0;
+    this->ClearSecretData(mDesc, sizeof(mDesc));
+}
+
+template <class Policy>
+inline EAXP_128_ECB<Policy>::~EAXP_128_ECB(void)
+{
+    AESWaitBlocks(0);
+    this->ClearSecretData(mDesc, sizeof(mDesc));
+}
+
+template <class Policy>
+inline void EAXP_128_ECB<Policy>::AESReset(void)
+{
+    AESWaitBlocks(0);
+    this->ClearSecretData(mDesc, sizeof(mDesc));
+}
+
+template <class Policy>
+inline void EAXP_128_ECB<Policy>::AESSetKey(const uint8_t *key, size_t keyLen)
+{
+    size_t i;
+
+    assert(keyLen == kKeyLength);
+    assert(mPending == 0);
+    for (i = 0; i < kAESQueueDepth; i++) {
+        memcpy(mDesc[i].key, key, kKeyLength);
+    }
+}
+
+template <class Policy>
+inline void EAXP_128_ECB<Policy>::AESEncryptBlock(uint8_t * data)
+{
+    AESSubmitBlock(data);
+    AESWaitBlocks(0);
+}
+
+template <class Policy>
+inline void EAXP_128_ECB<Policy>::AESEncryptBlocks(uint8_t * data, size_t nBlocks)
+{
+    size_t i;
+
+    /*
+     * The peripheral works on the queued blocks while the next ones are
+     * copied into the descriptors.
+     */
+    for (i = 0; i < nBlocks; i++) {
+        AESSubmitBlock(data + i * kBlockLength);
+    }
+    AESWaitBlocks(0);
+}
+
+template <class Policy>
+inline void EAXP_128_ECB<Policy>::AESSubmitBlock(uint8_t * data)
+{
+    size_t tail;
+
+    AESWaitBlocks(kAESQueueDepth - 1);
+
+    tail = (mHead + mPending) % kAESQueueDepth;
+    memcpy(mDesc[tail].cleartext, data, kBlockLength);
+    mDest[tail] = data;
+    mPending++;
+    if (mPending == 1) {
+        ecb_start();
+    }
+}
+
+template <class Policy>
+inline void EAXP_128_ECB<Policy>::AESWaitBlocks(size_t maxPending)
+{
+    while (mPending > maxPending) {
+        ecb_poll();
+    }
+}
+
+/*
+ * Clear the blocks left in the descriptors; the key is kept.
+ */
+template <class Policy>
+inline void EAXP_128_ECB<Policy>::AESWipeTemporaries(void)
+{
+    size_t i;
+
+    assert(mPending == 0);
+    for (i = 0; i < kAESQueueDepth; i++) {
+        EAXSecureWipe(mDesc[i].cleartext, 2 * kBlockLength);
+    }
+}
+
+/*
+ * Start the ECB peripheral on the oldest queued block.
+ */
+template <class Policy>
+inline void EAXP_128_ECB<Policy>::ecb_start(void)
+{
+    NRF_ECB->ECBDATAPTR = (uintptr_t)&mDesc[mHead];
+    NRF_ECB->EVENTS_ENDECB = 0;
+    NRF_ECB->EVENTS_ERRORECB = 0;
+    NRF_ECB->TASKS_STARTECB = 1;
+}
+
+/*
+ * Check whether the block being encrypted is done; if so, copy out its
+ * ciphertext and start the next queued block. A block whose encryption
+ * was aborted (ERRORECB, when a higher-priority peripheral takes over the
+ * AES core) is started again.
+ */
+template <class Policy>
+inline void EAXP_128_ECB<Policy>::ecb_poll(void)
+{
+    if (NRF_ECB->EVENTS_ENDECB) {
+        memcpy(mDest[mHead], mDesc[mHead].ciphertext, kBlockLength);
+        EAXWipeBlockTemp(mDesc[mHead].cleartext, 2 * kBlockLength);
+        mHead = (mHead + 1) % kAESQueueDepth;
+        mPending--;
+        if (mPending > 0) {
+            ecb_start();
+        } else {
+            NRF_ECB->EVENTS_ENDECB = 0;
+        }
+    } else if (NRF_ECB->EVENTS_ERRORECB) {
+        ecb_start();
+    }
+}
+
+/** Register the nRF5 EAX implementations enabled in this build with the EAX
+ *  backend registry (see EAXFactory.h).
+ *
+ *  Calibration (CalibrateEAXBackends()) can then be used to pick the fastest
+ *  of them, e.g. with nrf5utils::SysTime::GetSystemTime_US() as the clock.
+ */
+inline void RegisterNRF5EAXBackends(void)
+{
+#if NRF_CRYPTO_ENABLED
+    static const EAXBackendInfo sNRFCrypto128 = { "nrfcrypto-128", 16, 150, NULL, NewEAXObject<EAX_128_nrfcrypto> };
+    static const EAXBackendInfo sNRFCrypto256 = { "nrfcrypto-256", 32, 150, NULL, NewEAXObject<EAX_256_nrfcrypto> };
+
+    RegisterEAXBackend(&sNRFCrypto128);
+    RegisterEAXBackend(&sNRFCrypto256);
+#endif // NRF_CRYPTO_ENABLED
+
+#if defined(SOFTDEVICE_PRESENT) && SOFTDEVICE_PRESENT
+    static const EAXBackendInfo sSD128 = { "sd-128", 16, 100, NULL, NewEAXObject<EAX_128_SD> };
+
+    RegisterEAXBackend(&sSD128);
 #endif // defined(SOFTDEVICE_PRESENT) && SOFTDEVICE_PRESENT
+}
 
 //
-// NOTE: To test the nRF5 EAX classes, add the following code to the example
-// application initialization code located in main.cpp:
+// NOTE: The nRF5 EAX classes can be tested on the host, against a mock of
+// the ECB peripheral, the SoftDevice API and nrf_crypto, with 'make test-nrf5-eax' in
+// support/general. To test them on the device, add the following code to
+// the example application initialization code located in main.cpp:
 //
 //     #include <nRF5EAX.h>
+//     #include <EAXTest.h>
 //
 //     ...
 //
@@ -118,6 +431,15 @@ private:
 //             EAX_128_SD eax;
 //             TestEAX128(eax);
 //         }
+//         {
+//             EAXT_128_SD eax;
+//             TestEAX128(eax);
+//         }
+//         {
+//             // Only while the SoftDevice is disabled
+//             EAXT_128_ECB eax;
+//             TestEAX128(eax);
+//         }
 //         NRF_LOG_INFO("All tests complete");
 //
 //         ...